@@ -3,7 +3,9 @@
  * @author Alex Cajas (alexcajas505@gmail.com)
  * @brief 
  * Hybrid Example: Running a Synchronous HTTP Server and an Asynchronous MQTT Broker simultaneously.
- * * In this example, the HTTP server provides a simple status page showing if the Broker is full.
+ * * In this example, the HTTP server provides a simple status page showing if the Broker is full,
+ * and the last message published to "esp32/message". The sketch talks to the Broker in-process 
+ * (`broker->subscribe()` / `broker->publish()`), without opening a connection to itself.
  * @version 2.0.8
  */
 
@@ -21,6 +23,10 @@ uint16_t mqttPort = 1883;
 // We declare a pointer because the Factory will allocate it dynamically
 MqttBroker* broker;
 
+// Last message of "esp32/message", written by a Broker worker and read by loop().
+String lastMessage = "(none)";
+SemaphoreHandle_t lastMessageMutex;
+
 /****************** HTTP Server ********************/
 uint16_t httpPort = 80;
 // Standard synchronous WiFiServer (runs in loop())
@@ -68,6 +74,14 @@ void setup(){
   broker = MqttBrokerFactory::createTcpBroker(mqttPort);
   
   broker->setMaxNumClients(1); // Set low for testing "Broker Full" logic
+
+  // Local subscription: the callback runs in a Broker worker, keep it short.
+  lastMessageMutex = xSemaphoreCreateMutex();
+  broker->subscribe("esp32/message", [](PublishMqttMessage& message) {
+    xSemaphoreTake(lastMessageMutex, portMAX_DELAY);
+    lastMessage = message.getTopic().getPayLoad().toString();
+    xSemaphoreGive(lastMessageMutex);
+  });
   
   // 2. Start (Runs in background)
   broker->startBroker();
@@ -132,8 +146,18 @@ void loop(){
     } else{
         httpClient.print("<span style='color:green;'>Available</span>");
     }
+    httpClient.print("</p>");
+
+    xSemaphoreTake(lastMessageMutex, portMAX_DELAY);
+    String message = lastMessage;
+    xSemaphoreGive(lastMessageMutex);
+    httpClient.print("<p><strong>Last esp32/message:</strong> ");
+    httpClient.print(message);
     
     httpClient.println("</p></body></html>");
+
+    // Local publish: MQTT clients subscribed to "esp32/http" see each page request.
+    broker->publish("esp32/http", request);
     
     // Close connection
     httpClient.stop();
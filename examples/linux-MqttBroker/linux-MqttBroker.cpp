@@ -0,0 +1,47 @@
+/**
+ * @file linux-MqttBroker.cpp
+ * @brief 
+ * The TCP MQTT Broker, run natively on Linux (POSIX sockets backend).
+ * Build it with CMake from the root of the repository:
+ *   cmake -S . -B build && cmake --build build
+ *   ./build/linux-MqttBroker [port]
+ * Sessions, the offline message log and snapshots are kept in ./mqttbroker-data.
+ * Set the log level with -DCORE_DEBUG_LEVEL=ARDUHAL_LOG_LEVEL_INFO.
+ */
+
+#include <csignal>
+#include <unistd.h>
+#include "EmbeddedMqttBroker.h"
+
+using namespace mqttBrokerName;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int){
+  stopRequested = 1;
+}
+
+int main(int argc, char** argv){
+  uint16_t mqttPort = argc > 1 ? atoi(argv[1]) : 1883;
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  MqttBroker* broker = MqttBrokerFactory::createTcpBroker(mqttPort);
+
+  // Or, with io_uring instead of epoll:
+  // MqttBroker* broker = MqttBrokerFactory::createIoUringBroker(mqttPort);
+
+  broker->startBroker();
+  printf("Broker started, connect using: mqtt://localhost:%u\n", mqttPort);
+
+  // The broker runs in its own threads, until Ctrl+C.
+  while (!stopRequested) {
+    pause();
+  }
+
+  broker->stopBroker();
+  delete broker;
+  printf("Broker stopped\n");
+  return 0;
+}
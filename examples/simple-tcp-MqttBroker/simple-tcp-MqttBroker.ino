@@ -51,9 +51,22 @@ void setup(){
   // Create the Broker using the Factory Method for TCP
   broker = MqttBrokerFactory::createTcpBroker(mqttPort);
 
+  // Or serve browsers too, on the same broker (WebSockets on port 8080, "/mqtt"):
+  // broker = MqttBrokerFactory::createTcpAndWsBroker(mqttPort, 8080);
+
   // Optional: Configure buffer size for high-traffic bursts
   // broker->setOutBoxMaxSize(200); // Default is 100
 
+  // Optional: Throttle publishers (TCP flow control) instead of dropping
+  // messages when the broker can't keep up, e.g. for data-logging.
+  // broker->setLosslessMode(true); // Default is false
+  // broker->setNumWorkers(2); // Default is 1, max MAXNUMWORKERS
+
+  // Optional: Keep the messages missed by offline persistent sessions on LittleFS
+  // broker->setOfflineLogEnabled(false); // Default is true
+  // broker->setRetainedStoreSize(16 * 1024); // Default is 8KB
+  // broker->setSnapshotInterval(0); // Default is 60000 ms, 0 disables the restore after a reset
+
   // Start the broker (Listeners and Workers)
   broker->startBroker();
   
@@ -0,0 +1,52 @@
+#include "Arduino.h"
+#include <chrono>
+#include <atomic>
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point startTime = Clock::now();
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+EspClass ESP;
+
+void EspClass::restart() {
+    log_e("Restart requested, aborting");
+    fflush(stderr);
+    abort();
+}
+
+static std::atomic<uint32_t> minFreeHeap(UINT32_MAX);
+
+uint32_t EspClass::getFreeHeap() {
+    unsigned long long availableKb = 0;
+    FILE* meminfo = fopen("/proc/meminfo", "r");
+    if (meminfo) {
+        char line[128];
+        while (fgets(line, sizeof(line), meminfo)) {
+            if (sscanf(line, "MemAvailable: %llu kB", &availableKb) == 1) break;
+        }
+        fclose(meminfo);
+    }
+
+    uint32_t freeHeap = (uint32_t)std::min<unsigned long long>(availableKb * 1024, UINT32_MAX);
+    uint32_t lowest = minFreeHeap;
+    while (freeHeap < lowest && !minFreeHeap.compare_exchange_weak(lowest, freeHeap)) {
+    }
+    return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    getFreeHeap();
+    return minFreeHeap;
+}
@@ -0,0 +1,73 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/*
+ * Minimal Arduino core for running the broker natively on Linux (POSIX backend):
+ * `String`, time, logging and the `ESP` object, over the C++ standard library.
+ * FreeRTOS queues, semaphores and tasks are emulated on pthreads, see HostFreeRTOS.h.
+ * Only the API used by the broker is provided.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "WString.h"
+#include "HostFreeRTOS.h"
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+/** @brief Milliseconds since the program started. */
+unsigned long millis();
+
+/** @brief Microseconds since the program started. */
+unsigned long micros();
+
+void delay(unsigned long ms);
+
+// Log levels of the ESP32 core, selected with -DCORE_DEBUG_LEVEL (default: errors).
+#define ARDUHAL_LOG_LEVEL_NONE    0
+#define ARDUHAL_LOG_LEVEL_ERROR   1
+#define ARDUHAL_LOG_LEVEL_WARN    2
+#define ARDUHAL_LOG_LEVEL_INFO    3
+#define ARDUHAL_LOG_LEVEL_DEBUG   4
+#define ARDUHAL_LOG_LEVEL_VERBOSE 5
+
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL ARDUHAL_LOG_LEVEL_ERROR
+#endif
+
+#define HOST_LOG(level, letter, format, ...) do { \
+        if (CORE_DEBUG_LEVEL >= level) { \
+            fprintf(stderr, "[%6lu][" letter "][%s:%u] " format "\n", millis(), __FILE__, __LINE__, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_e(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_ERROR, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_WARN, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_INFO, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_DEBUG, "D", format, ##__VA_ARGS__)
+#define log_v(format, ...) HOST_LOG(ARDUHAL_LOG_LEVEL_VERBOSE, "V", format, ##__VA_ARGS__)
+
+/**
+ * @brief The `ESP` object of the ESP32 core: restart and heap statistics of the process.
+ */
+class EspClass {
+public:
+    /** @brief There is nothing to restart on a host: aborts, leaving a core dump. */
+    [[noreturn]] void restart();
+
+    /** @brief Memory available to the process (MemAvailable of the system). */
+    uint32_t getFreeHeap();
+
+    /** @brief Lowest value returned by `getFreeHeap()` so far. */
+    uint32_t getMinFreeHeap();
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
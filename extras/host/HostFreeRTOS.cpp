@@ -0,0 +1,257 @@
+#include "WrapperFreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <sched.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Longest uninterrupted wait of a task: a stop request is noticed within this delay.
+static const std::chrono::milliseconds STOPCHECKINTERVAL(10);
+
+/** @brief Thrown at a stop point, caught by the thread of the task. */
+struct TaskStopped {};
+
+// Stop flag of the task run by this thread, nullptr for the other threads.
+static thread_local std::atomic<bool>* currentStopRequest = nullptr;
+
+// Semaphores held by this thread: a task is never ended while it holds one.
+static thread_local int heldSemaphores = 0;
+
+static void stopPoint() {
+    if (currentStopRequest && *currentStopRequest && heldSemaphores == 0) {
+        throw TaskStopped();
+    }
+}
+
+static Clock::time_point deadline(TickType_t ticks) {
+    return ticks == portMAX_DELAY ? Clock::time_point::max()
+                                  : Clock::now() + std::chrono::milliseconds(ticks * portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief Waits on `condition` until `ready()` or the deadline, waking up regularly.
+ * @return false on timeout.
+ */
+template <typename Predicate>
+static bool waitUntil(std::condition_variable& condition, std::unique_lock<std::mutex>& lock,
+                      Clock::time_point until, Predicate ready) {
+    while (!ready()) {
+        Clock::time_point now = Clock::now();
+        if (now >= until) return false;
+        condition.wait_until(lock, std::min(until, now + STOPCHECKINTERVAL));
+    }
+    return true;
+}
+
+/****************************** Queues **********************************/
+
+struct HostQueue {
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    uint8_t* storage;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+
+    uint8_t* slot(UBaseType_t index) {
+        return storage + (size_t)(index % length) * itemSize;
+    }
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if (length == 0) return nullptr;
+
+    HostQueue* queue = new HostQueue;
+    queue->storage = new uint8_t[(size_t)length * itemSize];
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!queue) return;
+    delete[] queue->storage;
+    delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait, bool front) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitUntil(queue->notFull, lock, deadline(ticksToWait), [queue] { return queue->count < queue->length; })) {
+        return pdFAIL;
+    }
+
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        memcpy(queue->slot(queue->head), item, queue->itemSize);
+    } else {
+        memcpy(queue->slot(queue->head + queue->count), item, queue->itemSize);
+    }
+    queue->count++;
+    lock.unlock();
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitUntil(queue->notEmpty, lock, deadline(ticksToWait), [queue] { return queue->count > 0; })) {
+        return pdFAIL;
+    }
+
+    memcpy(item, queue->slot(queue->head), queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    lock.unlock();
+    queue->notFull.notify_one();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+/****************************** Semaphores **********************************/
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable released;
+    std::thread::id owner;
+    uint32_t depth = 0;
+    bool recursive;
+};
+
+static SemaphoreHandle_t createSemaphore(bool recursive) {
+    HostSemaphore* semaphore = new HostSemaphore;
+    semaphore->recursive = recursive;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createSemaphore(false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return createSemaphore(true);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+static BaseType_t take(SemaphoreHandle_t semaphore, TickType_t ticksToWait, bool recursive) {
+    std::thread::id self = std::this_thread::get_id();
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+
+    if (recursive && semaphore->depth > 0 && semaphore->owner == self) {
+        semaphore->depth++;
+        heldSemaphores++;
+        return pdTRUE;
+    }
+    if (!waitUntil(semaphore->released, lock, deadline(ticksToWait), [semaphore] { return semaphore->depth == 0; })) {
+        return pdFALSE;
+    }
+    semaphore->owner = self;
+    semaphore->depth = 1;
+    heldSemaphores++;
+    return pdTRUE;
+}
+
+static BaseType_t give(SemaphoreHandle_t semaphore) {
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (semaphore->depth == 0) {
+        return pdFALSE;
+    }
+    heldSemaphores--;
+    if (--semaphore->depth > 0) {
+        return pdTRUE;
+    }
+    lock.unlock();
+    semaphore->released.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    return take(semaphore, ticksToWait, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return give(semaphore);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    return take(semaphore, ticksToWait, true);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    return give(semaphore);
+}
+
+/****************************** Time and scheduling **********************************/
+
+TickType_t xTaskGetTickCount() {
+    return millis() / portTICK_PERIOD_MS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    Clock::time_point until = deadline(ticks);
+    do {
+        stopPoint();
+        std::this_thread::sleep_until(std::min(until, Clock::now() + STOPCHECKINTERVAL));
+    } while (Clock::now() < until);
+    stopPoint();
+}
+
+void hostTaskYield() {
+    stopPoint();
+    sched_yield();
+}
+
+BaseType_t xPortGetCoreID() {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % portNUM_PROCESSORS;
+}
+
+/****************************** Task **********************************/
+
+void Task::start(void* data) {
+    if (_thread.joinable()) return;
+
+    _stopRequested = false;
+    _thread = std::thread([this, data] {
+        currentStopRequest = &_stopRequested;
+        try {
+            run(data);
+        } catch (const TaskStopped&) {
+        }
+        currentStopRequest = nullptr;
+    });
+}
+
+void Task::stop() {
+    if (!_thread.joinable()) return;
+
+    _stopRequested = true;
+    if (_thread.get_id() == std::this_thread::get_id()) {
+        // Ends at the next stop point, the thread is released there.
+        _thread.detach();
+        return;
+    }
+    _thread.join();
+}
@@ -0,0 +1,67 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/*
+ * FreeRTOS API used by the broker, emulated on pthreads: queues (fixed-size item
+ * copies in a ring preallocated by xQueueCreate, as FreeRTOS does), mutexes,
+ * recursive mutexes, ticks of 1 ms and delays. Tasks are in WrapperFreeRTOS.h.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+// The broker keeps per-core counters: threads are spread over as many slots as an ESP32 has cores.
+#define portNUM_PROCESSORS 2
+
+struct HostQueue;
+struct HostSemaphore;
+typedef HostQueue* QueueHandle_t;
+typedef HostSemaphore* SemaphoreHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return xQueueSendToBack(queue, item, ticksToWait);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+
+TickType_t xTaskGetTickCount();
+
+/** @brief Sleeps. A stop point of the calling `Task`, see `Task::stop()`. */
+void vTaskDelay(TickType_t ticks);
+
+/** @brief Yields the processor. A stop point of the calling `Task`, see `Task::stop()`. */
+void hostTaskYield();
+#define taskYIELD() hostTaskYield()
+
+/** @brief Slot of the calling thread, below portNUM_PROCESSORS. */
+BaseType_t xPortGetCoreID();
+
+#endif // HOST_FREERTOS_H
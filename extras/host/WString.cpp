@@ -0,0 +1,177 @@
+#include "WString.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static std::string toBase(unsigned long long value, unsigned char base) {
+    if (base < 2 || base > 36) base = 10;
+
+    char digits[65];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do {
+        int digit = value % base;
+        digits[--i] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value > 0);
+    return std::string(digits + i);
+}
+
+static std::string toSignedBase(long long value, unsigned char base) {
+    // As the ESP32 core: only base 10 shows a sign, other bases print the two's complement.
+    if (base == 10 && value < 0) {
+        return "-" + toBase(-(unsigned long long)value, 10);
+    }
+    return toBase((unsigned long long)value, base);
+}
+
+String::String(unsigned char value, unsigned char base) : _buffer(toBase(value, base)) {}
+String::String(int value, unsigned char base) : _buffer(base == 10 ? toSignedBase(value, base) : toBase((unsigned int)value, base)) {}
+String::String(unsigned int value, unsigned char base) : _buffer(toBase(value, base)) {}
+String::String(long value, unsigned char base) : _buffer(base == 10 ? toSignedBase(value, base) : toBase((unsigned long)value, base)) {}
+String::String(unsigned long value, unsigned char base) : _buffer(toBase(value, base)) {}
+String::String(long long value, unsigned char base) : _buffer(toSignedBase(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : _buffer(toBase(value, base)) {}
+
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned int decimalPlaces) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", (int)decimalPlaces, value);
+    _buffer = text;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+    return _buffer.size() == other._buffer.size() &&
+           std::equal(_buffer.begin(), _buffer.end(), other._buffer.begin(), [](char a, char b) {
+               return tolower((unsigned char)a) == tolower((unsigned char)b);
+           });
+}
+
+bool String::endsWith(const String& suffix) const {
+    return _buffer.size() >= suffix._buffer.size() &&
+           _buffer.compare(_buffer.size() - suffix._buffer.size(), suffix._buffer.size(), suffix._buffer) == 0;
+}
+
+char& String::operator[](unsigned int index) {
+    static char dummy;
+    if (index >= _buffer.size()) {
+        dummy = 0;
+        return dummy;
+    }
+    return _buffer[index];
+}
+
+void String::getBytes(unsigned char* buffer, unsigned int size, unsigned int index) const {
+    if (size == 0 || buffer == nullptr) return;
+    if (index >= _buffer.size()) {
+        buffer[0] = 0;
+        return;
+    }
+    unsigned int n = std::min<size_t>(size - 1, _buffer.size() - index);
+    memcpy(buffer, _buffer.data() + index, n);
+    buffer[n] = 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t position = _buffer.find(c, from);
+    return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::indexOf(const String& text, unsigned int from) const {
+    size_t position = _buffer.find(text._buffer, from);
+    return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(char c) const {
+    size_t position = _buffer.rfind(c);
+    return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(const String& text) const {
+    size_t position = _buffer.rfind(text._buffer);
+    return position == std::string::npos ? -1 : (int)position;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    // As the ESP32 core: the bounds may be given in any order.
+    if (from > to) std::swap(from, to);
+    if (from >= _buffer.size()) return String();
+    to = std::min<size_t>(to, _buffer.size());
+    return String(_buffer.substr(from, to - from));
+}
+
+void String::replace(char find, char replacement) {
+    std::replace(_buffer.begin(), _buffer.end(), find, replacement);
+}
+
+void String::replace(const String& find, const String& replacement) {
+    if (find._buffer.empty()) return;
+    size_t position = 0;
+    while ((position = _buffer.find(find._buffer, position)) != std::string::npos) {
+        _buffer.replace(position, find._buffer.size(), replacement._buffer);
+        position += replacement._buffer.size();
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index < _buffer.size()) {
+        _buffer.erase(index, count);
+    }
+}
+
+void String::toLowerCase() {
+    for (char& c : _buffer) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+    for (char& c : _buffer) c = toupper((unsigned char)c);
+}
+
+void String::trim() {
+    size_t first = _buffer.find_first_not_of(" \t\r\n\f\v");
+    if (first == std::string::npos) {
+        _buffer.clear();
+        return;
+    }
+    size_t last = _buffer.find_last_not_of(" \t\r\n\f\v");
+    _buffer = _buffer.substr(first, last - first + 1);
+}
+
+long String::toInt() const {
+    return atol(_buffer.c_str());
+}
+
+float String::toFloat() const {
+    return (float)toDouble();
+}
+
+double String::toDouble() const {
+    return atof(_buffer.c_str());
+}
+
+String operator+(const String& left, const String& right) {
+    String sum(left);
+    sum.concat(right);
+    return sum;
+}
+
+String operator+(const String& left, const char* right) {
+    String sum(left);
+    sum.concat(right);
+    return sum;
+}
+
+String operator+(const char* left, const String& right) {
+    String sum(left);
+    sum.concat(right);
+    return sum;
+}
+
+String operator+(const String& left, char right) {
+    String sum(left);
+    sum.concat(right);
+    return sum;
+}
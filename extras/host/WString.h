@@ -0,0 +1,116 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief The Arduino `String`, over a `std::string`: binary safe, mutable, with the
+ * conversions and the search methods of the ESP32 core.
+ */
+class String {
+private:
+    std::string _buffer;
+
+public:
+    String() {}
+    String(const char* cstr) : _buffer(cstr ? cstr : "") {}
+    String(const char* data, unsigned int length) : _buffer(data, length) {}
+    String(const std::string& value) : _buffer(value) {}
+    explicit String(char c) : _buffer(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+
+    unsigned int length() const { return _buffer.size(); }
+    const char* c_str() const { return _buffer.c_str(); }
+    bool isEmpty() const { return _buffer.empty(); }
+    void clear() { _buffer.clear(); }
+
+    bool reserve(unsigned int size) {
+        _buffer.reserve(size);
+        return true;
+    }
+
+    bool concat(const String& other) { _buffer += other._buffer; return true; }
+    bool concat(const char* cstr) { if (cstr) _buffer += cstr; return cstr != nullptr; }
+    bool concat(const char* data, unsigned int length) { _buffer.append(data, length); return true; }
+    bool concat(char c) { _buffer += c; return true; }
+    bool concat(unsigned char value) { return concat(String(value)); }
+    bool concat(int value) { return concat(String(value)); }
+    bool concat(unsigned int value) { return concat(String(value)); }
+    bool concat(long value) { return concat(String(value)); }
+    bool concat(unsigned long value) { return concat(String(value)); }
+    bool concat(long long value) { return concat(String(value)); }
+    bool concat(unsigned long long value) { return concat(String(value)); }
+    bool concat(float value) { return concat(String(value)); }
+    bool concat(double value) { return concat(String(value)); }
+
+    template <typename T>
+    String& operator+=(const T& value) {
+        concat(value);
+        return *this;
+    }
+
+    bool equals(const String& other) const { return _buffer == other._buffer; }
+    bool equals(const char* cstr) const { return _buffer == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String& other) const;
+    bool startsWith(const String& prefix) const { return _buffer.compare(0, prefix.length(), prefix._buffer) == 0; }
+    bool endsWith(const String& suffix) const;
+
+    bool operator==(const String& other) const { return equals(other); }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator!=(const String& other) const { return !equals(other); }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+    bool operator<(const String& other) const { return _buffer < other._buffer; }
+    bool operator>(const String& other) const { return _buffer > other._buffer; }
+    bool operator<=(const String& other) const { return _buffer <= other._buffer; }
+    bool operator>=(const String& other) const { return _buffer >= other._buffer; }
+
+    char charAt(unsigned int index) const { return index < _buffer.size() ? _buffer[index] : 0; }
+    void setCharAt(unsigned int index, char c) { if (index < _buffer.size()) _buffer[index] = c; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index);
+
+    void getBytes(unsigned char* buffer, unsigned int size, unsigned int index = 0) const;
+    void toCharArray(char* buffer, unsigned int size, unsigned int index = 0) const {
+        getBytes((unsigned char*)buffer, size, index);
+    }
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& text, unsigned int from = 0) const;
+    int lastIndexOf(char c) const;
+    int lastIndexOf(const String& text) const;
+
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const;
+
+    void replace(char find, char replacement);
+    void replace(const String& find, const String& replacement);
+    void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+    void remove(unsigned int index, unsigned int count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+    const char* begin() const { return _buffer.data(); }
+    const char* end() const { return _buffer.data() + _buffer.size(); }
+};
+
+String operator+(const String& left, const String& right);
+String operator+(const String& left, const char* right);
+String operator+(const char* left, const String& right);
+String operator+(const String& left, char right);
+
+#endif // HOST_WSTRING_H
@@ -0,0 +1,53 @@
+#ifndef HOST_WRAPPER_FREERTOS_H
+#define HOST_WRAPPER_FREERTOS_H
+
+/*
+ * The `Task` class of the WrapperFreeRTOS library, one std::thread per task.
+ */
+
+#include <atomic>
+#include <thread>
+#include "Arduino.h"
+
+enum TaskPrio {
+    TaskPrio_Idle = 0,
+    TaskPrio_Low = 1,
+    TaskPrio_Mid = 2,
+    TaskPrio_High = 3,
+    TaskPrio_Highest = 4
+};
+
+/**
+ * @brief A thread running `run()`. Name, stack size, priority and core are accepted
+ * for compatibility and ignored: the host scheduler places the threads.
+ * * A FreeRTOS task is deleted wherever it is. A thread can't be, so `stop()` asks
+ * the task to end at its next stop point (`vTaskDelay()` or `taskYIELD()` called
+ * without any semaphore held) and waits for it.
+ */
+class Task {
+private:
+    std::thread _thread;
+    std::atomic<bool> _stopRequested{false};
+
+public:
+    Task(const char*, uint32_t, TaskPrio) {}
+
+    virtual ~Task() {
+        stop();
+    }
+
+    void setCore(BaseType_t) {}
+
+    /** @brief Starts the thread, unless it is already running. */
+    void start(void* data = nullptr);
+
+    /**
+     * @brief Ends the thread at its next stop point. Called by another thread, returns
+     * once it has ended; called by the task itself, returns at once.
+     */
+    void stop();
+
+    virtual void run(void* data) = 0;
+};
+
+#endif // HOST_WRAPPER_FREERTOS_H
@@ -2,7 +2,7 @@
 using namespace mqttBrokerName;
 ActionFactory::ActionFactory(){}
 
-Action* ActionFactory::getAction(MqttClient * mqttClient, ReaderMqttPacket &packetReaded){
+Action* ActionFactory::getAction(MqttClient * mqttClient, ReaderMqttPacket &packetReaded, ActionStorage &storage){
     
     uint8_t type = packetReaded.getFixedHeader() >> 4;
     type = packetReaded.getFixedHeader() >> 4;
@@ -10,24 +10,36 @@ Action* ActionFactory::getAction(MqttClient * mqttClient, ReaderMqttPacket &pack
     switch (type)
     {
     case PINGREQ:
-        return new PingResAction(mqttClient);
+        return new (&storage) PingResAction(mqttClient);
         break;
     
     case PUBLISH:
-        return new PublishAction(mqttClient,packetReaded);
+        return new (&storage) PublishAction(mqttClient,packetReaded);
+
+    case PUBACK:
+        return new (&storage) PubAckAction(mqttClient,packetReaded);
+
+    case PUBREC:
+        return new (&storage) PubRecAction(mqttClient,packetReaded);
+
+    case PUBREL:
+        return new (&storage) PubRelAction(mqttClient,packetReaded);
+
+    case PUBCOMP:
+        return new (&storage) PubCompAction(mqttClient,packetReaded);
     
     case SUBSCRIBE:
-        return new SubscribeAction(mqttClient,packetReaded);
+        return new (&storage) SubscribeAction(mqttClient,packetReaded);
     
     case DISCONNECT:
-        return new DisconnectAction(mqttClient);
+        return new (&storage) DisconnectAction(mqttClient);
 
     case UNSUBSCRIBE:
-        return new UnSubscribeAction(mqttClient, packetReaded);
+        return new (&storage) UnSubscribeAction(mqttClient, packetReaded);
     
     default:
         break;
     }
 
-    return new NoAction(mqttClient);
+    return new (&storage) NoAction(mqttClient);
 }
\ No newline at end of file
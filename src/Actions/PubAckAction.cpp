@@ -0,0 +1,10 @@
+#include "MqttBroker/MqttBroker.h"
+using namespace mqttBrokerName;
+PubAckAction::PubAckAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded):Action(mqttClient){
+    AckPublishMqttMessage pubAck(packetReaded);
+    packetId = pubAck.getPacketId();
+}
+
+void PubAckAction::doAction(){
+    mqttClient->onPubAck(packetId);
+}
\ No newline at end of file
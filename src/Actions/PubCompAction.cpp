@@ -0,0 +1,10 @@
+#include "MqttBroker/MqttBroker.h"
+using namespace mqttBrokerName;
+PubCompAction::PubCompAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded):Action(mqttClient){
+    AckPublishMqttMessage ack(packetReaded);
+    packetId = ack.getPacketId();
+}
+
+void PubCompAction::doAction(){
+    mqttClient->onPubComp(packetId);
+}
\ No newline at end of file
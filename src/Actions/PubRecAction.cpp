@@ -0,0 +1,10 @@
+#include "MqttBroker/MqttBroker.h"
+using namespace mqttBrokerName;
+PubRecAction::PubRecAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded):Action(mqttClient){
+    AckPublishMqttMessage ack(packetReaded);
+    packetId = ack.getPacketId();
+}
+
+void PubRecAction::doAction(){
+    mqttClient->onPubRec(packetId);
+}
\ No newline at end of file
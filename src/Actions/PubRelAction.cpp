@@ -0,0 +1,10 @@
+#include "MqttBroker/MqttBroker.h"
+using namespace mqttBrokerName;
+PubRelAction::PubRelAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded):Action(mqttClient){
+    AckPublishMqttMessage ack(packetReaded);
+    packetId = ack.getPacketId();
+}
+
+void PubRelAction::doAction(){
+    mqttClient->onPubRel(packetId);
+}
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "MqttBroker/MqttBroker.h"
 using namespace mqttBrokerName;
 PublishAction::PublishAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded):Action(mqttClient){
-    publishMqttMessage = new PublishMqttMessage(packetReaded);
+    // A pooled message with a StaticMqttBroker, read in place. None left: dropped by doAction().
+    publishMqttMessage = mqttClient->getBroker()->newMessage();
+    if (publishMqttMessage != nullptr) {
+        publishMqttMessage->readPacket(packetReaded);
+    }
 }
 
 PublishAction::~PublishAction(){
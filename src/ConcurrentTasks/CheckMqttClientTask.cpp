@@ -3,17 +3,18 @@
 using namespace mqttBrokerName;
 
 
-CheckMqttClientTask::CheckMqttClientTask(MqttBroker *broker)
+CheckMqttClientTask::CheckMqttClientTask(MqttBroker *broker, BrokerShard *shard)
     : Task("MqttWorker", 1024 * 4, TaskPrio_Low) 
 {
     this->broker = broker;
+    this->shard = shard;
     // Note: The stack size (4KB) is chosen to handle the overhead of 
     // processing MQTT packets and Trie traversals without overflow.
     // Priority is Low to ensure it doesn't starve the Network Task (LwIP).
 }
 
 
-void CheckMqttClientTask::run (void * data){
+void CheckMqttClientTask::run (void *){
   
   TickType_t lastKeepAliveCheck = 0;
   
@@ -24,26 +25,45 @@ void CheckMqttClientTask::run (void * data){
   while(true){
     bool workDone = false; // Flag to determine the CPU yielding strategy
 
+    // Clients resolved from the table stay valid until exitEpoch().
+    broker->enterEpoch(shard);
+
     // 1. HIGH PRIORITY: Process Pub/Sub Events
     // We delegate to the broker to process a batch of pending events.
     // If true, it means we handled data (throughput is needed).
-    if (broker->processBrokerEvents()) {
+    if (broker->processBrokerEvents(shard)) {
+        workDone = true;
+    }
+
+    // 1b. Lossless mode: the queue has room again, retry stalled publishers.
+    if (broker->processStalledClients(shard)) {
         workDone = true;
     }
 
     // 2. MEDIUM PRIORITY: Garbage Collection
     // Process the deletion queue to free memory of disconnected clients.
-    if (broker->processDeletions()) {
+    if (broker->processDeletions(shard)) {
         workDone = true;
     }
 
     // 3. LOW PRIORITY: Periodic Maintenance (Keep Alive)
     // Runs only if the time interval has passed.
     if ((xTaskGetTickCount() - lastKeepAliveCheck) > KEEP_ALIVE_INTERVAL) {
-        broker->processKeepAlives();
+        broker->processKeepAlives(shard);
         lastKeepAliveCheck = xTaskGetTickCount();
+
+        // Batched flush of the offline message log, snapshots and $SYS statistics, done by the first worker only.
+        if (shard->id == 0) {
+            broker->syncOfflineLog();
+            broker->checkSnapshot();
+            broker->checkSteadyStateAllocations();
+            broker->checkSysTopics();
+        }
     }
 
+    // Hold no client while yielding or sleeping, so retired ones can be freed.
+    broker->exitEpoch(shard);
+
     // --- ADAPTIVE SCHEDULING ---
     if (workDone) {
         // High Load Mode: If we did work, there might be more coming immediately.
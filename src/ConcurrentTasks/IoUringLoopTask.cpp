@@ -0,0 +1,24 @@
+#include "IoUringLoopTask.h"
+
+#if MQTTBROKER_IO_URING
+
+using namespace mqttBrokerName;
+
+IoUringLoopTask::IoUringLoopTask(std::shared_ptr<IoUringLoop> loop)
+    : Task("MqttNetwork", 1024 * 4, TaskPrio_Low)
+{
+    this->loop = loop;
+    // Note: The received data stays in the registered buffers of the loop, the
+    // stack (4KB) holds the MqttClient packet processing run from the callbacks.
+}
+
+void IoUringLoopTask::run(void *){
+    while (true) {
+        // The lock is only held while dispatching, not while waiting.
+        loop->poll(IOURINGWAITMS);
+        // Stop point of the task (see stop()), never inside a dispatch.
+        taskYIELD();
+    }
+}
+
+#endif // MQTTBROKER_IO_URING
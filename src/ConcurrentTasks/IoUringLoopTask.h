@@ -0,0 +1,30 @@
+#ifndef IO_URING_LOOP_TASK_H
+#define IO_URING_LOOP_TASK_H
+
+#include "WrapperFreeRTOS.h"
+#include "TransportLayer/IoUringTransport.h"
+
+#if MQTTBROKER_IO_URING
+
+namespace mqttBrokerName{
+
+/**
+ * @brief The Network Thread of the io_uring backend.
+ * * Submits the operations prepared on an `IoUringLoop` and dispatches their 
+ * completions, one `io_uring_enter` per iteration.
+ */
+class IoUringLoopTask : public Task {
+private:
+    std::shared_ptr<IoUringLoop> loop;
+
+public:
+    IoUringLoopTask(std::shared_ptr<IoUringLoop> loop);
+
+    void run(void *data) override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTTBROKER_IO_URING
+
+#endif // IO_URING_LOOP_TASK_H
@@ -0,0 +1,24 @@
+#include "PosixEventLoopTask.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+using namespace mqttBrokerName;
+
+PosixEventLoopTask::PosixEventLoopTask(std::shared_ptr<PosixEventLoop> loop)
+    : Task("MqttNetwork", 1024 * 4, TaskPrio_Low)
+{
+    this->loop = loop;
+    // Note: The stack (4KB) holds the receive buffer of PosixTcpTransport and
+    // the MqttClient packet processing run from its callbacks.
+}
+
+void PosixEventLoopTask::run(void *){
+    while (true) {
+        // The lock is only held while dispatching, not while waiting.
+        loop->poll(POSIXEVENTWAITMS);
+        // Stop point of the task (see stop()), never inside a dispatch.
+        taskYIELD();
+    }
+}
+
+#endif // MQTTBROKER_POSIX_SOCKETS
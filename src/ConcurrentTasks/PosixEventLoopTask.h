@@ -0,0 +1,31 @@
+#ifndef POSIX_EVENT_LOOP_TASK_H
+#define POSIX_EVENT_LOOP_TASK_H
+
+#include "WrapperFreeRTOS.h"
+#include "TransportLayer/PosixTcpTransport.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+namespace mqttBrokerName{
+
+/**
+ * @brief The Network Thread of the Linux build.
+ * * Waits on a `PosixEventLoop` and dispatches the socket events (accept, data,
+ * send buffer space, disconnection) to the listener and the transports, as the 
+ * AsyncTCP task does on the ESP32.
+ */
+class PosixEventLoopTask : public Task {
+private:
+    std::shared_ptr<PosixEventLoop> loop;
+
+public:
+    PosixEventLoopTask(std::shared_ptr<PosixEventLoop> loop);
+
+    void run(void *data) override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTTBROKER_POSIX_SOCKETS
+
+#endif // POSIX_EVENT_LOOP_TASK_H
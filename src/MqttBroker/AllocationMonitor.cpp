@@ -0,0 +1,63 @@
+#include "AllocationMonitor.h"
+
+#if MQTTBROKER_COUNT_ALLOCATIONS
+#include <atomic>
+
+using namespace mqttBrokerName;
+
+// Set while the current thread runs a steady-state path.
+static thread_local bool steadyState = false;
+
+// Allocations counted, by every thread.
+static std::atomic<uint32_t> steadyStateAllocations(0);
+
+AllocationScope::AllocationScope(bool steadyState) : previous(::steadyState) {
+    ::steadyState = steadyState;
+}
+
+AllocationScope::~AllocationScope() {
+    ::steadyState = previous;
+}
+
+uint32_t AllocationScope::count() {
+    return steadyStateAllocations.load(std::memory_order_relaxed);
+}
+
+static inline void countAllocation() {
+    if (steadyState) {
+        steadyStateAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#if defined(__GLIBC__)
+// Linux: wraps the glibc allocator, operator new ends up here too.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+}
+#elif defined(CONFIG_HEAP_USE_HOOKS)
+// ESP32: hook of the IDF heap, called after every successful allocation.
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+    countAllocation();
+}
+#else
+#error "MQTTBROKER_COUNT_ALLOCATIONS needs glibc or an ESP-IDF built with CONFIG_HEAP_USE_HOOKS"
+#endif
+
+#endif
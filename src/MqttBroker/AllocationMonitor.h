@@ -0,0 +1,43 @@
+#ifndef ALLOCATION_MONITOR_H
+#define ALLOCATION_MONITOR_H
+
+#include <Arduino.h>
+
+// Counts the heap allocations made on the steady-state path (publishes, acknowledgments,
+// pings, deliveries, keep-alives), see MqttBroker::getSteadyStateAllocations(). Set it to
+// 1 to check a StaticMqttBroker: malloc is hooked (glibc, or ESP-IDF built with
+// CONFIG_HEAP_USE_HOOKS), so keep it 0 in production.
+#ifndef MQTTBROKER_COUNT_ALLOCATIONS
+#define MQTTBROKER_COUNT_ALLOCATIONS 0
+#endif
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Marks the code run by the calling thread as steady-state (counted) or control
+ * path (not counted), see `MqttBroker::getSteadyStateAllocations()`.
+ * * Scopes nest: a SUBSCRIBE dispatched while reading a client's data pauses the
+ * counting until it returns. Compiled out unless MQTTBROKER_COUNT_ALLOCATIONS is set.
+ */
+class AllocationScope {
+#if MQTTBROKER_COUNT_ALLOCATIONS
+private:
+    bool previous;
+
+public:
+    AllocationScope(bool steadyState);
+    ~AllocationScope();
+
+    /** @brief Heap allocations made inside steady-state scopes, by every thread. */
+    static uint32_t count();
+#else
+public:
+    AllocationScope(bool) {}
+
+    static uint32_t count() { return 0; }
+#endif
+};
+
+} // namespace mqttBrokerName
+
+#endif // ALLOCATION_MONITOR_H
@@ -0,0 +1,52 @@
+#include "MqttBroker/BlockPool.h"
+
+// Blocks start on this alignment.
+static const size_t BLOCKALIGNMENT = alignof(std::max_align_t);
+
+void BlockPool::release() {
+    if (blocks == nullptr) return;
+
+    // A block still taken would be written after the release: kept, and reported.
+    if (available() < numBlocks) {
+        log_w("%u pooled blocks still in use, their storage is not freed.", (unsigned)(numBlocks - available()));
+    } else {
+        MemoryPolicy::release(blocks);
+    }
+    vQueueDelete(freeBlocks);
+    blocks = nullptr;
+    freeBlocks = nullptr;
+    numBlocks = 0;
+}
+
+void BlockPool::setCapacity(uint16_t numBlocks, size_t blockSize, MemoryUse use) {
+    release();
+    this->blockSize = (blockSize + BLOCKALIGNMENT - 1) & ~(BLOCKALIGNMENT - 1);
+    this->numBlocks = numBlocks;
+    if (numBlocks == 0) return;
+
+    blocks = (uint8_t*)MemoryPolicy::allocate(this->blockSize * numBlocks, use);
+    freeBlocks = xQueueCreate(numBlocks, sizeof(uint8_t*));
+    if (!blocks || !freeBlocks) {
+        log_e("Failed to allocate %u blocks of %u bytes", numBlocks, (unsigned)this->blockSize); ESP.restart();
+    }
+    for (uint16_t i = 0; i < numBlocks; i++) {
+        uint8_t* block = blocks + i * this->blockSize;
+        xQueueSend(freeBlocks, &block, 0);
+    }
+}
+
+void* BlockPool::take() {
+    uint8_t* block;
+    if (freeBlocks == nullptr || xQueueReceive(freeBlocks, &block, 0) != pdPASS) {
+        return nullptr;
+    }
+    return block;
+}
+
+void BlockPool::give(void* block) {
+    xQueueSend(freeBlocks, &block, 0);
+}
+
+uint16_t BlockPool::available() const {
+    return freeBlocks ? uxQueueMessagesWaiting(freeBlocks) : 0;
+}
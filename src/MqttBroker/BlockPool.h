@@ -0,0 +1,63 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <Arduino.h>
+#include "MemoryPolicy.h"
+
+/**
+ * @brief Fixed-size blocks allocated once, e.g. the message payloads of a
+ * `StaticMqttBroker` (see `MqttBytes::usePool`).
+ * * The free blocks are a FreeRTOS queue of pointers, as the pooled events of the
+ * Broker: `take` and `give` may be called by any thread, a block is often taken by
+ * the Network Thread and given back by a Worker.
+ */
+class BlockPool {
+private:
+    uint8_t* blocks = nullptr;
+    size_t blockSize = 0;
+    uint16_t numBlocks = 0;
+
+    /** @brief Free blocks, a queue of `uint8_t*`. */
+    QueueHandle_t freeBlocks = nullptr;
+
+    void release();
+
+public:
+    ~BlockPool() {
+        release();
+    }
+
+    /**
+     * @brief Allocates the blocks, in the region chosen for `use`. Only valid while
+     * no block is taken.
+     * @param numBlocks Number of blocks.
+     * @param blockSize Bytes of each block, rounded up to the `malloc` alignment.
+     * @param use What the blocks hold, see `MemoryPolicy::allocate`.
+     */
+    void setCapacity(uint16_t numBlocks, size_t blockSize, MemoryUse use);
+
+    /** @brief A free block of `getBlockSize()` bytes, nullptr if they are all taken. */
+    void* take();
+
+    /** @brief Gives back a block of `take`. */
+    void give(void* block);
+
+    /** @brief true if `memory` is a block of this pool. */
+    bool owns(const void* memory) const {
+        const uint8_t* address = (const uint8_t*)memory;
+        return address >= blocks && address < blocks + blockSize * numBlocks;
+    }
+
+    size_t getBlockSize() const {
+        return blockSize;
+    }
+
+    uint16_t getNumBlocks() const {
+        return numBlocks;
+    }
+
+    /** @brief Blocks not taken. */
+    uint16_t available() const;
+};
+
+#endif // BLOCK_POOL_H
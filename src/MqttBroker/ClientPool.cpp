@@ -0,0 +1,80 @@
+#include "MqttBroker/MqttBroker.h"
+
+using namespace mqttBrokerName;
+
+// Client objects start on this alignment.
+static const size_t BLOCKALIGNMENT = alignof(std::max_align_t);
+
+static size_t alignBlock(size_t bytes) {
+    return (bytes + BLOCKALIGNMENT - 1) & ~(BLOCKALIGNMENT - 1);
+}
+
+ClientPool::~ClientPool() {
+    release();
+}
+
+void ClientPool::release() {
+    // The slots are built once for all the blocks, destroyed the same way.
+    for (size_t i = 0; inflightSlots && i < (size_t)numBlocks * (inflightSize + pendingSize); i++) {
+        inflightSlots[i].~InflightMessage();
+    }
+    MemoryPolicy::release(clients);
+    MemoryPolicy::release(readers);
+    MemoryPolicy::release(outboxes);
+    MemoryPolicy::release(inflightSlots);
+    clients = readers = outboxes = nullptr;
+    inflightSlots = nullptr;
+}
+
+void ClientPool::setCapacity(uint16_t capacity, uint32_t readerBytes, uint32_t outboxBytes, 
+                             uint16_t inflightSize, uint16_t pendingSize) {
+    release();
+    this->readerBytes = readerBytes;
+    this->outboxBytes = outboxBytes;
+    this->inflightSize = inflightSize;
+    this->pendingSize = pendingSize;
+    clientSize = alignBlock(sizeof(MqttClient));
+    numBlocks = capacity;
+
+    // Objects in internal RAM, their bulk buffers wherever the policy puts them.
+    size_t numSlots = (size_t)capacity * (inflightSize + pendingSize);
+    clients = (uint8_t*)MemoryPolicy::allocate(clientSize * capacity, MEMORY_METADATA);
+    readers = (uint8_t*)MemoryPolicy::allocate((size_t)readerBytes * capacity, MEMORY_READER);
+    outboxes = (uint8_t*)MemoryPolicy::allocate((size_t)outboxBytes * capacity, MEMORY_OUTBOX);
+    inflightSlots = (InflightMessage*)MemoryPolicy::allocate(numSlots * sizeof(InflightMessage), MEMORY_METADATA);
+    if (!clients || !readers || !outboxes || !inflightSlots) {
+        log_e("Failed to allocate %u client blocks of %u bytes", capacity, (unsigned)getBlockSize()); ESP.restart();
+    }
+    for (size_t i = 0; i < numSlots; i++) {
+        new (&inflightSlots[i]) InflightMessage();
+    }
+
+// Stack of free blocks, block 0 on top.
+    freeBlocks.clear();
+    freeBlocks.reserve(capacity);
+    for (int i = capacity - 1; i >= 0; i--) {
+        freeBlocks.push_back(i);
+    }
+}
+
+MqttClient* ClientPool::create(MqttTransport* transport, int clientId, MqttBroker* broker, size_t outboxMaxSize) {
+    if (freeBlocks.empty()) {
+        return nullptr;
+    }
+    size_t block = freeBlocks.back();
+    freeBlocks.pop_back();
+
+    uint8_t* readerBuffer = readers + block * readerBytes;
+    uint8_t* outbox = outboxes + block * outboxBytes;
+    InflightMessage* slots = inflightSlots + block * (inflightSize + pendingSize);
+
+    MqttClient* client = new (clients + block * clientSize) MqttClient(transport, clientId, broker, outboxMaxSize);
+    client->useStaticBuffers(readerBuffer, readerBytes, outbox, outboxBytes, slots, inflightSize, pendingSize);
+    return client;
+}
+
+void ClientPool::destroy(MqttClient* client) {
+    uint16_t block = ((uint8_t*)client - clients) / clientSize;
+    client->~MqttClient();
+    freeBlocks.push_back(block);
+}
@@ -0,0 +1,87 @@
+#ifndef CLIENT_POOL_H
+#define CLIENT_POOL_H
+
+#include <Arduino.h>
+#include <vector>
+#include "MqttClient/InflightMessage.h"
+#include "TransportLayer/MqttTransport.h"
+
+namespace mqttBrokerName{
+
+class MqttClient;
+class MqttBroker;
+
+/**
+ * @brief Preallocated storage of the clients of a `StaticMqttBroker`.
+ * * One block per client: its `MqttClient` object, its reader buffer and its outbox 
+ * ring. Blocks are taken on accept and given back once the client is reclaimed, so 
+ * connections come and go without touching the heap.
+ * * The objects, the reader buffers and the outboxes are three arrays placed by 
+ * `MemoryPolicy`: the objects, read on every packet, in internal RAM, the buffers in 
+ * PSRAM when the board has it.
+ * * @note <b>Thread Safety:</b> `create` and `destroy` are serialized by the Broker 
+ * `clientSetMutex`, like the `ClientTable` writers.
+ */
+class ClientPool {
+private:
+    uint8_t* clients = nullptr;
+    uint8_t* readers = nullptr;
+    uint8_t* outboxes = nullptr;
+    size_t clientSize = 0;
+    uint16_t numBlocks = 0;
+    uint32_t readerBytes = 0;
+    uint32_t outboxBytes = 0;
+
+    /** @brief Slots of the QoS 1/2 queues of each client: in-flight window, then pending ones. */
+    InflightMessage* inflightSlots = nullptr;
+    uint16_t inflightSize = 0;
+    uint16_t pendingSize = 0;
+
+    void release();
+
+    /** @brief Indexes of the free blocks, used as a stack. */
+    std::vector<uint16_t> freeBlocks;
+
+public:
+    ~ClientPool();
+
+    /**
+     * @brief Allocates the blocks. Only valid while no client is created.
+     * @param capacity Number of blocks, the max number of clients.
+     * @param readerBytes Reader buffer of each client, the largest packet accepted.
+     * @param outboxBytes Outbox ring of each client.
+     * @param inflightSize QoS 1/2 publishes in flight to each client, its window.
+     * @param pendingSize QoS 1/2 publishes of each client waiting for the window.
+     */
+    void setCapacity(uint16_t capacity, uint32_t readerBytes, uint32_t outboxBytes, 
+                     uint16_t inflightSize, uint16_t pendingSize);
+
+    /** @brief true once the blocks are allocated: clients come from the pool. */
+    bool enabled() const {
+        return clients != nullptr;
+    }
+
+    /**
+     * @brief Builds a client in a free block, with its preallocated buffers.
+     * @return MqttClient* The client, or nullptr if every block is used.
+     */
+    MqttClient* create(MqttTransport* transport, int clientId, MqttBroker* broker, size_t outboxMaxSize);
+
+    /** @brief Destroys a client created by `create` and frees its block. */
+    void destroy(MqttClient* client);
+
+    /** @brief true if `client` lives in a block of this pool. */
+    bool owns(MqttClient* client) const {
+        uint8_t* address = (uint8_t*)client;
+        return address >= clients && address < clients + clientSize * numBlocks;
+    }
+
+    /** @brief Bytes of one block: the client object and its buffers. */
+    size_t getBlockSize() const {
+        return clientSize + readerBytes + outboxBytes + (inflightSize + pendingSize) * sizeof(InflightMessage);
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // CLIENT_POOL_H
@@ -0,0 +1,50 @@
+#include "ClientTable.h"
+
+using namespace mqttBrokerName;
+
+ClientTable::~ClientTable() {
+    delete[] slots;
+}
+
+void ClientTable::setCapacity(uint16_t capacity) {
+    delete[] slots;
+    slots = new Slot[capacity];
+    numSlots = capacity;
+    count = 0;
+
+    // Stack of free slots, slot 0 on top so clients fill the table in order.
+    freeSlots.clear();
+    freeSlots.reserve(capacity);
+    for (int i = capacity - 1; i >= 0; i--) {
+        freeSlots.push_back(i);
+    }
+}
+
+bool ClientTable::insert(MqttClient* client, ClientHandle& handle) {
+    if (freeSlots.empty()) {
+        return false;
+    }
+
+    uint16_t slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    handle.slot = slot;
+    handle.generation = slots[slot].generation;
+    slots[slot].client = client;
+    count++;
+    return true;
+}
+
+MqttClient* ClientTable::remove(const ClientHandle& handle) {
+    MqttClient* client = get(handle);
+    if (client == nullptr) {
+        return nullptr;
+    }
+
+    // Invalidate every copy of the handle before the slot is reused.
+    slots[handle.slot].client = nullptr;
+    slots[handle.slot].generation++;
+    freeSlots.push_back(handle.slot);
+    count--;
+    return client;
+}
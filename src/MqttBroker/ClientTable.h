@@ -0,0 +1,130 @@
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <vector>
+
+namespace mqttBrokerName{
+
+class MqttClient;
+
+/**
+ * @brief Generation-tagged reference to a slot of the `ClientTable`.
+ * * Unlike a raw `MqttClient*`, a handle stays safe to keep in the Trie, in queued 
+ * events or in timers after the client is deleted: the slot generation is bumped 
+ * on removal, so resolving a stale handle returns nullptr instead of freed memory.
+ * * The generation is 32 bits: a slot must be reused 2^32 times before a stale handle
+ * could match its new client again, where 16 bits wrapped after 65536 reuses.
+ */
+struct ClientHandle {
+    uint16_t slot;
+    uint32_t generation;
+
+    bool operator==(const ClientHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+
+    /** @brief A handle that never resolves, e.g. for a session restored without client. */
+    static ClientHandle invalid() {
+        return {UINT16_MAX, 0};
+    }
+
+    /**
+     * @brief Trie handle of a local subscription (`MqttBroker::subscribe`), never a client:
+     * the slot is reserved and the generation carries the subscription id.
+     */
+    static ClientHandle local(uint16_t subscriptionId) {
+        return {UINT16_MAX - 1, subscriptionId};
+    }
+
+    bool isLocal() const {
+        return slot == UINT16_MAX - 1;
+    }
+};
+
+/**
+ * @brief Fixed-capacity registry of the active clients.
+ * * Slots are allocated once (`setCapacity`), insertion pops a free slot and 
+ * removal pushes it back, so lookup, insertion and deletion are O(1) and iteration
+ * walks a contiguous array.
+ * * @note <b>Thread Safety:</b> `insert` and `remove` are serialized by the Broker 
+ * `clientSetMutex`. `get` and `at` are lock-free; a client returned by them stays 
+ * valid only while the caller is inside its epoch (see `EpochReclaimer`).
+ */
+class ClientTable {
+private:
+    struct Slot {
+        std::atomic<MqttClient*> client{nullptr};
+        std::atomic<uint32_t> generation{0};
+    };
+
+    Slot* slots = nullptr;
+    uint16_t numSlots = 0;
+
+    /** @brief Indexes of the empty slots, used as a stack. */
+    std::vector<uint16_t> freeSlots;
+
+    std::atomic<uint16_t> count{0};
+
+public:
+    ~ClientTable();
+
+    /**
+     * @brief Allocates the slots. Only valid while the table is empty.
+     * @param capacity Max number of clients.
+     */
+    void setCapacity(uint16_t capacity);
+
+    /**
+     * @brief Stores a client in a free slot.
+     * 
+     * @param client The client to store.
+     * @param handle Output, the handle of the client.
+     * @return false if the table is full.
+     */
+    bool insert(MqttClient* client, ClientHandle& handle);
+
+    /**
+     * @brief Resolves a handle, without locking.
+     * @return MqttClient* The client, or nullptr if it was removed.
+     */
+    MqttClient* get(const ClientHandle& handle) const {
+        if (handle.slot >= numSlots) {
+            return nullptr;
+        }
+        const Slot& slot = slots[handle.slot];
+        if (slot.generation != handle.generation) {
+            return nullptr;
+        }
+        MqttClient* client = slot.client;
+
+        // A concurrent remove clears the pointer, then bumps the generation.
+        if (slot.generation != handle.generation) {
+            return nullptr;
+        }
+        return client;
+    }
+
+    /**
+     * @brief Removes a client, invalidating all the copies of its handle.
+     * * The client is not freed: lock-free readers may still use it, the caller 
+     * hands it to the `EpochReclaimer`.
+     * @return MqttClient* The removed client, or nullptr if the handle was stale.
+     */
+    MqttClient* remove(const ClientHandle& handle);
+
+    /**
+     * @brief Client stored in a slot, for iteration.
+     * @return MqttClient* The client, or nullptr if the slot is empty.
+     */
+    MqttClient* at(uint16_t slot) const { return slots[slot].client; }
+
+    uint16_t capacity() const { return numSlots; }
+
+    uint16_t size() const { return count; }
+};
+
+} // namespace mqttBrokerName
+
+#endif // CLIENT_TABLE_H
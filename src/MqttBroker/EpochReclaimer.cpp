@@ -0,0 +1,21 @@
+#include "EpochReclaimer.h"
+
+using namespace mqttBrokerName;
+
+EpochReclaimer::EpochReclaimer() {
+    for (uint8_t i = 0; i < MAXNUMWORKERS; i++) {
+        readerEpochs[i] = 0;
+    }
+}
+
+bool EpochReclaimer::isReclaimable(uint32_t epoch) {
+    for (uint8_t i = 0; i < MAXNUMWORKERS; i++) {
+        uint32_t readerEpoch = readerEpochs[i];
+
+        // Entered before the retire: it may have resolved the object.
+        if (readerEpoch != 0 && readerEpoch <= epoch) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef EPOCH_RECLAIMER_H
+#define EPOCH_RECLAIMER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Max number of routing workers (CheckMqttClientTask shards). By default the 
+// broker runs one worker, use MqttBroker::setNumWorkers() to run one per core.
+#define MAXNUMWORKERS 4
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Epoch-based reclamation of removed clients.
+ * * Workers read the client table without locking. Each of them announces the 
+ * global epoch while it is processing (`enter`/`exit`), and a removed client is 
+ * retired with the epoch of its removal. It is only freed once every worker is 
+ * either idle or has entered a later epoch, so none can still hold it.
+ * * All the operations use sequentially consistent atomics: a worker entering 
+ * after a retire can't find the retired client in the table anymore.
+ */
+class EpochReclaimer {
+private:
+    std::atomic<uint32_t> globalEpoch{1};
+
+    /** @brief Epoch announced by each worker, 0 while it is idle. */
+    std::atomic<uint32_t> readerEpochs[MAXNUMWORKERS];
+
+public:
+    EpochReclaimer();
+
+    /** @brief Marks a worker as reading, with the current epoch. */
+    void enter(uint8_t reader){
+        readerEpochs[reader] = globalEpoch.load();
+    }
+
+    /** @brief Marks a worker as idle, it holds no client anymore. */
+    void exit(uint8_t reader){
+        readerEpochs[reader] = 0;
+    }
+
+    /**
+     * @brief Opens a new epoch for an object just removed from the table.
+     * @return uint32_t The retire epoch of the object.
+     */
+    uint32_t retire(){
+        return globalEpoch.fetch_add(1);
+    }
+
+    /**
+     * @brief Checks if an object retired at `epoch` can be freed.
+     * @return true if no worker entered at or before `epoch` is still reading.
+     */
+    bool isReclaimable(uint32_t epoch);
+};
+
+} // namespace mqttBrokerName
+
+#endif // EPOCH_RECLAIMER_H
@@ -0,0 +1,89 @@
+#include "KeepAliveWheel.h"
+
+using namespace mqttBrokerName;
+
+KeepAliveWheel::KeepAliveWheel() {
+    currentTick = millis() / KEEPALIVEWHEELTICKMS;
+    for (uint16_t& head : heads) {
+        head = NONE;
+    }
+}
+
+KeepAliveWheel::~KeepAliveWheel() {
+    delete[] entries;
+}
+
+void KeepAliveWheel::setCapacity(uint16_t slots) {
+    delete[] entries;
+    entries = new Entry[slots]();
+    numEntries = slots;
+    for (uint16_t& head : heads) {
+        head = NONE;
+    }
+}
+
+void KeepAliveWheel::unlink(uint16_t index) {
+    Entry& entry = entries[index];
+    if (entry.prev != NONE) {
+        entries[entry.prev].next = entry.next;
+    } else {
+        heads[entry.bucket] = entry.next;
+    }
+    if (entry.next != NONE) {
+        entries[entry.next].prev = entry.prev;
+    }
+    entry.scheduled = false;
+}
+
+void KeepAliveWheel::schedule(const ClientHandle& handle, unsigned long deadline) {
+    if (handle.slot >= numEntries) return;
+
+    unsigned long tick = deadline / KEEPALIVEWHEELTICKMS;
+
+    // A deadline already visited goes to the next bucket, it is checked on the next advance.
+    if ((long)(tick - currentTick) <= 0) {
+        tick = currentTick + 1;
+    }
+
+    // One deadline per slot: the previous one (maybe of a deleted client) is replaced.
+    Entry& entry = entries[handle.slot];
+    if (entry.scheduled) {
+        unlink(handle.slot);
+    }
+    entry.deadline = deadline;
+    entry.generation = handle.generation;
+    entry.bucket = tick % KEEPALIVEWHEELSLOTS;
+    entry.prev = NONE;
+    entry.next = heads[entry.bucket];
+    if (entry.next != NONE) {
+        entries[entry.next].prev = handle.slot;
+    }
+    heads[entry.bucket] = handle.slot;
+    entry.scheduled = true;
+}
+
+void KeepAliveWheel::advance(unsigned long now, std::vector<ClientHandle>& expired) {
+    unsigned long nowTick = now / KEEPALIVEWHEELTICKMS;
+    unsigned long elapsed = nowTick - currentTick;
+
+    // After a full revolution every bucket has been visited.
+    if (elapsed > KEEPALIVEWHEELSLOTS) {
+        elapsed = KEEPALIVEWHEELSLOTS;
+    }
+
+    for (unsigned long i = 1; i <= elapsed; i++) {
+        uint16_t index = heads[(currentTick + i) % KEEPALIVEWHEELSLOTS];
+
+        // Entries of later revolutions stay in the bucket.
+        while (index != NONE) {
+            Entry& entry = entries[index];
+            uint16_t next = entry.next;
+            if ((long)(now - entry.deadline) >= 0) {
+                unlink(index);
+                expired.push_back({index, entry.generation});
+            }
+            index = next;
+        }
+    }
+    currentTick = nowTick;
+}
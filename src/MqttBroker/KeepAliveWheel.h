@@ -0,0 +1,85 @@
+#ifndef KEEP_ALIVE_WHEEL_H
+#define KEEP_ALIVE_WHEEL_H
+
+#include <Arduino.h>
+#include <vector>
+#include "ClientTable.h"
+
+// Keep-alive timing wheel: number of buckets and time covered by each bucket.
+// One revolution spans KEEPALIVEWHEELSLOTS * KEEPALIVEWHEELTICKMS milliseconds,
+// longer deadlines stay in their bucket for the next revolutions.
+#define KEEPALIVEWHEELSLOTS 64
+#define KEEPALIVEWHEELTICKMS 100
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Hashed timing wheel of client keep-alive deadlines.
+ * * A client is stored in the bucket of its deadline, and `advance` only visits 
+ * the buckets elapsed since the previous call, so the maintenance cost depends on 
+ * the number of expirations instead of the number of clients.
+ * * Rescheduling is lazy: activity only updates `MqttClient::lastAlive`, the owner
+ * worker reads it when the old deadline expires and reinserts the client if it
+ * is still alive.
+ * * There is one entry per slot of the client table, linked in the list of its 
+ * bucket: scheduling replaces the deadline of the slot (a stale one left by a 
+ * deleted client included), and nothing is allocated after `setCapacity`.
+ * * @note Not thread-safe, the Broker guards it with `BrokerShard::timerMutex`.
+ */
+class KeepAliveWheel {
+private:
+    /** @brief No entry, the end of a bucket list. */
+    static const uint16_t NONE = UINT16_MAX;
+
+    struct Entry {
+        unsigned long deadline;
+        uint32_t generation;
+        uint16_t next;
+        uint16_t prev;
+        uint8_t bucket;
+        bool scheduled;
+    };
+
+    /** @brief Entries indexed by client slot. */
+    Entry* entries = nullptr;
+    uint16_t numEntries = 0;
+
+    /** @brief First entry of each bucket. */
+    uint16_t heads[KEEPALIVEWHEELSLOTS];
+
+    /** @brief Last tick (millis / KEEPALIVEWHEELTICKMS) visited by `advance`. */
+    unsigned long currentTick;
+
+    /** @brief Removes an entry from its bucket list. */
+    void unlink(uint16_t index);
+
+public:
+    KeepAliveWheel();
+    ~KeepAliveWheel();
+
+    /**
+     * @brief Allocates one entry per client slot. Only valid while nothing is scheduled.
+     * @param slots Capacity of the client table.
+     */
+    void setCapacity(uint16_t slots);
+
+    /**
+     * @brief Schedules a client expiration, replacing the previous one of its slot.
+     * 
+     * @param handle The client to check at the deadline.
+     * @param deadline Time (millis) when the client will be checked.
+     */
+    void schedule(const ClientHandle& handle, unsigned long deadline);
+
+    /**
+     * @brief Moves the wheel up to now, collecting the expired clients.
+     * 
+     * @param now The current system time (millis).
+     * @param expired Output, clients whose deadline is reached.
+     */
+    void advance(unsigned long now, std::vector<ClientHandle>& expired);
+};
+
+} // namespace mqttBrokerName
+
+#endif // KEEP_ALIVE_WHEEL_H
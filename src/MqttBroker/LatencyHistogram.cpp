@@ -0,0 +1,62 @@
+#include "MqttBroker/LatencyHistogram.h"
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the latency, rounded up: the 99th of 100 is the 99th.
+    uint32_t rank = ((uint64_t)count * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    uint8_t i = 0;
+    while (i < LATENCYBUCKETS - 1 && (seen += buckets[i]) < rank) {
+        i++;
+    }
+    // No bound beyond the longest one, when it is known.
+    uint32_t bound = (1u << i) - 1;
+    return (max > 0 && max < bound) ? max : bound;
+}
+
+const char* LatencyRecorder::stageName(LatencyStage stage) {
+    static const char* names[LATENCY_STAGES] = {"parse", "queue", "route", "fanout", "outbox", "total"};
+    return stage < LATENCY_STAGES ? names[stage] : "";
+}
+
+#if MQTTBROKER_LATENCY_HISTOGRAMS
+
+LatencyRecorder::LatencyRecorder() {
+    for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++) {
+        for (uint8_t i = 0; i < LATENCYBUCKETS; i++) {
+            buckets[stage][i].store(0, std::memory_order_relaxed);
+        }
+        maxima[stage].store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyRecorder::record(LatencyStage stage, uint32_t start) {
+    uint32_t elapsed = micros() - start;
+
+    // Bucket of the highest bit set: 1us is bucket 1, 2-3us bucket 2...
+    uint8_t bucket = elapsed == 0 ? 0 : 32 - __builtin_clz(elapsed);
+    if (bucket >= LATENCYBUCKETS) {
+        bucket = LATENCYBUCKETS - 1;
+    }
+    buckets[stage][bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t max = maxima[stage].load(std::memory_order_relaxed);
+    while (elapsed > max && !maxima[stage].compare_exchange_weak(max, elapsed, std::memory_order_relaxed)) {}
+}
+
+LatencyHistogram LatencyRecorder::get(LatencyStage stage) const {
+    LatencyHistogram histogram;
+    for (uint8_t i = 0; i < LATENCYBUCKETS; i++) {
+        histogram.buckets[i] = buckets[stage][i].load(std::memory_order_relaxed);
+        histogram.count += histogram.buckets[i];
+    }
+    histogram.max = maxima[stage].load(std::memory_order_relaxed);
+    return histogram;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Latency histograms of the publish pipeline stages, see MqttBroker::getLatencyHistogram().
+// 0 compiles the timestamps and the histograms out.
+#ifndef MQTTBROKER_LATENCY_HISTOGRAMS
+#define MQTTBROKER_LATENCY_HISTOGRAMS 1
+#endif
+
+// Buckets of a latency histogram: bucket 0 counts latencies under 1us, bucket i those
+// from 2^(i-1) to 2^i - 1 us, and the last one everything from about 4s.
+#define LATENCYBUCKETS 24
+
+/**
+ * @brief Stages of a publish through the broker, each with its histogram.
+ */
+enum LatencyStage : uint8_t {
+    /** @brief First byte of the PUBLISH received to the message decoded (`ReaderMqttPacket`). */
+    LATENCY_PARSE,
+
+    /** @brief Waiting in a worker event queue, publish or delivery handed over by another worker. */
+    LATENCY_QUEUE,
+
+    /** @brief Trie lookup of the subscribers (`Trie::getSubscribedMqttClients`). */
+    LATENCY_ROUTE,
+
+    /** @brief Serializing and writing the message to the subscribers of one worker. */
+    LATENCY_FANOUT,
+
+    /** @brief Packets waiting in a client outbox: from queued in an empty outbox to drained. */
+    LATENCY_OUTBOX,
+
+    /** @brief First byte received to the message written to its last subscriber, per worker. */
+    LATENCY_TOTAL,
+
+    LATENCY_STAGES
+};
+
+/**
+ * @brief Counts of one stage, see `MqttBroker::getLatencyHistogram()`.
+ */
+struct LatencyHistogram {
+    uint32_t buckets[LATENCYBUCKETS] = {};
+
+    /** @brief Latencies recorded, the sum of the buckets. */
+    uint32_t count = 0;
+
+    /** @brief Longest latency recorded (us). */
+    uint32_t max = 0;
+
+    /**
+     * @brief Latency under which `percent` % of the recorded ones are, rounded up to
+     * the end of its bucket, at most `max` if set (us). 0 if nothing is recorded.
+     */
+    uint32_t percentile(uint8_t percent) const;
+};
+
+/**
+ * @brief Latency histograms of all the stages, recorded by any thread.
+ * * A record is one bucket increment with a relaxed atomic, no lock. Timestamps are
+ * 32 bits microseconds: they wrap every 71 minutes, the differences stay right.
+ */
+class LatencyRecorder {
+#if MQTTBROKER_LATENCY_HISTOGRAMS
+private:
+    std::atomic<uint32_t> buckets[LATENCY_STAGES][LATENCYBUCKETS];
+    std::atomic<uint32_t> maxima[LATENCY_STAGES];
+
+public:
+    LatencyRecorder();
+
+    /** @brief Timestamp of a stage boundary. */
+    static uint32_t now() {
+        return micros();
+    }
+
+    /** @brief Records the time elapsed since `start`, a timestamp of `now()`. */
+    void record(LatencyStage stage, uint32_t start);
+
+    LatencyHistogram get(LatencyStage stage) const;
+#else
+public:
+    static uint32_t now() { return 0; }
+
+    void record(LatencyStage stage, uint32_t start) {}
+
+    LatencyHistogram get(LatencyStage stage) const { return LatencyHistogram(); }
+#endif
+
+    /** @brief Name of a stage in the $SYS topics: "parse", "queue"... */
+    static const char* stageName(LatencyStage stage);
+};
+
+#endif // LATENCY_HISTOGRAM_H
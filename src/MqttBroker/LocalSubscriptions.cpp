@@ -0,0 +1,78 @@
+#include "MqttBroker.h"
+
+using namespace mqttBrokerName;
+
+bool MqttBroker::publish(const String& topic, const MqttBytes& payload, uint8_t qos, bool retain) {
+    if (shards.empty()) {
+        log_w("Broker not started, local publish dropped.");
+        return false;
+    }
+    if (topic.length() == 0 || topic.indexOf('+') >= 0 || topic.indexOf('#') >= 0) {
+        log_w("Invalid topic for a local publish: %s", topic.c_str());
+        return false;
+    }
+
+    qos = min(qos, (uint8_t)MAXQOS);
+    CoreTrafficCounters::add(trafficCounters().messagesReceived);
+    PublishMqttMessage* msg = new PublishMqttMessage((qos << 1) | (retain ? 0x01 : 0x00), MqttTocpic(topic, payload, qos));
+
+    // Routed by the first worker, as the publishes of a client: in order.
+    if (!tryPublishMessage(msg, nullptr)) {
+        log_w("Broker Queue Full! Dropping local publish.");
+        CoreTrafficCounters::add(trafficCounters().publishesDropped);
+        delete msg;
+        return false;
+    }
+    return true;
+}
+
+uint16_t MqttBroker::subscribe(const String& topicFilter, LocalMessageCallback callback) {
+    if (topicFilter.length() == 0 || !callback) {
+        return 0;
+    }
+
+    uint16_t id = 0;
+    std::vector<RetainedMessage> retained;
+
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        if (localSubscriptions.size() < UINT16_MAX - 1) {
+            do {
+                id = nextLocalSubscription++;
+            } while (id == 0 || localSubscriptions.count(id));
+
+            // Refused when the preallocated Trie is full.
+            NodeTrie* node = topicTrie->subscribeLocal(topicFilter, id);
+            if (node != nullptr) {
+                localSubscriptions[id] = LocalSubscription{node, topicFilter, std::make_shared<LocalMessageCallback>(callback)};
+                retainedMessages.match(topicFilter, retained);
+            } else {
+                id = 0;
+            }
+        }
+        xSemaphoreGive(topicTrieMutex);
+    }
+
+    if (id == 0) {
+        log_w("Too many subscriptions, %s not subscribed.", topicFilter.c_str());
+        return 0;
+    }
+    log_i("Local subscription %u to %s", id, topicFilter.c_str());
+
+    // Outside of the lock: the callback may publish or subscribe.
+    for (const RetainedMessage& message : retained) {
+        PublishMqttMessage publish((message.qos << 1) | 1, MqttTocpic(message.topic, message.payload, message.qos));
+        callback(publish);
+    }
+    return id;
+}
+
+void MqttBroker::unsubscribe(uint16_t subscriptionId) {
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        auto it = localSubscriptions.find(subscriptionId);
+        if (it != localSubscriptions.end()) {
+            it->second.node->unSubscribeLocal(subscriptionId);
+            localSubscriptions.erase(it);
+        }
+        xSemaphoreGive(topicTrieMutex);
+    }
+}
@@ -0,0 +1,155 @@
+#include "MqttBroker/MemoryPolicy.h"
+
+#if !MQTTBROKER_EMULATED_MEMORY
+#include <esp_heap_caps.h>
+#endif
+
+/**
+ * @brief Prefix of every buffer, padded so the buffer keeps the `malloc` alignment.
+ */
+struct MemoryHeader {
+    size_t bytes;
+    uint8_t region;
+    uint8_t use;
+};
+
+static const size_t HEADERSIZE = (sizeof(MemoryHeader) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+struct RegionCounters {
+    std::atomic<size_t> used;
+    std::atomic<size_t> peak;
+    std::atomic<uint32_t> allocations;
+    std::atomic<uint32_t> failures;
+    std::atomic<size_t> usedBy[MEMORY_USES];
+};
+
+// Zero initialized, usable before any constructor runs.
+static RegionCounters counters[MEMORY_REGIONS];
+static std::atomic<size_t> externalThreshold(MEMORYEXTERNALTHRESHOLD);
+
+#if MQTTBROKER_EMULATED_MEMORY
+static std::atomic<size_t> emulatedCapacity[MEMORY_REGIONS] = {{MEMORYEMULATEDINTERNAL}, {MEMORYEMULATEDEXTERNAL}};
+#endif
+
+static void* regionMalloc(MemoryRegion region, size_t bytes) {
+    RegionCounters& c = counters[region];
+
+#if MQTTBROKER_EMULATED_MEMORY
+    // The budget is taken first: concurrent allocations can't overrun it.
+    size_t used = c.used.load(std::memory_order_relaxed);
+    size_t capacity = emulatedCapacity[region].load(std::memory_order_relaxed);
+    do {
+        if (used > capacity || bytes > capacity - used) {
+            return nullptr;
+        }
+    } while (!c.used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+    void* memory = malloc(bytes);
+    if (memory == nullptr) {
+        c.used.fetch_sub(bytes, std::memory_order_relaxed);
+        return nullptr;
+    }
+#else
+    uint32_t caps = (region == MEMORY_EXTERNAL ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+    void* memory = heap_caps_malloc(bytes, caps);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    c.used.fetch_add(bytes, std::memory_order_relaxed);
+#endif
+
+    size_t now = c.used.load(std::memory_order_relaxed);
+    size_t peak = c.peak.load(std::memory_order_relaxed);
+    while (now > peak && !c.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    return memory;
+}
+
+bool MemoryPolicy::hasExternal() {
+#if MQTTBROKER_EMULATED_MEMORY
+    return emulatedCapacity[MEMORY_EXTERNAL].load(std::memory_order_relaxed) > 0;
+#else
+    static const bool external = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    return external;
+#endif
+}
+
+MemoryRegion MemoryPolicy::regionFor(size_t bytes, MemoryUse use) {
+    if (use == MEMORY_METADATA || !hasExternal()) {
+        return MEMORY_INTERNAL;
+    }
+    return bytes >= externalThreshold.load(std::memory_order_relaxed) ? MEMORY_EXTERNAL : MEMORY_INTERNAL;
+}
+
+void* MemoryPolicy::allocate(size_t bytes, MemoryUse use) {
+    size_t total = HEADERSIZE + bytes;
+    MemoryRegion region = regionFor(bytes, use);
+    uint8_t* memory = (uint8_t*)regionMalloc(region, total);
+
+    // Slower or scarcer, still better than failing.
+    if (memory == nullptr) {
+        counters[region].failures.fetch_add(1, std::memory_order_relaxed);
+        if (!hasExternal()) {
+            return nullptr;
+        }
+        region = region == MEMORY_INTERNAL ? MEMORY_EXTERNAL : MEMORY_INTERNAL;
+        memory = (uint8_t*)regionMalloc(region, total);
+        if (memory == nullptr) {
+            counters[region].failures.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+
+    MemoryHeader* header = (MemoryHeader*)memory;
+    header->bytes = total;
+    header->region = region;
+    header->use = use;
+    counters[region].usedBy[use].fetch_add(total, std::memory_order_relaxed);
+    return memory + HEADERSIZE;
+}
+
+void MemoryPolicy::release(void* memory) {
+    if (memory == nullptr) {
+        return;
+    }
+    MemoryHeader* header = (MemoryHeader*)((uint8_t*)memory - HEADERSIZE);
+    RegionCounters& c = counters[header->region];
+    c.used.fetch_sub(header->bytes, std::memory_order_relaxed);
+    c.usedBy[header->use].fetch_sub(header->bytes, std::memory_order_relaxed);
+    c.allocations.fetch_sub(1, std::memory_order_relaxed);
+
+#if MQTTBROKER_EMULATED_MEMORY
+    free(header);
+#else
+    heap_caps_free(header);
+#endif
+}
+
+void MemoryPolicy::setExternalThreshold(size_t bytes) {
+    externalThreshold.store(bytes, std::memory_order_relaxed);
+}
+
+MemoryRegionStats MemoryPolicy::getStats(MemoryRegion region) {
+    RegionCounters& c = counters[region];
+    MemoryRegionStats stats;
+
+#if MQTTBROKER_EMULATED_MEMORY
+    stats.capacity = emulatedCapacity[region].load(std::memory_order_relaxed);
+#else
+    stats.capacity = heap_caps_get_total_size(region == MEMORY_EXTERNAL ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+#endif
+    stats.used = c.used.load(std::memory_order_relaxed);
+    stats.peak = c.peak.load(std::memory_order_relaxed);
+    stats.allocations = c.allocations.load(std::memory_order_relaxed);
+    stats.failures = c.failures.load(std::memory_order_relaxed);
+    for (uint8_t use = 0; use < MEMORY_USES; use++) {
+        stats.usedBy[use] = c.usedBy[use].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+#if MQTTBROKER_EMULATED_MEMORY
+void MemoryPolicy::setEmulatedCapacity(MemoryRegion region, size_t bytes) {
+    emulatedCapacity[region].store(bytes, std::memory_order_relaxed);
+}
+#endif
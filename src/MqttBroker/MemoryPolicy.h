@@ -0,0 +1,122 @@
+#ifndef MEMORY_POLICY_H
+#define MEMORY_POLICY_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Memory regions: the ESP-IDF heap capabilities on the ESP32 (internal RAM and
+ * PSRAM), two regions emulated on the heap elsewhere, with the sizes below, so the
+ * placement and the fallbacks can be exercised on Linux.
+ * Can be forced with -DMQTTBROKER_EMULATED_MEMORY=0 or 1.
+ */
+#ifndef MQTTBROKER_EMULATED_MEMORY
+#if defined(ESP_PLATFORM)
+#define MQTTBROKER_EMULATED_MEMORY 0
+#else
+#define MQTTBROKER_EMULATED_MEMORY 1
+#endif
+#endif
+
+// Bulk buffers of at least this size go to the external RAM when the board has it,
+// smaller ones are not worth the slower access. See MemoryPolicy::setExternalThreshold().
+#define MEMORYEXTERNALTHRESHOLD 512
+
+// Sizes of the emulated regions, unlimited on a host. (320 * 1024) and (4 * 1024 * 1024)
+// emulate an ESP32-WROVER, see MemoryPolicy::setEmulatedCapacity().
+#define MEMORYEMULATEDINTERNAL SIZE_MAX
+#define MEMORYEMULATEDEXTERNAL SIZE_MAX
+
+/**
+ * @brief Where a buffer lives.
+ */
+enum MemoryRegion : uint8_t {
+    /** @brief Internal RAM: fast and scarce (about 300KB on an ESP32). */
+    MEMORY_INTERNAL,
+
+    /** @brief External RAM (PSRAM, 4-8MB on WROVER boards): larger, slower, behind the cache. */
+    MEMORY_EXTERNAL,
+
+    MEMORY_REGIONS
+};
+
+/**
+ * @brief What a buffer holds, which decides its region.
+ */
+enum MemoryUse : uint8_t {
+    /** @brief Trie nodes and client objects, read on every packet: kept internal. */
+    MEMORY_METADATA,
+
+    /** @brief Reader buffers of the preallocated clients. */
+    MEMORY_READER,
+
+    /** @brief Outboxes of the preallocated clients, written once and drained by the transport. */
+    MEMORY_OUTBOX,
+
+    /** @brief Received packets and message payloads. */
+    MEMORY_PAYLOAD,
+
+    /** @brief The retained messages arena. */
+    MEMORY_RETAINED,
+
+    MEMORY_USES
+};
+
+/**
+ * @brief Usage of a region by the buffers of the broker, see `MemoryPolicy::getStats()`.
+ */
+struct MemoryRegionStats {
+    /** @brief Size of the region, 0 if the board doesn't have it, SIZE_MAX if emulated without limit. */
+    size_t capacity;
+
+    /** @brief Bytes currently allocated by the broker, and their highest value. */
+    size_t used;
+    size_t peak;
+
+    /** @brief Buffers currently allocated. */
+    uint32_t allocations;
+
+    /** @brief Allocations that did not fit, placed in the other region or failed. */
+    uint32_t failures;
+
+    /** @brief `used` split by `MemoryUse`. */
+    size_t usedBy[MEMORY_USES];
+};
+
+/**
+ * @brief Placement of the broker buffers between internal and external RAM.
+ * * Large, cold buffers (outboxes, reader buffers, the retained store, payloads) go
+ * to the PSRAM, hot metadata stays in internal RAM. When a region is full the other
+ * one is used, and counted as a failure. Every buffer carries a small header with
+ * its size, region and use, so `release()` needs only the pointer. Thread safe.
+ */
+class MemoryPolicy {
+public:
+    /**
+     * @brief Allocates a buffer in the region chosen for its size and use.
+     * @return void* The buffer (aligned as `malloc`), nullptr if no region has room.
+     */
+    static void* allocate(size_t bytes, MemoryUse use);
+
+    /** @brief Frees a buffer of `allocate`, nullptr is ignored. */
+    static void release(void* memory);
+
+    /** @brief The region `allocate` tries first. */
+    static MemoryRegion regionFor(size_t bytes, MemoryUse use);
+
+    /** @brief true if the board has external RAM (or its emulation is not empty). */
+    static bool hasExternal();
+
+    /** @brief Smallest bulk buffer placed in external RAM, SIZE_MAX keeps everything internal. */
+    static void setExternalThreshold(size_t bytes);
+
+    static MemoryRegionStats getStats(MemoryRegion region);
+
+#if MQTTBROKER_EMULATED_MEMORY
+    /** @brief Resizes an emulated region, 0 removes the external one. */
+    static void setEmulatedCapacity(MemoryRegion region, size_t bytes);
+#endif
+};
+
+#endif // MEMORY_POLICY_H
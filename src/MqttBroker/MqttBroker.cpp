@@ -4,154 +4,465 @@ using namespace mqttBrokerName;
 
 MqttBroker::MqttBroker(ServerListener* listener) {
     this->maxNumClients = MAXNUMCLIENTS;
-    this->listener = listener;
     
     // Inject dependencies: The listener needs a reference back to the broker
     // to notify when new clients connect.
-    if (this->listener) {
-        this->listener->setBroker(this);
+    if (listener) {
+        addListener(listener);
     }
     
     topicTrie = new Trie();
 
-    // 1. Create Queues
-    // deleteMqttClientQueue stores pointers to MqttTransport objects that need cleanup.
-    deleteMqttClientQueue = xQueueCreate(20, sizeof(MqttTransport*)); 
-    if (!deleteMqttClientQueue) {
-        log_e("Failed to create delete queue"); ESP.restart();
-    }
-
-    // brokerEventQueue stores pointers to BrokerEvent structs for the Worker.
-    brokerEventQueue = xQueueCreate(50, sizeof(BrokerEvent*)); 
-    if (!brokerEventQueue) {
-        log_e("Failed to create brokerEventQueue"); ESP.restart();
-    }
+#if MQTTBROKER_POSIX_SOCKETS
+    storage = new PosixFileStorage();
+#else
+    storage = new LittleFsStorage();
+#endif
 
-    // 2. Create Mutex
-    // Required to protect the 'clients' map from concurrent access by Core 1 (Network) and Core 0 (Worker).
+    // 1. Create Mutexes
+    // Required to protect the 'clients' table from concurrent access by Core 1 (Network) and the Workers.
     clientSetMutex = xSemaphoreCreateMutex();
     if (!clientSetMutex) {
         log_e("Failed to create mutex"); ESP.restart();
     }
 
-    // 3. Instantiate Worker (Core 0)
-    // The worker task handles heavy processing to keep the network loop non-blocking.
-    this->checkMqttClientTask = new CheckMqttClientTask(this);
-    this->checkMqttClientTask->setCore(0);
+    // Required to share the Trie between Workers.
+    topicTrieMutex = xSemaphoreCreateMutex();
+    if (!topicTrieMutex) {
+        log_e("Failed to create topicTrieMutex"); ESP.restart();
+    }
+
+    // Required to share the offline in-flight messages between Workers and the Network Thread.
+    sessionMutex = xSemaphoreCreateMutex();
+    if (!sessionMutex) {
+        log_e("Failed to create sessionMutex"); ESP.restart();
+    }
+
+    // 2. Shards (queues + Workers) are created by startBroker(),
+    // once the number of workers is known.
+}
+
+void MqttBroker::createShards() {
+    for (uint8_t i = 0; i < numWorkers; i++) {
+        BrokerShard* shard = new BrokerShard;
+        shard->id = i;
+
+        // eventQueue stores pointers to BrokerEvent structs for the Worker.
+        shard->eventQueue = xQueueCreate(capacity.eventQueueDepth, sizeof(BrokerEvent*)); 
+        if (!shard->eventQueue) {
+            log_e("Failed to create eventQueue"); ESP.restart();
+        }
+
+        // deleteQueue stores the handles of the clients that need cleanup.
+        shard->deleteQueue = xQueueCreate(20, sizeof(ClientHandle)); 
+        if (!shard->deleteQueue) {
+            log_e("Failed to create delete queue"); ESP.restart();
+        }
+
+        // timerMutex guards the keep-alive wheel, filled by the Network Thread on CONNECT.
+        shard->timerMutex = xSemaphoreCreateMutex();
+        if (!shard->timerMutex) {
+            log_e("Failed to create timerMutex"); ESP.restart();
+        }
+        shard->keepAliveWheel.setCapacity(maxNumClients);
+
+        // Instantiate Worker, spreading workers across cores (worker 0 on Core 0).
+        // The worker task handles heavy processing to keep the network loop non-blocking.
+        shard->worker = new CheckMqttClientTask(this, shard);
+        shard->worker->setCore(i % portNUM_PROCESSORS);
+
+        shards.push_back(shard);
+    }
 }
 
 
 MqttBroker::~MqttBroker() {
     stopBroker();
 
-    if (checkMqttClientTask) {
-        delete checkMqttClientTask; 
+    for (BrokerShard* shard : shards) {
+        delete shard->worker;
     }
     
-    // The Broker owns the Listener, so we are responsible for deleting it.
-    if (listener) {
+    // The Broker owns the Listeners, so we are responsible for deleting them.
+    for (ServerListener* listener : listeners) {
         delete listener;
     }
+    listeners.clear();
+    
+    // Clean up all active clients.
+    // Iterating and deleting here will close their transports and free memory.
+    for (uint16_t slot = 0; slot < clients.capacity(); slot++) {
+        MqttClient* client = clients.at(slot);
+        if (client) releaseClient(client);
+    }
+    
+    // Workers are stopped, retired clients can't be held anymore.
+    for (BrokerShard* shard : shards) {
+        for (auto const& [client, epoch] : shard->retiredClients) {
+            releaseClient(client);
+        }
+    }
     
+    // Clients unsubscribe from its nodes when deleted.
     if (topicTrie) {
         delete topicTrie;
     }
     
-    // Clean up all active clients.
-    // Iterating and deleting here will close their transports and free memory.
-    for (auto const& [transport, client] : clients) {
-        delete client; 
+    // Drain and clean up pending events in the queues to prevent leaks.
+    for (BrokerShard* shard : shards) {
+        BrokerEvent* event;
+        while(xQueueReceive(shard->eventQueue, &event, 0) == pdPASS) {
+            deleteEvent(event);
+        }
+        vQueueDelete(shard->eventQueue);
+        vQueueDelete(shard->deleteQueue);
+        vSemaphoreDelete(shard->timerMutex);
+        delete shard;
     }
-    clients.clear();
-    
-    // Drain and clean up pending events in the queue to prevent leaks.
-    BrokerEvent* event;
-    while(xQueueReceive(brokerEventQueue, &event, 0) == pdPASS) {
-        // Ideally, we should also delete the inner message objects (pubMsg/subMsg) here.
-        delete event;
+    shards.clear();
+
+    // Every pooled event is back in the free list.
+    if (eventPool) {
+        vQueueDelete(freeEvents);
+        delete[] eventPool;
+    }
+
+    // So are the pooled messages. Payloads still held (retained messages, sessions)
+    // outlive the pool: their blocks are kept.
+    if (messagePool) {
+        vQueueDelete(freeMessages);
+        delete[] messagePool;
+    }
+    if (MqttBytes::getPool() == &payloadPool) {
+        MqttBytes::usePool(nullptr);
+    }
+
+    for (auto const& [clientIdentifier, session] : sessions) {
+        delete session;
     }
-    vQueueDelete(brokerEventQueue);
-    vQueueDelete(deleteMqttClientQueue);
+    sessions.clear();
+    sessionsById.clear();
+
+    // The open files of the offline log don't need it.
+    delete storage;
 
     vSemaphoreDelete(clientSetMutex);
+    vSemaphoreDelete(topicTrieMutex);
+    vSemaphoreDelete(sessionMutex);
 }
 
 // --- CONTROL ---
 
 void MqttBroker::startBroker() {
-    // Start the specific network listener (TCP or WebSocket)
-    if (listener) {
-        listener->begin();
-        log_i("MqttBroker Listener Started");
+    // Workers and client slots must exist before the first client is accepted.
+    if (shards.empty()) {
+        clients.setCapacity(maxNumClients);
+        if (offlineLogEnabled) {
+            offlineLog.begin(storage);
+        }
+        createShards();
+
+        // The last allocations: nothing grows the heap after this with a fixed capacity.
+        if (capacity.maxClients > 0) {
+            preallocate();
+        }
+
+        // Sessions and retained messages of the previous run, before any client.
+        if (snapshotInterval > 0) {
+            loadSnapshot();
+        }
+        startTime = millis();
+        lastSysPublish = startTime;
     }
 
-    // Start the background worker task
-    checkMqttClientTask->start();
+    // Start the background worker tasks
+    for (BrokerShard* shard : shards) {
+        shard->worker->start();
+    }
+
+    // Start the specific network listeners (TCP and/or WebSocket)
+    for (ServerListener* listener : listeners) {
+        listener->begin();
+    }
+    listening = true;
+    log_i("MqttBroker %u Listeners Started (%u workers)", (unsigned)listeners.size(), numWorkers);
 }
 
 void MqttBroker::stopBroker() {
-    if (listener) {
+    listening = false;
+    for (ServerListener* listener : listeners) {
         listener->stop();
     }
-    if (checkMqttClientTask) {
-        checkMqttClientTask->stop();
+    for (BrokerShard* shard : shards) {
+        shard->worker->stop();
+    }
+
+    // Last state saved, e.g. before an OTA restart.
+    if (snapshotReady && snapshotInterval > 0 && snapshotDirty) {
+        saveSnapshot();
     }
 }
 
-// --- CLIENT MANAGEMENT (Incoming Connections) ---
+void MqttBroker::addListener(ServerListener* listener) {
+    listener->setBroker(this);
+    listeners.push_back(listener);
 
-void MqttBroker::acceptClient(MqttTransport *transport) {
-    
-    // 1. Capacity check
-    if (isBrokerFullOfClients()) {
-        log_w("Broker full. Rejecting client IP: %s", transport->getIP().c_str());
-        transport->close();
-        delete transport; // Must delete the wrapper since we won't store it
+    if (listening) {
+        listener->begin();
+    }
+}
+
+void MqttBroker::setNumWorkers(uint8_t numWorkers) {
+    if (!shards.empty()) {
+        log_w("Broker already started, number of workers unchanged.");
         return;
     }
+    this->numWorkers = constrain(numWorkers, 1, MAXNUMWORKERS);
+}
+
+void MqttBroker::setCapacity(const BrokerCapacity& capacity) {
+    if (!shards.empty()) {
+        log_w("Broker already started, capacity unchanged.");
+        return;
+    }
+    this->capacity = capacity;
+    this->capacity.eventQueueDepth = max(capacity.eventQueueDepth, (uint16_t)1);
+
+    if (capacity.maxClients > 0) {
+        // A packet must fit the reader buffer and the outbox.
+        this->capacity.maxSubscriptions = max(capacity.maxSubscriptions, (uint16_t)1);
+        this->capacity.maxPacketSize = max(capacity.maxPacketSize, (uint32_t)128);
+        this->capacity.outboxBytes = max(capacity.outboxBytes, this->capacity.maxPacketSize);
+        this->maxNumClients = capacity.maxClients;
+    }
+}
+
+void MqttBroker::preallocate() {
+    clientPool.setCapacity(capacity.maxClients, capacity.maxPacketSize, capacity.outboxBytes, 
+                           inflightWindowSize, PENDINGQOSSIZE);
+    topicTrie->reserve(capacity.maxSubscriptions, (uint32_t)capacity.maxSubscriptions * TRIENODESPERSUBSCRIPTION, 
+                       capacity.maxPacketSize);
+
+    // The Trie storage starts empty: local subscriptions made before are attached again.
+    for (auto it = localSubscriptions.begin(); it != localSubscriptions.end();) {
+        it->second.node = topicTrie->subscribeLocal(it->second.filter, it->first);
+        if (it->second.node == nullptr) {
+            log_w("Too many subscriptions, %s not subscribed.", it->second.filter.c_str());
+            it = localSubscriptions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // A full queue per worker, plus the events being processed or built.
+    size_t numEvents = (capacity.eventQueueDepth + 2) * shards.size() + 1;
+    eventPool = new BrokerEvent[numEvents];
+    freeEvents = xQueueCreate(numEvents, sizeof(BrokerEvent*));
+    if (!freeEvents) {
+        log_e("Failed to create freeEvents"); ESP.restart();
+    }
+    for (size_t i = 0; i < numEvents; i++) {
+        // Deliver events carry subscribers of another worker, only with several workers.
+        if (shards.size() > 1) {
+            eventPool[i].targets.reserve(capacity.maxSubscriptions);
+        }
+        BrokerEvent* event = &eventPool[i];
+        xQueueSend(freeEvents, &event, 0);
+    }
+
+    // Routed publishes: a full queue per worker plus one per client, the same number
+    // of payloads, kept by the deliveries in flight. A topic longer than reserved grows
+    // the String of its message once.
+    numMessages = capacity.messageBuffers > 0 ? capacity.messageBuffers 
+                                              : capacity.eventQueueDepth * shards.size() + capacity.maxClients;
+    messagePool = new PublishMqttMessage[numMessages];
+    freeMessages = xQueueCreate(numMessages, sizeof(PublishMqttMessage*));
+    if (!freeMessages) {
+        log_e("Failed to create freeMessages"); ESP.restart();
+    }
+    for (uint16_t i = 0; i < numMessages; i++) {
+        messagePool[i].reserveTopic(POOLEDTOPICLENGTH);
+        PublishMqttMessage* message = &messagePool[i];
+        xQueueSend(freeMessages, &message, 0);
+    }
+    payloadPool.setCapacity(numMessages, MqttBytes::allocationSize(capacity.maxPacketSize), MEMORY_PAYLOAD);
+    MqttBytes::usePool(&payloadPool);
+
+    // Each list holds at most one entry per subscription or per client.
+    for (BrokerShard* shard : shards) {
+        shard->matchedSubscribers.reserve(capacity.maxSubscriptions);
+        shard->localSubscribers.reserve(capacity.maxSubscriptions);
+        shard->localCallbacks.reserve(capacity.maxSubscriptions);
+        shard->expiredClients.reserve(capacity.maxClients);
+        shard->pumpedClients.reserve(capacity.maxClients);
+        shard->backlogClients.reserve(capacity.maxClients);
+        shard->stalledClients.reserve(capacity.maxClients);
+        shard->retriedClients.reserve(capacity.maxClients);
+        shard->resolvedClients.reserve(capacity.maxClients);
+        shard->retiredClients.reserve(capacity.maxClients);
+    }
+
+    log_i("Preallocated %u clients of %u bytes, %u subscriptions, %u events, %u messages of %u bytes.", 
+          capacity.maxClients, (unsigned)clientPool.getBlockSize(), capacity.maxSubscriptions, (unsigned)numEvents, 
+          numMessages, (unsigned)payloadPool.getBlockSize());
+}
+
+void MqttBroker::checkSteadyStateAllocations() {
+    uint32_t allocations = getSteadyStateAllocations();
+
+    // Reported once: the counter keeps going for getSteadyStateAllocations().
+    if (capacity.maxClients > 0 && reportedAllocations == 0 && allocations > 0) {
+        log_e("%u heap allocations on the steady-state path of a preallocated broker.", allocations);
+        reportedAllocations = allocations;
+    }
+}
+
+BrokerShardStats MqttBroker::getShardStats(uint8_t shardId) {
+    if (shardId >= shards.size()) {
+        return BrokerShardStats();
+    }
+    return shards[shardId]->stats;
+}
+
+ClientMemoryReport MqttBroker::getClientMemoryReport() {
+    ClientMemoryReport report;
+
+    // Clients stay in the table (so they are not freed) while the mutex is held.
+    if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
+        for (uint16_t slot = 0; slot < clients.capacity(); slot++) {
+            MqttClient* client = clients.at(slot);
+            if (client == nullptr) continue;
+
+            size_t bytes = client->memoryUsage();
+            report.clients++;
+            report.bytes += bytes;
+            report.largest = max(report.largest, bytes);
+        }
+        xSemaphoreGive(clientSetMutex);
+    }
+    return report;
+}
+
+// --- CLIENT MANAGEMENT (Incoming Connections) ---
+
+bool MqttBroker::acceptClient(MqttTransport *transport) {
     
-    // 2. Critical Section: Add to the map
+    // Critical Section: admission checks and insertion in the table
     if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
+        // Capacity check
+        if (isBrokerFullOfClients()) {
+            xSemaphoreGive(clientSetMutex);
+            rejectClient(transport, "Broker full");
+            return false;
+        }
+
+        // Silent connections must not take the slots of the clients that complete the handshake.
+        if (tooManyPendingClients()) {
+            xSemaphoreGive(clientSetMutex);
+            rejectClient(transport, "Too many pending handshakes");
+            return false;
+        }
+
+        // Reconnect storms: the refused devices retry later, at the accepted rate.
+        if (!takeAcceptCredit()) {
+            xSemaphoreGive(clientSetMutex);
+            rejectClient(transport, "Accept rate exceeded");
+            return false;
+        }
+
         numClient++; 
         int newId = numClient;
 
         // Instantiate MqttClient, injecting the abstract transport.
         // The MqttClient constructor will configure the transport callbacks.
-        MqttClient *mqttClient = new MqttClient(transport, newId, this, outBoxMaxSize);
+        MqttClient *mqttClient = clientPool.enabled() 
+            ? clientPool.create(transport, newId, this, outBoxMaxSize)
+            : new MqttClient(transport, newId, this, outBoxMaxSize);
+
+        // Every block is still held, by clients waiting to be reclaimed.
+        if (mqttClient == nullptr) {
+            xSemaphoreGive(clientSetMutex);
+            rejectClient(transport, "Broker full");
+            return false;
+        }
         
-        // Store in the map using the transport pointer as the unique key.
-        clients[transport] = mqttClient;
+        // Store in a free slot. The handle is set before any transport callback 
+        // can run, they are dispatched by this same Network Thread.
+        ClientHandle handle;
+        clients.insert(mqttClient, handle);
+        mqttClient->setHandle(handle);
+
+        mqttClient->holdHandshake();
+        pendingClients++;
         
         xSemaphoreGive(clientSetMutex);
         
-        log_i("Client Accepted. ID: %i, IP: %s", newId, transport->getIP().c_str());
+        log_i("Client Accepted. ID: %i, Slot: %u, IP: %s", newId, handle.slot, transport->getIP().c_str());
+
+        // The CONNECT deadline, checked by the worker with the keep-alives.
+        scheduleKeepAlive(mqttClient);
+        return true;
+    }
+
+    log_e("Mutex Error. Rejecting.");
+    transport->close();
+    delete transport;
+    return false;
+}
+
+void MqttBroker::rejectClient(MqttTransport* transport, const char* reason) {
+    log_w("%s. Rejecting client IP: %s", reason, transport->getIP().c_str());
+    rejectedConnections++;
+    transport->close();
+    delete transport; // Must delete the wrapper since we won't store it
+}
+
+bool MqttBroker::takeAcceptCredit() {
+    if (acceptRateLimit == 0) return true;
+
+    // Refill: acceptRateLimit thousandths per millisecond, up to a burst of one second.
+    unsigned long now = millis();
+    uint32_t burst = (uint32_t)acceptRateLimit * 1000;
+    unsigned long elapsed = now - lastAcceptRefill;
+    lastAcceptRefill = now;
+    if (elapsed >= 1000) {
+        acceptCredit = burst;
     } else {
-        log_e("Mutex Error. Rejecting.");
-        transport->close();
-        delete transport;
+        acceptCredit = min(burst, acceptCredit + (uint32_t)elapsed * acceptRateLimit);
+    }
+
+    if (acceptCredit < 1000) {
+        return false;
+    }
+    acceptCredit -= 1000;
+    return true;
+}
+
+void MqttBroker::handshakeDone(MqttClient* client) {
+    if (client->releaseHandshake()) {
+        pendingClients--;
     }
 }
 
 // --- CLIENT DELETION (Cleanup) ---
 
-void MqttBroker::queueClientForDeletion(MqttTransport* transportKey) {
-    // Push the transport pointer to the queue. The Worker will process this later.
-    xQueueSend(deleteMqttClientQueue, &transportKey, 0);
+void MqttBroker::queueClientForDeletion(ClientHandle handle) {
+    // Push the handle to the queue of the owner shard. Its Worker will process this later.
+    xQueueSend(shardOf(handle)->deleteQueue, &handle, 0);
 }
 
-void MqttBroker::deleteMqttClient(MqttTransport* transportKey) {
+void MqttBroker::deleteMqttClient(ClientHandle handle) {
     MqttClient* clientToDelete = nullptr;
 
-    // Critical Section: Remove from map
+    // Critical Section: Remove from table
     if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
-        auto it = clients.find(transportKey);
+        clientToDelete = clients.remove(handle);
         
-        if (it != clients.end()) {
-            clientToDelete = it->second;
-            clients.erase(it); // Remove the entry from the map
-            log_i("Client removed from map.");
+        if (clientToDelete != nullptr) {
+            log_i("Client removed from table.");
+            handshakeDone(clientToDelete);
         } else {
-            log_w("Client not found in map for deletion.");
+            log_w("Client not found in table for deletion.");
         }
         xSemaphoreGive(clientSetMutex);
     }
@@ -159,164 +470,779 @@ void MqttBroker::deleteMqttClient(MqttTransport* transportKey) {
     // Actual deletion happens OUTSIDE the mutex to prevent deadlocks
     // (e.g., if the destructor needs to access other locked resources).
     if (clientToDelete != nullptr) {
-        delete clientToDelete; // MqttClient destructor handles cleanup of Transport and Reader
+        // A stalled client must not be retried after deletion.
+        BrokerShard* shard = shardOf(handle);
+        if (xSemaphoreTake(shard->timerMutex, portMAX_DELAY) == pdTRUE) {
+            std::vector<ClientHandle>& stalledClients = shard->stalledClients;
+            auto stalled = std::find(stalledClients.begin(), stalledClients.end(), handle);
+            if (stalled != stalledClients.end()) {
+                stalledClients.erase(stalled);
+            }
+            xSemaphoreGive(shard->timerMutex);
+        }
+
+        // A persistent session keeps its Trie entries and unacknowledged publishes.
+        if (!detachSession(clientToDelete)) {
+            // Free its Trie entries, its handle is already stale for other workers.
+            unsubscribeClientFromTrie(clientToDelete);
+        }
+
+        // Other workers may have resolved it just before the remove: defer the delete.
+        shard->retiredClients.push_back(std::make_pair(clientToDelete, epochs.retire()));
+    }
+}
+
+bool MqttBroker::reclaimClients(BrokerShard* shard) {
+    std::vector<std::pair<MqttClient*, uint32_t>>& retired = shard->retiredClients;
+    bool workDone = false;
+
+    // Retired in epoch order: stop at the first one still reachable.
+    while (!retired.empty() && epochs.isReclaimable(retired.front().second)) {
+        releaseClient(retired.front().first); // MqttClient destructor handles cleanup of Transport and Reader
+        retired.erase(retired.begin());
         log_v("Client object memory freed.");
+        workDone = true;
+    }
+    return workDone;
+}
+
+void MqttBroker::releaseClient(MqttClient* client) {
+    if (!clientPool.owns(client)) {
+        delete client;
+        return;
+    }
+
+    // The free blocks are shared with acceptClient (Network Thread).
+    if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
+        clientPool.destroy(client);
+        xSemaphoreGive(clientSetMutex);
     }
 }
 
 // --- WORKER LOGIC ---
 
-bool MqttBroker::processDeletions() {
-    MqttTransport* transportKey;
+bool MqttBroker::processDeletions(BrokerShard* shard) {
+    ClientHandle handle;
     bool workDone = false;
     
     // Process all pending deletion requests
-    while (xQueueReceive(deleteMqttClientQueue, &transportKey, 0) == pdPASS) {
-        deleteMqttClient(transportKey);
+    while (xQueueReceive(shard->deleteQueue, &handle, 0) == pdPASS) {
+        deleteMqttClient(handle);
+        shard->stats.clientsDeleted++;
+        workDone = true;
+    }
+
+    if (reclaimClients(shard)) {
         workDone = true;
     }
     return workDone;
 }
 
-void MqttBroker::processKeepAlives() {
+void MqttBroker::processKeepAlives(BrokerShard* shard) {
+    AllocationScope steadyState(true);
     unsigned long now = millis();
+    std::vector<ClientHandle>& expired = shard->expiredClients;
+    std::vector<ClientHandle>& backlog = shard->pumpedClients;
+    std::vector<MqttClient*>& resolved = shard->resolvedClients;
+    expired.clear();
+    backlog.clear();
 
-    // Protect map iteration
-    if (xSemaphoreTake(clientSetMutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
-        for (auto const& [transport, client] : clients) {
-            // Only check KeepAlive for fully connected clients
-            if (client->getState() == STATE_CONNECTED) {
-                client->checkKeepAlive(now);
+    // Collect the due work, the lock is only held for the elapsed buckets.
+    if (xSemaphoreTake(shard->timerMutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        shard->keepAliveWheel.advance(now, expired);
+        backlog.swap(shard->backlogClients);
+        xSemaphoreGive(shard->timerMutex);
+    }
 
-                // 2. Active Flow Control / Outbox Pumping
-                client->processOutbox();
+    // 1. Keep Alive: only the clients whose deadline is reached.
+    if (!expired.empty()) {
+        resolved.clear();
+        resolveClients(expired, resolved);
+
+        for (MqttClient* client : resolved) {
+            shard->stats.keepAliveChecks++;
+            bool pending = client->getState() == STATE_PENDING;
+            // Active since it was scheduled: move it to its new deadline.
+            if (client->checkKeepAlive(now)) {
+                scheduleKeepAlive(client);
+            } else if (pending) {
+                shard->stats.handshakeTimeouts++;
+            }
+        }
+    }
+
+    // 2. Active Flow Control / Outbox Pumping
+    if (!backlog.empty()) {
+        resolved.clear();
+        resolveClients(backlog, resolved);
+
+        for (MqttClient* client : resolved) {
+            if (client->pumpBacklog()) {
+                notifyClientBacklog(client);
             }
         }
-        xSemaphoreGive(clientSetMutex);
     }
 }
 
-bool MqttBroker::processBrokerEvents() {
+void MqttBroker::resolveClients(const std::vector<ClientHandle>& handles, std::vector<MqttClient*>& resolved) {
+    for (const ClientHandle& handle : handles) {
+        MqttClient* client = clients.get(handle);
+        if (client != nullptr) {
+            resolved.push_back(client);
+        }
+    }
+}
+
+void MqttBroker::scheduleKeepAlive(MqttClient* client) {
+    if (client->getKeepAlive() == 0) return; // KeepAlive disabled
+
+    BrokerShard* shard = shardOf(client->getHandle());
+    if (xSemaphoreTake(shard->timerMutex, portMAX_DELAY) == pdTRUE) {
+        shard->keepAliveWheel.schedule(client->getHandle(), client->getKeepAliveDeadline());
+        xSemaphoreGive(shard->timerMutex);
+    }
+}
+
+void MqttBroker::notifyClientBacklog(MqttClient* client) {
+    BrokerShard* shard = shardOf(client->getHandle());
+    if (xSemaphoreTake(shard->timerMutex, portMAX_DELAY) == pdTRUE) {
+        shard->backlogClients.push_back(client->getHandle());
+        xSemaphoreGive(shard->timerMutex);
+    }
+}
+
+bool MqttBroker::processBrokerEvents(BrokerShard* shard) {
     BrokerEvent* event;
     int count = 0;
     bool workDone = false;
     const int MAX_BATCH = 10; // Limit processing per loop to yield CPU
 
-    while (count < MAX_BATCH && xQueueReceive(brokerEventQueue, &event, 0) == pdPASS) {
+    UBaseType_t waiting = uxQueueMessagesWaiting(shard->eventQueue);
+    if (waiting > shard->stats.eventQueueHighWater) {
+        shard->stats.eventQueueHighWater = waiting;
+    }
+
+    while (count < MAX_BATCH && xQueueReceive(shard->eventQueue, &event, 0) == pdPASS) {
+        // Routing and delivery are steady-state, subscriptions are not.
+        AllocationScope scope(event->type != EVENT_SUBSCRIBE);
+        if (event->type != EVENT_SUBSCRIBE) {
+            recordLatency(LATENCY_QUEUE, event->postedAt);
+        }
+
         if (event->type == EVENT_PUBLISH) {
-            _publishMessageImpl(event->message.pubMsg);
+            _publishMessageImpl(event->message.pubMsg, shard);
         } 
         else if (event->type == EVENT_SUBSCRIBE) {
             _subscribeClientImpl(event->message.subMsg, event->client);
         }
+        else if (event->type == EVENT_DELIVER) {
+            _deliverMessageImpl(event->message.pubMsg, event->targets, shard);
+        }
         
-        delete event; // Clean up the event container
+        releaseEvent(event); // Clean up the event container (the _impl methods own its content)
+        shard->stats.eventsProcessed++;
         count++;
         workDone = true;
     }
     return workDone;
 }
 
+bool MqttBroker::postEvent(BrokerShard* shard, BrokerEvent* event, TickType_t wait) {
+    event->postedAt = LatencyRecorder::now();
+    return xQueueSend(shard->eventQueue, &event, wait) == pdPASS;
+}
+
+void MqttBroker::deleteEvent(BrokerEvent* event) {
+    if (event->type == EVENT_SUBSCRIBE) {
+        delete event->message.subMsg;
+    } else {
+        deleteMessage(event->message.pubMsg);
+    }
+    releaseEvent(event);
+}
+
+PublishMqttMessage* MqttBroker::newMessage() {
+    if (messagePool == nullptr) {
+        return new PublishMqttMessage();
+    }
+    PublishMqttMessage* message;
+    if (xQueueReceive(freeMessages, &message, 0) != pdPASS) {
+        return nullptr;
+    }
+    return message;
+}
+
+void MqttBroker::deleteMessage(PublishMqttMessage* message) {
+    if (message >= messagePool && message < messagePool + numMessages) {
+        message->reset();
+        xQueueSend(freeMessages, &message, 0);
+        return;
+    }
+    delete message;
+}
+
+BrokerEvent* MqttBroker::newEvent() {
+    if (eventPool == nullptr) {
+        return new BrokerEvent;
+    }
+    BrokerEvent* event;
+    if (xQueueReceive(freeEvents, &event, 0) != pdPASS) {
+        return nullptr;
+    }
+    return event;
+}
+
+void MqttBroker::releaseEvent(BrokerEvent* event) {
+    event->targets.clear();
+    if (eventPool == nullptr) {
+        delete event;
+        return;
+    }
+    xQueueSend(freeEvents, &event, 0);
+}
+
 // --- INTERNAL LOGIC IMPLEMENTATIONS ---
 
-void MqttBroker::_publishMessageImpl(PublishMqttMessage* msg) {
+void MqttBroker::_publishMessageImpl(PublishMqttMessage* msg, BrokerShard* shard) {
     if (msg == nullptr) return;
 
-    String topic = msg->getTopic().getTopic();
+    const String& topic = msg->getTopic().getTopic();
     
-    // 1. Query the Trie to find interested subscribers
-    std::vector<MqttClient*>* subscribers = topicTrie->getSubscribedMqttClients(topic);
+    // Subscribers matching the topic, and the ones owned by this worker (scratch lists of the shard).
+    std::vector<Subscriber>& subscribers = shard->matchedSubscribers;
+    std::vector<Subscriber>& localSubscribers = shard->localSubscribers;
+    subscribers.clear();
+    localSubscribers.clear();
+    bool remote = false;
 
-    if (subscribers && !subscribers->empty()) {
-        log_v("Worker: Publishing topic %s to %i clients", topic.c_str(), subscribers->size());
+    // Callbacks of the application, served by this worker whatever their id.
+    std::vector<std::shared_ptr<LocalMessageCallback>>& localCallbacks = shard->localCallbacks;
+    localCallbacks.clear();
 
-        // 2. Iterate clients (Protected Read)
-        if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
-            
-            // 3. Publish to each subscriber
-            for (MqttClient* client : *subscribers) {
-                if (client && client->getState() == STATE_CONNECTED) {
-                    client->publishMessage(msg);
+    // 1. Query the Trie to find interested subscribers (Protected Read).
+    // Only handles are read, no client is dereferenced here.
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        uint32_t routeStart = LatencyRecorder::now();
+        topicTrie->getSubscribedMqttClients(topic, subscribers);
+        recordLatency(LATENCY_ROUTE, routeStart);
+
+        // Kept for the future subscribers, an empty payload clears it. The "$SYS"
+        // topics are republished by the broker, they are not worth a snapshot.
+        if (msg->isRetain()) {
+            retainedMessages.store(topic, msg->getTopic().getPayLoad(), msg->getQos());
+            if (!topic.startsWith("$")) {
+                snapshotDirty = true;
+            }
+        }
+
+        // Copied under the lock, unsubscribe() may remove them meanwhile.
+        if (!localSubscriptions.empty()) {
+            for (const Subscriber& subscriber : subscribers) {
+                if (!subscriber.handle.isLocal()) continue;
+                auto it = localSubscriptions.find(subscriber.handle.generation);
+                if (it != localSubscriptions.end()) {
+                    localCallbacks.push_back(it->second.callback);
                 }
             }
-            xSemaphoreGive(clientSetMutex);
         }
-        delete subscribers;
+        xSemaphoreGive(topicTrieMutex);
+
+        for (const Subscriber& subscriber : subscribers) {
+            if (subscriber.handle.isLocal()) continue;
+
+            if (shardOf(subscriber.handle) == shard) {
+                localSubscribers.push_back(subscriber);
+            } else {
+                remote = true;
+            }
+        }
+    }
+    shard->stats.publishesRouted++;
+
+    log_v("Worker %u: Publishing topic %s to %u local clients", shard->id, topic.c_str(), (unsigned)localSubscribers.size());
+
+    // 2. Hand over the other shards' subscribers, their workers serialize and send in parallel.
+    for (size_t i = 0; remote && i < shards.size(); i++) {
+        if (shards[i] == shard) continue;
+
+        BrokerEvent* event = newEvent();
+        if (event == nullptr) {
+            log_w("No free event! Dropping delivery to worker %u.", (unsigned)i);
+            shard->stats.eventsDropped++;
+            continue;
+        }
+        for (const Subscriber& subscriber : subscribers) {
+            if (!subscriber.handle.isLocal() && shardOf(subscriber.handle) == shards[i]) {
+                event->targets.push_back(subscriber);
+            }
+        }
+        if (event->targets.empty()) {
+            releaseEvent(event);
+            continue;
+        }
+        event->type = BrokerEventType::EVENT_DELIVER;
+        event->client = {};
+        // Shares the topic name and payload, the topic String is copied into the pooled one.
+        event->message.pubMsg = newMessage();
+        if (event->message.pubMsg == nullptr) {
+            log_w("No free message! Dropping delivery to worker %u.", (unsigned)i);
+            shard->stats.eventsDropped++;
+            releaseEvent(event);
+            continue;
+        }
+        *event->message.pubMsg = *msg;
+
+        // Bounded wait: two workers waiting on each other's full queue must not deadlock.
+        if (postEvent(shards[i], event, 10 / portTICK_PERIOD_MS)) {
+            shard->stats.remoteDeliveries++;
+        } else {
+            log_w("Worker %u queue full! Dropping delivery.", (unsigned)i);
+            shard->stats.eventsDropped++;
+            deleteEvent(event);
+        }
+    }
+
+    // 3. Publish to each local subscriber.
+    deliverToSubscribers(msg, localSubscribers, shard);
+
+    // 4. Hand the message object itself to the application callbacks.
+    for (const std::shared_ptr<LocalMessageCallback>& callback : localCallbacks) {
+        (*callback)(*msg);
+        shard->stats.localDeliveries++;
     }
+    localCallbacks.clear();
     
     // Important: Delete the message object here, as the broker took ownership.
-    delete msg; 
+    deleteMessage(msg); 
+}
+
+void MqttBroker::_deliverMessageImpl(PublishMqttMessage* msg, const std::vector<Subscriber>& targets, BrokerShard* shard) {
+    // Publish, this worker owns these clients.
+    deliverToSubscribers(msg, targets, shard);
+
+    deleteMessage(msg);
+}
+
+void MqttBroker::deliverToSubscribers(PublishMqttMessage* msg, const std::vector<Subscriber>& subscribers, BrokerShard* shard) {
+    if (subscribers.empty()) return;
+    uint8_t publishQos = msg->getQos();
+    uint32_t fanOutStart = LatencyRecorder::now();
+
+    for (const Subscriber& subscriber : subscribers) {
+        // Lock-free: skips clients deleted since routing, resolved ones stay alive 
+        // until this worker leaves its epoch.
+        MqttClient* client = clients.get(subscriber.handle);
+        // Delivered with the lower of the publish QoS and the granted QoS.
+        uint8_t qos = min(publishQos, subscriber.qos);
+
+        if (client != nullptr && client->getState() == STATE_CONNECTED) {
+            client->publishMessage(msg, qos);
+            shard->stats.messagesDelivered++;
+        } else if (subscriber.sessionId != 0 && qos > 0) {
+            // Offline persistent session: QoS 0 is dropped, QoS 1/2 is kept.
+            queueOfflineMessage(subscriber, msg, qos, shard);
+        }
+    }
+
+    recordLatency(LATENCY_FANOUT, fanOutStart);
+    recordLatency(LATENCY_TOTAL, msg->getReceivedAt());
 }
 
-void MqttBroker::_subscribeClientImpl(SubscribeMqttMessage* msg, MqttClient* client) {
-    if (msg == nullptr || client == nullptr) return;
+void MqttBroker::_subscribeClientImpl(SubscribeMqttMessage* msg, ClientHandle handle) {
+    if (msg == nullptr) return;
+
+    // The client may have disconnected after queuing its subscribe.
+    MqttClient* client = clients.get(handle);
+    if (client == nullptr) {
+        delete msg;
+        return;
+    }
 
-    std::vector<MqttTocpic> topics = msg->getTopics();
+    const std::vector<MqttTocpic>& topics = msg->getTopics();
+    std::vector<NodeTrie*> subscribedNodes;
+    std::vector<RetainedMessage> retained;
     NodeTrie *node;
     
-    // Access the Trie safely (serialized by the Worker thread)
-    for(int i = 0; i < topics.size(); i++){
-        node = topicTrie->subscribeToTopic(topics[i].getTopic(), client);
-        
-        if (node) { 
-             client->addNode(node);
-             log_i("Worker: Client %i subscribed to %s", client->getId(), topics[i].getTopic().c_str());
+    // Access the Trie safely (shared by all the Workers)
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        for(size_t i = 0; i < topics.size(); i++){
+            // Requested QoS, downgraded to what this broker supports.
+            uint8_t qos = min((uint8_t)topics[i].getQos(), (uint8_t)MAXQOS);
+            node = topicTrie->subscribeToTopic(topics[i].getTopic(), client, qos);
+            
+            if (node) { 
+                 client->addNode(node);
+                 subscribedNodes.push_back(node);
+                 log_i("Worker: Client %i subscribed to %s", client->getId(), topics[i].getTopic().c_str());
+
+                 // Retained messages matching the filter, delivered at most with the granted QoS.
+                 size_t first = retained.size();
+                 retainedMessages.match(topics[i].getTopic(), retained);
+                 for (size_t j = first; j < retained.size(); j++) {
+                     retained[j].qos = min(retained[j].qos, qos);
+                 }
+            } else {
+                 log_w("Worker: Trie storage full, client %i not subscribed to %s", client->getId(), topics[i].getTopic().c_str());
+            }
         }
+        xSemaphoreGive(topicTrieMutex);
     }
 
+    // A persistent session keeps its subscriptions after the client is gone.
+    if (client->getSessionId() != 0 && xSemaphoreTake(sessionMutex, portMAX_DELAY) == pdTRUE) {
+        auto it = sessionsById.find(client->getSessionId());
+        if (it != sessionsById.end()) {
+            std::vector<NodeTrie*>& sessionNodes = it->second->nodes;
+            for (NodeTrie* subscribed : subscribedNodes) {
+                if (std::find(sessionNodes.begin(), sessionNodes.end(), subscribed) == sessionNodes.end()) {
+                    sessionNodes.push_back(subscribed);
+                }
+            }
+            for (const MqttTocpic& topic : topics) {
+                it->second->subscriptions[topic.getTopic()] = min((uint8_t)topic.getQos(), (uint8_t)MAXQOS);
+            }
+            snapshotDirty = true;
+        }
+        xSemaphoreGive(sessionMutex);
+    }
 
     // Send SUBACK to the client
     // if client still connected, send SUBACK
     if (client->getState() == STATE_CONNECTED) {
         client->sendSubAck(msg); 
+
+        // After the SUBACK, with the RETAIN flag set.
+        for (const RetainedMessage& message : retained) {
+            PublishMqttMessage publish((message.qos << 1) | 1, MqttTocpic(message.topic, message.payload, message.qos));
+            client->publishMessage(&publish, message.qos, true);
+        }
     }
 
     delete msg; 
 }
 
+void MqttBroker::unsubscribeClientFromTrie(MqttClient* client) {
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        client->unsubscribeAll();
+        xSemaphoreGive(topicTrieMutex);
+    }
+}
+
 // --- PUBLIC QUEUING METHODS (Producers) ---
 
-void MqttBroker::publishMessage(PublishMqttMessage * msg) {
-    BrokerEvent* event = new BrokerEvent;
+void MqttBroker::publishMessage(PublishMqttMessage * msg, MqttClient* source) {
+    if (!tryPublishMessage(msg, source)) {
+        log_w("Broker Queue Full! Dropping publish.");
+        CoreTrafficCounters::add(trafficCounters().publishesDropped);
+        deleteMessage(msg); // Prevent memory leak
+    }
+}
+
+bool MqttBroker::tryPublishMessage(PublishMqttMessage * msg, MqttClient* source) {
+    BrokerEvent* event = newEvent();
+    if (event == nullptr) {
+        return false;
+    }
     event->type = BrokerEventType::EVENT_PUBLISH;
-    event->client = nullptr;
+    event->client = {};
     event->message.pubMsg = msg;
 
-    // Send to queue
-    if (xQueueSend(brokerEventQueue, &event, 0) != pdPASS) {
-        log_w("Broker Queue Full! Dropping publish.");
-        delete event;
-        delete msg; // Prevent memory leak
+    // The publisher's worker routes it, keeping per-client ordering.
+    BrokerShard* shard = source ? shardOf(source->getHandle()) : shards[0];
+
+    // Send to queue, the caller keeps the message if it is full
+    if (!postEvent(shard, event, 0)) {
+        releaseEvent(event);
+        return false;
     }
+    return true;
+}
+
+void MqttBroker::notifyClientStalled(ClientHandle handle) {
+    BrokerShard* shard = shardOf(handle);
+    std::vector<ClientHandle>& stalledClients = shard->stalledClients;
+
+    if (xSemaphoreTake(shard->timerMutex, portMAX_DELAY) == pdTRUE) {
+        if (std::find(stalledClients.begin(), stalledClients.end(), handle) == stalledClients.end()) {
+            stalledClients.push_back(handle);
+        }
+        xSemaphoreGive(shard->timerMutex);
+    }
+    log_w("Broker Queue Full! Pausing publisher.");
+}
+
+bool MqttBroker::processStalledClients(BrokerShard* shard) {
+    bool workDone = false;
+
+    // No room yet: keep clients paused.
+    if (!losslessMode || uxQueueSpacesAvailable(shard->eventQueue) == 0) {
+        return false;
+    }
+
+    // Take the list, the flushes run without any lock held.
+    std::vector<ClientHandle>& retried = shard->retriedClients;
+    retried.clear();
+    if (xSemaphoreTake(shard->timerMutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        retried.swap(shard->stalledClients);
+        xSemaphoreGive(shard->timerMutex);
+    }
+    if (retried.empty()) {
+        return false;
+    }
+
+    // Lock-free: the clients of this shard are only deleted by this worker.
+    size_t flushed = 0;
+    while (flushed < retried.size()) {
+        MqttClient* client = clients.get(retried[flushed]);
+
+        if (client == nullptr || client->flushStalledPublishes()) {
+            // Fully flushed (transport resumed) or already gone.
+            flushed++;
+            workDone = true;
+        } else {
+            // Queue is full again, retry after the next batch of events.
+            break;
+        }
+    }
+
+    // Still stalled: ahead of the clients stalled meanwhile.
+    if (flushed < retried.size() && xSemaphoreTake(shard->timerMutex, portMAX_DELAY) == pdTRUE) {
+        std::vector<ClientHandle>& stalledClients = shard->stalledClients;
+        stalledClients.insert(stalledClients.begin(), retried.begin() + flushed, retried.end());
+        xSemaphoreGive(shard->timerMutex);
+    }
+    return workDone;
 }
 
 void MqttBroker::SubscribeClientToTopic(SubscribeMqttMessage * msg, MqttClient* client) {
-    BrokerEvent* event = new BrokerEvent;
+    BrokerEvent* event = newEvent();
+    if (event == nullptr) {
+        log_w("No free event! Dropping subscribe.");
+        delete msg;
+        return;
+    }
     event->type = BrokerEventType::EVENT_SUBSCRIBE;
-    event->client = client;
+    event->client = client->getHandle();
     event->message.subMsg = msg;
     
-    if (xQueueSend(brokerEventQueue, &event, 0) != pdPASS) {
+    if (!postEvent(shardOf(client->getHandle()), event, 0)) {
         log_w("Broker Queue Full! Dropping subscribe.");
-        delete event;
+        releaseEvent(event);
         delete msg;
     }
 }
 
+// --- PERSISTENT SESSIONS ---
+
+bool MqttBroker::attachSession(MqttClient* client, bool cleanSession) {
+    String clientIdentifier = client->getClientIdentifier();
+    bool sessionPresent = false;
+
+    if (xSemaphoreTake(sessionMutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+
+    auto it = sessions.find(clientIdentifier);
+    MqttSession* session = (it != sessions.end()) ? it->second : nullptr;
+
+    // Only one connection per client identifier: the older one is closed.
+    if (session != nullptr && session->online) {
+        queueClientForDeletion(session->owner);
+    }
+
+    // Clean Session = 1 (or nothing to key it by): start from scratch.
+    if (cleanSession || clientIdentifier.length() == 0) {
+        if (session != nullptr) {
+            log_i("Session %s discarded.", clientIdentifier.c_str());
+            discardSession(session);
+            snapshotDirty = true;
+        }
+        xSemaphoreGive(sessionMutex);
+        return false;
+    }
+
+    if (session == nullptr) {
+        if (sessions.size() >= MAXNUMSESSIONS) {
+            log_w("Too many sessions, %s gets a clean session.", clientIdentifier.c_str());
+            xSemaphoreGive(sessionMutex);
+            return false;
+        }
+
+        session = new MqttSession;
+        session->clientIdentifier = clientIdentifier;
+        do {
+            session->id = nextSessionId++;
+        } while (session->id == 0 || sessionsById.count(session->id));
+        session->subscriberKey = client->getId();
+        session->replayFrom = offlineLog.end();
+
+        sessions[clientIdentifier] = session;
+        sessionsById[session->id] = session;
+        log_i("Session %s created.", clientIdentifier.c_str());
+        snapshotDirty = true;
+    } else {
+        sessionPresent = true;
+    }
+
+    bool takenOver = session->online;
+    ClientHandle previousOwner = session->owner;
+    session->owner = client->getHandle();
+    session->online = true;
+    client->setSession(session->id, session->subscriberKey);
+
+    // Route the stored subscriptions to this client.
+    if (sessionPresent && xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        for (NodeTrie* node : session->nodes) {
+            node->resubscribeMqttClient(client);
+        }
+        xSemaphoreGive(topicTrieMutex);
+    }
+
+    // Taken over: the unacknowledged publishes of the older connection are resent by
+    // this one. It can't be freed meanwhile, its detachSession() waits for sessionMutex.
+    MqttClient* previous = takenOver ? clients.get(previousOwner) : nullptr;
+    if (previous != nullptr) {
+        previous->takeInflight(session->inflight);
+        log_i("Session %s taken over, %u messages unacknowledged.", 
+              clientIdentifier.c_str(), (unsigned)session->inflight.size());
+    }
+
+    xSemaphoreGive(sessionMutex);
+    return sessionPresent;
+}
+
+void MqttBroker::resumeSession(MqttClient* client) {
+    if (client->getSessionId() == 0) {
+        client->setConnected();
+        return;
+    }
+
+    if (xSemaphoreTake(sessionMutex, portMAX_DELAY) == pdTRUE) {
+        auto it = sessionsById.find(client->getSessionId());
+        if (it != sessionsById.end() && it->second->owner == client->getHandle()) {
+            MqttSession* session = it->second;
+
+            // 1. Publishes not acknowledged by the previous connection.
+            client->restoreInflight(session->inflight);
+
+            // 2. Publishes missed while offline, in arrival order.
+            if (!session->loggedRecords.empty()) {
+                offlineLog.replay(session->id, session->replayFrom, session->loggedRecords,
+                                  [client](uint8_t qos, PublishMqttMessage& msg) {
+                                      client->publishMessage(&msg, qos);
+                                  });
+
+                for (auto const& [segment, records] : session->loggedRecords) {
+                    offlineLog.release(segment, records);
+                }
+                session->loggedRecords.clear();
+            }
+            session->replayFrom = offlineLog.end();
+            log_i("Session %s resumed.", session->clientIdentifier.c_str());
+        }
+
+        // Publishes routed from now on are sent after the ones above.
+        client->setConnected();
+        xSemaphoreGive(sessionMutex);
+    }
+}
+
+bool MqttBroker::detachSession(MqttClient* client) {
+    if (client->getSessionId() == 0) return false;
+
+    // Its Trie entries belong to the session, even if a newer connection took it over.
+    client->detachNodes();
+
+    if (xSemaphoreTake(sessionMutex, portMAX_DELAY) == pdTRUE) {
+        auto it = sessionsById.find(client->getSessionId());
+        if (it != sessionsById.end() && it->second->owner == client->getHandle()) {
+            MqttSession* session = it->second;
+            session->online = false;
+            client->takeInflight(session->inflight);
+            log_i("Session %s offline, %u messages unacknowledged.", 
+                  session->clientIdentifier.c_str(), (unsigned)session->inflight.size());
+        } else if (it != sessionsById.end()) {
+            // Taken over: what it got after attachSession() goes to the new connection
+            // once it is connected, or stays in the session until the next one.
+            MqttSession* session = it->second;
+            MqttClient* owner = session->online ? clients.get(session->owner) : nullptr;
+            if (owner != nullptr && owner->getState() == STATE_CONNECTED) {
+                std::deque<InflightMessage> late;
+                client->takeInflight(late);
+                owner->restoreInflight(late);
+            } else {
+                client->takeInflight(session->inflight);
+            }
+        }
+        xSemaphoreGive(sessionMutex);
+    }
+    return true;
+}
+
+void MqttBroker::discardSession(MqttSession* session) {
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) == pdTRUE) {
+        for (NodeTrie* node : session->nodes) {
+            node->unSubscribeSession(session->subscriberKey);
+        }
+        xSemaphoreGive(topicTrieMutex);
+    }
+
+    for (auto const& [segment, records] : session->loggedRecords) {
+        offlineLog.release(segment, records);
+    }
+
+    sessionsById.erase(session->id);
+    sessions.erase(session->clientIdentifier);
+    delete session;
+}
+
+void MqttBroker::queueOfflineMessage(const Subscriber& subscriber, PublishMqttMessage* msg, uint8_t qos, BrokerShard* shard) {
+    if (xSemaphoreTake(sessionMutex, portMAX_DELAY) != pdTRUE) return;
+
+    auto it = sessionsById.find(subscriber.sessionId);
+    if (it != sessionsById.end()) {
+        MqttSession* session = it->second;
+
+        // Resumed since the Trie was read: send it to the new client.
+        MqttClient* client = session->online ? clients.get(session->owner) : nullptr;
+        if (client != nullptr && client->getState() == STATE_CONNECTED) {
+            client->publishMessage(msg, qos);
+            shard->stats.messagesDelivered++;
+        } else {
+            // Kept out of RAM until the client comes back.
+            uint32_t segment;
+            if (offlineLog.append(session->id, qos, msg, segment)) {
+                session->loggedRecords[segment]++;
+                shard->stats.messagesLogged++;
+            }
+        }
+    }
+    xSemaphoreGive(sessionMutex);
+}
+
+void MqttBroker::syncOfflineLog() {
+    // Never wait: the next maintenance tick will do it.
+    if (xSemaphoreTake(sessionMutex, 0) == pdTRUE) {
+        offlineLog.sync();
+        xSemaphoreGive(sessionMutex);
+    }
+}
+
 void MqttBroker::setOutBoxMaxSize(size_t outBoxMaxSize){
         // 1. Update default value for future clients
         this->outBoxMaxSize = outBoxMaxSize;
 
-        // 2. CRITICAL SECTION: Protect access to the 'clients' map
+        // 2. CRITICAL SECTION: Protect access to the 'clients' table
         if (xSemaphoreTake(clientSetMutex, portMAX_DELAY) == pdTRUE) {
             
-            for (auto const& [transport, client] : clients) {
+            for (uint16_t slot = 0; slot < clients.capacity(); slot++) {
                 // Update the limit for existing clients
-                client->setOutboxMaxSize(outBoxMaxSize);
+                MqttClient* client = clients.at(slot);
+                if (client) client->setOutboxMaxSize(outBoxMaxSize);
             }
             
             xSemaphoreGive(clientSetMutex);
-            log_i("Outbox size updated to %u for all active clients.", outBoxMaxSize);
+            log_i("Outbox size updated to %u for all active clients.", (unsigned)outBoxMaxSize);
         } else {
             log_e("Failed to acquire mutex. Outbox size update skipped for active clients.");
         }
@@ -1,35 +1,129 @@
 #ifndef MQTTBROKER_H
 #define MQTTBROKER_H
 
-#include <WiFi.h> 
 #include <map>
-#include <AsyncTCP.h>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <cstddef>
 #include "WrapperFreeRTOS.h"
+#include "MemoryPolicy.h"
+#include "BlockPool.h"
+#include "LatencyHistogram.h"
+#include "MqttClient/ByteRing.h"
+#include "AllocationMonitor.h"
+#include "ClientTable.h"
+#include "ClientPool.h"
+#include "EpochReclaimer.h"
+#include "KeepAliveWheel.h"
+#include "OfflineLog.h"
+#include "MqttSession.h"
+#include "SysTopics.h"
+#include "MqttClient/InflightMessage.h"
+#include "MqttClient/PacketIdSet.h"
+#include "MqttClient/CompactQueue.h"
+#include "MqttClient/SubscriptionList.h"
+#include "TopicTree/SubscriberSet.h"
+#include "TopicTree/RetainedStore.h"
+#include "Storage/FileStorage.h"
 #include "MqttMessages/FactoryMqttMessages.h"
 #include "MqttMessages/SubscribeMqttMessage.h"
 #include "MqttMessages/UnsubscribeMqttMessage.h"
 #include "MqttMessages/PublishMqttMessage.h"
 #include "TransportLayer/MqttTransport.h"
+#include "TransportLayer/TlsTransport.h"
+#include "TransportLayer/LoopbackTransport.h"
+#if MQTTBROKER_POSIX_SOCKETS
+#include "TransportLayer/PosixTcpTransport.h"
+#include "TransportLayer/IoUringTransport.h"
+#else
+#include <WiFi.h> 
+#include <AsyncTCP.h>
 #include "TransportLayer/TcpTransport.h"
 #include "TransportLayer/WsTransport.h"
+#endif
 
 namespace mqttBrokerName{
 
 // Depends of your architecture, max num clients is exactly the 
-// max num open sockets that your divece can support.
+// max num open sockets that your divece can support: 16 on an ESP32 with the
+// default lwIP configuration. An idle client takes about 1KB of heap (see
+// MqttBroker::getClientMemoryReport()), plus about 0.4KB of lwIP PCB and AsyncClient
+// and up to 11KB of lwIP buffers while data is in flight: to serve more, rebuild the
+// core with a higher CONFIG_LWIP_MAX_ACTIVE_TCP and define MAXNUMCLIENTS to match
+// (see platformio.ini).
+#ifndef MAXNUMCLIENTS
+#if MQTTBROKER_POSIX_SOCKETS
+#define MAXNUMCLIENTS 64
+#else
 #define MAXNUMCLIENTS 16
+#endif
+#endif
 
 // When tcp conection have success, on average, a packet sended over
 // this tcp conecction takes at most 500milliseconds to arrive,
 // so an mqtt packet takes at most 500milliseconds to arrive to the broker.
 // If you mqtt client is connecting and disconnecting from the broker, you can
-// try to increasing this value.
+// try to increasing this value. It is also the time a new connection has to
+// send its CONNECT, see MqttBroker::setHandshakeTimeout().
 #define MAXWAITTOMQTTPACKET 500 
 
+// Time to CONNECT over TLS: the TLS handshake takes about a second on the ESP32.
+#define TLSHANDSHAKETIMEOUT 3000
+
+// Max number of connections waiting for their CONNECT at the same time, the 
+// others are refused. 0 for no limit (default), use MqttBroker::setMaxPendingClients()
+// to set one, e.g. 4 when sockets are scarce.
+#define MAXPENDINGCLIENTS 0
+
+// Connections accepted per second, in bursts of the same size, so a reconnect 
+// storm is spread over time. 0 for no limit (default), use 
+// MqttBroker::setAcceptRateLimit() to set one, e.g. 10.
+#define ACCEPTRATELIMIT 0
+
+// Depth of the event queue of each worker.
+#define EVENTQUEUESIZE 50
+
+// Trie nodes preallocated per subscription by a StaticMqttBroker. Each new character
+// of a topic filter takes up to two nodes, filters sharing a prefix take fewer.
+#define TRIENODESPERSUBSCRIPTION 24
+
+// Topic length reserved by each pooled message of a StaticMqttBroker: a longer topic
+// grows the String of its message once, on the heap, and the message keeps it.
+#define POOLEDTOPICLENGTH 64
+
+// QoS 1/2 publishes a StaticMqttBroker client keeps waiting for a slot of its
+// in-flight window. More are dropped, as packets are on a full outbox.
+#define PENDINGQOSSIZE 32
+
+// Highest QoS granted to subscriptions.
+#define MAXQOS 2
+
+// Default number of QoS 1 and 2 publishes sent to a client without waiting for
+// their acknowledgment. Use MqttBroker::setInflightWindowSize() to tune it.
+#define INFLIGHTWINDOWSIZE 16
+
+// Max number of persistent sessions kept, further Clean Session = 0 clients get a clean one.
+#define MAXNUMSESSIONS 32
+
+// Snapshot of the persistent sessions and retained messages (FileStorage): file, 
+// temporary file replaced atomically, and min delay between two snapshots.
+#define SNAPSHOTPATH "/mqttsnap.bin"
+#define SNAPSHOTTMPPATH "/mqttsnap.tmp"
+#define SNAPSHOTINTERVALMS 60000
+
+// Interval of the broker statistics published on the "$SYS/broker/..." topics.
+#define SYSINTERVALMS 10000
+
 class CheckMqttClientTask;
 class NewClientListenerTask;
 class FreeMqttClientTask;
 class MqttClient;
+class MqttBroker;
 class Trie;
 class NodeTrie;
 class TCPListenerTask;
@@ -37,6 +131,40 @@ class Action;
 class ServerListener;
 class TcpServerListener;
 class WsServerListener;
+class PosixTcpServerListener;
+class PosixEventLoopTask;
+class IoUringTcpServerListener;
+class IoUringLoopTask;
+class TlsServerListener;
+class MqttSnGateway;
+
+/**
+ * @brief Preallocated capacity of a broker, see `MqttBroker::setCapacity()` and 
+ * `StaticMqttBroker`. Everything sized here is allocated by `startBroker()`.
+ */
+struct BrokerCapacity {
+    /** @brief Client slots, each with its reader buffer and its outbox. */
+    uint16_t maxClients = 0;
+
+    /** @brief Trie subscriptions (client, session and local ones), with their Trie nodes. */
+    uint16_t maxSubscriptions = 0;
+
+    /** @brief Largest packet accepted from a client, larger ones close the connection. */
+    uint32_t maxPacketSize = 0;
+
+    /** @brief Bytes of each client outbox, packets waiting for the transport are stored back to back. */
+    uint32_t outboxBytes = 0;
+
+    /** @brief Depth of the event queue of each worker. */
+    uint16_t eventQueueDepth = EVENTQUEUESIZE;
+
+    /**
+     * @brief Publishes being routed, each with a payload buffer of `maxPacketSize` 
+     * bytes. The payloads stay until the QoS 1/2 deliveries sharing them are 
+     * acknowledged. 0 sizes them for a full event queue plus one per client.
+     */
+    uint16_t messageBuffers = 0;
+};
 
 /**
  * @brief Defines the types of asynchronous events handled by the CheckMqttClientTask Task.
@@ -50,7 +178,28 @@ enum BrokerEventType {
     /**
      * @brief A Subscribe packet received from a client that needs to be processed against the Trie.
      */
-    EVENT_SUBSCRIBE
+    EVENT_SUBSCRIBE,
+
+    /**
+     * @brief A Publish already routed by another worker, to be sent to the
+     * subscribers owned by this worker (see `BrokerEvent::targets`).
+     */
+    EVENT_DELIVER
+};
+
+/**
+ * @brief Callback of a local subscription, see `MqttBroker::subscribe`.
+ * * Receives the routed message object itself: no packet is built or parsed.
+ */
+typedef std::function<void(PublishMqttMessage& message)> LocalMessageCallback;
+
+/**
+ * @brief A piece of a packet: the pieces of a packet are written back to back,
+ * so a publish is sent without being copied into a buffer of its own.
+ */
+struct PacketPart {
+    const uint8_t* data;
+    size_t length;
 };
 
 /**
@@ -67,24 +216,86 @@ struct BrokerEvent {
     BrokerEventType type;
 
     /**
-     * @brief Pointer to the client associated with this event.
-     * - For SUBSCRIBE: It is the client requesting the subscription.
-     * - For PUBLISH: It is usually nullptr (as broadcast doesn't depend on source), 
-     * or the source client if access control is needed.
+     * @brief Handle of the client associated with this event.
+     * - For SUBSCRIBE: It is the client requesting the subscription, it may be 
+     * deleted before the event is processed.
+     * - For PUBLISH/DELIVER: Unused (as broadcast doesn't depend on source).
      */
-    MqttClient* client; 
+    ClientHandle client; 
     
     /**
      * @brief Polymorphic container for the message object.
-     * * @note **Memory Management Rule:** The objects pointed to by this union 
-     * MUST be allocated on the Heap (using `new`). The CheckMqttClientTask Task assumes 
-     * ownership of these pointers and is responsible for `delete`-ing them 
-     * after processing.
+     * * @note **Memory Management Rule:** The CheckMqttClientTask Task owns these 
+     * objects once the event is posted, and releases them after processing (or 
+     * `deleteEvent()` if it is dropped):
+     * - `pubMsg` comes from `MqttBroker::newMessage()` and goes back with 
+     * `MqttBroker::deleteMessage()`: to the message pool of a preallocated broker, 
+     * to the heap otherwise. An application publish allocated with `new` is 
+     * deleted the same way.
+     * - `subMsg` is allocated with `new` and `delete`d.
      */
     union {
         PublishMqttMessage* pubMsg;
         SubscribeMqttMessage* subMsg;
     } message;
+
+    /**
+     * @brief Subscribers to deliver `pubMsg` to (EVENT_DELIVER only, empty otherwise).
+     * * Cleared when the event is released: a pooled event keeps its capacity.
+     */
+    std::vector<Subscriber> targets;
+
+    /** @brief When the event was posted to its queue, for the latency histograms. */
+    uint32_t postedAt;
+};
+
+/**
+ * @brief Slice of the Broker work owned by one CheckMqttClientTask.
+ * * Each client belongs to exactly one shard (`handle.slot % numWorkers`, see `shardOf`). Only the 
+ * owner worker routes its publishes, writes its outbox, checks its keep-alive 
+ * and deletes it, so these operations scale with the number of workers.
+ */
+struct BrokerShard {
+    uint8_t id;
+
+    /** @brief Pending Publish/Subscribe/Deliver events of this shard. */
+    QueueHandle_t eventQueue;
+
+    /** @brief Handles of the clients of this shard waiting to be deleted. */
+    QueueHandle_t deleteQueue;
+
+    /** @brief Stalled clients of this shard (lossless mode), protected by `timerMutex`. */
+    std::vector<ClientHandle> stalledClients;
+
+    /** @brief Keep-alive deadlines of the connected clients of this shard. */
+    KeepAliveWheel keepAliveWheel;
+
+    /** @brief Clients of this shard with packets waiting in their outbox. */
+    std::vector<ClientHandle> backlogClients;
+
+    /** @brief Guards `keepAliveWheel`, `backlogClients` and `stalledClients`, written by the Network Thread. */
+    SemaphoreHandle_t timerMutex;
+
+    /** @brief Clients removed by this worker, waiting for the other workers to leave their epoch. */
+    std::vector<std::pair<MqttClient*, uint32_t>> retiredClients;
+
+    /**
+     * @brief Scratch lists of the worker (routing and maintenance), cleared and reused
+     * so they stop allocating once grown. A `StaticMqttBroker` reserves them up front.
+     */
+    std::vector<Subscriber> matchedSubscribers;
+    std::vector<Subscriber> localSubscribers;
+    std::vector<ClientHandle> expiredClients;
+    std::vector<ClientHandle> pumpedClients;
+    std::vector<ClientHandle> retriedClients;
+    std::vector<MqttClient*> resolvedClients;
+
+    /** @brief Callbacks of the application matching the publish being routed. */
+    std::vector<std::shared_ptr<LocalMessageCallback>> localCallbacks;
+
+    BrokerShardStats stats;
+
+    CheckMqttClientTask* worker;
 };
 
 /**
@@ -106,9 +317,14 @@ private:
     
     /**
      * @brief Strategy Interface for network listening.
-     * Polymorphic pointer that abstracts the underlying server implementation 
+     * Polymorphic pointers that abstract the underlying server implementations 
+     * (e.g. TCP for devices and WebSockets for browsers). All of them feed the 
+     * same topic tree, client table and workers. Owned by the broker.
      */
-    ServerListener* listener;
+    std::vector<ServerListener*> listeners;
+
+    /** @brief Set by startBroker(), listeners added meanwhile are started right away. */
+    bool listening = false;
 
     /** @brief Port number the broker is listening on (e.g., 1883 or 8080). */
     uint16_t port;
@@ -116,17 +332,42 @@ private:
     /** @brief Maximum number of concurrent connections allowed. */
     uint16_t maxNumClients;
 
+    /** @brief Time allowed to a new connection to send its CONNECT (ms). */
+    unsigned long handshakeTimeout = MAXWAITTOMQTTPACKET;
+
+    /** @brief Max number of clients in `STATE_PENDING`, 0 for no limit, see `setMaxPendingClients`. */
+    uint16_t maxPendingClients = MAXPENDINGCLIENTS;
+
+    /** @brief Clients accepted that have not sent their CONNECT yet. */
+    std::atomic<uint16_t> pendingClients{0};
+
+    /** @brief Connections refused by the admission checks of `acceptClient`. */
+    std::atomic<uint32_t> rejectedConnections{0};
+
+    /** @brief Accepts per second, 0 for no limit. */
+    uint16_t acceptRateLimit = ACCEPTRATELIMIT;
+
+    /**
+     * @brief Token bucket of the accept rate limiter, in thousandths of a connection.
+     * * Refilled by `acceptRateLimit` per millisecond, protected by `clientSetMutex`.
+     */
+    uint32_t acceptCredit = ACCEPTRATELIMIT * 1000;
+    unsigned long lastAcceptRefill = 0;
+
     /** * @brief Rolling counter for Client ID generation.
      * Used to assign a unique internal integer ID to every new connection.
      */
     int numClient = 0;
 
+    /** @brief Number of routing workers, see `setNumWorkers`. */
+    uint8_t numWorkers = 1;
+
     /**
-     * @brief The Background CheckMqttClientTask.
-     * A FreeRTOS task running to processes the `brokerEventQueue` 
-     * and handles client cleanups to keep the Network Thread non-blocking.
+     * @brief The Background Workers, one CheckMqttClientTask per shard.
+     * Each worker processes its shard event queue and handles client cleanups 
+     * to keep the Network Thread non-blocking. Created by `startBroker`.
      */
-    CheckMqttClientTask *checkMqttClientTask;
+    std::vector<BrokerShard*> shards;
 
     /**
      * @brief Data structure for efficient Topic matching.
@@ -136,37 +377,229 @@ private:
 
     size_t outBoxMaxSize = 100;
 
-    /***************************** Synchronization Primitives ****************/
+    /**
+     * @brief Preallocated capacity, see `setCapacity`. With `maxClients` at 0 clients, 
+     * events and Trie nodes are allocated on demand.
+     */
+    BrokerCapacity capacity;
+
+    /** @brief Blocks of the clients, when the capacity is preallocated. */
+    ClientPool clientPool;
+
+    /** @brief Preallocated events, nullptr when they are allocated on demand. */
+    BrokerEvent* eventPool = nullptr;
+
+    /** @brief Free events of `eventPool`, a queue of `BrokerEvent*`. */
+    QueueHandle_t freeEvents = nullptr;
+
+    /** @brief Preallocated publishes, nullptr when they are allocated on demand. */
+    PublishMqttMessage* messagePool = nullptr;
+    uint16_t numMessages = 0;
+
+    /** @brief Free messages of `messagePool`, a queue of `PublishMqttMessage*`. */
+    QueueHandle_t freeMessages = nullptr;
+
+    /** @brief Payload buffers of the preallocated capacity, see `MqttBytes::usePool`. */
+    BlockPool payloadPool;
+
+    /** @brief Value of `getSteadyStateAllocations()` last reported in the log. */
+    uint32_t reportedAllocations = 0;
 
     /**
-     * @brief Queue for deferred client deletion.
-     * Stores pointers to `MqttTransport` objects that need to be destroyed. 
-     * Used to safely delete clients outside of the network callback context.
+     * @brief Lossless publish mode (Flow Control instead of dropping).
+     * When enabled, a full worker event queue pauses the publisher's transport
+     * instead of dropping the message, see `setLosslessMode`.
      */
-    QueueHandle_t deleteMqttClientQueue;
+    bool losslessMode = false;
+
+    /***************************** Synchronization Primitives ****************/
 
     /**
      * @brief Mutex for thread safety.
-     * Protects shared resources (specifically the `clients` map) from concurrent 
-     * access between the Network Thread (AsyncTCP/WS callbacks) and the Worker Thread.
+     * Serializes the writers of the `clients` table (the Network Thread inserting, 
+     * the Workers removing) and the stalled lists. Readers don't take it.
      */
     SemaphoreHandle_t clientSetMutex;
 
     /**
-     * @brief Queue for high-level Broker Events.
-     * Buffers `BrokerEvent` structures (Publish/Subscribe requests) so they can 
-     * be processed sequentially by the CheckMqttClientTask task without blocking the network.
+     * @brief Mutex protecting the `topicTrie`.
+     * Workers hold it only while inserting, looking up or removing subscriptions, 
+     * never while writing to the network.
      */
-    QueueHandle_t brokerEventQueue;
+    SemaphoreHandle_t topicTrieMutex;
 
     /************************* Client Registry **************************/
 
     /**
      * @brief Main container of active clients.
-     * * **Key:** `MqttTransport*` - The pointer to the transport interface is used as the unique key.
-     * * **Value:** `MqttClient*` - The instance of the client logic.
+     * * Allocated with `maxNumClients` slots by `startBroker()`. Clients are referenced 
+     * everywhere else by their `ClientHandle`.
      */
-    std::map<MqttTransport*, MqttClient*> clients;
+    ClientTable clients;
+
+    /** @brief Max number of unacknowledged QoS 1 and 2 publishes per client. */
+    uint16_t inflightWindowSize = INFLIGHTWINDOWSIZE;
+
+    /** @brief Retained messages, guarded by `topicTrieMutex` as the Trie. */
+    RetainedStore retainedMessages;
+
+    /************************* Persistent Sessions **************************/
+
+    /** @brief Sessions of the clients that connected with Clean Session = 0, by client identifier. */
+    std::map<String, MqttSession*> sessions;
+
+    /** @brief Same sessions, by the id stored in their Trie entries. */
+    std::map<uint16_t, MqttSession*> sessionsById;
+
+    uint16_t nextSessionId = 1;
+
+    /** @brief File system of the offline log and the snapshots, see `setStorage()`. */
+    FileStorage* storage;
+
+    /** @brief Messages missed by offline sessions. */
+    OfflineLog offlineLog;
+    bool offlineLogEnabled = true;
+
+    /**
+     * @brief Guards the sessions and the offline log. Written by the Workers 
+     * (routing, deletions) and the Network Thread (CONNECT).
+     * * Lock order: `sessionMutex` before `topicTrieMutex` and the client mutexes.
+     */
+    SemaphoreHandle_t sessionMutex;
+
+    /*************************** Snapshot **********************************/
+
+    /** @brief Min delay between snapshots in ms, 0 disables them. */
+    uint32_t snapshotInterval = SNAPSHOTINTERVALMS;
+    uint32_t lastSnapshot = 0;
+
+    /***************************** $SYS Topics ******************************/
+
+    /** @brief Traffic counters, one set per core. */
+    CoreTrafficCounters traffic[portNUM_PROCESSORS];
+
+    /** @brief Interval of the $SYS statistics in ms, 0 disables them. */
+    uint32_t sysInterval = SYSINTERVALMS;
+    uint32_t lastSysPublish = 0;
+    uint32_t startTime = 0;
+
+    /** @brief Traffic at the previous $SYS publish, for the rates. */
+    BrokerTraffic sysTraffic;
+
+    /** @brief Totals published on $SYS, 64 bits where the counters would wrap in days. */
+    uint64_t sysBytesReceived = 0;
+    uint64_t sysBytesSent = 0;
+    uint64_t sysMessagesReceived = 0;
+    uint64_t sysMessagesSent = 0;
+
+    /** @brief Routes one $SYS statistic, retained, as a publish of the first Worker. */
+    void publishSys(const char* name, const String& value);
+
+    /** @brief Latency histograms of the publish pipeline stages. */
+    LatencyRecorder latency;
+
+#if MQTTBROKER_LATENCY_HISTOGRAMS
+    /** @brief Histograms at the previous $SYS publish: the $SYS ones cover the interval. */
+    LatencyHistogram sysLatency[LATENCY_STAGES];
+#endif
+
+    /************************* Local Subscriptions **************************/
+
+    /**
+     * @brief A callback registered by `subscribe()`, with the Trie node it is attached to.
+     * * Shared with the workers routing a publish to it: they copy a pointer, not the callback.
+     */
+    struct LocalSubscription {
+        NodeTrie* node;
+        String filter;
+        std::shared_ptr<LocalMessageCallback> callback;
+    };
+
+    /** @brief Local subscriptions by id, guarded by `topicTrieMutex` as the Trie. */
+    std::map<uint16_t, LocalSubscription> localSubscriptions;
+    uint16_t nextLocalSubscription = 1;
+
+    /** @brief Set on every change of the sessions or retained messages since the last snapshot. */
+    std::atomic<bool> snapshotDirty{false};
+
+    /** @brief LittleFS is mounted and the snapshot was loaded (or there was none). */
+    bool snapshotReady = false;
+
+    /**
+     * @brief Restores the sessions (with their subscriptions) and the retained messages.
+     * * Called by startBroker() before the workers and the listeners start. The restored
+     * sessions are offline: their QoS 1/2 messages are logged until their clients reconnect.
+     * A corrupted snapshot is ignored as a whole.
+     */
+    bool loadSnapshot();
+
+    /**
+     * @brief Writes the sessions and the retained messages to SNAPSHOTPATH.
+     * * The state is serialized in RAM under the locks, then written to a temporary 
+     * file renamed over the previous snapshot, so a reset while writing keeps the old one.
+     */
+    void saveSnapshot();
+
+    /**
+     * @brief Queues a publish for a persistent session whose client was not resolved.
+     * * Sent directly if the session was resumed meanwhile, otherwise logged.
+     * Lock-free client resolution: the caller must be inside its epoch.
+     */
+    void queueOfflineMessage(const Subscriber& subscriber, PublishMqttMessage* msg, uint8_t qos, BrokerShard* shard);
+
+    /** @brief Removes a session, its subscriptions and its logged messages. Caller must hold `sessionMutex`. */
+    void discardSession(MqttSession* session);
+
+    /**
+     * @brief Defers the deletion of removed clients until no worker can hold them,
+     * so workers resolve handles without taking `clientSetMutex`.
+     */
+    EpochReclaimer epochs;
+
+    /**
+     * @brief Frees the retired clients of a shard that no worker can hold anymore.
+     * @return true If at least one client was freed.
+     */
+    bool reclaimClients(BrokerShard* shard);
+
+    /**
+     * @brief Creates the shards and their workers (queues, tasks).
+     */
+    void createShards();
+
+    /**
+     * @brief Pushes an event into the queue of a shard.
+     * @return true if queued, false if the queue is full (event not deleted).
+     */
+    bool postEvent(BrokerShard* shard, BrokerEvent* event, TickType_t wait);
+
+    /**
+     * @brief Releases an event and the objects it owns.
+     */
+    void deleteEvent(BrokerEvent* event);
+
+    /**
+     * @brief Takes an empty event: from the pool when the capacity is preallocated.
+     * @return BrokerEvent* The event, nullptr if the pool is empty (as if the queue was full).
+     */
+    BrokerEvent* newEvent();
+
+    /**
+     * @brief Gives back an event taken by `newEvent`, without the objects it points to.
+     */
+    void releaseEvent(BrokerEvent* event);
+
+    /**
+     * @brief Allocates the clients, events, publishes with their payloads, Trie nodes 
+     * and worker scratch lists of the preallocated capacity. Called by startBroker() 
+     * before any client.
+     */
+    void preallocate();
+
+    /**
+     * @brief Frees a client that no worker can hold anymore, back to its pool block.
+     */
+    void releaseClient(MqttClient* client);
 
 public:
 
@@ -178,54 +611,107 @@ public:
     MqttBroker(ServerListener* listener);
     ~MqttBroker();
 
+    /**
+     * @brief Serves one more network listener (another port or protocol).
+     * * Clients of every listener share the topic tree, sessions and workers, so a 
+     * publish from a TCP device reaches the subscribers connected over WebSockets. 
+     * Usually called before startBroker(), otherwise the listener starts immediately.
+     * * @param listener Network listener, owned by the broker from now on.
+     */
+    void addListener(ServerListener* listener);
+
     /**
      * @brief Accepts a new physical connection from the ServerListener.
      * * This is the "Entry Point" for new clients. It is called by the `ServerListener`
      *  when a TCP handshake or WebSocket upgrade completes.
      * * @note <b>Thread Safety:</b> This method acquires the `clientSetMutex` to safely 
-     * add the new client to the `clients` map.
+     * add the new client to the `clients` table.
      * * @param transport A pointer to the abstract `MqttTransport` wrapper.
      * The Broker takes ownership of this pointer.
+     * @return false if the connection was refused: the transport is already closed
+     * and deleted, the caller must drop every reference to it.
      */
-    void acceptClient(MqttTransport* transport);
+    bool acceptClient(MqttTransport* transport);
+
+    /**
+     * @brief Called when a client leaves `STATE_PENDING` (CONNECT accepted, or deleted
+     * before), releasing its place among the pending handshakes. Idempotent.
+     */
+    void handshakeDone(MqttClient* client);
 
     /**
      * @brief Schedules a client for safe deletion.
      * * This method is called by `MqttClient` when a disconnection occurs.  
-     * It pushes the transport key into the `deleteMqttClientQueue`.
+     * It pushes the client handle into the delete queue of the client's shard.
      * * The actual deletion happens later in the CheckMqttClientTask thread.
-     * * @param transportKey The pointer to the transport, used as the unique key to identify the client.
+     * * @param handle The handle of the client, also selects the worker that deletes it.
      */
-    void queueClientForDeletion(MqttTransport* transportKey);
+    void queueClientForDeletion(ClientHandle handle);
 
     /**
-     * @brief Processes pending Broker events (Publish/Subscribe).
-     * * This method is called repeatedly by the `CheckMqttClientTask`.
-     * It consumes the `brokerEventQueue`, unpacking the `BrokerEvent` structures 
+     * @brief Gets the shard that owns a client.
+     * @param handle The handle assigned by the Broker, clients are spread by slot.
+     */
+    BrokerShard* shardOf(const ClientHandle& handle){
+        return shards[handle.slot % shards.size()];
+    }
+
+    /**
+     * @brief Processes pending Broker events (Publish/Subscribe/Deliver) of a shard.
+     * * This method is called repeatedly by the `CheckMqttClientTask` of the shard.
+     * It consumes the shard event queue, unpacking the `BrokerEvent` structures 
      * and dispatching them to the internal implementation methods (`_impl`).
-     * * @return true If at least one event was processed (keeps the CheckMqttClientTask busy).
+     * * @param shard The shard owned by the calling worker.
+     * @return true If at least one event was processed (keeps the CheckMqttClientTask busy).
      * @return false If the queue was empty (allows the CheckMqttClientTask to sleep).
      */
-    bool processBrokerEvents();
+    bool processBrokerEvents(BrokerShard* shard);
 
     /**
      * @brief Internal implementation of the Publish logic.
-     * * It queries the `Trie` to find subscribers for the 
-     * given topic and iterates through the `clients` map to send the message.
+     * * It queries the `Trie` to find subscribers for the given topic. Subscribers 
+     * owned by `shard` are served directly; the others are grouped per owner 
+     * shard and handed over as `EVENT_DELIVER` events, so fan-out runs in parallel.
      * * @note <b>Memory Management:</b> This method assumes ownership of the 
      * `PublishMqttMessage*` and is responsible for `delete`-ing it after processing.
      * * @param msg Pointer to the message object created on the Heap.
+     * @param shard The shard owned by the calling worker.
+     */
+    void _publishMessageImpl(PublishMqttMessage* msg, BrokerShard* shard);
+
+    /**
+     * @brief Internal implementation of the Deliver logic.
+     * * Resolves the `targets` routed by another worker and sends them the message.
+     * Targets that disconnected meanwhile are skipped.
+     * * @param msg Pointer to the message object (will be deleted after use).
+     * @param targets Subscribers owned by `shard`, held by the event.
+     * @param shard The shard owned by the calling worker.
      */
-    void _publishMessageImpl(PublishMqttMessage* msg);
+    void _deliverMessageImpl(PublishMqttMessage* msg, const std::vector<Subscriber>& targets, BrokerShard* shard);
+
+    /**
+     * @brief Sends a message to the subscribers owned by `shard`, with the QoS 
+     * granted to each subscription (capped by the publish QoS).
+     * * Lock-free: the caller must be inside its epoch.
+     */
+    void deliverToSubscribers(PublishMqttMessage* msg, const std::vector<Subscriber>& subscribers, BrokerShard* shard);
 
     /**
      * @brief Internal implementation of the Subscribe logic.
      * * Executed by the CheckMqttClientTask. It interacts with the `Trie` data structure to 
      * register the client's interest in specific topics.
      * * @param msg Pointer to the subscribe message object (will be deleted after use).
-     * @param client Pointer to the client requesting the subscription.
+     * @param handle Handle of the client requesting the subscription, skipped if it is gone.
      */
-    void _subscribeClientImpl(SubscribeMqttMessage* msg, MqttClient* client);
+    void _subscribeClientImpl(SubscribeMqttMessage* msg, ClientHandle handle);
+
+    /**
+     * @brief Removes every subscription of a client from the Trie.
+     * * Called by the owner worker before deleting the client, under `topicTrieMutex`.
+     * Stale handles left in the Trie would be skipped when routing, but never freed.
+     * @param client Client being deleted.
+     */
+    void unsubscribeClientFromTrie(MqttClient* client);
 
     /**
      * @brief Start the listen on port, waiting to new clients.
@@ -238,27 +724,119 @@ public:
      */
     void stopBroker();
 
-    /**
-     * @brief Create and store a new MqttClient object from a tcp connection and 
-     * the data on connect mqtt packet.
-     * 
-     * @param tcpClient socket where is the connection to this client.
-     */
-    void addNewMqttClient(AsyncClient *client);
-    
     /**
      * @brief delete and free a MqttClient object.
      * 
-     * @param clientId 
+     * * The client is removed from the table and the Trie at once, but only freed 
+     * by `reclaimClients` once the other workers left their current epoch.
+     * @param handle The handle of the client, ignored if it is already deleted.
      */
-    void deleteMqttClient(MqttTransport* transportKey);
+    void deleteMqttClient(ClientHandle handle);
 
     /**
      * @brief publish a mqtt message arrived to all mqtt clients interested.
      * 
      * @param publihsMqttMessage mqtt message to publish.
      */
-    void publishMessage(PublishMqttMessage * publihsMqttMessage);
+    void publishMessage(PublishMqttMessage * publihsMqttMessage, MqttClient* source = nullptr);
+
+    /**
+     * @brief Tries to queue a publish without dropping it.
+     * * Unlike `publishMessage`, if the worker event queue is full the message 
+     * is NOT deleted: ownership stays with the caller, who can retry later.
+     * 
+     * @param publishMqttMessage mqtt message to publish.
+     * @param source client that published the message, its worker routes it.
+     * @return true if the message was queued (the Broker took ownership).
+     * @return false if the queue is full.
+     */
+    bool tryPublishMessage(PublishMqttMessage * publishMqttMessage, MqttClient* source = nullptr);
+
+    /**
+     * @brief An empty publish to fill and route: from the pool when the capacity is 
+     * preallocated, from the heap when there is none.
+     * @return nullptr if the pool is exhausted: the caller drops the publish and counts it.
+     */
+    PublishMqttMessage* newMessage();
+
+    /**
+     * @brief Releases a publish the Broker owns, back to its pool if it came from it.
+     */
+    void deleteMessage(PublishMqttMessage* message);
+
+    /**
+     * @brief Publishes a message from the application running alongside the Broker.
+     * * The message object goes straight into the routing path of the first worker, 
+     * as if a client had published it, without any connection, packet or parsing. 
+     * Callable from any task.
+     * 
+     * @param topic Topic name, without wildcards.
+     * @param payload Message payload, a String, a text or `MqttBytes(data, length)` for binary data.
+     * @param qos QoS of the publish (capped by MAXQOS), each subscriber receives at most its granted QoS.
+     * @param retain Keeps the message for future subscribers, an empty payload clears it.
+     * @return false if the broker is not started, the topic is invalid or the worker queue is full.
+     */
+    bool publish(const String& topic, const MqttBytes& payload, uint8_t qos = 0, bool retain = false);
+
+    /**
+     * @brief Subscribes the application to a topic filter (wildcards allowed).
+     * * The callback is invoked by the worker that routes each matching publish, 
+     * with the message object itself. With several workers it may run concurrently 
+     * and must be quick: the worker delivers nothing else meanwhile. Retained 
+     * messages matching the filter are passed right away, from the calling task.
+     * 
+     * @param topicFilter Filter, as in a SUBSCRIBE packet.
+     * @param callback Receives the matching messages.
+     * @return uint16_t Id of the subscription, 0 if the filter is empty or too many are registered.
+     */
+    uint16_t subscribe(const String& topicFilter, LocalMessageCallback callback);
+
+    /**
+     * @brief Removes a local subscription.
+     * * A worker that routed a message just before may still invoke the callback once.
+     * 
+     * @param subscriptionId Id returned by `subscribe()`, ignored if unknown.
+     */
+    void unsubscribe(uint16_t subscriptionId);
+
+    /**
+     * @brief Registers a client whose publishes are stalled on a full event queue.
+     * * Called by `MqttClient` (Network Thread) after pausing its transport. The 
+     * CheckMqttClientTask will retry its pending publishes once the queue drains.
+     * 
+     * @param handle The handle of the client, also selects its worker.
+     */
+    void notifyClientStalled(ClientHandle handle);
+
+    /**
+     * @brief Adds a client to the keep-alive wheel of its worker.
+     * * Called by `MqttClient` once the CONNECT is accepted. Later activity doesn't
+     * need to call it again, see `KeepAliveWheel`.
+     * 
+     * @param client The connected client, with its keep-alive already set.
+     */
+    void scheduleKeepAlive(MqttClient* client);
+
+    /**
+     * @brief Registers a client that has packets queued in its outbox.
+     * * Its worker pumps the outbox on the next maintenance pass, for transports 
+     * that don't notify when they are ready to send again.
+     * 
+     * @param client The client with a non-empty outbox.
+     */
+    void notifyClientBacklog(MqttClient* client);
+
+    /**
+     * @brief Retries the pending publishes of the stalled clients of a shard.
+     * * Executed by the CheckMqttClientTask after draining events. Each stalled client 
+     * pushes its pending publishes into the freed queue slots; when a client has 
+     * no pending publishes left, its transport is resumed.
+     * 
+     * @param shard The shard owned by the calling worker.
+     * @return true If at least one pending publish was queued.
+     * @return false If there was nothing to do or the queue is still full.
+     */
+    bool processStalledClients(BrokerShard* shard);
 
     /**
      * @brief Subscribe a MqttClient to a topic.
@@ -268,8 +846,43 @@ public:
      */
     void SubscribeClientToTopic(SubscribeMqttMessage * subscribeMqttMessage, MqttClient* client);    
 
+    /**
+     * @brief Preallocates the whole capacity of the broker on `startBroker()`: client 
+     * objects, reader buffers, outboxes, events, Trie nodes and worker scratch lists.
+     * * From then on connections, subscriptions and routing reuse this storage and 
+     * fail (connection refused, subscription dropped, publish dropped as on a full
+     * queue) when it is exhausted, instead of growing the heap. Outboxes become byte 
+     * rings of `outboxBytes` and packets over `maxPacketSize` close their connection.
+     * `StaticMqttBroker` sets it at compile time.
+     * * @note Must be called before `startBroker()`. Overrides `setMaxNumClients()`.
+     */
+    void setCapacity(const BrokerCapacity& capacity);
+
+    const BrokerCapacity& getCapacity(){
+        return capacity;
+    }
+
+    /**
+     * @brief Heap allocations made on the steady-state path since boot: receiving 
+     * and routing publishes, acknowledgments, pings, deliveries, outbox draining 
+     * and keep-alives. Connections, subscriptions and sessions are not counted.
+     * * Always 0 unless built with MQTTBROKER_COUNT_ALLOCATIONS. With a preallocated 
+     * capacity, the first worker logs an error whenever it increases, and the host 
+     * test SteadyStateAllocationTest fails.
+     */
+    uint32_t getSteadyStateAllocations(){
+        return AllocationScope::count();
+    }
+
+    /**
+     * @brief Logs the steady-state allocations made since the previous call, with a
+     * preallocated capacity. Called by the first Worker.
+     */
+    void checkSteadyStateAllocations();
+
     /**
      * @brief Set the Max Num Clients that your system can support.
+     * * @note Must be called before `startBroker()`, which allocates the client table.
      * 
      * @param numMaxClients.
      */
@@ -277,6 +890,53 @@ public:
         this->maxNumClients = numMaxClients;
     }
 
+    /**
+     * @brief Sets the time a new connection has to send its CONNECT, it is closed after.
+     * * A connection that never speaks MQTT would otherwise hold a client slot forever.
+     * The transport handshake counts too: `TlsServerListener` raises it to 
+     * `TLSHANDSHAKETIMEOUT`.
+     * @param timeoutMs Default MAXWAITTOMQTTPACKET.
+     */
+    void setHandshakeTimeout(unsigned long timeoutMs){
+        this->handshakeTimeout = timeoutMs;
+    }
+
+    unsigned long getHandshakeTimeout(){
+        return handshakeTimeout;
+    }
+
+    /**
+     * @brief Sets the max number of connections waiting for their CONNECT at the same 
+     * time, new connections are refused beyond it.
+     * * Keeps the slots of `setMaxNumClients` for clients that complete the handshake.
+     * @param maxPending Default MAXPENDINGCLIENTS, 0 disables the limit.
+     */
+    void setMaxPendingClients(uint16_t maxPending){
+        this->maxPendingClients = maxPending;
+    }
+
+    /**
+     * @brief Sets the max number of connections accepted per second, allowed in bursts 
+     * of the same size. Connections over the rate are closed: after a WiFi outage the 
+     * devices reconnect over a few seconds instead of all at once.
+     * * @note Must be called before `startBroker()`.
+     * @param perSecond Default ACCEPTRATELIMIT, 0 disables the limit.
+     */
+    void setAcceptRateLimit(uint16_t perSecond){
+        this->acceptRateLimit = perSecond;
+        this->acceptCredit = (uint32_t)perSecond * 1000;
+    }
+
+    /** @brief Number of clients accepted that have not sent their CONNECT yet. */
+    uint16_t getPendingClients(){
+        return pendingClients;
+    }
+
+    /** @brief Number of connections refused: broker full, too many pending handshakes or over the accept rate. */
+    uint32_t getRejectedConnections(){
+        return rejectedConnections;
+    }
+
 /**
      * @brief Sets the maximum size of the Outbox queue for buffering packets.
      * * This method updates the configuration to prevent Out of Memory (OOM) errors
@@ -284,11 +944,215 @@ public:
      * 1. Updates the default value for any **future** client connections.
      * 2. Iterates through all **currently connected** clients to apply the new limit immediately.
      * * @note **Thread Safety:** This method acquires `clientSetMutex` to safely iterate 
-     * the shared `clients` map without race conditions with the Network Thread.
+     * the shared `clients` table without race conditions with the Network Thread.
      * * @param outBoxMaxSize The new maximum number of packets allowed in the queue (e.g., 50).
      */
     void setOutBoxMaxSize(size_t outBoxMaxSize);
 
+    /**
+     * @brief Sets the QoS 1/2 in-flight window of the clients.
+     * * Up to `windowSize` publishes are pipelined to a subscriber before waiting for 
+     * their PUBACK (QoS 1) or PUBCOMP (QoS 2), later ones wait in the client until 
+     * an acknowledgment frees a slot. A window of 1 is stop-and-wait. Applies to 
+     * clients connected afterwards.
+     * 
+     * @param windowSize Number of unacknowledged publishes (default INFLIGHTWINDOWSIZE,
+     * max PACKETIDSETSIZE).
+     */
+    void setInflightWindowSize(uint16_t windowSize){
+        this->inflightWindowSize = constrain(windowSize, 1, PACKETIDSETSIZE);
+    }
+
+    uint16_t getInflightWindowSize(){
+        return inflightWindowSize;
+    }
+
+    /**
+     * @brief Enables the offline message log of the persistent sessions (default enabled).
+     * * Missed QoS 1/2 publishes are written to the storage (LittleFS on the ESP32,
+     * which must be formatted, e.g. `LittleFS.begin(true)` once). Without it, sessions
+     * keep their subscriptions but offline messages are dropped. Must be called before startBroker().
+     */
+    void setOfflineLogEnabled(bool enabled){
+        this->offlineLogEnabled = enabled;
+    }
+
+    /**
+     * @brief Replaces the file system of the offline log and the snapshots: `LittleFsStorage`
+     * on the ESP32, `PosixFileStorage` in POSIXSTORAGEDIR on Linux by default.
+     * Must be called before startBroker().
+     * 
+     * @param storage The new storage, owned by the broker from now on.
+     */
+    void setStorage(FileStorage* storage){
+        delete this->storage;
+        this->storage = storage;
+    }
+
+    /**
+     * @brief Sets the size in bytes of the retained messages store (default RETAINEDSTORESIZE).
+     * * Topics and payloads of the retained messages share this budget, the least 
+     * recently used ones are evicted first. Must be called before startBroker().
+     */
+    void setRetainedStoreSize(size_t bytes){
+        retainedMessages.setCapacity(bytes);
+    }
+
+    /**
+     * @brief Binds a connecting client to its session, on CONNECT.
+     * * With Clean Session = 1 a stored session is discarded. Otherwise the session 
+     * is created or resumed: its subscriptions are moved to the client (and an 
+     * older connection with the same identifier is closed).
+     * 
+     * @param client The connecting client, its identifier is already set.
+     * @param cleanSession Clean Session flag of CONNECT.
+     * @return true if a stored session was resumed (Session Present).
+     */
+    bool attachSession(MqttClient* client, bool cleanSession);
+
+    /**
+     * @brief Sends the messages kept by the session of a client: first the 
+     * unacknowledged ones, then the ones logged while it was offline. Then marks the
+     * client connected, so routed publishes follow them.
+     * * Called after the CONNACK. Under `sessionMutex`: a publish routed meanwhile 
+     * is logged for the session, and replayed here.
+     */
+    void resumeSession(MqttClient* client);
+
+    /**
+     * @brief Keeps the state of a deleted client in its session.
+     * * Called by the Worker on client deletion. The unacknowledged publishes of a 
+     * connection taken over by a newer one go to that one, or stay in the session.
+     * @return true if the client had a persistent session: its Trie entries must be kept.
+     */
+    bool detachSession(MqttClient* client);
+
+    /**
+     * @brief Flushes the offline log if its batch delay elapsed. Called by the first Worker.
+     */
+    void syncOfflineLog();
+
+    /**
+     * @brief Writes a snapshot if the state changed and the snapshot interval elapsed.
+     * Called by the first Worker.
+     */
+    void checkSnapshot();
+
+    /**
+     * @brief Sets the min delay between snapshots (default SNAPSHOTINTERVALMS).
+     * * The persistent sessions, their subscriptions and the retained messages are 
+     * saved to the storage and restored by startBroker(), so clients don't need to 
+     * resubscribe after a reset. Messages logged for offline sessions are not kept.
+     * Each snapshot rewrites the whole file: a longer interval saves flash wear.
+     * Must be called before startBroker().
+     * 
+     * @param intervalMs Delay in ms, 0 disables the snapshots and their restore.
+     */
+    void setSnapshotInterval(uint32_t intervalMs){
+        this->snapshotInterval = intervalMs;
+    }
+
+    /**
+     * @brief Sets the interval of the broker statistics (default SYSINTERVALMS).
+     * * The first Worker routes them as retained messages on the "$SYS/broker/..." 
+     * topics: uptime, connected clients, messages and bytes received and sent (totals
+     * and rates per second), dropped publishes and outbox packets, worker queue depths
+     * and free heap. Subscribe to "$SYS/#", the "#" and "+" filters don't match them.
+     * 
+     * @param intervalMs Interval in ms, 0 disables them.
+     */
+    void setSysInterval(uint32_t intervalMs){
+        this->sysInterval = intervalMs;
+    }
+
+    /**
+     * @brief Publishes the $SYS statistics if the interval elapsed. Called by the first Worker.
+     */
+    void checkSysTopics();
+
+    /**
+     * @brief Traffic counters of the calling core, for the network threads and the workers.
+     */
+    CoreTrafficCounters& trafficCounters(){
+        return traffic[xPortGetCoreID() % portNUM_PROCESSORS];
+    }
+
+    /**
+     * @brief Sums the traffic counters of the cores and workers.
+     * * Cheap: a few loads per core and worker, no lock.
+     */
+    BrokerTraffic getTraffic();
+
+    /**
+     * @brief Records the latency of a pipeline stage that began at `start` (`LatencyRecorder::now()`).
+     */
+    void recordLatency(LatencyStage stage, uint32_t start){
+        latency.record(stage, start);
+    }
+
+    /**
+     * @brief Gets the latency histogram of a stage of the publish pipeline, since the broker started.
+     * * Parsing, worker queues, Trie routing, fan-out, outbox wait and end to end, in
+     * log2 buckets of microseconds. The $SYS topics publish them per interval under 
+     * "$SYS/broker/latency/<stage>/...". Empty if built with MQTTBROKER_LATENCY_HISTOGRAMS=0.
+     */
+    LatencyHistogram getLatencyHistogram(LatencyStage stage){
+        return latency.get(stage);
+    }
+
+    /**
+     * @brief Sets the number of routing workers (shards).
+     * * Clients are spread across workers by client table slot; each worker routes the publishes of 
+     * its clients, writes their outboxes and runs their maintenance, pinned to 
+     * core `worker % portNUM_PROCESSORS`. On dual-core parts, 2 workers let 
+     * routing use both cores. Each worker needs its own 4KB stack and event queue.
+     * * @note Must be called before `startBroker()`.
+     * * @param numWorkers Number of workers, between 1 and MAXNUMWORKERS (default 1).
+     */
+    void setNumWorkers(uint8_t numWorkers);
+
+    /**
+     * @brief Get the number of routing workers.
+     */
+    uint8_t getNumWorkers(){
+        return numWorkers;
+    }
+
+    /**
+     * @brief Get a snapshot of the counters of one worker.
+     * * @param shardId Worker index, between 0 and getNumWorkers() - 1.
+     * @return BrokerShardStats counters (zeroed if the broker is not started).
+     */
+    BrokerShardStats getShardStats(uint8_t shardId);
+
+    /**
+     * @brief Measures the memory held by the connected clients.
+     * * Divide `bytes` by `clients` for the cost of one more client, e.g. to size 
+     * `setMaxNumClients()` to the free heap. Walks the client table: not for a hot path.
+     */
+    ClientMemoryReport getClientMemoryReport();
+
+    /**
+     * @brief Enables or disables the lossless publish mode.
+     * * By default (QoS 0 behaviour), when the worker event queue is full the incoming 
+     * publish is dropped. In lossless mode the publisher's transport stops 
+     * acknowledging data instead, so TCP flow control slows the publisher down 
+     * until the CheckMqttClientTask drains the queue. Nothing is thrown away, at the 
+     * cost of a slow subscriber set slowing down the publishers.
+     * 
+     * @param enabled true to flow-control publishers, false to drop on a full queue.
+     */
+    void setLosslessMode(bool enabled){
+        this->losslessMode = enabled;
+    }
+
+    /**
+     * @brief check if lossless publish mode is enabled.
+     */
+    bool isLosslessMode(){
+        return losslessMode;
+    }
+
     /**
      * @brief check if broker has contains maxNumClients connects.
      * 
@@ -296,13 +1160,33 @@ public:
      * @return false if not.
      */
     bool isBrokerFullOfClients(){
-        return (clients.size() == maxNumClients);
+        return (clients.size() >= clients.capacity());
     }
 
+    /**
+     * @brief true if `maxPendingClients` connections are waiting for their CONNECT.
+     * * @note Called with `clientSetMutex` held.
+     */
+    bool tooManyPendingClients(){
+        return maxPendingClients != 0 && pendingClients >= maxPendingClients;
+    }
+
+    /**
+     * @brief Takes one connection from the accept rate limiter.
+     * * @note Called with `clientSetMutex` held.
+     * @return false if the rate is exceeded.
+     */
+    bool takeAcceptCredit();
+
+    /**
+     * @brief Closes and frees a transport refused by `acceptClient`.
+     */
+    void rejectClient(MqttTransport* transport, const char* reason);
+
 /**
      * @brief Processes the deferred client deletion queue.
      * * This method acts as the **Garbage Collector** of the Broker. It is executed 
-     * by the CheckMqttClientTask Task. It consumes the `deleteMqttClientQueue`, which 
+     * by the CheckMqttClientTask Task. It consumes the shard delete queue, which 
      * contains references to clients that have disconnected on the Network Thread.
      * * **Why is this needed?** Deleting an object directly inside its own callback causes 
      * "use-after-free" crashes. By deferring deletion to this separate thread/loop, 
@@ -310,19 +1194,45 @@ public:
      * * @return true If at least one client was deleted (signals the CheckMqttClientTask to keep running).
      * @return false If the queue was empty.
      */
-    bool processDeletions();
+    bool processDeletions(BrokerShard* shard);
+
+    /**
+     * @brief Announces that the worker of a shard starts reading the client table.
+     * * Clients resolved from handles stay valid until `exitEpoch`. Called by the 
+     * CheckMqttClientTask around each loop iteration.
+     */
+    void enterEpoch(BrokerShard* shard){
+        epochs.enter(shard->id);
+    }
+
+    /**
+     * @brief Announces that the worker of a shard holds no client anymore.
+     */
+    void exitEpoch(BrokerShard* shard){
+        epochs.exit(shard->id);
+    }
 
     /**
      * @brief Periodically checks for client inactivity (Keep-Alive).
-     * * This method iterates through the entire registry of active clients. For each 
-     * connected client, it calculates the time elapsed since the last received packet.
-     * If this time exceeds 1.5x the negotiated Keep-Alive interval (as per MQTT Spec), 
-     * the client is forcibly disconnected.
-     * * @note <b>Thread Safety:</b> Since this method reads the `clients` map (which is written 
-     * to by the Network Thread on new connections), it acquires the `clientSetMutex` 
-     * to prevent iterator invalidation crashes.
-     */
-    void processKeepAlives();
+     * * This method advances the shard keep-alive wheel and only checks the clients 
+     * whose deadline is reached. If the time elapsed since their last received packet 
+     * exceeds 1.5x the negotiated Keep-Alive interval (as per MQTT Spec), the client 
+     * is forcibly disconnected, otherwise it is rescheduled. It also pumps the outbox 
+     * of the clients registered by `notifyClientBacklog`.
+     * * @note <b>Thread Safety:</b> The expired clients are resolved against the `clients` 
+     * table without locking, the caller must be inside its epoch.
+     * * @param shard Only the clients owned by this shard are checked.
+     */
+    void processKeepAlives(BrokerShard* shard);
+
+    /**
+     * @brief Resolves client handles of a shard, skipping deleted clients.
+     * * Lock-free: the caller must be inside its epoch (`enterEpoch`).
+     * 
+     * @param handles The handles to resolve.
+     * @param resolved Output, the live clients.
+     */
+    void resolveClients(const std::vector<ClientHandle>& handles, std::vector<MqttClient*>& resolved);
 };
 
 /**
@@ -339,7 +1249,13 @@ protected:
      * The listener uses this to notify the broker when a new client connects
      * by calling `broker->acceptClient()`.
      */
-    MqttBroker* broker = nullptr;
+    MqttBroker* broker = nullptr;
+
+    /**
+     * @brief Listener decorating this one (e.g. `TlsServerListener`), nullptr if none.
+     * Accepted connections go through it before reaching the broker.
+     */
+    ServerListener* outer = nullptr;
 
 public:
     virtual ~ServerListener() {}
@@ -350,6 +1266,24 @@ public:
      */
     void setBroker(MqttBroker* b) { broker = b; }
 
+    /**
+     * @brief Routes the accepted connections through a decorating listener.
+     */
+    void setOuter(ServerListener* o) { outer = o; }
+
+    /**
+     * @brief Hands an accepted connection to the broker, through the decorating 
+     * listener if any. Called by the concrete listeners.
+     * * @param transport The new connection, owned by the receiver.
+     * @return false if the broker refused it: `transport` is already deleted.
+     */
+    virtual bool accept(MqttTransport* transport) {
+        if (outer) {
+            return outer->accept(transport);
+        }
+        return broker->acceptClient(transport);
+    }
+
     // --- Lifecycle Methods ---
 
     /**
@@ -366,6 +1300,8 @@ public:
     virtual void stop() = 0;
 };
 
+#if !MQTTBROKER_POSIX_SOCKETS
+
 /**
  * @brief Concrete implementation of ServerListener for TCP connections.
  * * This class wraps the `AsyncServer` from the AsyncTCP library. It is responsible
@@ -489,18 +1425,19 @@ private:
     void onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
 };
 
-
+#endif // !MQTTBROKER_POSIX_SOCKETS
 /*********************** Tasks **************************/
 
 /**
  * @brief The Background Worker Task (The Engine).
  * * This class implements the **Worker Thread Pattern**. It runs on a separate FreeRTOS 
  * task (typically pinned to **Core 0**), isolating heavy processing logic from the 
- * Network I/O events (which occur on **Core 1** via AsyncTCP).
+ * Network I/O events (which occur on **Core 1** via AsyncTCP). With several workers, 
+ * each one owns a `BrokerShard` and they are spread across cores.
  * * Its main responsibilities are:
- * 1. **Event Processing:** Consuming the `brokerEventQueue` to handle PUBLISH routing 
+ * 1. **Event Processing:** Consuming the shard event queue to handle PUBLISH routing 
  * and SUBSCRIBE trie insertions sequentially.
- * 2. **Garbage Collection:** Consuming the `deleteMqttClientQueue` to safely destroy 
+ * 2. **Garbage Collection:** Consuming the shard delete queue to safely destroy 
  * disconnected clients without race conditions.
  * 3. **Maintenance:** Periodically checking Keep-Alive timeouts.
  */
@@ -509,14 +1446,18 @@ private:
     /** @brief Reference to the Broker instance to access queues and implementation methods. */
     MqttBroker *broker;
 
+    /** @brief The slice of clients and events owned by this worker. */
+    BrokerShard *shard;
+
 public:
     /**
      * @brief Construct a new Worker Task.
      * * Initializes the task configuration (stack size, priority). It does not start 
      * the task immediately; `start()` must be called explicitly by the Broker.
      * * @param broker Pointer to the main MqttBroker instance.
+     * @param shard The shard processed by this worker.
      */
-    CheckMqttClientTask(MqttBroker *broker);
+    CheckMqttClientTask(MqttBroker *broker, BrokerShard *shard);
     
     /**
      * @brief The Main Event Loop.
@@ -562,7 +1503,7 @@ class Action{
          * @brief Action to implement.
          * 
          */
-        virtual void doAction();
+        virtual void doAction() = 0;
 };
 
 
@@ -603,8 +1544,11 @@ enum MqttClientState {
  * and the logic layer (`MqttBroker`).
  * * It is agnostic to the underlying protocol (TCP or WebSocket) thanks to the 
  * `MqttTransport` abstraction.
+ * * Its footprint bounds the number of clients of a small device: an idle client 
+ * allocates nothing besides this object, its transport and its client identifier
+ * (see `memoryUsage()`). Queues are allocated on their first packet.
  */
-class MqttClient
+class MqttClient : public MqttTransportListener
 {
 private:
     /** @brief Unique Client ID assigned by the Broker. */
@@ -615,17 +1559,14 @@ private:
      */
     MqttTransport* transport;
 
-    /** @brief State machine parser for incoming MQTT packets. */
-    ReaderMqttPacket *reader;
+    /** @brief State machine parser for incoming MQTT packets, bound to `onPacketReady`. */
+    ReaderMqttPacket reader;
 
     /** @brief Current internal state (STATE_PENDING or STATE_CONNECTED). */
     MqttClientState _state;
 
-    /** * @brief Pointer to the deletion queue. 
-     * @note In the latest architecture, the client calls `broker->queueClientForDeletion`, 
-     * so this member might be legacy depending on implementation details.
-     */
-    QueueHandle_t *deleteMqttClientQueue;
+    /** @brief Slot of this client in the Broker client table, used by every queue and timer. */
+    ClientHandle handle;
 
     /** @brief Maximum inactivity time (in seconds) allowed before disconnection. */
     uint16_t keepAlive;
@@ -633,18 +1574,18 @@ private:
     /** @brief Timestamp (millis) of the last packet received from this client. */
     unsigned long lastAlive;
 
-    /** @brief Factory to create response messages (CONNACK, PINGRESP, etc.). */
-    FactoryMqttMessages messagesFactory;
+    /** @brief Set while this client counts in the Broker pending handshakes. */
+    std::atomic<bool> handshakePending{false};
+
+    /** @brief Factory to create response messages (CONNACK, PINGRESP, etc.), stateless so shared by all the clients. */
+    static FactoryMqttMessages messagesFactory;
 
-    /** @brief Current action being processed (Strategy Pattern for packet handling). */
-    Action *action;
-    
     /**
      * @brief Registry of Trie Nodes this client is subscribed to.
      * Used to efficiently unsubscribe the client from the Topic Trie 
      * upon disconnection without searching the entire tree.
      */
-    std::vector<NodeTrie*> nodesToFree;
+    SubscriptionList nodesToFree;
 
     /**
      * @brief Software Output Buffer (Outbox).
@@ -660,34 +1601,144 @@ private:
      *
      * This ensures data integrity and prevents packet loss during high-traffic bursts.
      */
-    std::deque<String> _outbox;
-    size_t outboxMaxSize = 100; // Default max size of the Outbox queue
+    CompactQueue<String> _outbox;
+    uint16_t outboxMaxSize = 100; // Default max size of the Outbox queue
+
+    /**
+     * @brief Preallocated outbox of a `StaticMqttBroker` client, used instead of `_outbox` 
+     * once set (`useStaticBuffers`): packets are copied back to back, bounded in bytes.
+     */
+    ByteRing _outboxRing;
+
+    /** @brief true if no packet waits in the outbox in use. Caller must hold `_mutex`. */
+    bool _outboxEmpty() {
+        return _outboxRing.enabled() ? _outboxRing.empty() : _outbox.empty();
+    }
 
     /**
-     * @brief Mutex for thread-safe access to the Outbox queue.
+     * @brief Recursive mutex for thread-safe access to the client queues: `_outbox`, 
+     * `_stalledPublishes`, `_inflight`, `_pendingQos` and the QoS 2 tables.
      *
      * **Concurrency Critical:**
-     * This mutex protects the `_outbox` std::deque from race conditions.
      * - **Producer:** The Worker Task (Core 0) locks this when adding packets via `sendPacketByTcpConnection`.
      * - **Consumer:** The Network Thread (Core 1) locks this when removing packets via `_drainOutbox`.
      *
-     * Without this lock, simultaneous push/pop operations would corrupt the queue's memory.
+     * One mutex per client instead of one per queue: the in-flight window sends packets 
+     * (outbox) while holding it, hence recursive.
+     */
+    SemaphoreHandle_t _mutex;
+
+    /**
+     * @brief Publishes waiting for room in the Broker event queue (lossless mode).
+     * * Filled by the Network Thread when `tryPublishMessage` fails, and drained 
+     * in FIFO order by the Worker through `flushStalledPublishes`. While it is not 
+     * empty, the transport is paused, so its size is bounded by the TCP receive window.
+     */
+    CompactQueue<PublishMqttMessage*> _stalledPublishes;
+
+    /** @brief Set while the client is registered in its shard `backlogClients`. */
+    std::atomic<bool> _backlogScheduled{false};
+
+    /** @brief When a packet was queued in the empty outbox, the start of its backlog. */
+    uint32_t _outboxSince = 0;
+
+    /** @brief Client identifier sent in CONNECT. */
+    String clientIdentifier;
+
+    /** @brief Persistent session of this client, 0 with Clean Session = 1. */
+    uint16_t sessionId = 0;
+
+    /** @brief Key of this client in the Trie: its id, or the key of its persistent session. */
+    int subscriberKey;
+
+    /** @brief Next packet id for QoS 1/2 publishes sent to this client (never 0). */
+    uint16_t nextPacketId = 1;
+
+    /** @brief Max size of `_inflight` plus `_qos2Released`, copied from the Broker on creation. */
+    uint16_t inflightWindowSize;
+
+    /**
+     * @brief QoS 1/2 publishes sent to this client, waiting for their PUBACK or PUBREC.
+     * * Several of them are pipelined (up to `inflightWindowSize`); acknowledgments 
+     * may arrive in any order.
+     */
+    CompactQueue<InflightMessage> _inflight;
+
+    /** @brief QoS 1/2 publishes waiting for a free slot of the in-flight window. */
+    CompactQueue<InflightMessage> _pendingQos;
+
+    /**
+     * @brief QoS 2 publishes sent to this client and received by it: PUBREL sent, 
+     * waiting for PUBCOMP. Only their packet id is kept, they still use a window slot.
+     */
+    PacketIdSet _qos2Released;
+
+    /**
+     * @brief QoS 2 publishes received from this client and routed: PUBREC sent, 
+     * waiting for PUBREL. A retransmission of one of them is not routed again.
+     */
+    PacketIdSet _qos2Received;
+
+    /**
+     * @brief Next packet id for a QoS 1/2 publish, skipping the ids still used by the 
+     * in-flight window, the pending publishes and the QoS 2 table. Caller must hold `_mutex`.
+     */
+    uint16_t _allocatePacketId();
+
+    /** @brief true if a packet id waits for an acknowledgment. Caller must hold `_mutex`. */
+    bool _packetIdInUse(uint16_t packetId);
+
+    /**
+     * @brief Moves pending QoS 1/2 publishes into the in-flight window and sends them,
+     * while it has free slots. Caller must hold `_mutex`, so the window is filled in order.
+     */
+    void _fillInflightWindow();
+
+    /**
+     * @brief Finds a packet of the in-flight window. Caller must hold `_mutex`.
+     * @param type PUBLISH, or PUBREL for one resent after a reconnection.
+     * @return uint16_t Its index in `_inflight`, or `_inflight.size()` if not found.
+     */
+    uint16_t findInflight(uint16_t packetId, uint8_t type);
+
+    /**
+     * @brief Acknowledges a publish from this client, once the Broker accepted it:
+     * PUBACK for QoS 1, PUBREC for QoS 2 (recording its packet id).
      */
-    SemaphoreHandle_t _outboxMutex;
+    void acknowledgePublish(uint8_t qos, uint16_t packetId);
 
     /** @brief Pointer to the main Broker instance (The Owner). */
     MqttBroker *broker;
 
     /**
      * @brief Sends a serialized MQTT packet over the network.
-     * * It uses the `transport` abstraction to send data. 
-     * @note **QoS 0 Implementation:** Currently, if the transport buffer is full,
-     * the packet is dropped to prevent blocking the asynchronous loop. 
-     * Future improvements for QoS 1/2 should implement an Outbox queue here.
+     * * It uses the `transport` abstraction to send data. When the transport is 
+     * busy, or older packets wait, the packet is queued in the outbox (FIFO) and
+     * drained when the transport can send; a full outbox drops it (`outboxDrops`).
+     * A QoS 1/2 publish dropped this way stays in the in-flight window, and is resent
+     * when its persistent session reconnects.
      * * @param mqttPacket The raw string/bytes of the MQTT packet to send.
      */
     void sendPacketByTcpConnection(String mqttPacket);
 
+    /**
+     * @brief Sends a packet given in parts, written back to back: into the outbox ring 
+     * of a `StaticMqttBroker` client, without allocating, or joined into a String.
+     * * @param parts The pieces of the packet, in order.
+     * @param numParts Number of pieces.
+     */
+    void sendPacket(const PacketPart* parts, uint8_t numParts);
+
+    /**
+     * @brief Sends a PUBLISH from its shared topic and payload, see `sendPacket`.
+     * * @param header First byte: PUBLISH and its flags.
+     * @param packetId Written only for QoS > 0.
+     */
+    void sendPublish(uint8_t header, uint16_t packetId, const MqttBytes& topic, const MqttBytes& payload);
+
+    /** @brief Sends a packet of the in-flight window: its PUBLISH, or its PUBREL. */
+    void sendInflight(const InflightMessage& message);
+
     /**
      * @brief Operational Callback: Processes standard MQTT packets.
      * * This method is the callback for the `ReaderMqttPacket` when the client 
@@ -718,6 +1769,12 @@ private:
      */
     void _drainOutbox();
 
+    /**
+     * @brief Reader callback: dispatches a complete packet according to the state.
+     * @param context The client owning the reader.
+     */
+    static void onPacketReady(void* context);
+
 public:
 
     /**
@@ -737,19 +1794,74 @@ public:
      */
     ~MqttClient();
 
+    /**
+     * @brief Binds the preallocated buffers of a `ClientPool` block, before any data.
+     * * Packets larger than the reader buffer close the connection, and the outbox 
+     * is a byte ring bounded by `outboxBytes` instead of a number of packets. The 
+     * QoS 1/2 queues use `inflightSize` and then `pendingSize` slots at `inflightSlots`, 
+     * a publish finding them full is dropped.
+     */
+    void useStaticBuffers(uint8_t* readerBuffer, uint32_t readerBytes, uint8_t* outbox, uint32_t outboxBytes,
+                          InflightMessage* inflightSlots, uint16_t inflightSize, uint16_t pendingSize);
+
+    /**
+     * @brief On Data Received: feeds the raw bytes into the reader (Network Thread).
+     */
+    void onTransportData(uint8_t* data, size_t len) override;
+
+    /**
+     * @brief On Disconnect: notifies the Broker to schedule the cleanup.
+     */
+    void onTransportDisconnect() override;
+
+    /**
+     * @brief On Ready to Send: attempts to drain the outbox.
+     */
+    void onTransportReadyToSend() override;
+
+    /**
+     * @brief Heap and object bytes used by this client: the object itself, its 
+     * transport, the packet being parsed, its queues and the packets they hold.
+     * * Queued packets are read without locking: an estimate, for reports.
+     */
+    size_t memoryUsage();
+
     /**
      * @brief Get the unique Client ID.
      * @return int The client ID.
      */
     int getId(){return clientId;}
 
+    /**
+     * @brief Get the handle of this client in the Broker client table.
+     */
+    ClientHandle getHandle(){return handle;}
+
+    /**
+     * @brief Get the Broker managing this client.
+     */
+    MqttBroker* getBroker(){return broker;}
+
+    /**
+     * @brief Set by the Broker once the client is stored in its client table.
+     */
+    void setHandle(ClientHandle handle){
+        this->handle = handle;
+    }
+
+    /**
+     * @brief Removes this client from all the Trie nodes it is subscribed to.
+     * @note Caller must hold the Broker `topicTrieMutex`.
+     */
+    void unsubscribeAll();
+
     /**
      * @brief Sets the maximum size of the Outbox queue.
      * * This allows tuning the buffer size for handling backpressure, to prevent OOM
      * * @param maxSize The maximum number of packets to store in the Outbox.
      */
     void setOutboxMaxSize(size_t maxSize){
-        outboxMaxSize = maxSize;
+        outboxMaxSize = min(maxSize, (size_t)UINT16_MAX);
     }
 
     /**
@@ -760,13 +1872,113 @@ public:
      */
     void notifyPublishRecived(PublishMqttMessage *publishMessage);
 
+    /**
+     * @brief Retries the publishes stalled on a full Broker event queue.
+     * * Called by the Worker (lossless mode). Queues pending publishes in order until 
+     * the queue is full again. Once all of them are queued, the transport is resumed.
+     * 
+     * @return true if no publish is pending anymore (client is no longer stalled).
+     */
+    bool flushStalledPublishes();
+
     /**
      * @brief Sends a PUBLISH message TO this client.
      * * Called by the Broker/Worker when this client is identified as a subscriber
      * for a topic. It serializes the message and sends it via the transport.
+     * With QoS 1/2 a packet id is allocated, and the message stays in the in-flight 
+     * window (or waits for a slot) until the client acknowledges it.
      * * @param publishMessage The message object to send.
+     * @param qos QoS of this delivery (0, 1 or 2).
+     * @param retain true for a retained message sent on a new subscription.
+     */
+    void publishMessage(PublishMqttMessage *publishMessage, uint8_t qos = 0, bool retain = false);
+
+    /**
+     * @brief Processes a PUBACK from this client.
+     * * Frees the slot of the acknowledged publish and sends the publishes waiting
+     * for the window.
+     * @param packetId Packet id of the acknowledged publish.
+     */
+    void onPubAck(uint16_t packetId);
+
+    /**
+     * @brief Processes a PUBREC from this client (QoS 2, step 1 of the delivery).
+     * * The publish is not resent anymore: its packet is freed, only its packet id 
+     * is kept until the PUBCOMP, and a PUBREL is sent.
+     * @param packetId Packet id of the received publish.
+     */
+    void onPubRec(uint16_t packetId);
+
+    /**
+     * @brief Processes a PUBCOMP from this client (QoS 2, end of the delivery).
+     * * Frees the window slot and sends the publishes waiting for it.
+     * @param packetId Packet id of the completed publish.
+     */
+    void onPubComp(uint16_t packetId);
+
+    /**
+     * @brief Processes a PUBREL from this client (QoS 2 publish it sent to the Broker).
+     * * Forgets the packet id, so it can be reused, and sends a PUBCOMP.
+     * @param packetId Packet id of the released publish.
+     */
+    void onPubRel(uint16_t packetId);
+
+    /**
+     * @brief Sends a PUBACK, PUBREC, PUBREL or PUBCOMP packet to the client.
+     * @param type The acknowledgment type.
+     * @param packetId Packet id of the acknowledged publish.
+     */
+    void sendPublishAck(uint8_t type, uint16_t packetId);
+
+    /**
+     * @brief Takes the unacknowledged QoS 1/2 publishes, to keep them in the session.
+     * * Already sent publishes get the DUP flag, PUBRELs are added for the QoS 2 ones
+     * waiting for PUBCOMP.
+     * @param messages Output, in resend order.
+     */
+    void takeInflight(std::deque<InflightMessage>& messages);
+
+    /**
+     * @brief Sends again the publishes kept by the session (from `takeInflight`).
+     * @param messages Messages to send, moved out.
+     */
+    void restoreInflight(std::deque<InflightMessage>& messages);
+
+    /**
+     * @brief Enters `STATE_CONNECTED`: routed publishes are delivered from now on.
+     * * Set by `MqttBroker::resumeSession`, once the session messages are queued.
+     */
+    void setConnected(){
+        _state = STATE_CONNECTED;
+    }
+
+    String getClientIdentifier(){
+        return clientIdentifier;
+    }
+
+    uint16_t getSessionId(){
+        return sessionId;
+    }
+
+    int getSubscriberKey(){
+        return subscriberKey;
+    }
+
+    /**
+     * @brief Binds the client to a persistent session (0 for none).
+     * @param subscriberKey Trie key of the session subscriptions.
+     */
+    void setSession(uint16_t sessionId, int subscriberKey){
+        this->sessionId = sessionId;
+        this->subscriberKey = subscriberKey;
+    }
+
+    /**
+     * @brief Forgets the Trie nodes without unsubscribing: the persistent session keeps them.
      */
-    void publishMessage(PublishMqttMessage *publishMessage);
+    void detachNodes(){
+        nodesToFree.clear();
+    }
 
     /**
      * @brief Sends a SUBACK packet to the client.
@@ -816,11 +2028,30 @@ public:
      * @brief Checks if the client has timed out.
      * * Called periodically by the Broker's Worker. It compares the current time
      * against `lastAlive`. If the limit (1.5x KeepAlive) is exceeded, 
-     * it triggers disconnection.
+     * it triggers disconnection. Before the CONNECT, the limit is the Broker 
+     * handshake timeout.
      * * @param currentMillis The current system time.
      * @return true if the client is still alive, false if disconnected.
      */
     bool checkKeepAlive(unsigned long currentMillis);
+
+    /**
+     * @brief Gets the Keep Alive interval negotiated in the CONNECT packet.
+     * @return Time in seconds, 0 if disabled.
+     */
+    uint16_t getKeepAlive() { return keepAlive; }
+
+    /**
+     * @brief Gets the time when the client will time out if it stays silent.
+     * @return Time (millis), `lastAlive` + 1.5x KeepAlive, or the CONNECT deadline 
+     * while in `STATE_PENDING`.
+     */
+    unsigned long getKeepAliveDeadline() { 
+        if (_state == STATE_PENDING) {
+            return lastAlive + broker->getHandshakeTimeout();
+        }
+        return lastAlive + (unsigned long)keepAlive * 1500; 
+    }
     
     /**
      * @brief Gets the current lifecycle state.
@@ -828,6 +2059,15 @@ public:
      */
     MqttClientState getState() { return _state; }
 
+    /** @brief Marks this client as counted in the Broker pending handshakes. */
+    void holdHandshake() { handshakePending = true; }
+
+    /**
+     * @brief Clears the pending handshake mark.
+     * @return true if it was set: the caller releases the Broker count, once.
+     */
+    bool releaseHandshake() { return handshakePending.exchange(false); }
+
 /**
      * @brief Public trigger to attempt flushing the Outbox.
      *
@@ -840,6 +2080,12 @@ public:
     void processOutbox() {
         _drainOutbox();
     }
+
+    /**
+     * @brief Pumps the outbox on behalf of the Worker backlog list.
+     * * @return true if packets are still waiting, so the client stays registered.
+     */
+    bool pumpBacklog();
 };
 
 
@@ -872,6 +2118,70 @@ class PublishAction: public Action{
         void doAction() override;
 };
 
+/**
+ * @brief Strategy GRASP: When a mqttClient acknowledges a QoS 1 publish, its
+ * in-flight window slot is released. This class implements this logic.
+ * 
+ */
+class PubAckAction: public Action{
+    private:
+        uint16_t packetId;
+
+    public:
+
+        PubAckAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded);
+
+        void doAction() override;
+};
+
+/**
+ * @brief Strategy GRASP: When a mqttClient has received a QoS 2 publish, the
+ * broker releases it (PUBREL). This class implements this logic.
+ * 
+ */
+class PubRecAction: public Action{
+    private:
+        uint16_t packetId;
+
+    public:
+
+        PubRecAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded);
+
+        void doAction() override;
+};
+
+/**
+ * @brief Strategy GRASP: When a mqttClient releases a QoS 2 publish it sent,
+ * the broker completes the flow (PUBCOMP). This class implements this logic.
+ * 
+ */
+class PubRelAction: public Action{
+    private:
+        uint16_t packetId;
+
+    public:
+
+        PubRelAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded);
+
+        void doAction() override;
+};
+
+/**
+ * @brief Strategy GRASP: When a mqttClient completes a QoS 2 delivery, its
+ * in-flight window slot is released. This class implements this logic.
+ * 
+ */
+class PubCompAction: public Action{
+    private:
+        uint16_t packetId;
+
+    public:
+
+        PubCompAction(MqttClient* mqttClient, ReaderMqttPacket &packetReaded);
+
+        void doAction() override;
+};
+
 
 /**
  * @brief Strategy GRASP: When a mqttClient wants to subscribe to some topic, this topci
@@ -977,6 +2287,25 @@ class DisconnectAction: public Action{
         void doAction() override;
 };
 
+/**
+ * @brief Room for any Action, so `ActionFactory` builds them on the caller stack.
+ */
+union ActionStorage {
+    ActionStorage() {}
+    ~ActionStorage() {}
+
+    PublishAction publish;
+    PubAckAction pubAck;
+    PubRecAction pubRec;
+    PubRelAction pubRel;
+    PubCompAction pubComp;
+    SubscribeAction subscribe;
+    UnSubscribeAction unsubscribe;
+    NoAction none;
+    PingResAction pingRes;
+    DisconnectAction disconnect;
+};
+
 /**
  * @brief Class that implements Factory Method to dispatch actions
  * objects.
@@ -990,20 +2319,27 @@ public:
     ActionFactory();
     
     /**
-     * @brief Get the Action object
+     * @brief Get the Action object, built in `storage` instead of the heap.
      * 
      * @param mqttClient context to pass to Action object. 
      * @param packetReaded context that has the information to know what kind of
      *               Action object it is needed.
+     * @param storage where the Action is built, the caller destroys it (`~Action()`) after use.
      * @return Action* 
      */
-    Action* getAction(MqttClient * mqttClient, ReaderMqttPacket &packetReaded);
+    Action* getAction(MqttClient * mqttClient, ReaderMqttPacket &packetReaded, ActionStorage &storage);
 
 };
 
 
 /****************************** NodeTrie Class *****************************/
 
+/**
+ * @brief End mark of a topic in the Trie. NUL can't be part of a topic name (MQTT 
+ * forbids it), so any other character, '$' of the "$SYS" topics included, can.
+ */
+const char TRIEENDMARK = '\0';
+
 /**
  * @brief Node for a prefix tree structure.
  * 
@@ -1013,7 +2349,7 @@ class NodeTrie
 private:
     char character;
     NodeTrie *bro, *son;
-    std::map<int, MqttClient*> *subscribedClients;
+    SubscriberSet *subscribedClients;
 
     /**
      * @brief When some client subscribe to a topic usin "+" wildcard, the tree
@@ -1024,7 +2360,7 @@ private:
      * @param topic where is looking for in the tree.
      * @param index where start the topic level.
      */
-    void matchWithPlusWildCard(std::vector<MqttClient*>* clients,String topic, int index);
+    void matchWithPlusWildCard(std::vector<Subscriber>* clients, const String& topic, int index);
     
     /**
      * @brief When some client subscribe to a topic usin "#" wildcard, the tree
@@ -1033,10 +2369,15 @@ private:
      * @param clientsIds vector where store the id of mqttClients.
      * @param topic where is looking for in the tree.
      */
-    void matchWithNumberSignWildCard(std::vector<MqttClient*>* clients,String topic);
+    void matchWithNumberSignWildCard(std::vector<Subscriber>* clients, const String& topic);
 
 public:
     NodeTrie();
+
+    /**
+     * @brief Frees the node with its brothers and sons, for a Trie allocated on the 
+     * heap (the nodes of a reserved Trie are released with its storage).
+     */
     ~NodeTrie();
 
     /**
@@ -1051,12 +2392,14 @@ public:
 
     /**
      * @brief insert a new character in the prefix, the insertion is 
-     * in order. If character == '$', the character will insert in the current NodeTrie.
+     * in order. If character == TRIEENDMARK, the character will insert in the current NodeTrie.
      * 
      * @param character to insert.
      * @param son new node to insert in the prefix.
+     * @param trie allocates the new node, or the subscribers of an end mark.
+     * @return false if the trie storage is exhausted.
      */
-    void insert(char character, NodeTrie *son);
+    bool insert(char character, NodeTrie *son, Trie *trie);
 
     /**
      * @brief insert the 
@@ -1064,22 +2407,53 @@ public:
      * the new char.
      * 
      * @param character to insert.
+     * @param trie allocates the new nodes.
+     * @return false if the trie storage is exhausted.
      */
-    void takeNew(char character);
+    bool takeNew(char character, Trie *trie);
 
     /**
-     * @brief Add a mqttClient in subscribed clients map. 
+     * @brief Add a mqttClient in subscribed clients map, or update its QoS
+     * if it was already subscribed.
      * 
      * @param client to add .
+     * @param qos granted to the subscription.
+     * @return false if the trie storage is exhausted.
+     */
+    bool addSubscribedMqttClient(MqttClient* client, uint8_t qos);
+
+    /**
+     * @brief Adds the subscription of a persistent session without client.
+     * 
+     * @param subscriberKey Trie key of the session.
+     * @param sessionId Id of the session.
+     * @param qos granted to the subscription.
+     * @return false if the trie storage is exhausted.
+     */
+    bool addSubscribedSession(int subscriberKey, uint16_t sessionId, uint8_t qos);
+
+    /**
+     * @brief Adds a local subscription (`MqttBroker::subscribe`).
+     * 
+     * @param subscriptionId Id of the subscription, keyed apart from clients and sessions.
+     * @return false if the trie storage is exhausted.
+     */
+    bool addLocalSubscriber(uint16_t subscriptionId);
+
+    /**
+     * @brief Trie key of a local subscription: below the keys of the clients (their 
+     * id) and of the sessions restored from a snapshot (minus their id).
      */
-    void addSubscribedMqttClient(MqttClient* client);
+    static int localSubscriberKey(uint16_t subscriptionId){
+        return -0x10000 - (int)subscriptionId;
+    }
 
     /**
-     * @brief Get the Subscribed Mqtt Clients map.
+     * @brief Get the Subscribed Mqtt Clients set.
      * 
-     * @return std::map<int, MqttClient*>*.
+     * @return SubscriberSet* handles and granted QoS keyed by client id, NULL if no topic ends here.
      */
-    std::map<int, MqttClient*> * getSubscribedMqttClients(){
+    SubscriberSet * getSubscribedMqttClients(){
         return subscribedClients;
     }
 
@@ -1091,10 +2465,37 @@ public:
      * @param topic that clients are subscribed.
      * @param index where start the proccesing of topic.
      */
-    void findSubscribedMqttClients(std::vector<MqttClient*>* clients, String topic, int index);
+    void findSubscribedMqttClients(std::vector<Subscriber>* clients, const String& topic, int index);
 
     void unSubscribeMqttClient(MqttClient * mqttClient){
-        subscribedClients->erase(mqttClient->getId());
+        subscribedClients->erase(mqttClient->getSubscriberKey());
+    }
+
+    /**
+     * @brief Removes the subscription of a persistent session.
+     * @param subscriberKey Trie key of the session.
+     */
+    void unSubscribeSession(int subscriberKey){
+        subscribedClients->erase(subscriberKey);
+    }
+
+    /**
+     * @brief Removes a local subscription.
+     * @param subscriptionId Id of the local subscription.
+     */
+    void unSubscribeLocal(uint16_t subscriptionId){
+        subscribedClients->erase(localSubscriberKey(subscriptionId));
+    }
+
+    /**
+     * @brief Points the subscription of a persistent session to its new client.
+     * @param client The client that resumed the session.
+     */
+    void resubscribeMqttClient(MqttClient * client){
+        Subscriber* subscriber = subscribedClients->find(client->getSubscriberKey());
+        if (subscriber != nullptr) {
+            subscriber->handle = client->getHandle();
+        }
     }
 
     int getNumSubscribedClients(){
@@ -1106,7 +2507,9 @@ public:
 
 /**
  * @brief prefix trie class.
- * 
+ * * Nodes and subscriber entries come from the heap, or from storage allocated once 
+ * by `reserve()` (StaticMqttBroker): then nothing is allocated when subscribing or 
+ * routing, and a subscription is refused when the storage is exhausted.
  */
 class Trie
 {
@@ -1114,6 +2517,26 @@ private:
     NodeTrie *root;
     int numElem;
 
+    /** @brief Reserved storage, nullptr while the Trie uses the heap. */
+    NodeTrie *nodeArena = nullptr;
+    uint32_t numNodes = 0;
+    uint32_t nodesUsed = 0;
+
+    SubscriberSet *setArena = nullptr;
+    uint16_t numSets = 0;
+    uint16_t setsUsed = 0;
+
+    SubscriberSet::Entry *entryArena = nullptr;
+
+    /** @brief Free entries of `entryArena`, linked by `next`. */
+    SubscriberSet::Entry *freeEntries = nullptr;
+
+    /** @brief Topic of the lookup with its end mark, reused by `getSubscribedMqttClients`. */
+    String query;
+
+    /** @brief Releases the reserved storage. */
+    void releaseArenas();
+
 public:
     Trie();
     ~Trie();
@@ -1124,12 +2547,39 @@ public:
      */
     void clear(void);
 
+    /**
+     * @brief Allocates the storage of the Trie once, replacing the heap. Only valid 
+     * while the Trie is empty.
+     * 
+     * @param maxSubscriptions Subscriber entries, and topic filters.
+     * @param maxNodes Nodes of the tree.
+     * @param maxTopicLength Longest topic looked up without allocating.
+     */
+    void reserve(uint16_t maxSubscriptions, uint32_t maxNodes, size_t maxTopicLength);
+
+    /** @brief A new node, nullptr if the reserved storage is exhausted. */
+    NodeTrie* newNode();
+
+    /** @brief A new subscriber set (end mark node), nullptr if the reserved storage is exhausted. */
+    SubscriberSet* newSubscriberSet();
+
+    /** @brief A new subscriber entry, nullptr if the reserved storage is exhausted. */
+    SubscriberSet::Entry* newEntry();
+
+    /** @brief Gives back an entry taken by `newEntry`. */
+    void releaseEntry(SubscriberSet::Entry* entry);
+
+    /** @brief true if the nodes and sets live in reserved storage: they are never deleted. */
+    bool isReserved() const {
+        return nodeArena != nullptr;
+    }
+
     /**
      * @brief Insert a topic in the tree.
      * 
      * @param topic to insert.
-     * @return NodeTrie* where is the end mark of the prefix '$',
-     *         this node has the subscribed clients map.
+     * @return NodeTrie* where is the end mark of the prefix,
+     *         this node has the subscribed clients map. NULL if the storage is exhausted.
      */
     NodeTrie* insert(String topic);
 
@@ -1155,21 +2605,43 @@ public:
      * 
      * @param topic to subscribe.
      * @param client that subscribe.
-     * @param NodeTrie* where the client is subscribed.
+     * @param qos granted to the subscription.
+     * @param NodeTrie* where the client is subscribed, NULL if the storage is exhausted.
+     */
+    NodeTrie* subscribeToTopic(String topic, MqttClient* client, uint8_t qos = 0);
+
+    /**
+     * @brief Subscribe a persistent session without client (restored from a snapshot)
+     * to topic, its publishes are logged until a client resumes the session.
+     * 
+     * @param topic to subscribe.
+     * @param subscriberKey Trie key of the session.
+     * @param sessionId Id of the session.
+     * @param qos granted to the subscription.
+     * @return NodeTrie* where the session is subscribed, NULL if the storage is exhausted.
+     */
+    NodeTrie* subscribeSession(String topic, int subscriberKey, uint16_t sessionId, uint8_t qos);
+
+    /**
+     * @brief Subscribe a local callback of the Broker to topic.
+     * 
+     * @param topic to subscribe.
+     * @param subscriptionId Id of the local subscription.
+     * @return NodeTrie* where the subscription is stored, NULL if the storage is exhausted.
      */
-    NodeTrie* subscribeToTopic(String topic, MqttClient* client);
+    NodeTrie* subscribeLocal(String topic, uint16_t subscriptionId);
 
     /**
-     * @brief Get the vector of the id of subscribed mqtt clients, Warning!, this 
-     * method allocate dinamically the vector but don't free this, the user is responsible
-     * to free the memory allocated to avoid memory holes.
+     * @brief Appends the subscribers matching a topic (wildcards included) to a 
+     * list owned by the caller, so a reused list allocates nothing.
      * 
      * @param topic that mqttClients are subscribed.
-     * @return std::vector<int>* vector where are all id of the mqttClients subscribed to this topic.
+     * @param clients Output, handles (and granted QoS) of the mqttClients subscribed to this topic.
      */
-    std::vector<MqttClient*>* getSubscribedMqttClients(String topic);
+    void getSubscribedMqttClients(const String& topic, std::vector<Subscriber>& clients);
 
 };
 
+}
+
 #endif //MQTTBROKER_H
-}
\ No newline at end of file
@@ -2,6 +2,11 @@
 #define MQTT_BROKER_FACTORY_H
 
 #include "MqttBroker.h"
+#include "StaticMqttBroker.h"
+#include "TransportLayer/PosixTcpListener.h"
+#include "TransportLayer/IoUringListener.h"
+#include "TransportLayer/TlsListener.h"
+#include "MqttSnGateway/MqttSnGateway.h"
 
 using namespace mqttBrokerName;
 
@@ -21,13 +26,97 @@ public:
      * of the returned pointer (e.g., calling `delete` if the broker is stopped/destroyed).
      */
     static MqttBroker* createTcpBroker(uint16_t port = 1883) {
-        // Create the concrete strategy for TCP
+        // Create the concrete strategy for TCP (epoll sockets on Linux)
+#if MQTTBROKER_POSIX_SOCKETS
+        ServerListener* listener = new PosixTcpServerListener(port);
+#else
         ServerListener* listener = new TcpServerListener(port);
+#endif
         
         // Inject dependency and return the configured Context (Broker)
         return new MqttBroker(listener);
     }
 
+    /**
+     * @brief Creates an MQTT Broker serving several listeners, e.g. 
+     * `createBroker({new TcpServerListener(1883), new WsServerListener(8080, "/mqtt")})`.
+     * * @param listeners The listeners, owned by the broker. At least one.
+     * @return MqttBroker* Pointer to the new Broker instance.
+     * @note **Ownership:** The caller is responsible for managing the lifetime 
+     * of the returned pointer.
+     */
+    static MqttBroker* createBroker(std::initializer_list<ServerListener*> listeners) {
+        auto it = listeners.begin();
+        MqttBroker* broker = new MqttBroker(*it);
+        while (++it != listeners.end()) {
+            broker->addListener(*it);
+        }
+        return broker;
+    }
+
+    /**
+     * @brief Creates an MQTT Broker over TCP with an MQTT-SN gateway over UDP.
+     * * Battery powered sensors publish with a few bytes per message and may sleep
+     * between them, other clients see their topics as usual.
+     * @param tcpPort The TCP port to listen on. Default is 1883.
+     * @param udpPort The UDP port of the MQTT-SN gateway. Default is 1884.
+     * @return MqttBroker* Pointer to the new Broker instance.
+     * @note **Ownership:** The caller is responsible for managing the lifetime
+     * of the returned pointer.
+     */
+    static MqttBroker* createTcpAndMqttSnBroker(uint16_t tcpPort = 1883, uint16_t udpPort = 1884) {
+#if MQTTBROKER_POSIX_SOCKETS
+        MqttBroker* broker = new MqttBroker(new PosixTcpServerListener(tcpPort));
+#else
+        MqttBroker* broker = new MqttBroker(new TcpServerListener(tcpPort));
+#endif
+        broker->addListener(new MqttSnGateway(udpPort));
+        return broker;
+    }
+
+#if MQTTBROKER_TLS
+    /**
+     * @brief Creates an MQTT Broker over TLS (MQTTS), built with -DMQTTBROKER_TLS=1.
+     * * Clients reconnecting within a day resume their session with a ticket, 
+     * skipping the certificate exchange. Use `TlsServerListener` with a `TlsConfig` 
+     * to tune the ticket lifetime and the record size.
+     * @param certificate Server certificate (PEM), not copied: must outlive the broker.
+     * @param privateKey Private key of the certificate (PEM), not copied either.
+     * @param port The TCP port to listen on. Default is 8883 (IANA standard).
+     * @return MqttBroker* Pointer to the new Broker instance.
+     * @note **Ownership:** The caller is responsible for managing the lifetime 
+     * of the returned pointer.
+     */
+    static MqttBroker* createTlsBroker(const char* certificate, const char* privateKey, uint16_t port = 8883) {
+        TlsConfig config;
+        config.certificate = certificate;
+        config.privateKey = privateKey;
+#if MQTTBROKER_POSIX_SOCKETS
+        ServerListener* inner = new PosixTcpServerListener(port);
+#else
+        ServerListener* inner = new TcpServerListener(port);
+#endif
+        return new MqttBroker(new TlsServerListener(inner, config));
+    }
+#endif
+
+#if MQTTBROKER_IO_URING
+    /**
+     * @brief Creates an MQTT Broker over TCP served by io_uring (Linux 5.19 or later).
+     * * Same protocol as `createTcpBroker()`, with batched submissions instead of one 
+     * syscall per socket event: worth it with many busy clients.
+     * @param port The TCP port to listen on. Default is 1883 (IANA standard).
+     * @return MqttBroker* Pointer to the new Broker instance.
+     * @note **Ownership:** The caller is responsible for managing the lifetime 
+     * of the returned pointer.
+     */
+    static MqttBroker* createIoUringBroker(uint16_t port = 1883) {
+        ServerListener* listener = new IoUringTcpServerListener(port);
+        return new MqttBroker(listener);
+    }
+#endif
+
+#if !MQTTBROKER_POSIX_SOCKETS
     /**
      * @brief Creates an MQTT Broker over WebSockets.
      * * @param port The HTTP port to listen on. Default is 8080.
@@ -42,6 +131,24 @@ public:
         // Inject dependency and return the configured Context (Broker)
         return new MqttBroker(listener);
     }
+
+    /**
+     * @brief Creates an MQTT Broker serving both TCP and WebSockets.
+     * * Native MQTT devices and browser dashboards connect to the same broker and 
+     * see each other's publishes, with one topic tree and one set of workers.
+     * @param tcpPort The TCP port to listen on. Default is 1883.
+     * @param wsPort The HTTP port to listen on. Default is 8080.
+     * @param wsEndpoint The WebSocket path. Default is "/mqtt".
+     * @return MqttBroker* Pointer to the new Broker instance.
+     * @note **Ownership:** The caller is responsible for managing the lifetime 
+     * of the returned pointer.
+     */
+    static MqttBroker* createTcpAndWsBroker(uint16_t tcpPort = 1883, uint16_t wsPort = 8080, const char* wsEndpoint = "/mqtt") {
+        MqttBroker* broker = new MqttBroker(new TcpServerListener(tcpPort));
+        broker->addListener(new WsServerListener(wsPort, wsEndpoint));
+        return broker;
+    }
+#endif
 };
 
 #endif // MQTT_BROKER_FACTORY_H
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include "ClientTable.h"
+#include "OfflineLog.h"
+#include "MqttClient/InflightMessage.h"
+
+namespace mqttBrokerName{
+
+class NodeTrie;
+
+/**
+ * @brief State of a client that connected with Clean Session = 0, keyed by its client identifier.
+ * * It outlives the MqttClient: its Trie entries stay (keyed by `subscriberKey`, with
+ * a stale handle), so the QoS 1/2 publishes they match while it is offline are
+ * appended to the `OfflineLog`. On reconnection the entries are moved to the new
+ * client, then the unacknowledged and logged messages are sent.
+ */
+struct MqttSession {
+    String clientIdentifier;
+    uint16_t id;
+
+    /** @brief Trie key of its subscriptions (the id of the client that created it). */
+    int subscriberKey;
+
+    /** @brief Client currently attached, meaningful while `online`. */
+    ClientHandle owner;
+    bool online;
+
+    /** @brief Trie nodes where the session is subscribed. */
+    std::vector<NodeTrie*> nodes;
+
+    /** @brief Topic filters of these nodes and their granted QoS, saved by the snapshot. */
+    std::map<String, uint8_t> subscriptions;
+
+    /** @brief Publishes not acknowledged when the client disconnected. */
+    std::deque<InflightMessage> inflight;
+
+    /** @brief Number of records logged for this session, per log segment. */
+    std::map<uint32_t, uint16_t> loggedRecords;
+
+    /** @brief Log position when the session was last resumed. */
+    LogPosition replayFrom;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTT_SESSION_H
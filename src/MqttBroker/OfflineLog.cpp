@@ -0,0 +1,206 @@
+#include "OfflineLog.h"
+
+using namespace mqttBrokerName;
+
+// session id (2) | qos (1) | topic length (2) | payload length (4)
+#define LOGRECORDHEADERSIZE 9
+
+/**
+ * @brief Reads `length` bytes of a record field, payloads may hold any byte.
+ */
+static bool readField(StorageFile* file, uint32_t length, String& field){
+    uint8_t buffer[64];
+    field.reserve(length);
+
+    while (length > 0) {
+        size_t chunk = file->read(buffer, min(length, (uint32_t)sizeof(buffer)));
+        if (chunk == 0) return false;
+
+        field.concat((const char*)buffer, chunk);
+        length -= chunk;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a payload straight into the buffer of the message.
+ */
+static bool readField(StorageFile* file, uint32_t length, MqttBytes& field){
+    field = MqttBytes::allocate(length);
+    uint8_t* buffer = field.writableData();
+    if (length > 0 && buffer == nullptr) return false;
+
+    while (length > 0) {
+        size_t chunk = file->read(buffer, length);
+        if (chunk == 0) return false;
+
+        buffer += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+OfflineLog::~OfflineLog(){
+    delete writer;
+}
+
+String OfflineLog::segmentPath(uint32_t number){
+    return String(OFFLINELOGDIR) + "/" + String(number) + ".log";
+}
+
+bool OfflineLog::begin(FileStorage* storage){
+    this->storage = storage;
+    if (!storage->begin()) {
+        log_w("File storage not mounted, offline messages of persistent sessions will be dropped.");
+        return false;
+    }
+
+    if (!storage->exists(OFFLINELOGDIR)) {
+        storage->mkdir(OFFLINELOGDIR);
+    }
+
+    // Log positions of the sessions live in RAM: the records of a previous boot can't be claimed anymore.
+    for (const String& name : storage->list(OFFLINELOGDIR)) {
+        storage->remove(String(OFFLINELOGDIR) + "/" + name);
+    }
+
+    openSegment(0);
+    ready = writer != nullptr;
+    return ready;
+}
+
+LogPosition OfflineLog::end(){
+    if (segments.empty()) return {0, 0};
+    return {segments.back().number, writeOffset};
+}
+
+void OfflineLog::openSegment(uint32_t number){
+    if (writer) {
+        writer->flush();
+        delete writer;
+    }
+
+    writer = storage->open(segmentPath(number), "a");
+    if (!writer) {
+        log_e("Failed to open offline log segment %u", number);
+    }
+    segments.push_back({number, 0});
+    writeOffset = 0;
+    dirty = false;
+
+    // Bounded flash usage: the oldest messages are lost first.
+    while (segments.size() > OFFLINELOGMAXSEGMENTS) {
+        if (segments.front().liveRecords > 0) {
+            log_w("Offline log full, dropping %u messages.", segments.front().liveRecords);
+        }
+        storage->remove(segmentPath(segments.front().number));
+        segments.pop_front();
+    }
+}
+
+bool OfflineLog::append(uint16_t sessionId, uint8_t qos, PublishMqttMessage* msg, uint32_t& segment){
+    if (!ready) return false;
+
+    const String& name = msg->getTopic().getTopic();
+    const MqttBytes& payload = msg->getTopic().getPayLoad();
+    uint32_t recordSize = LOGRECORDHEADERSIZE + name.length() + payload.length();
+
+    // Rotate: a record never spans two segments.
+    if (writeOffset > 0 && writeOffset + recordSize > OFFLINELOGSEGMENTSIZE) {
+        openSegment(segments.back().number + 1);
+    }
+    if (!writer) return false;
+
+    uint8_t header[LOGRECORDHEADERSIZE] = {
+        (uint8_t)(sessionId >> 8), (uint8_t)sessionId,
+        qos,
+        (uint8_t)(name.length() >> 8), (uint8_t)name.length(),
+        (uint8_t)(payload.length() >> 24), (uint8_t)(payload.length() >> 16),
+        (uint8_t)(payload.length() >> 8), (uint8_t)payload.length()
+    };
+
+    size_t written = writer->write(header, LOGRECORDHEADERSIZE);
+    written += writer->write((const uint8_t*)name.c_str(), name.length());
+    written += writer->write(payload.data(), payload.length());
+
+    if (written != recordSize) {
+        // A torn record would hide the next ones: continue in a new segment.
+        log_e("Offline log write failed.");
+        openSegment(segments.back().number + 1);
+        return false;
+    }
+
+    writeOffset += recordSize;
+    segments.back().liveRecords++;
+    segment = segments.back().number;
+    dirty = true;
+    return true;
+}
+
+void OfflineLog::replay(uint16_t sessionId, LogPosition from, const std::map<uint32_t, uint16_t>& sessionSegments,
+                        std::function<void(uint8_t qos, PublishMqttMessage& msg)> onMessage){
+    if (!ready) return;
+
+    // Readers must see the buffered records.
+    sync(true);
+
+    for (auto const& [number, records] : sessionSegments) {
+        StorageFile* reader = storage->open(segmentPath(number), "r");
+        if (!reader) continue; // Dropped by rotation.
+
+        uint32_t offset = 0;
+        uint8_t header[LOGRECORDHEADERSIZE];
+
+        while (reader->read(header, LOGRECORDHEADERSIZE) == LOGRECORDHEADERSIZE) {
+            uint16_t recordSession = (header[0] << 8) | header[1];
+            uint8_t qos = header[2];
+            uint16_t topicLength = (header[3] << 8) | header[4];
+            uint32_t payloadLength = ((uint32_t)header[5] << 24) | ((uint32_t)header[6] << 16) |
+                                     ((uint32_t)header[7] << 8) | header[8];
+            uint32_t next = offset + LOGRECORDHEADERSIZE + topicLength + payloadLength;
+
+            bool pending = number > from.segment || (number == from.segment && offset >= from.offset);
+            if (recordSession == sessionId && pending) {
+                String name;
+                MqttBytes payload;
+                if (!readField(reader, topicLength, name) || !readField(reader, payloadLength, payload)) {
+                    break;
+                }
+                PublishMqttMessage msg(qos << 1, MqttTocpic(name, payload, qos));
+                onMessage(qos, msg);
+            } else if (!reader->seek(next)) {
+                break;
+            }
+            offset = next;
+        }
+        delete reader;
+    }
+}
+
+void OfflineLog::release(uint32_t segment, uint16_t records){
+    for (Segment& s : segments) {
+        if (s.number == segment) {
+            s.liveRecords -= min((uint32_t)records, s.liveRecords);
+            break;
+        }
+    }
+    collect();
+}
+
+void OfflineLog::collect(){
+    // The segment being written is kept.
+    while (segments.size() > 1 && segments.front().liveRecords == 0) {
+        storage->remove(segmentPath(segments.front().number));
+        segments.pop_front();
+    }
+}
+
+void OfflineLog::sync(bool force){
+    if (!dirty || !writer) return;
+
+    if (force || (millis() - lastSync) >= OFFLINELOGSYNCMS) {
+        writer->flush();
+        dirty = false;
+        lastSync = millis();
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef OFFLINE_LOG_H
+#define OFFLINE_LOG_H
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <functional>
+#include "Storage/FileStorage.h"
+#include "MqttMessages/PublishMqttMessage.h"
+
+// Offline message log of the persistent sessions (FileStorage): directory, size of
+// a segment file, max number of segments kept (the oldest is dropped when full),
+// and max delay before buffered records are flushed to flash.
+#define OFFLINELOGDIR "/mqttlog"
+#define OFFLINELOGSEGMENTSIZE (16 * 1024)
+#define OFFLINELOGMAXSEGMENTS 8
+#define OFFLINELOGSYNCMS 500
+
+namespace mqttBrokerName{
+
+/** @brief Position in the `OfflineLog`: segment number and byte offset. */
+struct LogPosition {
+    uint32_t segment;
+    uint32_t offset;
+};
+
+/**
+ * @brief Append-only log of the QoS 1/2 publishes missed by offline persistent sessions.
+ * * Records are appended to the newest segment file of OFFLINELOGDIR, so writes are
+ * sequential and buffered: they are flushed every OFFLINELOGSYNCMS by `sync` instead 
+ * of on each publish. A segment is rotated once it reaches OFFLINELOGSEGMENTSIZE, 
+ * and deleted when all its records were replayed (or when more than 
+ * OFFLINELOGMAXSEGMENTS exist, losing the oldest messages).
+ * * Record layout: session id (2) | qos (1) | topic length (2) | payload length (4) | topic | payload.
+ * * @note Not thread-safe, the Broker guards it with `sessionMutex`.
+ */
+class OfflineLog {
+private:
+    struct Segment {
+        uint32_t number;
+        uint32_t liveRecords;
+    };
+
+    /** @brief Existing segments, oldest first. The last one is being written. */
+    std::deque<Segment> segments;
+
+    FileStorage* storage = nullptr;
+    StorageFile* writer = nullptr;
+    uint32_t writeOffset = 0;
+    bool ready = false;
+    bool dirty = false;
+    unsigned long lastSync = 0;
+
+    String segmentPath(uint32_t number);
+
+    /** @brief Closes the current segment and starts writing `number`, dropping the oldest ones if needed. */
+    void openSegment(uint32_t number);
+
+    /** @brief Deletes the oldest segments without live records. */
+    void collect();
+
+public:
+    ~OfflineLog();
+
+    /**
+     * @brief Mounts the storage and starts an empty log (records of a previous boot are removed).
+     * @param storage Where the segments are written, owned by the Broker.
+     * @return false if the storage could not be mounted: offline messages are then dropped.
+     */
+    bool begin(FileStorage* storage);
+
+    bool isReady(){
+        return ready;
+    }
+
+    /** @brief Position of the next record. */
+    LogPosition end();
+
+    /**
+     * @brief Appends a publish for an offline session.
+     * 
+     * @param sessionId Session the message is queued for.
+     * @param qos QoS granted to that delivery.
+     * @param msg The message, not modified.
+     * @param segment Output, the segment where the record was written.
+     * @return false if the record could not be written.
+     */
+    bool append(uint16_t sessionId, uint8_t qos, PublishMqttMessage* msg, uint32_t& segment);
+
+    /**
+     * @brief Reads back, in order, the records of a session.
+     * 
+     * @param sessionId Session to replay.
+     * @param from Records before this position were already replayed.
+     * @param sessionSegments Segments holding records of the session.
+     * @param onMessage Called with each message and its QoS.
+     */
+    void replay(uint16_t sessionId, LogPosition from, const std::map<uint32_t, uint16_t>& sessionSegments,
+                std::function<void(uint8_t qos, PublishMqttMessage& msg)> onMessage);
+
+    /** @brief Marks records of a segment as consumed, segments without live records are deleted. */
+    void release(uint32_t segment, uint16_t records);
+
+    /**
+     * @brief Flushes the buffered records (batched fsync).
+     * @param force Flush now, even if OFFLINELOGSYNCMS has not elapsed.
+     */
+    void sync(bool force = false);
+};
+
+} // namespace mqttBrokerName
+
+#endif // OFFLINE_LOG_H
@@ -0,0 +1,250 @@
+#include "MqttBroker.h"
+
+using namespace mqttBrokerName;
+
+// "MQS" + format version.
+static const uint8_t SNAPSHOTMAGIC[4] = {'M', 'Q', 'S', 1};
+
+// Smallest retained message record: qos (1) | topic length (2) | payload length (4).
+#define SNAPSHOTRETAINEDHEADERSIZE 7
+
+/*
+ * Layout, big endian:
+ *   magic (4) | session count (2)
+ *   per session: id (2) | identifier length (2) | identifier | filter count (2)
+ *                per filter: qos (1) | length (2) | filter
+ *   retained count (2)
+ *   per message: qos (1) | topic length (2) | payload length (4) | topic | payload
+ */
+
+static void putU8(std::vector<uint8_t>& image, uint8_t value){
+    image.push_back(value);
+}
+
+static void putU16(std::vector<uint8_t>& image, uint16_t value){
+    image.push_back(value >> 8);
+    image.push_back(value);
+}
+
+static void putU32(std::vector<uint8_t>& image, uint32_t value){
+    putU16(image, value >> 16);
+    putU16(image, value);
+}
+
+static void putBytes(std::vector<uint8_t>& image, const String& bytes){
+    image.insert(image.end(), (const uint8_t*)bytes.c_str(), (const uint8_t*)bytes.c_str() + bytes.length());
+}
+
+static void putBytes(std::vector<uint8_t>& image, const MqttBytes& bytes){
+    image.insert(image.end(), bytes.data(), bytes.data() + bytes.length());
+}
+
+/**
+ * @brief Bounds-checked cursor over the snapshot image, `ok` turns false on overrun.
+ */
+struct SnapshotReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+
+    bool has(size_t n){
+        ok = ok && (size - pos >= n);
+        return ok;
+    }
+
+    uint8_t u8(){
+        return has(1) ? data[pos++] : 0;
+    }
+
+    uint16_t u16(){
+        if (!has(2)) return 0;
+        uint16_t value = (data[pos] << 8) | data[pos + 1];
+        pos += 2;
+        return value;
+    }
+
+    uint32_t u32(){
+        uint32_t high = u16();
+        return (high << 16) | u16();
+    }
+
+    String bytes(size_t n){
+        String value;
+        if (has(n)) {
+            value.concat((const char*)data + pos, n);
+            pos += n;
+        }
+        return value;
+    }
+
+    MqttBytes payload(size_t n){
+        MqttBytes value;
+        if (has(n)) {
+            value = MqttBytes(data + pos, n);
+            pos += n;
+        }
+        return value;
+    }
+};
+
+struct SnapshotSession {
+    uint16_t id;
+    String clientIdentifier;
+    std::map<String, uint8_t> subscriptions;
+};
+
+bool MqttBroker::loadSnapshot() {
+    if (!storage->begin()) {
+        log_w("File storage not mounted, broker state won't survive a reset.");
+        return false;
+    }
+    snapshotReady = true;
+
+    StorageFile* file = storage->open(SNAPSHOTPATH, "r");
+    if (file == nullptr) return true; // First boot.
+
+    // One read, then parsed in RAM.
+    std::vector<uint8_t> image(file->size());
+    size_t read = file->read(image.data(), image.size());
+    delete file;
+
+    SnapshotReader reader{image.data(), read};
+    if (!reader.has(sizeof(SNAPSHOTMAGIC)) || memcmp(image.data(), SNAPSHOTMAGIC, sizeof(SNAPSHOTMAGIC)) != 0) {
+        log_w("Unknown snapshot format, ignored.");
+        return true;
+    }
+    reader.pos = sizeof(SNAPSHOTMAGIC);
+
+    // 1. Parse everything first: a truncated snapshot restores nothing.
+    // Counts are checked before allocating, a corrupted one must not exhaust the heap.
+    uint16_t numSessions = reader.u16();
+    if (numSessions > MAXNUMSESSIONS) reader.ok = false;
+
+    std::vector<SnapshotSession> parsedSessions(reader.ok ? numSessions : 0);
+    for (SnapshotSession& session : parsedSessions) {
+        session.id = reader.u16();
+        session.clientIdentifier = reader.bytes(reader.u16());
+
+        uint16_t numFilters = reader.u16();
+        for (uint16_t i = 0; i < numFilters && reader.ok; i++) {
+            uint8_t qos = reader.u8();
+            session.subscriptions[reader.bytes(reader.u16())] = qos;
+        }
+    }
+
+    uint16_t numRetained = reader.u16();
+    std::vector<RetainedMessage> retained(reader.has(numRetained * SNAPSHOTRETAINEDHEADERSIZE) ? numRetained : 0);
+    for (RetainedMessage& message : retained) {
+        message.qos = reader.u8();
+        uint16_t topicLength = reader.u16();
+        uint32_t payloadLength = reader.u32();
+        message.topic = reader.bytes(topicLength);
+        message.payload = reader.payload(payloadLength);
+    }
+
+    if (!reader.ok) {
+        log_w("Corrupted snapshot, ignored.");
+        return true;
+    }
+
+    // 2. Rebuild the state, workers and listeners are not started yet: no lock needed.
+    for (const SnapshotSession& parsed : parsedSessions) {
+        if (parsed.id == 0 || sessionsById.count(parsed.id)) continue;
+
+        MqttSession* session = new MqttSession;
+        session->clientIdentifier = parsed.clientIdentifier;
+        session->id = parsed.id;
+        // Client ids are positive, a restored session can't collide with a new client.
+        session->subscriberKey = -(int)parsed.id;
+        session->owner = ClientHandle::invalid();
+        session->online = false;
+        session->replayFrom = offlineLog.end();
+        session->subscriptions = parsed.subscriptions;
+
+        for (auto const& [filter, qos] : parsed.subscriptions) {
+            NodeTrie* node = topicTrie->subscribeSession(filter, session->subscriberKey, session->id, qos);
+            if (node != nullptr) {
+                session->nodes.push_back(node);
+            }
+        }
+
+        sessions[session->clientIdentifier] = session;
+        sessionsById[session->id] = session;
+        nextSessionId = max(nextSessionId, (uint16_t)(session->id + 1));
+    }
+
+    for (const RetainedMessage& message : retained) {
+        retainedMessages.store(message.topic, message.payload, message.qos);
+    }
+
+    log_i("Snapshot restored: %u sessions, %u retained messages.", (unsigned)sessions.size(), (unsigned)retainedMessages.size());
+    return true;
+}
+
+void MqttBroker::saveSnapshot() {
+    std::vector<uint8_t> image(SNAPSHOTMAGIC, SNAPSHOTMAGIC + sizeof(SNAPSHOTMAGIC));
+    std::vector<RetainedMessage> retained;
+
+    // 1. Serialize under the locks, the flash write happens without them.
+    if (xSemaphoreTake(sessionMutex, portMAX_DELAY) != pdTRUE) return;
+    if (xSemaphoreTake(topicTrieMutex, portMAX_DELAY) != pdTRUE) {
+        xSemaphoreGive(sessionMutex);
+        return;
+    }
+
+    // Changes made from now on go to the next snapshot.
+    snapshotDirty = false;
+
+    putU16(image, sessions.size());
+    for (auto const& [clientIdentifier, session] : sessions) {
+        putU16(image, session->id);
+        putU16(image, clientIdentifier.length());
+        putBytes(image, clientIdentifier);
+        putU16(image, session->subscriptions.size());
+        for (auto const& [filter, qos] : session->subscriptions) {
+            putU8(image, qos);
+            putU16(image, filter.length());
+            putBytes(image, filter);
+        }
+    }
+    retainedMessages.copyAll(retained);
+
+    xSemaphoreGive(topicTrieMutex);
+    xSemaphoreGive(sessionMutex);
+
+    // The "$SYS" statistics are republished after a restart, stale ones are not restored.
+    retained.erase(std::remove_if(retained.begin(), retained.end(), [](const RetainedMessage& message) {
+        return message.topic.startsWith("$");
+    }), retained.end());
+
+    putU16(image, retained.size());
+    for (const RetainedMessage& message : retained) {
+        putU8(image, message.qos);
+        putU16(image, message.topic.length());
+        putU32(image, message.payload.length());
+        putBytes(image, message.topic);
+        putBytes(image, message.payload);
+    }
+
+    // 2. Write aside, then replace: a reset in between keeps the previous snapshot.
+    StorageFile* file = storage->open(SNAPSHOTTMPPATH, "w");
+    size_t written = file ? file->write(image.data(), image.size()) : 0;
+    delete file;
+
+    if (written != image.size() || !storage->rename(SNAPSHOTTMPPATH, SNAPSHOTPATH)) {
+        log_e("Snapshot write failed.");
+        snapshotDirty = true; // Retried on the next interval.
+        return;
+    }
+    log_v("Snapshot written, %u bytes.", (unsigned)image.size());
+}
+
+void MqttBroker::checkSnapshot() {
+    if (!snapshotReady || snapshotInterval == 0 || !snapshotDirty) return;
+
+    if ((millis() - lastSnapshot) >= snapshotInterval) {
+        saveSnapshot();
+        lastSnapshot = millis();
+    }
+}
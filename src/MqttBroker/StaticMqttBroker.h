@@ -0,0 +1,47 @@
+#ifndef STATIC_MQTT_BROKER_H
+#define STATIC_MQTT_BROKER_H
+
+#include "MqttBroker.h"
+
+namespace mqttBrokerName{
+
+/**
+ * @brief A `MqttBroker` with its capacity fixed at compile time, for targets where 
+ * nothing may be allocated after boot, e.g. 
+ * `StaticMqttBroker<16, 64, 1024, 4096, 32> broker(new TcpServerListener(1883));`.
+ * * Everything is allocated by `startBroker()` (see `MqttBroker::setCapacity()`), and 
+ * `getSteadyStateAllocations()` checks the steady-state path when built with 
+ * MQTTBROKER_COUNT_ALLOCATIONS.
+ * 
+ * @tparam MaxClients Client slots.
+ * @tparam MaxSubscriptions Trie subscriptions, client, session and local ones.
+ * @tparam MaxPacketSize Largest packet accepted from a client.
+ * @tparam OutboxBytes Outbox of each client.
+ * @tparam EventQueueDepth Event queue of each worker.
+ * @tparam MessageBuffers Publishes being routed or in flight, see `BrokerCapacity`.
+ */
+template<uint16_t MaxClients, uint16_t MaxSubscriptions, uint32_t MaxPacketSize, 
+         uint32_t OutboxBytes, uint16_t EventQueueDepth = EVENTQUEUESIZE, uint16_t MessageBuffers = 0>
+class StaticMqttBroker : public MqttBroker {
+    static_assert(MaxClients > 0 && MaxClients < UINT16_MAX - 1, "MaxClients must fit the client table");
+    static_assert(MaxSubscriptions > 0, "MaxSubscriptions must be positive");
+    static_assert(MaxPacketSize >= 128, "MaxPacketSize must hold a CONNECT");
+    static_assert(OutboxBytes >= MaxPacketSize, "OutboxBytes must hold the largest packet");
+    static_assert(EventQueueDepth > 0, "EventQueueDepth must be positive");
+
+public:
+    StaticMqttBroker(ServerListener* listener) : MqttBroker(listener) {
+        BrokerCapacity capacity;
+        capacity.maxClients = MaxClients;
+        capacity.maxSubscriptions = MaxSubscriptions;
+        capacity.maxPacketSize = MaxPacketSize;
+        capacity.outboxBytes = OutboxBytes;
+        capacity.eventQueueDepth = EventQueueDepth;
+        capacity.messageBuffers = MessageBuffers;
+        setCapacity(capacity);
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // STATIC_MQTT_BROKER_H
@@ -0,0 +1,101 @@
+#include "MqttBroker.h"
+
+using namespace mqttBrokerName;
+
+BrokerTraffic MqttBroker::getTraffic() {
+    BrokerTraffic total;
+    for (CoreTrafficCounters& counters : traffic) {
+        total.bytesReceived += counters.bytesReceived.load(std::memory_order_relaxed);
+        total.bytesSent += counters.bytesSent.load(std::memory_order_relaxed);
+        total.messagesReceived += counters.messagesReceived.load(std::memory_order_relaxed);
+        total.publishesDropped += counters.publishesDropped.load(std::memory_order_relaxed);
+        total.outboxDrops += counters.outboxDrops.load(std::memory_order_relaxed);
+    }
+
+    // Deliveries are already counted by each worker.
+    for (BrokerShard* shard : shards) {
+        total.messagesSent += shard->stats.messagesDelivered + shard->stats.localDeliveries;
+    }
+    return total;
+}
+
+static String perSecond(uint32_t count, uint32_t elapsedMs) {
+    return String((unsigned long)((uint64_t)count * 1000 / max(elapsedMs, (uint32_t)1)));
+}
+
+void MqttBroker::checkSysTopics() {
+    if (sysInterval == 0 || shards.empty()) return;
+
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastSysPublish;
+    if (elapsed < sysInterval) return;
+    lastSysPublish = now;
+
+    // Differences of the wrapping counters, right across a wrap.
+    BrokerTraffic current = getTraffic();
+    uint32_t bytesReceived = current.bytesReceived - sysTraffic.bytesReceived;
+    uint32_t bytesSent = current.bytesSent - sysTraffic.bytesSent;
+    uint32_t messagesReceived = current.messagesReceived - sysTraffic.messagesReceived;
+    uint32_t messagesSent = current.messagesSent - sysTraffic.messagesSent;
+    sysTraffic = current;
+
+    sysBytesReceived += bytesReceived;
+    sysBytesSent += bytesSent;
+    sysMessagesReceived += messagesReceived;
+    sysMessagesSent += messagesSent;
+
+    uint16_t tableSize = clients.size();
+    uint16_t pending = pendingClients;
+
+    publishSys("uptime", String((unsigned long)((now - startTime) / 1000)) + " seconds");
+    publishSys("clients/connected", String((unsigned)(tableSize > pending ? tableSize - pending : 0)));
+    publishSys("messages/received", String((unsigned long long)sysMessagesReceived));
+    publishSys("messages/sent", String((unsigned long long)sysMessagesSent));
+    publishSys("load/messages/received", perSecond(messagesReceived, elapsed));
+    publishSys("load/messages/sent", perSecond(messagesSent, elapsed));
+    publishSys("bytes/received", String((unsigned long long)sysBytesReceived));
+    publishSys("bytes/sent", String((unsigned long long)sysBytesSent));
+    publishSys("load/bytes/received", perSecond(bytesReceived, elapsed));
+    publishSys("load/bytes/sent", perSecond(bytesSent, elapsed));
+    publishSys("publish/messages/dropped", String((unsigned long)current.publishesDropped));
+    publishSys("outbox/dropped", String((unsigned long)current.outboxDrops));
+
+    for (BrokerShard* shard : shards) {
+        String worker = "workers/" + String((unsigned)shard->id);
+        publishSys((worker + "/queue/depth").c_str(), String((unsigned)uxQueueMessagesWaiting(shard->eventQueue)));
+        publishSys((worker + "/queue/max").c_str(), String((unsigned)shard->stats.eventQueueHighWater));
+    }
+
+    publishSys("heap/free", String((unsigned long)ESP.getFreeHeap()));
+    publishSys("heap/min_free", String((unsigned long)ESP.getMinFreeHeap()));
+
+#if MQTTBROKER_LATENCY_HISTOGRAMS
+    // Latencies of the interval: the difference with the histograms of the previous publish.
+    for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++) {
+        LatencyHistogram total = latency.get((LatencyStage)stage);
+        LatencyHistogram interval;
+        String buckets;
+        for (uint8_t i = 0; i < LATENCYBUCKETS; i++) {
+            interval.buckets[i] = total.buckets[i] - sysLatency[stage].buckets[i];
+            interval.count += interval.buckets[i];
+            if (i > 0) buckets += ',';
+            buckets += String((unsigned long)interval.buckets[i]);
+        }
+        sysLatency[stage] = total;
+
+        String name = String("latency/") + LatencyRecorder::stageName((LatencyStage)stage);
+        publishSys((name + "/histogram").c_str(), buckets);
+        publishSys((name + "/p50").c_str(), String((unsigned long)interval.percentile(50)));
+        publishSys((name + "/p99").c_str(), String((unsigned long)interval.percentile(99)));
+    }
+#endif
+}
+
+void MqttBroker::publishSys(const char* name, const String& value) {
+    String topic = "$SYS/broker/";
+    topic += name;
+    PublishMqttMessage* msg = new PublishMqttMessage(0x01, MqttTocpic(topic, MqttBytes(value), 0));
+
+    // Routed right away by the calling (first) Worker: never dropped on its own full queue.
+    _publishMessageImpl(msg, shards[0]);
+}
@@ -0,0 +1,103 @@
+#ifndef SYS_TOPICS_H
+#define SYS_TOPICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "WrapperFreeRTOS.h"
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Per-worker counters, written only by the worker that owns the shard.
+ */
+struct BrokerShardStats {
+    /** @brief Events consumed from the shard event queue. */
+    uint32_t eventsProcessed = 0;
+
+    /** @brief Publishes routed against the Trie by this worker. */
+    uint32_t publishesRouted = 0;
+
+    /** @brief Publish packets written to the outboxes of this shard's clients. */
+    uint32_t messagesDelivered = 0;
+
+    /** @brief Local subscription callbacks invoked by this worker. */
+    uint32_t localDeliveries = 0;
+
+    /** @brief Deliver events handed over to other workers. */
+    uint32_t remoteDeliveries = 0;
+
+    /** @brief Deliver events dropped because the target worker queue was full. */
+    uint32_t eventsDropped = 0;
+
+    /** @brief Clients of this shard deleted by this worker. */
+    uint32_t clientsDeleted = 0;
+
+    /** @brief Keep-alive deadlines checked by this worker (timed out or rescheduled). */
+    uint32_t keepAliveChecks = 0;
+
+    /** @brief Clients of this shard closed because no CONNECT came in time. */
+    uint32_t handshakeTimeouts = 0;
+
+    /** @brief Publishes appended to the offline log for disconnected persistent sessions. */
+    uint32_t messagesLogged = 0;
+
+    /** @brief Max number of events seen waiting in the shard event queue. */
+    UBaseType_t eventQueueHighWater = 0;
+};
+
+/**
+ * @brief Traffic counters of one core, see `MqttBroker::getTraffic()`.
+ * * Incremented by the network threads and the workers running on that core with 
+ * relaxed atomics: no lock, and no cache line shared with the other core.
+ */
+struct alignas(64) CoreTrafficCounters {
+    std::atomic<uint32_t> bytesReceived{0};
+    std::atomic<uint32_t> bytesSent{0};
+    std::atomic<uint32_t> messagesReceived{0};
+    std::atomic<uint32_t> publishesDropped{0};
+    std::atomic<uint32_t> outboxDrops{0};
+
+    static void add(std::atomic<uint32_t>& counter, uint32_t value = 1) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Traffic since the broker started, see `MqttBroker::getTraffic()`. 
+ * The counters wrap around at 2^32.
+ */
+struct BrokerTraffic {
+    /** @brief Bytes read from and written to the client transports. */
+    uint32_t bytesReceived = 0;
+    uint32_t bytesSent = 0;
+
+    /** @brief PUBLISH received from the clients and the application. */
+    uint32_t messagesReceived = 0;
+
+    /** @brief Messages delivered to the subscribers, clients and local callbacks. */
+    uint32_t messagesSent = 0;
+
+    /** @brief Publishes dropped before routing: worker queue full or no room to track them. */
+    uint32_t publishesDropped = 0;
+
+    /** @brief Packets dropped because the outbox of their client was full. */
+    uint32_t outboxDrops = 0;
+};
+
+/**
+ * @brief Memory used by the connected clients, see `MqttBroker::getClientMemoryReport()`.
+ */
+struct ClientMemoryReport {
+    /** @brief Clients in the client table, pending handshakes included. */
+    uint16_t clients = 0;
+
+    /** @brief Sum of `MqttClient::memoryUsage()`: objects, transports, queues and packets. */
+    size_t bytes = 0;
+
+    /** @brief Bytes of the client using the most memory. */
+    size_t largest = 0;
+};
+
+} // namespace mqttBrokerName
+
+#endif // SYS_TOPICS_H
@@ -0,0 +1,18 @@
+#include "ByteRing.h"
+#include <string.h>
+
+using namespace mqttBrokerName;
+
+bool ByteRing::write(const uint8_t* data, uint32_t len) {
+    if (len > capacity - count) {
+        return false;
+    }
+
+    // Up to the end of the buffer, then the rest from its start.
+    uint32_t tail = (head + count) % capacity;
+    uint32_t first = min(len, capacity - tail);
+    memcpy(buffer + tail, data, first);
+    memcpy(buffer, data + first, len - first);
+    count += len;
+    return true;
+}
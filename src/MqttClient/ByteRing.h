@@ -0,0 +1,72 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <Arduino.h>
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Byte ring over a caller-provided buffer: the outbox of a `StaticMqttBroker` 
+ * client, where packets are stored back to back instead of one heap block each, and
+ * the records a `TlsTransport` could not write yet.
+ * * A packet may leave in several writes (TCP, WebSocket and TLS are streams), so the 
+ * ring only tracks bytes, never packet boundaries.
+ * @note Not thread-safe, guarded by the mutex of its owner (client or TLS transport).
+ */
+class ByteRing {
+private:
+    uint8_t* buffer = nullptr;
+    uint32_t capacity = 0;
+    uint32_t head = 0;
+    uint32_t count = 0;
+
+public:
+    /** @brief Uses `size` bytes at `buffer`, not owned. Only valid while the ring is empty. */
+    void setBuffer(uint8_t* buffer, uint32_t size) {
+        this->buffer = buffer;
+        this->capacity = size;
+        head = count = 0;
+    }
+
+    /** @brief true once a buffer is set. */
+    bool enabled() const {
+        return buffer != nullptr;
+    }
+
+    /**
+     * @brief Appends the whole data, or nothing.
+     * @return false if there is not enough room.
+     */
+    bool write(const uint8_t* data, uint32_t len);
+
+    /**
+     * @brief Oldest bytes, without consuming them.
+     * @param contiguous Output, bytes readable at the returned pointer (up to the end of the buffer).
+     */
+    const uint8_t* peek(uint32_t& contiguous) const {
+        contiguous = min(count, capacity - head);
+        return buffer + head;
+    }
+
+    /** @brief Drops the `len` oldest bytes, once they are sent. */
+    void consume(uint32_t len) {
+        head = (head + len) % capacity;
+        count -= len;
+        if (count == 0) head = 0;
+    }
+
+    uint32_t size() const { return count; }
+
+    /** @brief Bytes that can still be written. */
+    uint32_t available() const { return capacity - count; }
+
+    bool empty() const { return count == 0; }
+
+    void clear() { head = count = 0; }
+
+    uint32_t capacityBytes() const { return capacity; }
+};
+
+} // namespace mqttBrokerName
+
+#endif // BYTE_RING_H
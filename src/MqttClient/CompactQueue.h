@@ -0,0 +1,155 @@
+#ifndef COMPACT_QUEUE_H
+#define COMPACT_QUEUE_H
+
+#include <Arduino.h>
+#include <utility>
+
+// First capacity of a client queue (outbox, in-flight window...), allocated on 
+// the first packet queued and doubled when full. An emptied queue keeps at most
+// this capacity.
+#define COMPACTQUEUEMINCAPACITY 4
+
+namespace mqttBrokerName{
+
+/**
+ * @brief FIFO queue of a client (outbox, in-flight window...), stored in a ring buffer.
+ * * An idle client owns several empty queues: unlike `std::deque`, which allocates
+ * its map and a 512 byte block on construction, nothing is allocated until the 
+ * first item is pushed, and a buffer grown by a burst is released once drained.
+ * Items are moved when the buffer grows, removed slots are reset to `T()`.
+ * A `StaticMqttBroker` client gives its queues fixed storage instead (`setStorage`).
+ * @note Not thread-safe, guarded by the mutex of the owner client.
+ */
+template<typename T>
+class CompactQueue {
+private:
+    T* items = nullptr;
+    uint16_t capacity = 0;
+    uint16_t head = 0;
+    uint16_t count = 0;
+
+    /** @brief `items` is the storage of `setStorage`: never grown nor freed. */
+    bool fixed = false;
+
+    bool grow() {
+        if (fixed || capacity > UINT16_MAX / 2) return false;
+
+        uint16_t newCapacity = capacity ? capacity * 2 : COMPACTQUEUEMINCAPACITY;
+        T* newItems = new T[newCapacity];
+        for (uint16_t i = 0; i < count; i++) {
+            newItems[i] = std::move((*this)[i]);
+        }
+        delete[] items;
+        items = newItems;
+        capacity = newCapacity;
+        head = 0;
+        return true;
+    }
+
+    void onEmptied() {
+        head = 0;
+        if (!fixed && capacity > COMPACTQUEUEMINCAPACITY) clear();
+    }
+
+public:
+    CompactQueue() {}
+
+    ~CompactQueue() {
+        clear();
+    }
+
+    /**
+     * @brief Stores the items in `capacity` slots at `storage`, not owned, instead of
+     * allocating: a full queue refuses items. Only valid while the queue is empty.
+     */
+    void setStorage(T* storage, uint16_t capacity) {
+        clear();
+        items = storage;
+        this->capacity = capacity;
+        fixed = true;
+    }
+
+    CompactQueue(const CompactQueue&) = delete;
+    CompactQueue& operator=(const CompactQueue&) = delete;
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    uint16_t size() const {
+        return count;
+    }
+
+    /** @brief Item at a position, 0 being the front. */
+    T& operator[](uint16_t index) {
+        return items[(head + index) % capacity];
+    }
+
+    T& front() {
+        return items[head];
+    }
+
+    T& back() {
+        return (*this)[count - 1];
+    }
+
+    /**
+     * @brief Appends an item.
+     * @return false if the queue can't grow anymore, the item is not added.
+     */
+    bool push_back(T item) {
+        if (count == capacity && !grow()) return false;
+        (*this)[count] = std::move(item);
+        count++;
+        return true;
+    }
+
+    /**
+     * @brief Inserts an item before the front.
+     * @return false if the queue can't grow anymore, the item is not added.
+     */
+    bool push_front(T item) {
+        if (count == capacity && !grow()) return false;
+        head = (head + capacity - 1) % capacity;
+        items[head] = std::move(item);
+        count++;
+        return true;
+    }
+
+    void pop_front() {
+        items[head] = T();
+        head = (head + 1) % capacity;
+        if (--count == 0) onEmptied();
+    }
+
+    /** @brief Removes the item at a position, the next ones move up. */
+    void erase(uint16_t index) {
+        for (uint16_t i = index; i + 1 < count; i++) {
+            (*this)[i] = std::move((*this)[i + 1]);
+        }
+        back() = T();
+        if (--count == 0) onEmptied();
+    }
+
+    /** @brief Removes every item and frees the buffer (fixed storage is kept). */
+    void clear() {
+        if (fixed) {
+            while (count > 0) pop_front();
+            return;
+        }
+        delete[] items;
+        items = nullptr;
+        capacity = 0;
+        head = 0;
+        count = 0;
+    }
+
+    /** @brief Size of the buffer, without what the items point to. */
+    size_t capacityBytes() const {
+        return capacity * sizeof(T);
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // COMPACT_QUEUE_H
@@ -0,0 +1,30 @@
+#ifndef INFLIGHT_MESSAGE_H
+#define INFLIGHT_MESSAGE_H
+
+#include <Arduino.h>
+#include "MqttMessages/MqttBytes.h"
+
+namespace mqttBrokerName{
+
+/**
+ * @brief A QoS 1/2 publish sent (or waiting to be sent) to a client, until its 
+ * PUBACK (QoS 1) or PUBREC (QoS 2).
+ * * Its topic and payload are shared with the routed message (and with the other
+ * subscribers), the packet is written to the outbox when it is sent. A 
+ * retransmission only sets the DUP flag of `header`. After a reconnection it may 
+ * also be a PUBREL to resend, without topic nor payload.
+ */
+struct InflightMessage {
+    uint16_t packetId;
+    uint8_t qos;
+
+    /** @brief First byte of the packet: PUBLISH and its flags, or PUBREL. */
+    uint8_t header;
+
+    MqttBytes topic;
+    MqttBytes payload;
+};
+
+} // namespace mqttBrokerName
+
+#endif // INFLIGHT_MESSAGE_H
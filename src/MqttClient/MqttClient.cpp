@@ -3,23 +3,17 @@
 
 using namespace mqttBrokerName;
 
+FactoryMqttMessages MqttClient::messagesFactory;
+
 // --- DESTRUCTOR ---
 MqttClient::~MqttClient(){
     log_v("Client %i destructor called.", this->clientId);
 
     // 1. Unsubscribe from all topics in the Trie to prevent dangling pointers.
-    for(int i = 0; i < nodesToFree.size(); i++){
-        nodesToFree[i]->unSubscribeMqttClient(this);
-    }  
-    nodesToFree.clear();
-
-    // 2. Free the Packet Reader.
-    if (reader) {
-        delete reader;
-        reader = NULL;
-    }
+    // (Already done by the Broker under the Trie lock, unless the Broker itself is destroyed).
+    unsubscribeAll();
 
-    // 3. Free the Transport Interface.
+    // 2. Free the Transport Interface.
     // This action closes the underlying socket (TCP or WS) and releases its memory.
     if (transport) {
         transport->close();
@@ -27,88 +21,150 @@ MqttClient::~MqttClient(){
         transport = NULL;
     }
 
-    // Free the Outbox Mutex
-    if (_outboxMutex) {
-        vSemaphoreDelete(_outboxMutex);
+    // 3. Free publishes that never reached the Broker queue.
+    while (!_stalledPublishes.empty()) {
+        broker->deleteMessage(_stalledPublishes.front());
+        _stalledPublishes.pop_front();
+    }
+
+    if (_mutex) {
+        vSemaphoreDelete(_mutex);
     }
 }
 
 // --- CONSTRUCTOR ---
-MqttClient::MqttClient(MqttTransport* transport, int clientId, MqttBroker * broker, size_t outboxMaxSize) {
+MqttClient::MqttClient(MqttTransport* transport, int clientId, MqttBroker * broker, size_t outboxMaxSize)
+    : reader(onPacketReady, this) {
     this->transport = transport;
     this->clientId = clientId;
-    this->outboxMaxSize = outboxMaxSize;
+    this->outboxMaxSize = min(outboxMaxSize, (size_t)UINT16_MAX);
     this->broker = broker;
     this->_state = STATE_PENDING; // Start in Handshake mode
 
     this->keepAlive = 60; // Default value, will be updated by CONNECT packet
     this->lastAlive = millis();
-    this->action = NULL;
+    this->inflightWindowSize = broker->getInflightWindowSize();
+    this->subscriberKey = clientId;
 
     // Critical Failure Check:
-    _outboxMutex = xSemaphoreCreateMutex();
-    if (!_outboxMutex) {
-        log_e("Failed to create outboxMutex"); ESP.restart();
+    _mutex = xSemaphoreCreateRecursiveMutex();
+    if (!_mutex) {
+        log_e("Failed to create client mutex"); ESP.restart();
     }
 
-    // 1. Configure Reader Callback (State Machine Entry Point)
-    // The reader accumulates bytes and calls this lambda when a full packet is ready.
-    this->reader = new ReaderMqttPacket([this](){
-        log_v("Client %i: Mqtt Packet ready.", this->clientId);
-        
-        // Dispatch based on current lifecycle state
-        if (this->_state == STATE_PENDING) {
-             this->processOnConnectMqttPacket(); // Expecting CONNECT only
-        } else {
-             this->proccessOnMqttPacket(); // Expecting standard MQTT packets
-        }
-    });
+    // Bind network events (data, ready to send, disconnect) to this object.
+    this->transport->setListener(this);
+}
 
-    // 2. Configure Transport Callbacks (Network Layer Binding)
-    
-    // On Data Received: Feed the raw bytes into the Reader
-    this->transport->setOnData([this](uint8_t* data, size_t len) {
-        log_v("Client %i: Received %u bytes", this->clientId, len);
-        if(this->reader) {
-            this->reader->addData(data, len);
+void MqttClient::onPacketReady(void* context){
+    MqttClient* client = (MqttClient*)context;
+    log_v("Client %i: Mqtt Packet ready.", client->clientId);
+
+    // Dispatch based on current lifecycle state
+    if (client->_state == STATE_PENDING) {
+        client->processOnConnectMqttPacket(); // Expecting CONNECT only
+    } else {
+        client->proccessOnMqttPacket(); // Expecting standard MQTT packets
+    }
+}
+
+void MqttClient::useStaticBuffers(uint8_t* readerBuffer, uint32_t readerBytes, uint8_t* outbox, uint32_t outboxBytes,
+                                  InflightMessage* inflightSlots, uint16_t inflightSize, uint16_t pendingSize){
+    reader.setBuffer(readerBuffer, readerBytes);
+    _outboxRing.setBuffer(outbox, outboxBytes);
+    _inflight.setStorage(inflightSlots, inflightSize);
+    _pendingQos.setStorage(inflightSlots + inflightSize, pendingSize);
+}
+
+void MqttClient::onTransportData(uint8_t* data, size_t len){
+    log_v("Client %i: Received %u bytes", this->clientId, (unsigned)len);
+    AllocationScope steadyState(true);
+    CoreTrafficCounters::add(broker->trafficCounters().bytesReceived, len);
+    reader.addData(data, len);
+
+    // Over the preallocated buffer: the stream can't be parsed anymore.
+    if (reader.isPacketTooLarge()) {
+        log_w("Client %i: Packet too large. Disconnecting.", this->clientId);
+        disconnect();
+    }
+}
+
+void MqttClient::onTransportReadyToSend(){
+    AllocationScope steadyState(true);
+    _drainOutbox();
+}
+
+void MqttClient::onTransportDisconnect(){
+    log_i("Client %i disconnected (Transport closed).", this->clientId);
+    // We use the handle as the unique key for deletion
+    this->broker->queueClientForDeletion(this->handle);
+}
+
+size_t MqttClient::memoryUsage(){
+    size_t bytes = sizeof(MqttClient) + reader.memoryUsage() + clientIdentifier.length();
+    bytes += nodesToFree.capacityBytes();
+
+    if (xSemaphoreTakeRecursive(_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        bytes += _outbox.capacityBytes() + _outboxRing.capacityBytes() + _stalledPublishes.capacityBytes();
+        bytes += _inflight.capacityBytes() + _pendingQos.capacityBytes();
+        for (uint16_t i = 0; i < _outbox.size(); i++) {
+            bytes += _outbox[i].length();
+        }
+        // Topics and payloads are shared with the other subscribers: an upper bound.
+        for (uint16_t i = 0; i < _inflight.size(); i++) {
+            bytes += _inflight[i].topic.length() + _inflight[i].payload.length();
+        }
+        for (uint16_t i = 0; i < _pendingQos.size(); i++) {
+            bytes += _pendingQos[i].topic.length() + _pendingQos[i].payload.length();
         }
-    });
+        xSemaphoreGiveRecursive(_mutex);
+    }
 
-    // On Ready to Send: Attempt to drain the outbox
-    this->transport->setOnReadyToSend([this]() {
-            this->_drainOutbox();
-        });
+    if (transport) {
+        bytes += transport->memoryUsage();
+    }
+    return bytes;
+}
 
-    // On Disconnect: Notify Broker to schedule cleanup
-    this->transport->setOnDisconnect([this]() {
-        log_i("Client %i disconnected (Transport closed).", this->clientId);
-        // We use the transport pointer as the unique key for deletion
-        this->broker->queueClientForDeletion(this->transport);
-    });
+void MqttClient::unsubscribeAll(){
+    for(int i = 0; i < nodesToFree.size(); i++){
+        nodesToFree[i]->unSubscribeMqttClient(this);
+    }  
+    nodesToFree.clear();
 }
 
 // --- HANDSHAKE LOGIC ---
 
 void MqttClient::processOnConnectMqttPacket(){
-    uint8_t type = reader->getFixedHeader() >> 4;
+    // Control path: sessions and the client identifier are allocated here.
+    AllocationScope controlPath(false);
+    uint8_t type = reader.getFixedHeader() >> 4;
 
     if (type == CONNECT) {
-        ConnectMqttMessage connectMessage(*reader); 
+        ConnectMqttMessage connectMessage(reader); 
         
         if (!connectMessage.malFormedPacket()) {
             log_i("Client %i (%s): Handshake OK.", 
                   this->clientId, 
                   transport->getIP().c_str());
 
-            // Transition to Operational State
-            this->_state = STATE_CONNECTED;
             this->setKeepAlive(connectMessage.getKeepAlive());
             this->lastAlive = millis();
+            this->clientIdentifier = connectMessage.getClientId();
+            // The handshake deadline scheduled on accept moves on to the keep-alive one.
+            broker->handshakeDone(this);
+
+            // Clean Session = 0: create or resume the stored session.
+            bool sessionPresent = broker->attachSession(this, connectMessage.isCleanSession());
 
             // Send CONNACK to confirm connection
-            String ack = messagesFactory.getAceptedAckConnectMessage().buildMqttPacket();
+            String ack = messagesFactory.getAceptedAckConnectMessage(sessionPresent).buildMqttPacket();
             sendPacketByTcpConnection(ack);
 
+            // Send what the session kept: unacknowledged, then missed publishes. Then
+            // the client enters the Operational State, publishes may be routed to it.
+            broker->resumeSession(this);
+
         } else {
             log_w("Client %i: Malformed CONNECT.", this->clientId);
             disconnect();
@@ -125,30 +181,238 @@ void MqttClient::proccessOnMqttPacket(){
     // Reset Keep-Alive timer on any valid packet received
     lastAlive = millis(); 
 
+    // Subscriptions are control path, publishes, acknowledgments and pings are not.
+    uint8_t type = reader.getFixedHeader() >> 4;
+    AllocationScope scope(type != SUBSCRIBE && type != UNSUBSCRIBE);
+
     // Use Factory to create the specific Action (Publish, Subscribe, etc.)
     ActionFactory factory;
-    action = factory.getAction(this, *reader);
+    ActionStorage storage;
+    Action* action = factory.getAction(this, reader, storage);
     
     if (action) {
         action->doAction();
-        delete action;  
-        action = NULL;
+        action->~Action();
     }
 }
 
 
 void MqttClient::sendSubAck(SubscribeMqttMessage * subscribeMqttMessage) {
     uint16_t packetId = subscribeMqttMessage->getMessageId();
-    AckSubscriptionMqttMessage subAck = messagesFactory.getSubAckMessage(packetId);
+
+    // One return code per topic filter: the QoS granted by the Broker.
+    AckSubscriptionMqttMessage subAck = messagesFactory.getSubAckMessage(packetId, subscribeMqttMessage->getTopics(), MAXQOS);
     String packet = subAck.buildMqttPacket();
     sendPacketByTcpConnection(packet);
     
     log_v("Client %i: Sent SUBACK for PacketID %u", clientId, packetId);
 }
 
-void MqttClient::publishMessage(PublishMqttMessage* publishMessage){
-    // Serializes the message object into bytes and sends it
-    sendPacketByTcpConnection(publishMessage->buildMqttPacket());
+void MqttClient::sendPublishAck(uint8_t type, uint16_t packetId) {
+    uint8_t packet[AckPublishMqttMessage::PACKETSIZE];
+    messagesFactory.getAckPublishMessage(type, packetId).writePacket(packet);
+    PacketPart part = {packet, sizeof(packet)};
+    sendPacket(&part, 1);
+}
+
+void MqttClient::acknowledgePublish(uint8_t qos, uint16_t packetId) {
+    if (qos == 1) {
+        sendPublishAck(PUBACK, packetId);
+    } else if (qos == 2) {
+        if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+            if (!_qos2Received.insert(packetId)) {
+                // Only a retransmission could be routed twice.
+                log_w("Client %i: QoS 2 table full, PacketID %u not tracked.", clientId, packetId);
+            }
+            xSemaphoreGiveRecursive(_mutex);
+        }
+        sendPublishAck(PUBREC, packetId);
+    }
+}
+
+void MqttClient::publishMessage(PublishMqttMessage* publishMessage, uint8_t qos, bool retain){
+    // PUBLISH, DUP = 0, RETAIN = 0 when forwarded to an established subscription.
+    uint8_t header = (PUBLISH << 4) | (qos << 1) | (retain ? 0x01 : 0x00);
+    const MqttBytes& payload = publishMessage->getTopic().getPayLoad();
+
+    if (qos == 0) {
+        // Written straight from the message, nothing is kept.
+        sendPublish(header, 0, publishMessage->getTopicName(), payload);
+        return;
+    }
+
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        uint16_t packetId = _allocatePacketId();
+
+        // Topic and payload shared with the message, a retransmission sends them again.
+        if (_pendingQos.size() < outboxMaxSize &&
+            _pendingQos.push_back({packetId, qos, header, publishMessage->getTopicName(), payload})) {
+            _fillInflightWindow();
+        } else {
+            log_e("Client %i: QoS %u queue full! Dropping packet.", clientId, qos);
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+}
+
+uint16_t MqttClient::_allocatePacketId(){
+    // Ids restored from the session may still be in use: skipped, never reused.
+    for (uint32_t attempts = 0; attempts < UINT16_MAX; attempts++) {
+        uint16_t packetId = nextPacketId++;
+        // Packet id 0 is not allowed.
+        if (nextPacketId == 0) nextPacketId = 1;
+        if (!_packetIdInUse(packetId)) return packetId;
+    }
+    return nextPacketId;
+}
+
+bool MqttClient::_packetIdInUse(uint16_t packetId){
+    if (_qos2Released.contains(packetId)) return true;
+    for (uint16_t i = 0; i < _inflight.size(); i++) {
+        if (_inflight[i].packetId == packetId) return true;
+    }
+    for (uint16_t i = 0; i < _pendingQos.size(); i++) {
+        if (_pendingQos[i].packetId == packetId) return true;
+    }
+    return false;
+}
+
+void MqttClient::_fillInflightWindow(){
+    // FIFO: a publish never overtakes one waiting for the window.
+    // Released QoS 2 publishes keep their slot until PUBCOMP.
+    while (!_pendingQos.empty() && _inflight.size() + _qos2Released.size() < inflightWindowSize) {
+        _inflight.push_back(std::move(_pendingQos.front()));
+        _pendingQos.pop_front();
+        sendInflight(_inflight.back());
+    }
+}
+
+void MqttClient::sendInflight(const InflightMessage& message){
+    if ((message.header >> 4) == PUBLISH) {
+        sendPublish(message.header, message.packetId, message.topic, message.payload);
+    } else {
+        sendPublishAck(message.header >> 4, message.packetId);
+    }
+}
+
+uint16_t MqttClient::findInflight(uint16_t packetId, uint8_t type){
+    uint16_t index = 0;
+    while (index < _inflight.size() &&
+           (_inflight[index].packetId != packetId || (_inflight[index].header >> 4) != type)) {
+        index++;
+    }
+    return index;
+}
+
+void MqttClient::onPubAck(uint16_t packetId){
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        // PUBACKs may come in any order, the window is small enough for a linear search.
+        uint16_t index = findInflight(packetId, PUBLISH);
+        if (index < _inflight.size()) {
+            _inflight.erase(index);
+            _fillInflightWindow();
+        } else {
+            log_w("Client %i: PUBACK for unknown PacketID %u", clientId, packetId);
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+}
+
+void MqttClient::onPubRec(uint16_t packetId){
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        uint16_t index = findInflight(packetId, PUBLISH);
+        if (index < _inflight.size() && _inflight[index].qos == 2) {
+            // Received by the client: the packet is not needed anymore, only its id.
+            // The window is capped to PACKETIDSETSIZE, so there is always room.
+            _inflight.erase(index);
+            _qos2Released.insert(packetId);
+            sendPublishAck(PUBREL, packetId);
+        } else if (_qos2Released.contains(packetId)) {
+            // PUBREC sent again: our PUBREL was lost.
+            sendPublishAck(PUBREL, packetId);
+        } else {
+            log_w("Client %i: PUBREC for unknown PacketID %u", clientId, packetId);
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+}
+
+void MqttClient::onPubComp(uint16_t packetId){
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        // A PUBREL resent after a reconnection is tracked in `_inflight`.
+        uint16_t index = findInflight(packetId, PUBREL);
+
+        if (_qos2Released.erase(packetId)) {
+            _fillInflightWindow();
+        } else if (index < _inflight.size()) {
+            _inflight.erase(index);
+            _fillInflightWindow();
+        } else {
+            log_w("Client %i: PUBCOMP for unknown PacketID %u", clientId, packetId);
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+}
+
+void MqttClient::onPubRel(uint16_t packetId){
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        _qos2Received.erase(packetId);
+        xSemaphoreGiveRecursive(_mutex);
+    }
+
+    // Always completed, even if unknown (e.g. PUBREL resent after our PUBCOMP was lost).
+    sendPublishAck(PUBCOMP, packetId);
+}
+
+void MqttClient::restoreInflight(std::deque<InflightMessage>& messages){
+    if (messages.empty()) return;
+
+    log_i("Client %i: Resending %u unacknowledged messages.", clientId, (unsigned)messages.size());
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        // Normally restored before anything is routed here (see `MqttBroker::resumeSession`).
+        // Late ones, from a connection that was taken over, may meet an id in use: a
+        // publish gets a new one, a PUBREL can't be matched anymore.
+        for (auto it = messages.rbegin(); it != messages.rend(); ++it) {
+            if (_packetIdInUse(it->packetId)) {
+                if ((it->header >> 4) != PUBLISH) {
+                    log_w("Client %i: PacketID %u in use, PUBREL not resent.", clientId, it->packetId);
+                    continue;
+                }
+                it->packetId = _allocatePacketId();
+            }
+            if (!_pendingQos.push_front(std::move(*it))) {
+                log_w("Client %i: QoS queue full, PacketID %u not resent.", clientId, it->packetId);
+            }
+        }
+        _fillInflightWindow();
+        xSemaphoreGiveRecursive(_mutex);
+    }
+    messages.clear();
+}
+
+void MqttClient::takeInflight(std::deque<InflightMessage>& unacknowledged){
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        // Already sent ones are resent with the DUP flag, then the PUBRELs of the
+        // QoS 2 publishes waiting for PUBCOMP, then the ones never sent.
+        for (uint16_t i = 0; i < _inflight.size(); i++) {
+            InflightMessage& message = _inflight[i];
+            if ((message.header >> 4) == PUBLISH) {
+                message.header |= 0x08;
+            }
+            unacknowledged.push_back(std::move(message));
+        }
+        for (uint8_t i = 0; i < _qos2Released.size(); i++) {
+            uint16_t packetId = _qos2Released.at(i);
+            unacknowledged.push_back({packetId, 2, (PUBREL << 4) | RESERVERTO2, MqttBytes(), MqttBytes()});
+        }
+        for (uint16_t i = 0; i < _pendingQos.size(); i++) {
+            unacknowledged.push_back(std::move(_pendingQos[i]));
+        }
+        _inflight.clear();
+        _qos2Released.clear();
+        _pendingQos.clear();
+        xSemaphoreGiveRecursive(_mutex);
+    }
 }
 
 void MqttClient::subscribeToTopic(SubscribeMqttMessage * subscribeMqttMessage){
@@ -157,8 +421,115 @@ void MqttClient::subscribeToTopic(SubscribeMqttMessage * subscribeMqttMessage){
 }
 
 void MqttClient::notifyPublishRecived(PublishMqttMessage *publishMessage){
-    // Delegates routing logic to the Broker
-    broker->publishMessage(publishMessage);
+    CoreTrafficCounters& counters = broker->trafficCounters();
+    CoreTrafficCounters::add(counters.messagesReceived);
+
+    // Every pooled message is being routed: not acknowledged, so the publisher sends it again.
+    if (publishMessage == nullptr) {
+        log_w("Client %i: No free message! Dropping publish.", clientId);
+        CoreTrafficCounters::add(counters.publishesDropped);
+        return;
+    }
+
+    // Read before the Broker takes ownership of the message.
+    uint8_t qos = publishMessage->getQos();
+    uint16_t packetId = publishMessage->getMessageId();
+    broker->recordLatency(LATENCY_PARSE, publishMessage->getReceivedAt());
+
+    if (qos == 2) {
+        bool duplicate = false;
+        bool full = false;
+        if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+            duplicate = _qos2Received.contains(packetId);
+            full = _qos2Received.full();
+            xSemaphoreGiveRecursive(_mutex);
+        }
+
+        // Exactly once: a retransmission of a routed publish is only acknowledged again.
+        if (duplicate) {
+            sendPublishAck(PUBREC, packetId);
+            broker->deleteMessage(publishMessage);
+            return;
+        }
+
+        // No room to track it: not acknowledged, so the publisher sends it again.
+        if (full) {
+            log_w("Client %i: Too many QoS 2 publishes in flight, dropping PacketID %u.", clientId, packetId);
+            CoreTrafficCounters::add(counters.publishesDropped);
+            broker->deleteMessage(publishMessage);
+            return;
+        }
+    }
+
+    // Default mode: Delegates routing logic to the Broker, dropping on a full queue.
+    // A dropped QoS 1/2 publish is not acknowledged, so the publisher sends it again.
+    if (!broker->isLosslessMode()) {
+        if (broker->tryPublishMessage(publishMessage, this)) {
+            acknowledgePublish(qos, packetId);
+        } else {
+            log_w("Broker Queue Full! Dropping publish.");
+            CoreTrafficCounters::add(counters.publishesDropped);
+            broker->deleteMessage(publishMessage);
+        }
+        return;
+    }
+
+    // Lossless mode: never overtake publishes that are already stalled.
+    bool firstStall = false;
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        if (_stalledPublishes.empty() && broker->tryPublishMessage(publishMessage, this)) {
+            xSemaphoreGiveRecursive(_mutex);
+            acknowledgePublish(qos, packetId);
+            return;
+        }
+
+        firstStall = _stalledPublishes.empty();
+        if (!_stalledPublishes.push_back(publishMessage)) {
+            // Not acknowledged, so the publisher sends it again.
+            log_e("Client %i: Too many stalled publishes! Dropping publish.", clientId);
+            CoreTrafficCounters::add(counters.publishesDropped);
+            broker->deleteMessage(publishMessage);
+        }
+
+        // Stop acknowledging data, so TCP throttles the publisher until the Worker drains.
+        // Under the lock: a flush can't resume the transport before it is paused.
+        if (firstStall) {
+            log_w("Client %i: Broker queue full, pausing transport.", clientId);
+            transport->pauseReceive();
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+
+    if (firstStall) {
+        broker->notifyClientStalled(handle);
+    }
+}
+
+bool MqttClient::flushStalledPublishes(){
+    bool flushed = false;
+
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        while (!_stalledPublishes.empty()) {
+            PublishMqttMessage* publishMessage = _stalledPublishes.front();
+            uint8_t qos = publishMessage->getQos();
+            uint16_t packetId = publishMessage->getMessageId();
+
+            if (!broker->tryPublishMessage(publishMessage, this)) break;
+            _stalledPublishes.pop_front();
+
+            // Acknowledged only once the Broker has accepted it.
+            acknowledgePublish(qos, packetId);
+        }
+        flushed = _stalledPublishes.empty();
+
+        // Under the lock: a publish stalled by another Worker can't be resumed past.
+        if (flushed) {
+            log_i("Client %i: Broker queue drained, resuming transport.", clientId);
+            transport->resumeReceive();
+        }
+        xSemaphoreGiveRecursive(_mutex);
+    }
+    return flushed;
 }
 
 // --- NETWORK I/O ---
@@ -166,16 +537,17 @@ void MqttClient::notifyPublishRecived(PublishMqttMessage *publishMessage){
 void MqttClient::sendPacketByTcpConnection(String mqttPacket){
     // 1. Sanity Check: If disconnected, clear outbox to free RAM.
     if (!transport || !transport->connected()) {
-        if (xSemaphoreTake(_outboxMutex, portMAX_DELAY)) {
+        if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY)) {
             _outbox.clear();
-            xSemaphoreGive(_outboxMutex);
+            _outboxRing.clear();
+            xSemaphoreGiveRecursive(_mutex);
         }
         return;
     }
 
     // --- CRITICAL SECTION (Producer) ---
     // Protect access to the std::deque
-    if (xSemaphoreTake(_outboxMutex, portMAX_DELAY) == pdTRUE) {
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
         
         size_t len = mqttPacket.length();
         // Check if the network stack is ready right now
@@ -183,16 +555,30 @@ void MqttClient::sendPacketByTcpConnection(String mqttPacket){
 
         // 2. FIFO Logic: If queue has items OR network is busy -> Queue it.
         // We cannot bypass existing items in the queue.
-        if (!_outbox.empty() || !transportReady) {
+        if (!_outboxEmpty() || !transportReady) {
             
-            // Queue Protection: Cap size to prevent OOM
-            if (_outbox.size() < outboxMaxSize) {
-                _outbox.push_back(mqttPacket);
+            // Queue Protection: Cap size to prevent OOM. The preallocated ring is 
+            // bounded by its bytes and keeps a copy, the String is freed.
+            bool backlogStart = _outboxEmpty();
+            bool queued;
+            if (_outboxRing.enabled()) {
+                queued = _outboxRing.write((const uint8_t*)mqttPacket.c_str(), len);
             } else {
+                queued = _outbox.size() < outboxMaxSize && _outbox.push_back(std::move(mqttPacket));
+            }
+            if (!queued) {
                 log_e("Client %i: Outbox full! Dropping packet.", clientId);
+                CoreTrafficCounters::add(broker->trafficCounters().outboxDrops);
+            } else if (backlogStart) {
+                _outboxSince = LatencyRecorder::now();
             }
             
-            xSemaphoreGive(_outboxMutex); // Release lock before calling draining logic
+            xSemaphoreGiveRecursive(_mutex); // Release lock before calling draining logic
+
+            // Let the Worker pump it if the transport never reports it is ready again.
+            if (!_backlogScheduled.exchange(true)) {
+                broker->notifyClientBacklog(this);
+            }
             
             // Try to drain immediately in case space just freed up
             if (transportReady) _drainOutbox();
@@ -201,20 +587,130 @@ void MqttClient::sendPacketByTcpConnection(String mqttPacket){
         
         // 3. Fast Path (Optimization): Queue is empty AND Network is ready.
         // Release mutex first to avoid holding it during the network call.
-        xSemaphoreGive(_outboxMutex); 
+        xSemaphoreGiveRecursive(_mutex); 
         
         // Send directly without queuing (Zero-Copy efficiency)
-        transport->send(mqttPacket.c_str(), len);
+        CoreTrafficCounters::add(broker->trafficCounters().bytesSent, transport->send(mqttPacket.c_str(), len));
     }
 }
 
+void MqttClient::sendPacket(const PacketPart* parts, uint8_t numParts){
+    size_t len = 0;
+    for (uint8_t i = 0; i < numParts; i++) {
+        len += parts[i].length;
+    }
+
+    // Queue of Strings: joined once, then sent or queued as any packet.
+    if (!_outboxRing.enabled()) {
+        String mqttPacket;
+        mqttPacket.reserve(len);
+        for (uint8_t i = 0; i < numParts; i++) {
+            mqttPacket.concat((const char*)parts[i].data, parts[i].length);
+        }
+        sendPacketByTcpConnection(std::move(mqttPacket));
+        return;
+    }
+
+    if (!transport || !transport->connected()) {
+        if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY)) {
+            _outboxRing.clear();
+            xSemaphoreGiveRecursive(_mutex);
+        }
+        return;
+    }
+
+    // --- CRITICAL SECTION (Producer) ---
+    // The parts are written back to back into the ring, which is the packet buffer:
+    // sent right away from there when nothing waits before it.
+    if (xSemaphoreTakeRecursive(_mutex, portMAX_DELAY) == pdTRUE) {
+        if (len > _outboxRing.available()) {
+            xSemaphoreGiveRecursive(_mutex);
+            log_e("Client %i: Outbox full! Dropping packet.", clientId);
+            CoreTrafficCounters::add(broker->trafficCounters().outboxDrops);
+            return;
+        }
+
+        bool backlogStart = _outboxRing.empty();
+        bool transportReady = transport->canSend() && transport->space() >= len;
+        for (uint8_t i = 0; i < numParts; i++) {
+            _outboxRing.write(parts[i].data, parts[i].length);
+        }
+
+        // Fast Path: the ring was empty, so the packet starts at its first byte.
+        if (backlogStart && transportReady) {
+            uint32_t contiguous;
+            const uint8_t* data = _outboxRing.peek(contiguous);
+            size_t written = transport->send((const char*)data, contiguous);
+            _outboxRing.consume(written);
+            CoreTrafficCounters::add(broker->trafficCounters().bytesSent, written);
+            if (_outboxRing.empty()) {
+                xSemaphoreGiveRecursive(_mutex);
+                return;
+            }
+        }
+        if (backlogStart) {
+            _outboxSince = LatencyRecorder::now();
+        }
+        xSemaphoreGiveRecursive(_mutex);
+
+        // Let the Worker pump it if the transport never reports it is ready again.
+        if (!_backlogScheduled.exchange(true)) {
+            broker->notifyClientBacklog(this);
+        }
+        if (transportReady) _drainOutbox();
+    }
+}
+
+void MqttClient::sendPublish(uint8_t header, uint16_t packetId, const MqttBytes& topic, const MqttBytes& payload){
+    // Fixed header (at most 5 bytes) and topic length, then the packet id.
+    uint8_t head[7];
+    uint8_t id[2] = {(uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+    bool hasId = (header & 0x06) != 0;
+    size_t remainingLength = 2 + topic.length() + (hasId ? 2 : 0) + payload.length();
+
+    size_t index = 0;
+    head[index++] = header;
+    do {
+        uint8_t encodedByte = remainingLength % 128;
+        remainingLength /= 128;
+        if (remainingLength > 0) encodedByte |= 0x80;
+        head[index++] = encodedByte;
+    } while (remainingLength > 0);
+    head[index++] = topic.length() >> 8;
+    head[index++] = topic.length() & 0xFF;
+
+    PacketPart parts[4] = {
+        {head, index},
+        {topic.data(), topic.length()},
+        {id, hasId ? sizeof(id) : 0},
+        {payload.data(), payload.length()}
+    };
+    sendPacket(parts, 4);
+}
+
 void MqttClient::_drainOutbox() {
     if (!transport || !transport->connected()) return;
 
     // --- CRITICAL SECTION (Consumer) ---
     // Try to acquire lock with a short timeout. If Worker is writing, we retry later 
     // rather than blocking the Network Thread for too long.
-    if (xSemaphoreTake(_outboxMutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+    if (xSemaphoreTakeRecursive(_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        size_t sent = 0;
+        bool backlog = !_outboxEmpty();
+
+        // Preallocated ring: as many bytes as the transport takes, a packet may
+        // leave in several writes.
+        while (!_outboxRing.empty() && transport->canSend()) {
+            uint32_t contiguous;
+            const uint8_t* data = _outboxRing.peek(contiguous);
+            size_t len = min((size_t)contiguous, transport->space());
+            if (len == 0) break;
+
+            size_t written = transport->send((const char*)data, len);
+            if (written == 0) break;
+            _outboxRing.consume(written);
+            sent += written;
+        }
         
         while (!_outbox.empty()) {
             String& nextPacket = _outbox.front();
@@ -227,6 +723,7 @@ void MqttClient::_drainOutbox() {
                 
                 if (written == len) {
                     _outbox.pop_front(); // Success: Remove from queue
+                    sent += written;
                 } else {
                     break; // Partial write/Failure: Stop and retry later
                 }
@@ -234,13 +731,35 @@ void MqttClient::_drainOutbox() {
                 break; // Buffer full: Stop pumping
             }
         }
-        xSemaphoreGive(_outboxMutex);
+        // The backlog is drained: its first packet waited the longest.
+        if (backlog && _outboxEmpty()) {
+            broker->recordLatency(LATENCY_OUTBOX, _outboxSince);
+        }
+        xSemaphoreGiveRecursive(_mutex);
+        CoreTrafficCounters::add(broker->trafficCounters().bytesSent, sent);
     }
 }
 
+bool MqttClient::pumpBacklog() {
+    // Cleared first: a packet queued from now on registers the client again.
+    _backlogScheduled = false;
+    _drainOutbox();
+
+    bool pending = true;
+    if (xSemaphoreTakeRecursive(_mutex, 10 / portTICK_PERIOD_MS) == pdTRUE) {
+        pending = !_outboxEmpty();
+        xSemaphoreGiveRecursive(_mutex);
+    }
+
+    // Stay registered once, unless a producer already did it.
+    return pending && !_backlogScheduled.exchange(true);
+}
+
 void MqttClient::sendPingRes(){
-    String resPacket = messagesFactory.getPingResMessage().buildMqttPacket();
-    sendPacketByTcpConnection(resPacket);
+    uint8_t packet[PingResMqttMessage::PACKETSIZE];
+    messagesFactory.getPingResMessage().writePacket(packet);
+    PacketPart part = {packet, sizeof(packet)};
+    sendPacket(&part, 1);
 }
 
 void MqttClient::disconnect(){
@@ -252,12 +771,23 @@ void MqttClient::disconnect(){
 // --- MAINTENANCE ---
 
 bool MqttClient::checkKeepAlive(unsigned long currentMillis){
+    // Handshake: the CONNECT is due within the Broker handshake timeout.
+    if (this->_state == STATE_PENDING) {
+        if ((long)(currentMillis - this->lastAlive) > (long)broker->getHandshakeTimeout()) {
+            log_w("Client %i: no CONNECT in time. Disconnecting.", this->clientId);
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
     if (this->keepAlive == 0) return true; // KeepAlive disabled
 
     // MQTT Spec allows 1.5x the keep alive interval
     unsigned long timeoutMs = (unsigned long)this->keepAlive * 1500;
 
-    if ((currentMillis - this->lastAlive) > timeoutMs) {
+    // Signed: lastAlive may be updated by the Network Thread after currentMillis was read.
+    if ((long)(currentMillis - this->lastAlive) > (long)timeoutMs) {
         log_w("Client %i: KeepAlive Timeout. Disconnecting.", this->clientId);
         disconnect(); 
         return false;
@@ -0,0 +1,29 @@
+#include "PacketIdSet.h"
+
+using namespace mqttBrokerName;
+
+bool PacketIdSet::contains(uint16_t packetId) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (ids[i] == packetId) return true;
+    }
+    return false;
+}
+
+bool PacketIdSet::insert(uint16_t packetId) {
+    if (contains(packetId)) return true;
+    if (full()) return false;
+
+    ids[count++] = packetId;
+    return true;
+}
+
+bool PacketIdSet::erase(uint16_t packetId) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (ids[i] == packetId) {
+            // Order is not relevant: the last entry fills the hole.
+            ids[i] = ids[--count];
+            return true;
+        }
+    }
+    return false;
+}
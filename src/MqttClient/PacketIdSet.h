@@ -0,0 +1,57 @@
+#ifndef PACKET_ID_SET_H
+#define PACKET_ID_SET_H
+
+#include <Arduino.h>
+
+// Capacity of each per-client QoS 2 state table (packet ids waiting for PUBREL
+// or PUBCOMP). It is also the largest in-flight window.
+#define PACKETIDSETSIZE 32
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Fixed-size set of packet ids, used for the QoS 2 state of a client.
+ * * There is one set per handshake step (e.g. "PUBREC sent, waiting for PUBREL"),
+ * so an entry is only its packet id: 2 bytes per in-flight message and no heap
+ * allocation. Lookups are linear, the set is small (PACKETIDSETSIZE).
+ */
+class PacketIdSet {
+private:
+    uint16_t ids[PACKETIDSETSIZE];
+    uint8_t count = 0;
+
+public:
+    bool contains(uint16_t packetId) const;
+
+    /**
+     * @brief Adds a packet id, doing nothing if it is already present.
+     * @return false if the set is full and the id was not added.
+     */
+    bool insert(uint16_t packetId);
+
+    /**
+     * @brief Removes a packet id.
+     * @return false if the id was not present.
+     */
+    bool erase(uint16_t packetId);
+
+    uint8_t size() const {
+        return count;
+    }
+
+    bool full() const {
+        return count == PACKETIDSETSIZE;
+    }
+
+    uint16_t at(uint8_t index) const {
+        return ids[index];
+    }
+
+    void clear() {
+        count = 0;
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // PACKET_ID_SET_H
@@ -0,0 +1,17 @@
+#include "SubscriptionList.h"
+
+using namespace mqttBrokerName;
+
+bool SubscriptionList::push_back(NodeTrie* node) {
+    for (uint16_t i = 0; i < count; i++) {
+        if (nodes[i] == node) return true;
+    }
+    if (count == UINT16_MAX) return false;
+
+    NodeTrie** grown = (NodeTrie**)realloc(nodes, (count + 1) * sizeof(NodeTrie*));
+    if (!grown) return false;
+
+    nodes = grown;
+    nodes[count++] = node;
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef SUBSCRIPTION_LIST_H
+#define SUBSCRIPTION_LIST_H
+
+#include <Arduino.h>
+
+namespace mqttBrokerName{
+
+class NodeTrie;
+
+/**
+ * @brief Trie nodes a client is subscribed to, to unsubscribe it on disconnection.
+ * * Most clients have one or two subscriptions: the array is grown by one entry 
+ * at a time, so it never holds unused slots, and a node is stored once even if 
+ * the client subscribes to it again.
+ * @note Not thread-safe, written under the Broker `topicTrieMutex`.
+ */
+class SubscriptionList {
+private:
+    NodeTrie** nodes = nullptr;
+    uint16_t count = 0;
+
+public:
+    SubscriptionList() {}
+
+    ~SubscriptionList() {
+        clear();
+    }
+
+    SubscriptionList(const SubscriptionList&) = delete;
+    SubscriptionList& operator=(const SubscriptionList&) = delete;
+
+    /**
+     * @brief Adds a node, doing nothing if it is already present.
+     * @return false if there is no memory left, the node is not added.
+     */
+    bool push_back(NodeTrie* node);
+
+    uint16_t size() const {
+        return count;
+    }
+
+    NodeTrie* operator[](uint16_t index) const {
+        return nodes[index];
+    }
+
+    void clear() {
+        free(nodes);
+        nodes = nullptr;
+        count = 0;
+    }
+
+    size_t capacityBytes() const {
+        return count * sizeof(NodeTrie*);
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // SUBSCRIPTION_LIST_H
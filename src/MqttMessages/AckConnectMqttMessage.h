@@ -22,7 +22,7 @@
             If the Server has stored Session state, it MUST set Session Present to 1 in the CONNACK packet [MQTT-3.2.2-2]. 
             If the Server does not have stored Session state, it MUST set Session Present to 0 in the CONNACK packet. This is in addition to setting a zero return code in the CONNACK packet [MQTT-3.2.2-3].
  *       
-         -> This Server, doesn't store down connections, for this, flag is always 0
+         -> This Server keeps the sessions of clients connected with CleanSession set to 0, see MqttBroker::attachSession.
  *      
  *       -> return code of acceptance:
  *          -> one byte, here it is indicated if the connection is accepted or not and why not.
@@ -0,0 +1,35 @@
+#include "AckPublishMqttMessage.h"
+
+AckPublishMqttMessage::AckPublishMqttMessage(uint8_t type, uint16_t packetId)
+    : MqttMessage(type, type == PUBREL ? RESERVERTO2 : RESERVERTO0) 
+{
+    this->packetId = packetId;
+}
+
+AckPublishMqttMessage::AckPublishMqttMessage(ReaderMqttPacket &packetReaded)
+    : MqttMessage(packetReaded.getFixedHeader()) 
+{
+    packetId = 0;
+    packetReaded.decodeTwoBytes(0, &packetId);
+}
+
+String AckPublishMqttMessage::buildMqttPacket(){
+    uint8_t packet[PACKETSIZE];
+    writePacket(packet);
+    
+    String ackPacket;
+    ackPacket.concat((const char*)packet, PACKETSIZE);
+    return ackPacket;
+}
+
+void AckPublishMqttMessage::writePacket(uint8_t* packet){
+    // 1. Fixed Header
+    packet[0] = getTypeAndFlags();
+    
+    // Remaining Length: 2 bytes (PacketID)
+    packet[1] = 2;
+    
+    // 2. Variable Header (Packet Identifier)
+    packet[2] = packetId >> 8;
+    packet[3] = packetId & 0xFF;
+}
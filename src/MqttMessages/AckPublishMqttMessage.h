@@ -0,0 +1,60 @@
+#ifndef ACKPUBLISHMQTTMESSAGE_H
+#define ACKPUBLISHMQTTMESSAGE_H
+
+#include "MqttMessage.h"
+#include "MqttMessagesSerealizable.h"
+#include "ReaderMqttPacket.h"
+
+/**
+ * @brief Class to build and decode the acknowledgments of a QoS > 0 publish 
+ * (PUBACK, and the PUBREC/PUBREL/PUBCOMP packets that share its format).
+ * MQTT PUBACK packet structure has two parts:
+ * 1. Fixed header (2 bytes):
+ * -> Control Packet Type (PUBACK = 4)
+ * -> Flags (Reserved, 0 except PUBREL that uses 2)
+ * -> Remaining Length (Always 2)
+ * * 2. Variable header (2 bytes):
+ * -> Packet Identifier: The same Message ID from the acknowledged PUBLISH packet.
+ */
+class AckPublishMqttMessage: public MqttMessage, public MqttMessageSerealizable
+{
+private:
+    uint16_t packetId;
+
+public:
+
+    /**
+     * @brief Construct a new Ack Publish Mqtt Message object to send.
+     * * @param type The acknowledgment type (PUBACK, PUBREC, PUBREL or PUBCOMP).
+     * @param packetId The Message ID of the acknowledged PUBLISH packet.
+     */
+    AckPublishMqttMessage(uint8_t type, uint16_t packetId);
+
+    /**
+     * @brief Construct a new Ack Publish Mqtt Message object from raw bytes
+     * readed from a client.
+     * 
+     * @param packetReaded object who contains bytes readed from tcp connection. 
+     */
+    AckPublishMqttMessage(ReaderMqttPacket &packetReaded);
+
+    uint16_t getPacketId(){
+        return packetId;
+    }
+
+    /**
+     * @brief Build the string representation of the acknowledgment packet.
+     * @return String containing the raw bytes to be sent over TCP/WS.
+     */
+    String buildMqttPacket() override;
+
+    /** @brief Size of the packet, always the same. */
+    static const size_t PACKETSIZE = 4;
+
+    /**
+     * @brief Writes the packet into `packet`, of `PACKETSIZE` bytes, without allocating.
+     */
+    void writePacket(uint8_t* packet);
+};
+
+#endif // ACKPUBLISHMQTTMESSAGE_H
@@ -7,17 +7,34 @@ AckSubscriptionMqttMessage::AckSubscriptionMqttMessage(uint16_t packetId, uint8_
     this->returnCode = returnCode;
 }
 
+AckSubscriptionMqttMessage::AckSubscriptionMqttMessage(uint16_t packetId, const std::vector<MqttTocpic>& topics, uint8_t maxQos)
+    : MqttMessage(SUBACK, RESERVERTO0) 
+{
+    this->packetId = packetId;
+    this->topics = &topics;
+    this->maxQos = maxQos;
+}
+
 String AckSubscriptionMqttMessage::buildMqttPacket(){
     String ackPacket;
+    size_t numCodes = topics ? topics->size() : 1;
+
+    // Allocated once: fixed header (at most 5 bytes), packet id and return codes.
+    ackPacket.reserve(5 + 2 + numCodes);
     
     // 1. Fixed Header
     // Byte 1: Type (SUBACK) + Flags (RESERVERTO0)
     ackPacket.concat((char)getTypeAndFlags());
     
-    // Byte 2: Remaining Length
-    // Length = 2 bytes (PacketID) + 1 byte (Return Code) = 3 bytes
-    // Note: Assuming simple ack for 1 topic.
-    ackPacket.concat((char)3); 
+    // Byte 2..: Remaining Length
+    // Length = 2 bytes (PacketID) + 1 byte per topic (Return Codes)
+    size_t remainingLength = 2 + numCodes;
+    do {
+        uint8_t encodedByte = remainingLength % 128;
+        remainingLength /= 128;
+        if (remainingLength > 0) encodedByte |= 0x80;
+        ackPacket.concat((char)encodedByte);
+    } while (remainingLength > 0);
     
     // 2. Variable Header (Packet Identifier)
     // MSB (Most Significant Byte)
@@ -25,8 +42,14 @@ String AckSubscriptionMqttMessage::buildMqttPacket(){
     // LSB (Least Significant Byte)
     ackPacket.concat((char)(packetId & 0xFF));
     
-    // 3. Payload (Return Code)
-    ackPacket.concat((char)returnCode);
+    // 3. Payload (Return Codes): the QoS granted to each topic filter.
+    if (topics) {
+        for (const MqttTocpic& topic : *topics) {
+            ackPacket.concat((char)min(topic.getQos(), maxQos));
+        }
+    } else {
+        ackPacket.concat((char)returnCode);
+    }
     
     return ackPacket;
 }
\ No newline at end of file
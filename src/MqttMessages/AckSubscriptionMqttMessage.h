@@ -4,6 +4,8 @@
 #include "MqttMessage.h"
 #include "MqttMessagesSerealizable.h"
 #include "ControlPacketType.h" // Asumo que aquí tienes definidos los tipos como SUBACK
+#include "MqttTocpic.h"
+#include <vector>
 
 /**
  * @brief Class to build a AckSubscriptionMqttMessage (SUBACK).
@@ -25,7 +27,11 @@ class AckSubscriptionMqttMessage: public MqttMessage, public MqttMessageSerealiz
 {
 private:
     uint16_t packetId;
-    uint8_t returnCode;
+    uint8_t returnCode = 0x00;
+
+    /** @brief Topic filters of the SUBSCRIBE, not owned: one return code each. */
+    const std::vector<MqttTocpic>* topics = nullptr;
+    uint8_t maxQos = 0;
   
 public:
 
@@ -35,6 +41,15 @@ public:
      * @param returnCode The result code (default 0x00 for Success QoS 0).
      */
     AckSubscriptionMqttMessage(uint16_t packetId, uint8_t returnCode = 0x00);
+
+    /**
+     * @brief Construct a new Ack Subscription Mqtt Message object for several topics,
+     * granting each of them its requested QoS up to `maxQos`.
+     * * @param packetId The Message ID from the original SUBSCRIBE packet to acknowledge.
+     * @param topics Topic filters of the SUBSCRIBE, in its order. Must outlive this object.
+     * @param maxQos Highest QoS granted by the Broker.
+     */
+    AckSubscriptionMqttMessage(uint16_t packetId, const std::vector<MqttTocpic>& topics, uint8_t maxQos);
     
     /**
      * @brief Build the string representation of the SUBACK packet.
@@ -45,6 +45,15 @@ class ConnectMqttMessage: public MqttMessage{
         return clientID;
     }
 
+    /**
+     * @brief Check the Clean Session flag of the connect flags.
+     * 
+     * @return true if the client doesn't want to resume a previous session.
+     */
+    bool isCleanSession(){
+        return (connectFlags & 0x02) == 0x02;
+    }
+
     /**
      * @brief Check if packet is good formed, check type of packet
      * and flags, in connect packet that is 000010000.
@@ -13,7 +13,6 @@ MqttMessage FactoryMqttMessages::decodeMqttPacket(ReaderMqttPacket &reader){
     }
 
     uint8_t type;
-    uint8_t flagsControlType;
     type = reader.getFixedHeader() >> 4;
     switch (type)
     {
@@ -41,14 +40,26 @@ ConnectMqttMessage FactoryMqttMessages::getConnectMqttMessage(ReaderMqttPacket &
 
 
 
-AckConnectMqttMessage FactoryMqttMessages::getAceptedAckConnectMessage(){
-    return AckConnectMqttMessage(NOTSESIONPRESENT,CONNECTACCEPTED);
+AckConnectMqttMessage FactoryMqttMessages::getAceptedAckConnectMessage(bool sessionPresent){
+    return AckConnectMqttMessage(sessionPresent ? SESIONPRESENT : NOTSESIONPRESENT, CONNECTACCEPTED);
 }
 
 AckSubscriptionMqttMessage FactoryMqttMessages::getSubAckMessage(uint16_t packetId){
     return AckSubscriptionMqttMessage(packetId, 0x00); // 0x00 = Success QoS 0
 }
 
+AckSubscriptionMqttMessage FactoryMqttMessages::getSubAckMessage(uint16_t packetId, const std::vector<MqttTocpic>& topics, uint8_t maxQos){
+    return AckSubscriptionMqttMessage(packetId, topics, maxQos); // 0x00/0x01/0x02 = Success QoS 0/1/2
+}
+
+AckPublishMqttMessage FactoryMqttMessages::getPubAckMessage(uint16_t packetId){
+    return AckPublishMqttMessage(PUBACK, packetId);
+}
+
+AckPublishMqttMessage FactoryMqttMessages::getAckPublishMessage(uint8_t type, uint16_t packetId){
+    return AckPublishMqttMessage(type, packetId);
+}
+
 PingResMqttMessage FactoryMqttMessages::getPingResMessage(){
     return PingResMqttMessage();
 }
@@ -5,6 +5,7 @@
 #include "ConnectMqttMessage.h"
 #include "AckConnectMqttMessage.h"
 #include "AckSubscriptionMqttMessage.h"
+#include "AckPublishMqttMessage.h"
 #include "PingResMqttMessage.h"
 #include "PingReqMqttMessage.h"
 #include "ReaderMqttPacket.h"
@@ -19,11 +20,14 @@ class FactoryMqttMessages {
     public:
         FactoryMqttMessages();
         MqttMessage decodeMqttPacket(ReaderMqttPacket &reader);
-        AckConnectMqttMessage getAceptedAckConnectMessage();
+        AckConnectMqttMessage getAceptedAckConnectMessage(bool sessionPresent = false);
         PingResMqttMessage getPingResMessage();
         PublishMqttMessage getPublishMqttMessage(uint8_t publishFlags);
         ConnectMqttMessage getConnectMqttMessage(ReaderMqttPacket &reader);
         AckSubscriptionMqttMessage getSubAckMessage(uint16_t packetId);
+        AckSubscriptionMqttMessage getSubAckMessage(uint16_t packetId, const std::vector<MqttTocpic>& topics, uint8_t maxQos);
+        AckPublishMqttMessage getPubAckMessage(uint16_t packetId);
+        AckPublishMqttMessage getAckPublishMessage(uint8_t type, uint16_t packetId);
 };
 
 #endif
\ No newline at end of file
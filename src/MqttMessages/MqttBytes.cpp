@@ -0,0 +1,126 @@
+#include "MqttBytes.h"
+#include "MqttBroker/MemoryPolicy.h"
+#include "MqttBroker/BlockPool.h"
+
+static std::atomic<BlockPool*> pool(nullptr);
+
+MqttBytes::MqttBytes(const uint8_t* data, size_t length) : MqttBytes(allocate(length)) {
+    if (size > 0) {
+        memcpy(writableData(), data, size);
+    }
+}
+
+MqttBytes::MqttBytes(const char* text) : MqttBytes((const uint8_t*)text, text ? strlen(text) : 0) {}
+
+MqttBytes::MqttBytes(const String& text) : MqttBytes((const uint8_t*)text.c_str(), text.length()) {}
+
+MqttBytes::MqttBytes(const MqttBytes& other) : buffer(other.buffer), start(other.start), size(other.size) {
+    if (buffer) {
+        buffer->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+MqttBytes::MqttBytes(MqttBytes&& other) noexcept : buffer(other.buffer), start(other.start), size(other.size) {
+    other.buffer = nullptr;
+    other.start = nullptr;
+    other.size = 0;
+}
+
+MqttBytes& MqttBytes::operator=(const MqttBytes& other) {
+    if (this != &other) {
+        // Taken first: `other` may be a slice of the same buffer.
+        if (other.buffer) {
+            other.buffer->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        release();
+        buffer = other.buffer;
+        start = other.start;
+        size = other.size;
+    }
+    return *this;
+}
+
+MqttBytes& MqttBytes::operator=(MqttBytes&& other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = other.buffer;
+        start = other.start;
+        size = other.size;
+        other.buffer = nullptr;
+        other.start = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+void MqttBytes::release() {
+    // The last slice frees the buffer, its writes are visible to the thread freeing it.
+    if (buffer && buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        bool pooled = buffer->pooled;
+        buffer->~Buffer();
+        if (!pooled) {
+            MemoryPolicy::release(buffer);
+        } else {
+            // Not reused if it outlived its pool, whose storage was then kept.
+            BlockPool* current = pool.load(std::memory_order_acquire);
+            if (current && current->owns(buffer)) {
+                current->give(buffer);
+            }
+        }
+    }
+    buffer = nullptr;
+    start = nullptr;
+    size = 0;
+}
+
+MqttBytes MqttBytes::allocate(size_t length) {
+    MqttBytes bytes;
+    if (length == 0) {
+        return bytes;
+    }
+
+    // A block of the pool when it fits, large payloads go to the PSRAM when there is one.
+    BlockPool* current = pool.load(std::memory_order_acquire);
+    void* memory = nullptr;
+    if (current && sizeof(Buffer) + length <= current->getBlockSize()) {
+        memory = current->take();
+    }
+    bool pooled = memory != nullptr;
+    if (!pooled) {
+        memory = MemoryPolicy::allocate(sizeof(Buffer) + length, MEMORY_PAYLOAD);
+    }
+    if (memory == nullptr) {
+        log_e("Failed to allocate %u bytes for a message.", (unsigned)length);
+        return bytes;
+    }
+    bytes.buffer = new (memory) Buffer;
+    bytes.buffer->references.store(1, std::memory_order_relaxed);
+    bytes.buffer->pooled = pooled;
+    bytes.start = bytes.buffer->bytes();
+    bytes.size = length;
+    return bytes;
+}
+
+void MqttBytes::usePool(BlockPool* blocks) {
+    pool.store(blocks, std::memory_order_release);
+}
+
+BlockPool* MqttBytes::getPool() {
+    return pool.load(std::memory_order_acquire);
+}
+
+MqttBytes MqttBytes::slice(size_t offset, size_t length) const {
+    MqttBytes part(*this);
+    offset = min(offset, size);
+    part.start = start + offset;
+    part.size = min(length, size - offset);
+    return part;
+}
+
+String MqttBytes::toString() const {
+    String text;
+    if (size > 0) {
+        text.concat((const char*)start, size);
+    }
+    return text;
+}
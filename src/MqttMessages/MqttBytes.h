@@ -0,0 +1,131 @@
+#ifndef MQTTBYTES_H
+#define MQTTBYTES_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <new>
+
+class BlockPool;
+
+/**
+ * @brief Bytes of a message field (a payload), binary safe with an explicit length.
+ * * A slice of a reference counted buffer: copies share the buffer instead of
+ * copying its bytes, so a message routed to several workers, kept for an offline
+ * session or buffered for a sleeping device is stored once. Only the constructors
+ * from raw bytes or text copy. The buffer is immutable once shared, it is freed
+ * with its last slice, by any thread.
+ * * With a pool (`usePool`), the buffers that fit its blocks are taken from it
+ * instead of the heap.
+ */
+class MqttBytes
+{
+private:
+    /**
+     * @brief Header of a shared buffer, its bytes follow it in the same allocation.
+     */
+    struct Buffer {
+        std::atomic<uint32_t> references;
+
+        /** @brief Block of the pool, given back instead of freed. */
+        bool pooled;
+
+        uint8_t* bytes() {
+            return reinterpret_cast<uint8_t*>(this + 1);
+        }
+    };
+
+    Buffer* buffer;
+    const uint8_t* start;
+    size_t size;
+
+    void release();
+
+public:
+    MqttBytes() : buffer(nullptr), start(nullptr), size(0) {}
+
+    /**
+     * @brief Copies `length` bytes into a new buffer.
+     */
+    MqttBytes(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Copies a text, without its terminator.
+     */
+    MqttBytes(const char* text);
+
+    /**
+     * @brief Copies the bytes of a String, NUL bytes included.
+     */
+    MqttBytes(const String& text);
+
+    MqttBytes(const MqttBytes& other);
+    MqttBytes(MqttBytes&& other) noexcept;
+    MqttBytes& operator=(const MqttBytes& other);
+    MqttBytes& operator=(MqttBytes&& other) noexcept;
+
+    ~MqttBytes() {
+        release();
+    }
+
+    /**
+     * @brief A new buffer of `length` bytes to fill with `writableData()`, before
+     * sharing it.
+     *
+     * @return MqttBytes The buffer, empty if the allocation failed.
+     */
+    static MqttBytes allocate(size_t length);
+
+    /** @brief Bytes taken by a buffer of `length` bytes, its header included: the block size of a pool. */
+    static size_t allocationSize(size_t length) {
+        return sizeof(Buffer) + length;
+    }
+
+    /**
+     * @brief Takes the next buffers from `pool` when they fit its blocks, from the
+     * heap otherwise (or when the pool is empty). nullptr goes back to the heap.
+     * * Set by the Broker that preallocates the pool, before any buffer is shared.
+     * A buffer released once its pool is replaced is not reused.
+     */
+    static void usePool(BlockPool* pool);
+
+    /** @brief The pool of `usePool`, nullptr if none. */
+    static BlockPool* getPool();
+
+    /**
+     * @brief Bytes of a buffer made by `allocate`, only its creator writes them.
+     */
+    uint8_t* writableData() {
+        return const_cast<uint8_t*>(start);
+    }
+
+    /**
+     * @brief A part of these bytes, sharing their buffer (no copy).
+     *
+     * @param offset First byte of the slice, clamped to the length.
+     * @param length Bytes of the slice, clamped to the remaining ones.
+     */
+    MqttBytes slice(size_t offset, size_t length) const;
+
+    const uint8_t* data() const {
+        return start;
+    }
+
+    size_t length() const {
+        return size;
+    }
+
+    bool isEmpty() const {
+        return size == 0;
+    }
+
+    bool equals(const MqttBytes& other) const {
+        return size == other.size && (size == 0 || memcmp(start, other.start, size) == 0);
+    }
+
+    /**
+     * @brief Copies the bytes into a String, for text payloads.
+     */
+    String toString() const;
+};
+
+#endif
@@ -1,7 +1,7 @@
 #ifndef MQTTMESSAGE_H
 #define MQTTMESSAGE_H
 
-#include "WiFi.h"
+#include <Arduino.h>
 #include "ControlPacketType.h"
 /**
  * @brief This class is an interfaz for the diferents mqtt packets. 
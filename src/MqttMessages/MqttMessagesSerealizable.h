@@ -11,6 +11,14 @@ class MqttMessageSerealizable{
 
         }
 
+        /**
+         * @brief Virtual: the messages are deleted through their concrete type, 
+         * e.g. a `PublishMqttMessage` released by `MqttBroker::deleteMessage()`.
+         */
+        virtual ~MqttMessageSerealizable(){
+
+        }
+
         /**
          * @brief Get the String that is a representation of a mqtt packet, it is
          * to use String.getBytes() to get a bytesByffer to send by tcp connection to
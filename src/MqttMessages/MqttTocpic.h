@@ -1,72 +1,85 @@
 #ifndef MQTTTOPIC_H
 #define MQTTTOPIC_H
 
+#include "MqttBytes.h"
+
 class MqttTocpic
 {
 private:
     String topic;
     uint8_t qos;
-    String payLoad;
+
+    /**
+     * @brief Payload bytes, shared by the copies of this topic (see `MqttBytes`).
+     */
+    MqttBytes payLoad;
 
 public:
     MqttTocpic(){}
-    MqttTocpic(String topic, String payLoad, uint8_t qos = 0){
-        this->topic = topic;
-        this->payLoad = payLoad;
-        this->qos = qos;
+    MqttTocpic(String topic, MqttBytes payLoad, uint8_t qos = 0)
+        : topic(std::move(topic)), qos(qos), payLoad(std::move(payLoad)) {
     }
 
-    String getTopic(){
+    const String& getTopic() const {
         return topic;
     }
 
-    uint16_t getTopicLength(){
+    uint16_t getTopicLength() const {
         return topic.length();
     }
 
-    String getPayLoad(){
+    /**
+     * @brief Get the payload, binary safe: use its `length()`, not a terminator.
+     */
+    const MqttBytes& getPayLoad() const {
         return payLoad;
     }
 
     void setTopic(String topic){
-        this->topic = topic;
+        this->topic = std::move(topic);
     }
 
-    void setPayLoad(String payLoad){
-        this->payLoad = payLoad;
+    /**
+     * @brief Copies a topic name in place: the String keeps its capacity, so a
+     * pooled message reads the topics that fit it without allocating.
+     */
+    void setTopic(const char* name, size_t length){
+        topic.remove(0);
+        topic.concat(name, length);
+    }
+
+    /** @brief Reserves the topic String, see `setTopic(const char*, size_t)`. */
+    void reserveTopic(size_t length){
+        topic.reserve(length);
     }
 
-    uint8_t getQos(){
+    void setPayLoad(MqttBytes payLoad){
+        this->payLoad = std::move(payLoad);
+    }
+
+    uint8_t getQos() const {
         return qos;
     }
     void setQos(uint8_t qos){
         this->qos = qos;
     }
 
-    bool isTopic(MqttTocpic topic){
+    bool isTopic(const MqttTocpic& topic) const {
         return this->topic.equals(topic.getTopic());
     }
 
     /**
      * @brief Get the Topic Length, This is a String topic length +
-     *        String payload length.
+     *        payload length.
      * 
      * 
-     * @return uint16_t 
+     * @return size_t 
      */
-    uint16_t getTopicAndPayloadLength(){
-        uint16_t length = topic.length()+payLoad.length();
-        return length;
-    }
-
-    String getTopicAndPayLoad(){
-        String topicAndPayload;
-        topicAndPayload.concat(topic);
-        topicAndPayload.concat(payLoad);
-        return topicAndPayload;
+    size_t getTopicAndPayloadLength() const {
+        return topic.length() + payLoad.length();
     }
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -21,6 +21,15 @@ public:
         pingRespPacket.concat((char)0);
         return pingRespPacket;        
     }
+
+    /** @brief Size of the packet, always the same. */
+    static const size_t PACKETSIZE = 2;
+
+    /** @brief Writes the packet into `packet`, of `PACKETSIZE` bytes, without allocating. */
+    void writePacket(uint8_t* packet){
+        packet[0] = getTypeAndFlags();
+        packet[1] = 0;
+    }
 };
 
 
@@ -6,31 +6,40 @@ PublishMqttMessage::PublishMqttMessage(uint8_t publishFlags):MqttMessage(PUBLISH
 
 PublishMqttMessage::PublishMqttMessage(uint8_t publishFlags, MqttTocpic topic):MqttMessage(PUBLISH,publishFlags){
     this->setFlagsControlType(publishFlags);
-    this->topic = topic;
+    this->topic = std::move(topic);
+    this->topicName = MqttBytes(this->topic.getTopic());
 }
 
 String PublishMqttMessage::buildMqttPacket(){
+    return buildMqttPacket(0, 0);
+}
+
+String PublishMqttMessage::buildMqttPacket(uint8_t qos, uint16_t packetId, bool retain){
     
     /**
-     * there is not message Id field in qos = 0, add this field in next versions.
+     * there is not message Id field in qos = 0.
      * 
      */
     String mqttPacket;
 
-    //concat fixed header
-    //mqttPacket.concat((char)getTypeAndFlags()); // for versions with qos > 0 support
-    mqttPacket.concat((char)48); // this line must be 
-    // replaced for the above line, for versions with qos > 0
+    // 1ª calculate remainingLengt value
+    size_t remainingLength = topic.getTopicAndPayloadLength()+2;
+    if (qos > 0) {
+        remainingLength += 2; // packet id
+    }
+
+    // Allocated once: fixed header (at most 5 bytes) and remaining packet.
+    mqttPacket.reserve(remainingLength + 5);
+
+    //concat fixed header: PUBLISH, DUP = 0, RETAIN = 0 when forwarded to an established subscription.
+    mqttPacket.concat((char)((PUBLISH << 4) | (qos << 1) | (retain ? 0x01 : 0x00)));
 
     // process to concat remainingLength
-        // 1ª calculate remainingLengt value
-    size_t remainingLength = topic.getTopicAndPayloadLength()+2;
-        
         // 2ª Encode remaininLengt value according mqtt format.
     uint32_t encodedSize = codeSize(remainingLength);  
         
         // 3ª Concatenate encoded remaining length field to mqttPacket.
-    mqttPacket = concatEncodedSize(encodedSize,mqttPacket);
+    concatEncodedSize(encodedSize,mqttPacket);
 
     // concat topic lengt field, the field have two bytes allways
     uint8_t MSB = topic.getTopicLength() >> 8;
@@ -38,19 +47,37 @@ String PublishMqttMessage::buildMqttPacket(){
     mqttPacket.concat((char)MSB);
     mqttPacket.concat((char)LSB);
 
-    // concat topic and payload.
-    mqttPacket.concat(topic.getTopicAndPayLoad());
+    // concat topic, packet id and payload.
+    mqttPacket.concat(topic.getTopic());
+    if (qos > 0) {
+        mqttPacket.concat((char)(packetId >> 8));
+        mqttPacket.concat((char)(packetId & 0xFF));
+    }
+    const MqttBytes& payLoad = topic.getPayLoad();
+    if (!payLoad.isEmpty()) {
+        mqttPacket.concat((const char*)payLoad.data(), payLoad.length());
+    }
 
     return mqttPacket;
 }
 
 PublishMqttMessage::PublishMqttMessage(ReaderMqttPacket &packetReaded):MqttMessage(packetReaded.getFixedHeader()){
+    readPacket(packetReaded);
+}
+
+void PublishMqttMessage::readPacket(ReaderMqttPacket &packetReaded){
     int index = 0;
     messageId = 0;
+    receivedAt = packetReaded.getPacketStart();
+    this->setFlagsControlType(packetReaded.getFixedHeader() & 0x0F);
+    topic.setPayLoad(MqttBytes());
 
     index = packetReaded.decodeTopic(index, &topic);
 
-    // it is for qos > 0, not implement yet!!    
+    // The topic name follows its two bytes length, a slice keeps the packet.
+    topicName = packetReaded.getPacketBytes().slice(2, topic.getTopicLength());
+
+    // packet id is only present for qos > 0
     if( (this->getFlagsControlType() & 0x6) > 0){
         index = packetReaded.decodeTwoBytes(index,&messageId);
     }
@@ -58,9 +85,14 @@ PublishMqttMessage::PublishMqttMessage(ReaderMqttPacket &packetReaded):MqttMessa
     index = packetReaded.decodePayLoad(index,&topic);
 }
 
+void PublishMqttMessage::reset(){
+    topic.setPayLoad(MqttBytes());
+    topicName = MqttBytes();
+}
+
 
 
-String PublishMqttMessage::concatEncodedSize(uint32_t encodedSize, String mqttPacket){
+void PublishMqttMessage::concatEncodedSize(uint32_t encodedSize, String& mqttPacket){
    
     /**
      * remaining lengt field has between 1 to 4 bytes,
@@ -110,6 +142,4 @@ String PublishMqttMessage::concatEncodedSize(uint32_t encodedSize, String mqttPa
     byteToConcat = encodedSize;
     mqttPacket.concat((char)byteToConcat);
 
-    return mqttPacket;
-
 }
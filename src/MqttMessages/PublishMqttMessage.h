@@ -21,15 +21,23 @@ private:
     MqttTocpic topic;
     uint16_t messageId;
 
+    /**
+     * @brief Topic name as shared bytes, kept by the QoS 1/2 deliveries: a slice of
+     * the packet when the message was read from one, a copy of `topic` otherwise.
+     */
+    MqttBytes topicName;
+
+    /** @brief When the broker got the message (first byte of the packet), kept by the copies. */
+    uint32_t receivedAt = LatencyRecorder::now();
+
 
     /**
      * @brief Concatenate encoded size according to mqtt packet formar. 
      * 
      * @param encodedSize size to concatenate.
      * @param mqttPacket String where concat the encodedSize.
-     * @return String with encodedSize concatenated.
      */
-    String concatEncodedSize(uint32_t encodedSize, String mqttPacket);
+    void concatEncodedSize(uint32_t encodedSize, String& mqttPacket);
 
 public:
 
@@ -44,6 +52,25 @@ public:
      * @param packetReaded object who contains bytes readed from tcp connection. 
      */
     PublishMqttMessage(ReaderMqttPacket &packetReaded);
+
+    /**
+     * @brief Reads a publish packet into this message, reusing the capacity of its
+     * topic: how a pooled message of the Broker is filled.
+     *
+     * @param packetReaded object who contains bytes readed from tcp connection.
+     */
+    void readPacket(ReaderMqttPacket &packetReaded);
+
+    /**
+     * @brief Drops the payload and the topic name before the message goes back to
+     * its pool, the topic String keeps its capacity.
+     */
+    void reset();
+
+    /** @brief Reserves the topic String, so topics up to `length` bytes fit it. */
+    void reserveTopic(size_t length){
+        topic.reserveTopic(length);
+    }
     
     /**
      * @brief Construct a new Publish Mqtt Message object indicating
@@ -63,18 +90,30 @@ public:
      */
     PublishMqttMessage(uint8_t publishFlags, MqttTocpic topic);
     
-    bool isTopic(MqttTocpic topic){
+    bool isTopic(const MqttTocpic& topic){
         return this->topic.isTopic(topic);
     }
 
     String buildMqttPacket();
 
+    /**
+     * @brief Build the publish packet sent to a subscriber, with the QoS granted
+     * to its subscription.
+     * 
+     * @param qos QoS of this delivery (0, 1 or 2), the packet id is only written if > 0.
+     * @param packetId Packet id allocated by the subscriber session.
+     * @param retain true only for a retained message sent on a new subscription.
+     * @return String with the raw mqtt packet, the payload is its only copy.
+     */
+    String buildMqttPacket(uint8_t qos, uint16_t packetId, bool retain = false);
+
     void setTopic(String topic){
-        this->topic.setTopic(topic);
+        this->topic.setTopic(std::move(topic));
+        topicName = MqttBytes(this->topic.getTopic());
     }
 
-    void setPayLoad(String payLoad){
-        this->topic.setPayLoad(payLoad);
+    void setPayLoad(MqttBytes payLoad){
+        this->topic.setPayLoad(std::move(payLoad));
     }
 
     void setQos(uint8_t qos){
@@ -84,10 +123,45 @@ public:
         this->messageId = messageId;
     }
 
-    MqttTocpic getTopic(){
+    uint16_t getMessageId(){
+        return messageId;
+    }
+
+    /**
+     * @brief Get the QoS requested by the publisher, from the fixed header flags.
+     */
+    uint8_t getQos(){
+        return (getFlagsControlType() >> 1) & 0x03;
+    }
+
+    /**
+     * @brief Check if the publisher asked the Broker to retain this message.
+     */
+    bool isRetain(){
+        return (getFlagsControlType() & 0x01) == 0x01;
+    }
+
+    /**
+     * @brief Get the topic and payload, by reference: valid as long as this message.
+     */
+    const MqttTocpic& getTopic() const {
         return topic;
     }
 
+    /**
+     * @brief Get the topic name as shared bytes, see `topicName`.
+     */
+    const MqttBytes& getTopicName() const {
+        return topicName;
+    }
+
+    /**
+     * @brief Get when the broker got this message, see `LatencyRecorder::now()`.
+     */
+    uint32_t getReceivedAt() const {
+        return receivedAt;
+    }
+
 };
 
 
@@ -1,22 +1,19 @@
 #include "ReaderMqttPacket.h"
 
-ReaderMqttPacket::ReaderMqttPacket(std::function<void(void)> onPacketReadyCallback)
-    : _onPacketReadyCallback(onPacketReadyCallback) {
+ReaderMqttPacket::ReaderMqttPacket(PacketReadyCallback onPacketReadyCallback, void* context)
+    : _onPacketReadyCallback(onPacketReadyCallback), _callbackContext(context) {
     remainingPacket = NULL;
     reset(); // Initialize all state variables
 }
 
 ReaderMqttPacket::~ReaderMqttPacket(){
-    if (remainingPacket != NULL) {
-        free(remainingPacket);
-    }
 }
 
 void ReaderMqttPacket::reset() {
-    if (remainingPacket != NULL) {
-        free(remainingPacket);
-        remainingPacket = NULL;
-    }
+    // The preallocated buffer is kept for the next packet, an allocated one 
+    // is freed with the last payload sliced from it.
+    _packet = MqttBytes();
+    remainingPacket = NULL;
 
     remainingLengt = 0;
     fixedHeader[0] = 0;
@@ -56,12 +53,17 @@ bool ReaderMqttPacket::_parseRemainingLength(uint8_t byte) {
 void ReaderMqttPacket::addData(uint8_t* data, size_t len) {
     size_t dataIdx = 0;
 
+    if (_tooLarge) {
+        return;
+    }
+
     // Process all bytes in the incoming buffer
     while (dataIdx < len) {
 
         switch (_state) {
 
             case WAITING_FIXED_HEADER:
+                _packetStart = LatencyRecorder::now();
                 fixedHeader[0] = data[dataIdx];
                 dataIdx++;
                 _state = WAITING_REMAINING_LENGTH;
@@ -76,9 +78,20 @@ void ReaderMqttPacket::addData(uint8_t* data, size_t len) {
                     if (remainingLengt == 0) {
                         // No 'remaining packet' (e.g., PINGREQ)
                         _state = PACKET_READY;
+                    } else if (_fixedBuffer != NULL) {
+                        if (remainingLengt > _fixedBufferSize) {
+                            log_w("MQTT packet of %u bytes exceeds the %u bytes buffer.", (unsigned)remainingLengt, (unsigned)_fixedBufferSize);
+                            reset();
+                            _tooLarge = true;
+                            return; // The rest of the stream is not parsed
+                        }
+                        remainingPacket = _fixedBuffer;
+                        _bytesReadSoFar = 0;
+                        _state = WAITING_REMAINING_PACKET;
                     } else {
                         // Allocate memory for the 'remaining packet'
-                        remainingPacket = (uint8_t*) malloc(remainingLengt);
+                        _packet = MqttBytes::allocate(remainingLengt);
+                        remainingPacket = _packet.writableData();
                         if (remainingPacket == NULL) {
                             log_e("Failed to allocate memory for MQTT packet!");
                             // Critical error, reset and stop processing.
@@ -128,7 +141,7 @@ void ReaderMqttPacket::addData(uint8_t* data, size_t len) {
             
             // ...trigger the callback so the packet can be processed.
             if (_onPacketReadyCallback) {
-                _onPacketReadyCallback();
+                _onPacketReadyCallback(_callbackContext);
             }
 
             // ...and reset the parser for the *next* packet.
@@ -162,23 +175,30 @@ int ReaderMqttPacket::decodeTextField(int index, String* textField){
 
 
 int ReaderMqttPacket::decodeTopic(int index, MqttTocpic *topic){
-    String topicAux;
-    index = decodeTextField(index,&topicAux);
-    topic->setTopic(topicAux);
-    return index;
+    uint16_t length = concatenateTwoBytes(remainingPacket[index], remainingPacket[index + 1]);
+    index += 2;
+    topic->setTopic((const char*)&remainingPacket[index], length);
+    return index + length;
 }
 
 int ReaderMqttPacket::decodePayLoad(int index, MqttTocpic *topic){
-    size_t length = remainingLengt - index;
-    String payLoad;
-    if(length > 0){
-        index = bytesToString(index,length,&payLoad);
-        topic->setPayLoad(payLoad);
+    if((size_t)index < remainingLengt){
+        size_t length = remainingLengt - index;
+        topic->setPayLoad(getPacketBytes().slice(index, length));
+        index += length;
     }
 
     return index;
 }
 
+const MqttBytes& ReaderMqttPacket::getPacketBytes(){
+    // Copied once from the preallocated buffer, which the next packet overwrites.
+    if (_fixedBuffer != NULL && _packet.isEmpty() && remainingLengt > 0) {
+        _packet = MqttBytes(remainingPacket, remainingLengt);
+    }
+    return _packet;
+}
+
 int ReaderMqttPacket::decodeQosTopic(int index, MqttTocpic * topic){
     topic->setQos(remainingPacket[index]);
     index++;
@@ -215,8 +235,8 @@ uint16_t ReaderMqttPacket::concatenateTwoBytes(uint8_t msByte, uint8_t lsByte){
 
 int ReaderMqttPacket::bytesToString(int index, size_t textFieldLengt,String*textField){
 
-    for (size_t i = 0; i < textFieldLengt; i++) {
-        textField->concat((char)remainingPacket[index + i]);
+    if (textFieldLengt > 0) {
+        textField->concat((const char*)&remainingPacket[index], textFieldLengt);
     }
 
     return index + textFieldLengt;
@@ -2,8 +2,14 @@
 #define READERMQTTPACKET_H
 
 #include <Arduino.h>
-#include <functional>     // Required for std::function (our callback)
 #include "MqttTocpic.h"   // Keep for decode utils
+#include "MqttBroker/LatencyHistogram.h"
+
+/**
+ * @brief Called when a full packet is ready, with the context given to the reader.
+ * A plain function: binding it to its owner allocates nothing.
+ */
+typedef void (*PacketReadyCallback)(void* context);
 
 /**
  * @brief MQTT Packet State Machine Parser.
@@ -42,6 +48,25 @@ private:
      */
     uint8_t * remainingPacket;
 
+    /**
+     * @brief Shared buffer holding `remainingPacket` when it is allocated (or its
+     * copy, see `getPacketBytes`): a payload decoded from it is a slice, not a copy.
+     */
+    MqttBytes _packet;
+
+    /**
+     * @brief Preallocated buffer (see `setBuffer`), used instead of allocating 
+     * `remainingPacket` for each packet. NULL when packets are allocated.
+     */
+    uint8_t * _fixedBuffer = NULL;
+    size_t _fixedBufferSize = 0;
+
+    /** @brief Set when a packet did not fit `_fixedBuffer`, the stream can't be parsed anymore. */
+    bool _tooLarge = false;
+
+    /** @brief When the first byte of the current packet was read, see `LatencyRecorder::now()`. */
+    uint32_t _packetStart = 0;
+
     /**
      * @brief Current state of the parser state machine.
      */
@@ -50,7 +75,10 @@ private:
     /**
      * @brief Callback function to be executed when a full packet is ready.
      */
-    std::function<void(void)> _onPacketReadyCallback;
+    PacketReadyCallback _onPacketReadyCallback;
+
+    /** @brief Argument of `_onPacketReadyCallback` (its owner). */
+    void* _callbackContext;
 
     // --- State machine variables for parsing remaining length ---
 
@@ -116,8 +144,9 @@ public:
      *
      * @param onPacketReadyCallback The function to call when one
      * complete packet has been parsed and is ready.
+     * @param context Passed to the callback.
      */
-    ReaderMqttPacket(std::function<void(void)> onPacketReadyCallback);
+    ReaderMqttPacket(PacketReadyCallback onPacketReadyCallback, void* context);
     ~ReaderMqttPacket();
 
     /**
@@ -135,10 +164,27 @@ public:
 
     /**
      * @brief Resets the parser state machine to wait for a new packet.
-     * Frees the internal 'remainingPacket' buffer.
+     * Releases the internal 'remainingPacket' buffer, decoded payloads keep it.
      */
     void reset();
 
+    /**
+     * @brief Parses every packet into `buffer` instead of allocating one per packet.
+     * * A packet larger than `size` is not read: `isPacketTooLarge()` turns true and 
+     * the rest of the data is ignored. Call it before any data.
+     * @param buffer Storage for the variable header and payload, not owned.
+     * @param size Largest remaining length accepted.
+     */
+    void setBuffer(uint8_t* buffer, size_t size) {
+        _fixedBuffer = buffer;
+        _fixedBufferSize = size;
+    }
+
+    /** @brief true once a packet overflowed the buffer of `setBuffer`, the owner must close the stream. */
+    bool isPacketTooLarge() {
+        return _tooLarge;
+    }
+
     /**
      * @brief Get the Fixed Header byte.
      * Call this *after* the onPacketReadyCallback has fired.
@@ -149,6 +195,13 @@ public:
         return fixedHeader[0];
     }
 
+    /**
+     * @brief Get when the first byte of the packet was read, for the latency histograms.
+     */
+    uint32_t getPacketStart(){
+        return _packetStart;
+    }
+
     /**
      * @brief Get the Remaining Packet buffer (variable header + payload).
      * Call this *after* the onPacketReadyCallback has fired.
@@ -193,7 +246,8 @@ public:
     int decodeTopic(int index,MqttTocpic *topic);
 
     /**
-     * @brief Extrat payLoad from the 'remainingPacket' buffer.
+     * @brief Extrat payLoad from the 'remainingPacket' buffer, as a slice of
+     * `getPacketBytes()`.
      *
      * @param index where start the payload mqtt field.
      * @param topic MqttTopic where store payload.
@@ -201,6 +255,13 @@ public:
      */
     int decodePayLoad(int index, MqttTocpic *topic);
 
+    /**
+     * @brief The remaining packet as shared bytes: decoded fields are slices of it.
+     * With a buffer given to `setBuffer`, reused by the next packet, it is a copy
+     * made by the first call.
+     */
+    const MqttBytes& getPacketBytes();
+
     /**
      * @brief Extract qos level for a subscribe topic.
      *
@@ -236,9 +297,21 @@ public:
     /*
      * @brief Set a new callback function to be called when a full packet is ready.
      * @param onPacketReadyCallback The new function to call.
+     * @param context Passed to the callback.
      */
-    void setCallback(std::function<void(void)> onPacketReadyCallback) {
+    void setCallback(PacketReadyCallback onPacketReadyCallback, void* context) {
         _onPacketReadyCallback = onPacketReadyCallback;
+        _callbackContext = context;
+    }
+
+    /**
+     * @brief Bytes held by the parser: the packet being received.
+     */
+    size_t memoryUsage() {
+        if (_fixedBuffer != NULL) {
+            return _fixedBufferSize;
+        }
+        return remainingPacket != NULL ? remainingLengt : 0;
     }
 };
 
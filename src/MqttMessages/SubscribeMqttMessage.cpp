@@ -11,7 +11,7 @@ SubscribeMqttMessage::SubscribeMqttMessage(ReaderMqttPacket &packetReaded):MqttM
 
 int SubscribeMqttMessage::decodeTopics(int index, ReaderMqttPacket &packetReaded){
     
-    while (index < packetReaded.getRemainingPacketLength() ){
+    while ((size_t)index < packetReaded.getRemainingPacketLength() ){
         MqttTocpic topic;
         index = packetReaded.decodeTopic(index, &topic);
         index = packetReaded.decodeQosTopic(index, &topic);
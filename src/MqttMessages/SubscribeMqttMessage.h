@@ -42,7 +42,7 @@ public:
      */
     SubscribeMqttMessage(ReaderMqttPacket &packetReaded);
 
-    std::vector<MqttTocpic> getTopics(){
+    const std::vector<MqttTocpic>& getTopics(){
         return topics;
     }
 
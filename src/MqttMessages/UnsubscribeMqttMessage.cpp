@@ -13,7 +13,7 @@ UnsubscribeMqttMessage::UnsubscribeMqttMessage(ReaderMqttPacket &packetReaded):M
 
 int UnsubscribeMqttMessage::decodeTopics(int index, ReaderMqttPacket &packetReaded){
     
-    while (index < packetReaded.getRemainingPacketLength() ){
+    while ((size_t)index < packetReaded.getRemainingPacketLength() ){
         MqttTocpic topic;
         index = packetReaded.decodeTopic(index, &topic);
         topics.push_back(topic);       
@@ -0,0 +1,640 @@
+#include "MqttSnGateway.h"
+#include "ConcurrentTasks/PosixEventLoopTask.h"
+
+using namespace mqttBrokerName;
+
+// MQTT-SN v1.2 message types.
+enum MqttSnType : uint8_t {
+    SN_SEARCHGW = 0x01,
+    SN_GWINFO = 0x02,
+    SN_CONNECT = 0x04,
+    SN_CONNACK = 0x05,
+    SN_REGISTER = 0x0A,
+    SN_REGACK = 0x0B,
+    SN_PUBLISH = 0x0C,
+    SN_PUBACK = 0x0D,
+    SN_PUBCOMP = 0x0E,
+    SN_PUBREC = 0x0F,
+    SN_PUBREL = 0x10,
+    SN_SUBSCRIBE = 0x12,
+    SN_SUBACK = 0x13,
+    SN_UNSUBSCRIBE = 0x14,
+    SN_UNSUBACK = 0x15,
+    SN_PINGREQ = 0x16,
+    SN_PINGRESP = 0x17,
+    SN_DISCONNECT = 0x18
+};
+
+// Return codes.
+#define SN_ACCEPTED 0x00
+#define SN_REJECTED_CONGESTION 0x01
+#define SN_REJECTED_INVALIDTOPICID 0x02
+#define SN_REJECTED_NOTSUPPORTED 0x03
+
+// Flags field.
+#define SN_FLAG_RETAIN 0x10
+#define SN_FLAG_WILL 0x08
+#define SN_FLAG_CLEANSESSION 0x04
+#define SN_TOPIC_NORMAL 0x00
+#define SN_TOPIC_PREDEFINED 0x01
+#define SN_TOPIC_SHORT 0x02
+
+static uint16_t readTwoBytes(const uint8_t* data) {
+    return ((uint16_t)data[0] << 8) | data[1];
+}
+
+static String twoBytes(uint16_t value) {
+    String bytes;
+    bytes.concat((char)(value >> 8));
+    bytes.concat((char)(value & 0xFF));
+    return bytes;
+}
+
+static String toString(const uint8_t* data, size_t len) {
+    String string;
+    string.concat((const char*)data, len);
+    return string;
+}
+
+static bool isWildcard(const String& topic) {
+    return topic.indexOf('+') >= 0 || topic.indexOf('#') >= 0;
+}
+
+MqttSnGateway::MqttSnGateway(uint16_t port, uint8_t gatewayId) : port(port), gatewayId(gatewayId) {
+    mutex = xSemaphoreCreateRecursiveMutex();
+    if (!mutex) {
+        log_e("Failed to create MQTT-SN mutex"); ESP.restart();
+    }
+}
+
+MqttSnGateway::~MqttSnGateway() {
+    stop();
+    delete socket;
+#if MQTTBROKER_POSIX_SOCKETS
+    delete loopTask;
+#endif
+    vSemaphoreDelete(mutex);
+}
+
+void MqttSnGateway::addPredefinedTopic(uint16_t topicId, const String& topic) {
+    predefinedTopics[topicId] = topic;
+}
+
+void MqttSnGateway::begin() {
+    if (!socket) {
+#if MQTTBROKER_POSIX_SOCKETS
+        loop = std::make_shared<PosixEventLoop>();
+        socket = new PosixUdpSocket(loop);
+#else
+        socket = new AsyncUdpSocket();
+#endif
+        socket->setOnDatagram([this](const UdpEndpoint& source, const uint8_t* data, size_t len) {
+            onDatagram(source, data, len);
+        });
+    }
+
+    if (!socket->begin(port)) {
+        log_e("MQTT-SN Gateway: can't listen on UDP port %u", port);
+        return;
+    }
+
+#if MQTTBROKER_POSIX_SOCKETS
+    if (!loopTask) {
+        loopTask = new PosixEventLoopTask(loop);
+    }
+    loopTask->start();
+#endif
+    log_i("MQTT-SN Gateway started on UDP port %u", port);
+}
+
+void MqttSnGateway::stop() {
+    if (!socket) return;
+
+#if MQTTBROKER_POSIX_SOCKETS
+    // Ends between two polls, once the running dispatch is over.
+    loopTask->stop();
+#endif
+    socket->stop();
+
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (auto const& [clientId, client] : clients) {
+        unsubscribeAll(client);
+        delete client;
+    }
+    clients.clear();
+    endpoints.clear();
+    xSemaphoreGiveRecursive(mutex);
+}
+
+// --- DATAGRAMS (Network Thread) ---
+
+void MqttSnGateway::onDatagram(const UdpEndpoint& source, const uint8_t* data, size_t len) {
+    if (len < 2) return;
+
+    // Length field: 1 byte, or 0x01 followed by 2 bytes.
+    size_t length, header;
+    if (data[0] == 0x01) {
+        if (len < 4) return;
+        length = readTwoBytes(data + 1);
+        header = 3;
+    } else {
+        length = data[0];
+        header = 1;
+    }
+    if (length < header + 1 || length > len) {
+        log_v("MQTT-SN: malformed datagram from %s", source.toString().c_str());
+        return;
+    }
+
+    uint8_t type = data[header];
+    const uint8_t* body = data + header + 1;
+    size_t bodyLen = length - header - 1;
+
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    sweep();
+
+    auto it = endpoints.find(source);
+    SnClient* client = (it != endpoints.end()) ? it->second : nullptr;
+    if (client) {
+        client->lastSeen = millis();
+    }
+
+    switch (type) {
+        case SN_SEARCHGW:
+            send(source, SN_GWINFO, String((char)gatewayId));
+            break;
+        case SN_CONNECT:
+            handleConnect(source, body, bodyLen);
+            break;
+        case SN_PINGREQ:
+            handlePingreq(source, body, bodyLen);
+            break;
+        case SN_PUBLISH:
+            // QoS -1 publishes come without a connection.
+            handlePublish(client, source, body, bodyLen);
+            break;
+        default:
+            if (!client) {
+                log_v("MQTT-SN: message 0x%02x from unknown %s ignored", type, source.toString().c_str());
+                break;
+            }
+            switch (type) {
+                case SN_REGISTER:    handleRegister(client, body, bodyLen); break;
+                case SN_REGACK:      handleRegack(client, body, bodyLen); break;
+                case SN_PUBREL:      handlePubrel(client, body, bodyLen); break;
+                case SN_SUBSCRIBE:   handleSubscribe(client, body, bodyLen, true); break;
+                case SN_UNSUBSCRIBE: handleSubscribe(client, body, bodyLen, false); break;
+                case SN_DISCONNECT:  handleDisconnect(client, body, bodyLen); break;
+                default: break; // PUBACK, PUBREC, PUBCOMP: nothing is sent with QoS > 0.
+            }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+void MqttSnGateway::handleConnect(const UdpEndpoint& source, const uint8_t* body, size_t len) {
+    // Flags, ProtocolId, Duration, ClientId
+    if (len < 5) return;
+
+    uint8_t flags = body[0];
+    uint16_t keepAlive = readTwoBytes(body + 2);
+    String clientId = toString(body + 4, len - 4);
+
+    if (flags & SN_FLAG_WILL) {
+        log_w("MQTT-SN: %s asked for a will, not supported.", clientId.c_str());
+        send(source, SN_CONNACK, String((char)SN_REJECTED_NOTSUPPORTED));
+        return;
+    }
+
+    SnClient* client;
+    auto it = clients.find(clientId);
+    if (it == clients.end()) {
+        if (clients.size() >= MQTTSNMAXCLIENTS) {
+            log_w("MQTT-SN: too many clients, %s rejected.", clientId.c_str());
+            send(source, SN_CONNACK, String((char)SN_REJECTED_CONGESTION));
+            return;
+        }
+        client = new SnClient;
+        client->clientId = clientId;
+        clients[clientId] = client;
+    } else {
+        client = it->second;
+        auto previous = endpoints.find(client->endpoint);
+        if (previous != endpoints.end() && previous->second == client) {
+            endpoints.erase(previous);
+        }
+        if (flags & SN_FLAG_CLEANSESSION) {
+            unsubscribeAll(client);
+            client->pending.clear();
+        }
+    }
+
+    // Another device at this address (e.g. restarted with a new client id).
+    auto other = endpoints.find(source);
+    if (other != endpoints.end() && other->second != client) {
+        disconnect(other->second);
+    }
+
+    client->endpoint = source;
+    client->state = SN_ACTIVE;
+    client->cleanSession = flags & SN_FLAG_CLEANSESSION;
+    client->duration = (uint32_t)keepAlive * 1000;
+    client->lastSeen = millis();
+    // Registrations only last for a connection.
+    client->registered.clear();
+    client->registerMsgId = 0;
+    client->pingPending = false;
+    client->qos2Received.clear();
+    endpoints[source] = client;
+
+    send(source, SN_CONNACK, String((char)SN_ACCEPTED));
+    log_i("MQTT-SN: %s connected from %s", clientId.c_str(), source.toString().c_str());
+
+    // Messages kept while it was asleep.
+    pump(client);
+}
+
+void MqttSnGateway::handleRegister(SnClient* client, const uint8_t* body, size_t len) {
+    // TopicId, MsgId, TopicName
+    if (len < 5) return;
+
+    uint16_t msgId = readTwoBytes(body + 2);
+    String topic = toString(body + 4, len - 4);
+
+    uint8_t returnCode = SN_ACCEPTED;
+    uint16_t topicId = 0;
+    if (isWildcard(topic)) {
+        returnCode = SN_REJECTED_NOTSUPPORTED;
+    } else if ((topicId = registerTopic(topic)) == 0) {
+        returnCode = SN_REJECTED_CONGESTION;
+    } else if (std::find(client->registered.begin(), client->registered.end(), topicId) == client->registered.end()) {
+        client->registered.push_back(topicId);
+    }
+
+    send(client->endpoint, SN_REGACK, twoBytes(topicId) + twoBytes(msgId) + String((char)returnCode));
+}
+
+void MqttSnGateway::handleRegack(SnClient* client, const uint8_t* body, size_t len) {
+    // TopicId, MsgId, ReturnCode
+    if (len < 5) return;
+
+    uint16_t topicId = readTwoBytes(body);
+    uint16_t msgId = readTwoBytes(body + 2);
+    if (msgId != client->registerMsgId) return;
+    client->registerMsgId = 0;
+
+    if (body[4] == SN_ACCEPTED) {
+        client->registered.push_back(topicId);
+    } else {
+        // Refused by the device: its messages on this topic are dropped.
+        auto& pending = client->pending;
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [topicId](const PendingMessage& message) {
+            return message.topicIdType == SN_TOPIC_NORMAL && message.topicId == topicId;
+        }), pending.end());
+    }
+    pump(client);
+}
+
+void MqttSnGateway::handlePublish(SnClient* client, const UdpEndpoint& source, const uint8_t* body, size_t len) {
+    // Flags, TopicId, MsgId, Data
+    if (len < 5) return;
+
+    uint8_t flags = body[0];
+    uint8_t qosBits = (flags >> 5) & 0x03;
+    uint8_t topicIdType = flags & 0x03;
+    uint16_t topicId = readTwoBytes(body + 1);
+    uint16_t msgId = readTwoBytes(body + 3);
+
+    // QoS -1 (bits 11): fire and forget, even without connection, on ids known in advance.
+    bool connectionless = qosBits == 0x03;
+    if (connectionless) {
+        if (topicIdType == SN_TOPIC_NORMAL) return;
+    } else if (!client || client->state == SN_DISCONNECTED) {
+        return;
+    }
+    uint8_t qos = connectionless ? 0 : qosBits;
+
+    String topic = topicOf(topicIdType, topicId);
+    if (topic.length() == 0) {
+        if (!connectionless) {
+            send(source, SN_PUBACK, twoBytes(topicId) + twoBytes(msgId) + String((char)SN_REJECTED_INVALIDTOPICID));
+        }
+        return;
+    }
+
+    // Retransmission of a QoS 2 publish already routed.
+    if (qos == 2 && std::find(client->qos2Received.begin(), client->qos2Received.end(), msgId) != client->qos2Received.end()) {
+        send(source, SN_PUBREC, twoBytes(msgId));
+        return;
+    }
+
+    uint8_t publishFlags = (qos << 1) | ((flags & SN_FLAG_RETAIN) ? 0x01 : 0x00);
+    PublishMqttMessage* msg = new PublishMqttMessage(publishFlags, MqttTocpic(topic, MqttBytes(body + 5, len - 5), qos));
+    bool queued = broker->tryPublishMessage(msg, nullptr);
+    if (!queued) {
+        log_w("Broker Queue Full! Dropping MQTT-SN publish.");
+        delete msg;
+    }
+
+    if (qos == 1 || (qos == 2 && !queued)) {
+        send(source, SN_PUBACK, twoBytes(topicId) + twoBytes(msgId) + String((char)(queued ? SN_ACCEPTED : SN_REJECTED_CONGESTION)));
+    } else if (qos == 2) {
+        if (client->qos2Received.size() >= PACKETIDSETSIZE) {
+            client->qos2Received.erase(client->qos2Received.begin());
+        }
+        client->qos2Received.push_back(msgId);
+        send(source, SN_PUBREC, twoBytes(msgId));
+    }
+}
+
+void MqttSnGateway::handlePubrel(SnClient* client, const uint8_t* body, size_t len) {
+    if (len < 2) return;
+
+    uint16_t msgId = readTwoBytes(body);
+    auto it = std::find(client->qos2Received.begin(), client->qos2Received.end(), msgId);
+    if (it != client->qos2Received.end()) {
+        client->qos2Received.erase(it);
+    }
+    send(client->endpoint, SN_PUBCOMP, twoBytes(msgId));
+}
+
+void MqttSnGateway::handleSubscribe(SnClient* client, const uint8_t* body, size_t len, bool subscribe) {
+    // Flags, MsgId, TopicName or TopicId
+    if (len < 3) return;
+
+    uint8_t topicIdType = body[0] & 0x03;
+    uint16_t msgId = readTwoBytes(body + 1);
+
+    String filter;
+    uint16_t topicId = 0;
+    if (topicIdType == SN_TOPIC_NORMAL) {
+        filter = toString(body + 3, len - 3);
+        // A topic name gets its id in the SUBACK, no REGISTER needed later.
+        if (subscribe && filter.length() > 0 && !isWildcard(filter)) {
+            topicId = registerTopic(filter);
+            if (topicId && std::find(client->registered.begin(), client->registered.end(), topicId) == client->registered.end()) {
+                client->registered.push_back(topicId);
+            }
+        }
+    } else if (len >= 5) {
+        topicId = readTwoBytes(body + 3);
+        filter = topicOf(topicIdType, topicId);
+    }
+
+    if (!subscribe) {
+        auto it = client->subscriptions.find(filter);
+        if (it != client->subscriptions.end()) {
+            broker->unsubscribe(it->second);
+            client->subscriptions.erase(it);
+        }
+        send(client->endpoint, SN_UNSUBACK, twoBytes(msgId));
+        return;
+    }
+
+    uint8_t returnCode = SN_ACCEPTED;
+    if (filter.length() == 0) {
+        returnCode = SN_REJECTED_INVALIDTOPICID;
+    } else if (!client->subscriptions.count(filter)) {
+        // Retained messages are delivered from subscribe(), after the SUBACK.
+        String clientId = client->clientId;
+        client->holdDeliveries = true;
+        uint16_t subscriptionId = broker->subscribe(filter, [this, clientId](PublishMqttMessage& message) {
+            deliver(clientId, message);
+        });
+        client->holdDeliveries = false;
+
+        if (subscriptionId) {
+            client->subscriptions[filter] = subscriptionId;
+            log_i("MQTT-SN: %s subscribed to %s", client->clientId.c_str(), filter.c_str());
+        } else {
+            returnCode = SN_REJECTED_CONGESTION;
+        }
+    }
+
+    // Granted QoS 0: deliveries to sleeping devices are not acknowledged.
+    send(client->endpoint, SN_SUBACK, String((char)0x00) + twoBytes(topicId) + twoBytes(msgId) + String((char)returnCode));
+    pump(client);
+}
+
+void MqttSnGateway::handlePingreq(const UdpEndpoint& source, const uint8_t* body, size_t len) {
+    // A sleeping device wakes up with its client id, maybe from a new address.
+    if (len > 0) {
+        auto it = clients.find(toString(body, len));
+        SnClient* client = (it != clients.end()) ? it->second : nullptr;
+
+        if (client && (client->state == SN_ASLEEP || client->state == SN_AWAKE)) {
+            if (!(client->endpoint == source)) {
+                endpoints.erase(client->endpoint);
+                client->endpoint = source;
+                endpoints[source] = client;
+            }
+            client->state = SN_AWAKE;
+            client->lastSeen = millis();
+
+            // The PINGRESP ends the buffered messages, then it sleeps again.
+            client->pingPending = true;
+            pump(client);
+            return;
+        }
+    }
+    send(source, SN_PINGRESP, String());
+}
+
+void MqttSnGateway::handleDisconnect(SnClient* client, const uint8_t* body, size_t len) {
+    send(client->endpoint, SN_DISCONNECT, String());
+
+    if (len >= 2) {
+        // Sleep: messages are buffered until the next PINGREQ.
+        client->state = SN_ASLEEP;
+        client->duration = (uint32_t)readTwoBytes(body) * 1000;
+        client->lastSeen = millis();
+        client->pingPending = false;
+        log_i("MQTT-SN: %s asleep for %us", client->clientId.c_str(), (unsigned)(client->duration / 1000));
+    } else {
+        log_i("MQTT-SN: %s disconnected", client->clientId.c_str());
+        disconnect(client);
+    }
+}
+
+// --- DELIVERIES (Workers) ---
+
+void MqttSnGateway::deliver(const String& clientId, PublishMqttMessage& message) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+
+    auto it = clients.find(clientId);
+    SnClient* client = (it != clients.end()) ? it->second : nullptr;
+    if (!client || client->state == SN_DISCONNECTED) {
+        xSemaphoreGiveRecursive(mutex);
+        return;
+    }
+
+    const String& topic = message.getTopic().getTopic();
+    PendingMessage pending;
+    pending.topicId = 0;
+    pending.topicIdType = SN_TOPIC_NORMAL;
+    // Only the retained messages sent on a new subscription keep their flag.
+    pending.retain = client->holdDeliveries && message.isRetain();
+    pending.payload = message.getTopic().getPayLoad();
+
+    if (topic.length() == 2) {
+        pending.topicIdType = SN_TOPIC_SHORT;
+        pending.topicId = ((uint8_t)topic[0] << 8) | (uint8_t)topic[1];
+    } else {
+        for (auto const& [topicId, name] : predefinedTopics) {
+            if (name == topic) {
+                pending.topicIdType = SN_TOPIC_PREDEFINED;
+                pending.topicId = topicId;
+                break;
+            }
+        }
+        if (pending.topicId == 0) {
+            pending.topicId = registerTopic(topic);
+        }
+    }
+
+    if (pending.topicId == 0) {
+        log_w("MQTT-SN: topic registry full, %s not delivered to %s", topic.c_str(), clientId.c_str());
+    } else {
+        if (client->pending.size() >= MQTTSNBUFFEREDMESSAGES) {
+            log_w("MQTT-SN: buffer of %s full, oldest message dropped", clientId.c_str());
+            client->pending.pop_front();
+        }
+        client->pending.push_back(pending);
+        pump(client);
+    }
+
+    sweep();
+    xSemaphoreGiveRecursive(mutex);
+}
+
+void MqttSnGateway::pump(SnClient* client) {
+    if (client->state == SN_ASLEEP || client->state == SN_DISCONNECTED || client->holdDeliveries) {
+        return;
+    }
+
+    // Waiting for a REGACK: the REGISTER is sent again if it timed out.
+    if (client->registerMsgId != 0) {
+        if (millis() - client->registerSent < MQTTSNRETRYMS) return;
+        client->registerMsgId = 0;
+    }
+
+    while (!client->pending.empty()) {
+        PendingMessage& message = client->pending.front();
+
+        if (message.topicIdType == SN_TOPIC_NORMAL &&
+            std::find(client->registered.begin(), client->registered.end(), message.topicId) == client->registered.end()) {
+            if (++client->nextMsgId == 0) client->nextMsgId = 1;
+            client->registerMsgId = client->nextMsgId;
+            client->registerSent = millis();
+            send(client->endpoint, SN_REGISTER, twoBytes(message.topicId) + twoBytes(client->registerMsgId) + topicNames[message.topicId - 1]);
+            return;
+        }
+
+        uint8_t flags = (message.retain ? SN_FLAG_RETAIN : 0x00) | message.topicIdType;
+        String body = String((char)flags) + twoBytes(message.topicId) + twoBytes(0);
+        body.concat((const char*)message.payload.data(), message.payload.length());
+        send(client->endpoint, SN_PUBLISH, body);
+        client->pending.pop_front();
+    }
+
+    if (client->pingPending) {
+        client->pingPending = false;
+        send(client->endpoint, SN_PINGRESP, String());
+        if (client->state == SN_AWAKE) {
+            client->state = SN_ASLEEP;
+            client->lastSeen = millis();
+        }
+    }
+}
+
+// --- DEVICES ---
+
+void MqttSnGateway::sweep() {
+    unsigned long now = millis();
+    if (now - lastSweep < 1000) return;
+    lastSweep = now;
+
+    std::vector<SnClient*> lost;
+    for (auto const& [clientId, client] : clients) {
+        // Keep-alive while connected, sleep duration while asleep: 1.5x tolerance.
+        if (client->state != SN_DISCONNECTED && client->duration > 0 &&
+            now - client->lastSeen > client->duration + client->duration / 2) {
+            lost.push_back(client);
+        }
+    }
+    for (SnClient* client : lost) {
+        log_i("MQTT-SN: %s lost", client->clientId.c_str());
+        disconnect(client);
+    }
+}
+
+void MqttSnGateway::disconnect(SnClient* client) {
+    auto it = endpoints.find(client->endpoint);
+    if (it != endpoints.end() && it->second == client) {
+        endpoints.erase(it);
+    }
+
+    if (client->cleanSession) {
+        unsubscribeAll(client);
+        clients.erase(client->clientId);
+        delete client;
+    } else {
+        // Subscriptions kept for the next CONNECT, messages meanwhile are dropped.
+        client->state = SN_DISCONNECTED;
+        client->pending.clear();
+        client->registerMsgId = 0;
+        client->pingPending = false;
+    }
+}
+
+void MqttSnGateway::unsubscribeAll(SnClient* client) {
+    for (auto const& [filter, subscriptionId] : client->subscriptions) {
+        broker->unsubscribe(subscriptionId);
+    }
+    client->subscriptions.clear();
+}
+
+// --- TOPIC IDS ---
+
+String MqttSnGateway::topicOf(uint8_t topicIdType, uint16_t topicId) {
+    if (topicIdType == SN_TOPIC_NORMAL) {
+        return (topicId >= 1 && topicId <= topicNames.size()) ? topicNames[topicId - 1] : String();
+    }
+    if (topicIdType == SN_TOPIC_PREDEFINED) {
+        auto it = predefinedTopics.find(topicId);
+        return (it != predefinedTopics.end()) ? it->second : String();
+    }
+    if (topicIdType == SN_TOPIC_SHORT) {
+        return twoBytes(topicId);
+    }
+    return String();
+}
+
+uint16_t MqttSnGateway::registerTopic(const String& topic) {
+    auto it = topicIds.find(topic);
+    if (it != topicIds.end()) {
+        return it->second;
+    }
+    if (topicNames.size() >= MQTTSNMAXTOPICS) {
+        return 0;
+    }
+    topicNames.push_back(topic);
+    uint16_t topicId = topicNames.size();
+    topicIds[topic] = topicId;
+    return topicId;
+}
+
+void MqttSnGateway::send(const UdpEndpoint& destination, uint8_t type, const String& body) {
+    String packet;
+    size_t length = body.length() + 2;
+    if (length < 256) {
+        packet.concat((char)length);
+    } else {
+        length += 2;
+        packet.concat((char)0x01);
+        packet.concat(twoBytes(length));
+    }
+    packet.concat((char)type);
+    packet.concat(body);
+
+    socket->sendTo(destination, (const uint8_t*)packet.c_str(), packet.length());
+}
@@ -0,0 +1,178 @@
+#ifndef MQTT_SN_GATEWAY_H
+#define MQTT_SN_GATEWAY_H
+
+#include "MqttBroker/MqttBroker.h"
+#include "TransportLayer/UdpSocket.h"
+
+// MQTT-SN gateway: max number of clients, of gateway assigned topic ids (shared by
+// all the clients), messages buffered for a sleeping or registering client (the 
+// oldest is dropped when full), and delay before a REGISTER is sent again.
+#define MQTTSNMAXCLIENTS 32
+#define MQTTSNMAXTOPICS 256
+#define MQTTSNBUFFEREDMESSAGES 16
+#define MQTTSNRETRYMS 5000
+
+namespace mqttBrokerName{
+
+/**
+ * @brief MQTT-SN (v1.2) gateway over UDP, for battery powered sensor nodes.
+ * * Served like a listener: `broker->addListener(new MqttSnGateway(1884))`. There is no
+ * MqttClient per device, the gateway speaks MQTT-SN itself:
+ * - Publishes are routed with `MqttBroker::tryPublishMessage`, from a topic id of 
+ *   2 bytes instead of the topic name: gateway assigned (REGISTER), predefined 
+ *   (`addPredefinedTopic`) or a short name of 2 characters.
+ * - Subscriptions are local subscriptions of the broker (`MqttBroker::subscribe`), 
+ *   delivered with QoS 0. Topics unknown to the device are REGISTERed first.
+ * - A device that goes to sleep (DISCONNECT with a duration) gets its messages 
+ *   buffered until it wakes up (PINGREQ), up to MQTTSNBUFFEREDMESSAGES.
+ * - Publishes with QoS -1 are accepted from devices that never connected, on 
+ *   predefined or short topics.
+ * * Not supported: wills (CONNECT with the Will flag is refused), gateway ADVERTISE
+ * broadcasts (SEARCHGW is answered), forwarder encapsulation.
+ * * @note <b>Thread Safety:</b> datagrams are handled by the network thread (AsyncUDP 
+ * task, or the event loop on Linux) and deliveries by the Workers, under `mutex`.
+ * Keep-alive and sleep deadlines are checked as datagrams and deliveries come in.
+ */
+class MqttSnGateway : public ServerListener {
+private:
+    enum ClientState : uint8_t {
+        SN_ACTIVE,
+        SN_ASLEEP,
+        SN_AWAKE,
+        SN_DISCONNECTED
+    };
+
+    /** @brief A message waiting for a REGACK or for the device to wake up. */
+    struct PendingMessage {
+        uint16_t topicId;
+        uint8_t topicIdType;
+        bool retain;
+        MqttBytes payload;
+    };
+
+    /** @brief State of a device, kept after a disconnection when Clean Session = 0. */
+    struct SnClient {
+        String clientId;
+        UdpEndpoint endpoint;
+        ClientState state;
+        bool cleanSession;
+
+        /** @brief Keep-alive, or sleep duration while asleep (ms, 0 for none). */
+        uint32_t duration;
+        unsigned long lastSeen;
+
+        /** @brief Gateway topic ids known by the device (sent in a REGACK, SUBACK or REGISTER). */
+        std::vector<uint16_t> registered;
+
+        /** @brief Local subscription of the broker per topic filter. */
+        std::map<String, uint16_t> subscriptions;
+
+        std::deque<PendingMessage> pending;
+        /** @brief A PINGRESP is due once `pending` is empty (end of a wake up). */
+        bool pingPending = false;
+        /** @brief Set while a SUBSCRIBE is handled: retained messages wait for the SUBACK. */
+        bool holdDeliveries = false;
+
+        /** @brief Msg id of the REGISTER waiting for its REGACK, 0 if none. */
+        uint16_t registerMsgId = 0;
+        unsigned long registerSent = 0;
+        uint16_t nextMsgId = 1;
+
+        /** @brief QoS 2 publishes received, waiting for their PUBREL. */
+        std::vector<uint16_t> qos2Received;
+    };
+
+    uint16_t port;
+    uint8_t gatewayId;
+    UdpSocket* socket = nullptr;
+
+#if MQTTBROKER_POSIX_SOCKETS
+    std::shared_ptr<PosixEventLoop> loop;
+    PosixEventLoopTask* loopTask = nullptr;
+#endif
+
+    /** @brief Devices by client id, and the connected ones by address. */
+    std::map<String, SnClient*> clients;
+    std::map<UdpEndpoint, SnClient*> endpoints;
+
+    /** @brief Gateway assigned topic ids, shared by all the devices (never released). */
+    std::map<String, uint16_t> topicIds;
+    std::vector<String> topicNames;
+
+    /** @brief Topic ids configured on both sides, see `addPredefinedTopic`. */
+    std::map<uint16_t, String> predefinedTopics;
+
+    unsigned long lastSweep = 0;
+
+    /** @brief Guards the devices and the registry, recursive: subscribing delivers retained messages. */
+    SemaphoreHandle_t mutex;
+
+    void onDatagram(const UdpEndpoint& source, const uint8_t* data, size_t len);
+
+    void handleConnect(const UdpEndpoint& source, const uint8_t* body, size_t len);
+    void handleRegister(SnClient* client, const uint8_t* body, size_t len);
+    void handleRegack(SnClient* client, const uint8_t* body, size_t len);
+    void handlePublish(SnClient* client, const UdpEndpoint& source, const uint8_t* body, size_t len);
+    void handlePubrel(SnClient* client, const uint8_t* body, size_t len);
+    void handleSubscribe(SnClient* client, const uint8_t* body, size_t len, bool subscribe);
+    void handlePingreq(const UdpEndpoint& source, const uint8_t* body, size_t len);
+    void handleDisconnect(SnClient* client, const uint8_t* body, size_t len);
+
+    /** @brief Routes a message of a local subscription to a device (Worker thread). */
+    void deliver(const String& clientId, PublishMqttMessage& message);
+
+    /** @brief Sends the pending messages the device can take now. */
+    void pump(SnClient* client);
+
+    /** @brief Drops the devices whose keep-alive or sleep expired, at most once per second. */
+    void sweep();
+
+    /** @brief Ends a connection: the device is forgotten, or only disconnected if Clean Session = 0. */
+    void disconnect(SnClient* client);
+
+    /** @brief Removes the local subscriptions of a device. */
+    void unsubscribeAll(SnClient* client);
+
+    /**
+     * @brief Topic name of a topic id of the given type, empty if unknown.
+     */
+    String topicOf(uint8_t topicIdType, uint16_t topicId);
+
+    /**
+     * @brief Gateway topic id of a topic name, assigned on first use.
+     * @return 0 if the registry is full.
+     */
+    uint16_t registerTopic(const String& topic);
+
+    void send(const UdpEndpoint& destination, uint8_t type, const String& body);
+
+public:
+    /**
+     * @brief Construct a new MQTT-SN Gateway.
+     * * @param port The UDP port to listen on (MQTT-SN has no IANA port, 1884 is common).
+     * @param gatewayId Id announced in GWINFO.
+     */
+    MqttSnGateway(uint16_t port = 1884, uint8_t gatewayId = 1);
+
+    ~MqttSnGateway();
+
+    /**
+     * @brief Declares a topic id known in advance by the devices (type "predefined"):
+     * they publish and subscribe with it without any REGISTER. Call before begin().
+     */
+    void addPredefinedTopic(uint16_t topicId, const String& topic);
+
+    /**
+     * @brief Binds the UDP port.
+     */
+    void begin() override;
+
+    /**
+     * @brief Closes the UDP port and forgets the devices.
+     */
+    void stop() override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTT_SN_GATEWAY_H
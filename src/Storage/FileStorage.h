@@ -0,0 +1,200 @@
+#ifndef FILE_STORAGE_H
+#define FILE_STORAGE_H
+
+#include <vector>
+#include "TransportLayer/MqttTransport.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+#include <cstdio>
+#else
+#include <LittleFS.h>
+#endif
+
+// Directory of the broker files (offline log, snapshot) with the POSIX backend,
+// relative to the working directory unless absolute. Use MqttBroker::setStorage()
+// to place them elsewhere at runtime.
+#ifndef POSIXSTORAGEDIR
+#define POSIXSTORAGEDIR "mqttbroker-data"
+#endif
+
+/**
+ * @brief An open file of a `FileStorage`, closed when deleted.
+ */
+class StorageFile {
+public:
+    virtual ~StorageFile() {}
+
+    /** @return size_t Bytes read, 0 at the end of the file. */
+    virtual size_t read(uint8_t* buffer, size_t length) = 0;
+
+    /** @return size_t Bytes written, less than `length` on error. */
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+
+    /** @brief Moves the read position to `position` bytes from the start. */
+    virtual bool seek(uint32_t position) = 0;
+
+    virtual size_t size() = 0;
+
+    /** @brief Writes the buffered data to the medium. */
+    virtual void flush() = 0;
+};
+
+/**
+ * @brief Abstract interface of the file system keeping the persistent broker state
+ * (offline log and snapshot), the counterpart of `MqttTransport` for files.
+ * * `LittleFsStorage` on the ESP32, `PosixFileStorage` (regular files) on Linux.
+ * Paths are absolute within the storage, e.g. "/mqttlog/0.log".
+ * @note Not thread-safe, its users are guarded by the Broker.
+ */
+class FileStorage {
+public:
+    virtual ~FileStorage() {}
+
+    /**
+     * @brief Mounts the storage, may be called more than once.
+     * @return false if it can't be used.
+     */
+    virtual bool begin() = 0;
+
+    /**
+     * @brief Opens a file.
+     * @param mode "r" to read, "w" to truncate and write, "a" to append.
+     * @return StorageFile* The file, owned by the caller, nullptr if it can't be opened.
+     */
+    virtual StorageFile* open(const String& path, const char* mode) = 0;
+
+    virtual bool exists(const String& path) = 0;
+
+    virtual bool mkdir(const String& path) = 0;
+
+    virtual bool remove(const String& path) = 0;
+
+    /** @brief Renames a file, replacing `to` if it exists. */
+    virtual bool rename(const String& from, const String& to) = 0;
+
+    /** @brief Names (without directory) of the files of a directory. */
+    virtual std::vector<String> list(const String& directory) = 0;
+};
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+/**
+ * @brief Concrete implementation of FileStorage over regular files (`FILE*`),
+ * below a root directory.
+ */
+class PosixFileStorage : public FileStorage {
+private:
+    String _root;
+
+    String _fullPath(const String& path) {
+        return _root + path;
+    }
+
+public:
+    /**
+     * @param root Directory holding the files, created by `begin()` if needed.
+     */
+    PosixFileStorage(const char* root = POSIXSTORAGEDIR) : _root(root) {
+    }
+
+    bool begin() override;
+
+    StorageFile* open(const String& path, const char* mode) override;
+
+    bool exists(const String& path) override;
+
+    bool mkdir(const String& path) override;
+
+    bool remove(const String& path) override;
+
+    bool rename(const String& from, const String& to) override;
+
+    std::vector<String> list(const String& directory) override;
+};
+
+#else
+
+/**
+ * @brief Concrete implementation of StorageFile for the ESP32, adapter of `fs::File`.
+ */
+class LittleFsFile : public StorageFile {
+private:
+    File _file;
+
+public:
+    LittleFsFile(File file) : _file(file) {
+    }
+
+    ~LittleFsFile() {
+        _file.close();
+    }
+
+    size_t read(uint8_t* buffer, size_t length) override {
+        return _file.read(buffer, length);
+    }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        return _file.write(data, length);
+    }
+
+    bool seek(uint32_t position) override {
+        return _file.seek(position);
+    }
+
+    size_t size() override {
+        return _file.size();
+    }
+
+    void flush() override {
+        _file.flush();
+    }
+};
+
+/**
+ * @brief Concrete implementation of FileStorage for the ESP32, adapter of `LittleFS`,
+ * which must be formatted (e.g. `LittleFS.begin(true)` once).
+ */
+class LittleFsStorage : public FileStorage {
+public:
+    bool begin() override {
+        return LittleFS.begin();
+    }
+
+    StorageFile* open(const String& path, const char* mode) override {
+        File file = LittleFS.open(path, mode);
+        return file ? new LittleFsFile(file) : nullptr;
+    }
+
+    bool exists(const String& path) override {
+        return LittleFS.exists(path);
+    }
+
+    bool mkdir(const String& path) override {
+        return LittleFS.mkdir(path);
+    }
+
+    bool remove(const String& path) override {
+        return LittleFS.remove(path);
+    }
+
+    bool rename(const String& from, const String& to) override {
+        return LittleFS.rename(from, to);
+    }
+
+    std::vector<String> list(const String& directory) override {
+        std::vector<String> names;
+        File dir = LittleFS.open(directory);
+        File entry = dir.openNextFile();
+        while (entry) {
+            names.push_back(entry.name());
+            entry.close();
+            entry = dir.openNextFile();
+        }
+        dir.close();
+        return names;
+    }
+};
+
+#endif // MQTTBROKER_POSIX_SOCKETS
+
+#endif // FILE_STORAGE_H
@@ -0,0 +1,94 @@
+#include "FileStorage.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+/**
+ * @brief StorageFile over a `FILE*`, buffered by the C library like the LittleFS files.
+ */
+class PosixFile : public StorageFile {
+private:
+    FILE* _file;
+
+public:
+    PosixFile(FILE* file) : _file(file) {
+    }
+
+    ~PosixFile() {
+        fclose(_file);
+    }
+
+    size_t read(uint8_t* buffer, size_t length) override {
+        return fread(buffer, 1, length, _file);
+    }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        return fwrite(data, 1, length, _file);
+    }
+
+    bool seek(uint32_t position) override {
+        return fseek(_file, position, SEEK_SET) == 0;
+    }
+
+    size_t size() override {
+        struct stat st;
+        return fstat(fileno(_file), &st) == 0 ? st.st_size : 0;
+    }
+
+    void flush() override {
+        fflush(_file);
+    }
+};
+
+bool PosixFileStorage::begin() {
+    // Each missing level of the root, as `mkdir -p`.
+    for (int slash = _root.indexOf('/', 1); slash > 0; slash = _root.indexOf('/', slash + 1)) {
+        ::mkdir(_root.substring(0, slash).c_str(), 0755);
+    }
+    if (::mkdir(_root.c_str(), 0755) != 0 && errno != EEXIST) {
+        log_e("Storage: can't create %s: %d", _root.c_str(), errno);
+        return false;
+    }
+    return true;
+}
+
+StorageFile* PosixFileStorage::open(const String& path, const char* mode) {
+    const char* binaryMode = mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb";
+    FILE* file = fopen(_fullPath(path).c_str(), binaryMode);
+    return file ? new PosixFile(file) : nullptr;
+}
+
+bool PosixFileStorage::exists(const String& path) {
+    struct stat st;
+    return stat(_fullPath(path).c_str(), &st) == 0;
+}
+
+bool PosixFileStorage::mkdir(const String& path) {
+    return ::mkdir(_fullPath(path).c_str(), 0755) == 0;
+}
+
+bool PosixFileStorage::remove(const String& path) {
+    return ::remove(_fullPath(path).c_str()) == 0;
+}
+
+bool PosixFileStorage::rename(const String& from, const String& to) {
+    return ::rename(_fullPath(from).c_str(), _fullPath(to).c_str()) == 0;
+}
+
+std::vector<String> PosixFileStorage::list(const String& directory) {
+    std::vector<String> names;
+    DIR* dir = opendir(_fullPath(directory).c_str());
+    if (dir == nullptr) return names;
+
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) continue;
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    return names;
+}
+
+#endif // MQTTBROKER_POSIX_SOCKETS
@@ -22,7 +22,7 @@ NodeTrie::~NodeTrie()
 
 NodeTrie *NodeTrie::find(char character)
 {
-    if (character == '$' || this->character == character){
+    if (character == TRIEENDMARK || this->character == character){
         return this->son;
     }
 
@@ -43,13 +43,17 @@ NodeTrie *NodeTrie::find(char character)
         
 }
 
-void NodeTrie::insert(char character, NodeTrie *son)
+bool NodeTrie::insert(char character, NodeTrie *son, Trie *trie)
 {   
-    // if character is end mark, create a new map for subscribed clients.
-    if (character == '$')
+    // if character is end mark, create a new set for subscribed clients.
+    if (character == TRIEENDMARK)
     {
-        this->character = '$';
-        this->subscribedClients = new std::map<int,MqttClient*>;
+        SubscriberSet *subscribers = trie->newSubscriberSet();
+        if (subscribers == NULL) {
+            return false;
+        }
+        this->character = TRIEENDMARK;
+        this->subscribedClients = subscribers;
         this->son = son;
 
     } else { // if not, insert in order in this level.
@@ -67,39 +71,66 @@ void NodeTrie::insert(char character, NodeTrie *son)
 
         }else{ // if not present, insert the char and his son between
                // the tmp nodeTrie and his brother.
-            NodeTrie *aux = new NodeTrie();
+            NodeTrie *aux = trie->newNode();
+            if (aux == NULL) {
+                return false;
+            }
             aux->character = character;
             aux->son = son;
             aux->bro = tmp->bro;
             tmp->bro = aux;
         }
     }
+    return true;
 }
 
-void NodeTrie::takeNew(char character)
+bool NodeTrie::takeNew(char character, Trie *trie)
 {
-    NodeTrie *son = new NodeTrie();
-    insert(character, son);
+    NodeTrie *son = trie->newNode();
+    if (son == NULL) {
+        return false;
+    }
+    if (!insert(character, son, trie)) {
+        // A reserved node is not given back, its storage is exhausted anyway.
+        if (!trie->isReserved()) {
+            delete son;
+        }
+        return false;
+    }
+    return true;
 }
 
 
-void NodeTrie::addSubscribedMqttClient(MqttClient* client){
-    subscribedClients->insert(std::make_pair(client->getId(),client));
+bool NodeTrie::addSubscribedMqttClient(MqttClient* client, uint8_t qos){
+    // a repeated subscription replaces the granted QoS.
+    return subscribedClients->set(client->getSubscriberKey(), Subscriber{client->getHandle(), qos, client->getSessionId()});
 }
 
+bool NodeTrie::addSubscribedSession(int subscriberKey, uint16_t sessionId, uint8_t qos){
+    return subscribedClients->set(subscriberKey, Subscriber{ClientHandle::invalid(), qos, sessionId});
+}
 
-void NodeTrie::findSubscribedMqttClients(std::vector<MqttClient*>* clients, String topic, int index){
+bool NodeTrie::addLocalSubscriber(uint16_t subscriptionId){
+    // In-process delivery, no QoS downgrade.
+    return subscribedClients->set(localSubscriberKey(subscriptionId), Subscriber{ClientHandle::local(subscriptionId), MAXQOS, 0});
+}
+
+
+void NodeTrie::findSubscribedMqttClients(std::vector<Subscriber>* clients, const String& topic, int index){
    
     NodeTrie *tmp = this;
     unsigned int i = index;
 
     // when start to explorer a topic level, we need to now
     // if some one subcribed to this level usin "+" or "#" wildcards.
-    tmp->matchWithPlusWildCard(clients,topic,i);
-    tmp->matchWithNumberSignWildCard(clients,topic);
+    // Wildcards at the first level don't match the "$SYS"-like topics.
+    if (index != 0 || topic[0] != '$') {
+        tmp->matchWithPlusWildCard(clients,topic,i);
+        tmp->matchWithNumberSignWildCard(clients,topic);
+    }
     
     // explore main branch
-    while (topic[i] != '$')
+    while (topic[i] != TRIEENDMARK)
     {   
         // if character is not present, means that this topic is
         // not present in the tree, no body subcribe to this topic.
@@ -118,29 +149,27 @@ void NodeTrie::findSubscribedMqttClients(std::vector<MqttClient*>* clients, Stri
 
     // if numer of branch level explored is == topic.length() - 1
     // and there is end mark in this branch, there is a match with topic in the main branch. 
-   if ( (i == topic.length() - 1) &&  (tmp->find('$')) ){
+   if ( (i == topic.length() - 1) &&  (tmp->find(TRIEENDMARK)) ){
        // insert the mqttClients subscribed to this topic into clients map.
        
-        std::map<int,MqttClient*>* subs = tmp->getSubscribedMqttClients();
+        SubscriberSet* subs = tmp->getSubscribedMqttClients();
        
         if (subs) {
-            for(auto const& [id, client] : *subs) {
-                clients->push_back(client);
-            }    
+            subs->collect(*clients);
         }
    }
         
 }
 
 
-void NodeTrie::matchWithPlusWildCard(std::vector<MqttClient*>* clients,String topic, int index){
+void NodeTrie::matchWithPlusWildCard(std::vector<Subscriber>* clients, const String& topic, int index){
 
     NodeTrie *plusWildCard = this->find('+');
     if(plusWildCard == NULL){
         return; // there is not "+" wildcard in this topic level.
     }
 
-// ***** explorer ("/prefix/"->"+"->"/"->"some suffix$"), branch. ****************
+// ***** explorer ("/prefix/"->"+"->"/"->"some suffix" end mark), branch. ****************
     int indexAux = index;
     indexAux++;
     indexAux = topic.indexOf('/',indexAux);
@@ -148,8 +177,8 @@ void NodeTrie::matchWithPlusWildCard(std::vector<MqttClient*>* clients,String to
         plusWildCard->findSubscribedMqttClients(clients,topic,indexAux);
     }
     
-// ***** explorer ("/prefix/"->"+"->"$"), branch. *******************
-    plusWildCard = plusWildCard->find('$');
+// ***** explorer ("/prefix/"->"+"-> end mark), branch. *******************
+    plusWildCard = plusWildCard->find(TRIEENDMARK);
     if(plusWildCard == NULL){
         return; // no body subscribed at /prefix/+ topic in this topic level.
     }
@@ -163,7 +192,7 @@ void NodeTrie::matchWithPlusWildCard(std::vector<MqttClient*>* clients,String to
     }
 }
 
-void NodeTrie::matchWithNumberSignWildCard(std::vector<MqttClient*>* clients,String topic){
+void NodeTrie::matchWithNumberSignWildCard(std::vector<Subscriber>* clients, const String& topic){
 
     NodeTrie * numberSingWildCard = this->find('#');
     if(numberSingWildCard == NULL){
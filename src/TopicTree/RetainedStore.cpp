@@ -0,0 +1,258 @@
+#include "RetainedStore.h"
+#include "MqttBroker/MemoryPolicy.h"
+
+/****************************** RetainedStore Class *************************************/
+using namespace mqttBrokerName;
+
+RetainedStore::~RetainedStore(){
+    deleteChildren(&root);
+    MemoryPolicy::release(arena);
+}
+
+void RetainedStore::deleteChildren(Node* node){
+    for (auto const& [level, child] : node->children) {
+        deleteChildren(child);
+        delete child;
+    }
+    node->children.clear();
+}
+
+void RetainedStore::setCapacity(size_t bytes){
+    deleteChildren(&root);
+    MemoryPolicy::release(arena);
+    arena = nullptr;
+    capacity = bytes;
+    arenaEnd = 0;
+    liveBytes = 0;
+    entries.clear();
+    freeEntries.clear();
+    lruHead = -1;
+    lruTail = -1;
+}
+
+RetainedStore::Node* RetainedStore::findNode(const String& topic, bool create){
+    Node* node = &root;
+    int start = 0;
+
+    // One node per topic level, "a//b" has an empty level.
+    while (true) {
+        int end = topic.indexOf('/', start);
+        String level = topic.substring(start, end == -1 ? topic.length() : end);
+
+        auto it = node->children.find(level);
+        if (it != node->children.end()) {
+            node = it->second;
+        } else if (create) {
+            Node* child = new Node();
+            child->level = level;
+            child->parent = node;
+            node->children[level] = child;
+            node = child;
+        } else {
+            return nullptr;
+        }
+
+        if (end == -1) return node;
+        start = end + 1;
+    }
+}
+
+void RetainedStore::prune(Node* node){
+    while (node != nullptr && node != &root && node->entry < 0 && node->children.empty()) {
+        Node* parent = node->parent;
+        parent->children.erase(node->level);
+        delete node;
+        node = parent;
+    }
+}
+
+void RetainedStore::unlink(int32_t index){
+    Entry& e = entries[index];
+    if (e.newer >= 0) entries[e.newer].older = e.older; else lruHead = e.older;
+    if (e.older >= 0) entries[e.older].newer = e.newer; else lruTail = e.newer;
+    e.newer = e.older = -1;
+}
+
+void RetainedStore::touch(int32_t index){
+    if (lruHead == index) return;
+    // Not the head: linked only if it has a newer neighbour (a new entry has none).
+    if (entries[index].newer >= 0) unlink(index);
+
+    Entry& e = entries[index];
+    e.older = lruHead;
+    if (lruHead >= 0) entries[lruHead].newer = index;
+    lruHead = index;
+    if (lruTail < 0) lruTail = index;
+}
+
+void RetainedStore::release(int32_t index){
+    Entry& e = entries[index];
+    unlink(index);
+
+    liveBytes -= e.topicLength + e.payloadLength;
+    e.node->entry = -1;
+    e.node = nullptr;
+    freeEntries.push_back(index);
+
+    // Nothing referenced: the arena can be reused from the start.
+    if (liveBytes == 0) arenaEnd = 0;
+}
+
+void RetainedStore::compact(){
+    std::vector<int32_t> live;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].node) live.push_back(i);
+    }
+    std::sort(live.begin(), live.end(),
+              [this](int32_t a, int32_t b) { return entries[a].offset < entries[b].offset; });
+
+    // Slide the messages down in address order, a move never overwrites a live message.
+    size_t end = 0;
+    for (int32_t index : live) {
+        Entry& e = entries[index];
+        size_t size = e.topicLength + e.payloadLength;
+        if (e.offset != end) {
+            memmove(arena + end, arena + e.offset, size);
+            e.offset = end;
+        }
+        end += size;
+    }
+    arenaEnd = end;
+}
+
+bool RetainedStore::allocate(size_t size, uint32_t& offset){
+    if (size > capacity) return false;
+
+    if (arena == nullptr) {
+        arena = (uint8_t*)MemoryPolicy::allocate(capacity, MEMORY_RETAINED);
+        if (arena == nullptr) {
+            log_e("Failed to allocate the retained store of %u bytes", (unsigned)capacity);
+            return false;
+        }
+    }
+
+    while (liveBytes + size > capacity && lruTail >= 0) {
+        Node* node = entries[lruTail].node;
+        log_v("Retained store full, evicting a message.");
+        release(lruTail);
+        prune(node);
+    }
+
+    if (arenaEnd + size > capacity) {
+        compact();
+    }
+
+    offset = arenaEnd;
+    arenaEnd += size;
+    liveBytes += size;
+    return true;
+}
+
+bool RetainedStore::store(const String& topic, const MqttBytes& payload, uint8_t qos){
+    // The previous message of the topic is replaced (or removed).
+    Node* node = findNode(topic, false);
+    if (node && node->entry >= 0) {
+        release(node->entry);
+        prune(node);
+    }
+    if (payload.length() == 0) return true;
+
+    // Allocated before the node is created, an eviction prunes empty nodes.
+    uint32_t offset;
+    size_t size = topic.length() + payload.length();
+    if (!allocate(size, offset)) {
+        log_w("Retained message of %s is bigger than the store, dropped.", topic.c_str());
+        return false;
+    }
+    memcpy(arena + offset, topic.c_str(), topic.length());
+    memcpy(arena + offset + topic.length(), payload.data(), payload.length());
+
+    int32_t index;
+    if (!freeEntries.empty()) {
+        index = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        index = entries.size();
+        entries.push_back({});
+    }
+
+    node = findNode(topic, true);
+    node->entry = index;
+    entries[index] = {offset, (uint16_t)topic.length(), (uint32_t)payload.length(), qos, node, -1, -1};
+    touch(index);
+    return true;
+}
+
+void RetainedStore::emit(int32_t index, std::vector<RetainedMessage>& messages){
+    // A fetch is a use: the messages new subscribers ask for are evicted last.
+    touch(index);
+    copy(index, messages);
+}
+
+void RetainedStore::copy(int32_t index, std::vector<RetainedMessage>& messages){
+    const Entry& e = entries[index];
+    RetainedMessage message;
+    message.topic.concat((const char*)arena + e.offset, e.topicLength);
+    message.payload = MqttBytes(arena + e.offset + e.topicLength, e.payloadLength);
+    message.qos = e.qos;
+    messages.push_back(std::move(message));
+}
+
+void RetainedStore::emitSubtree(Node* node, std::vector<RetainedMessage>& messages){
+    if (node->entry >= 0) emit(node->entry, messages);
+    for (auto const& [level, child] : node->children) {
+        emitSubtree(child, messages);
+    }
+}
+
+void RetainedStore::match(Node* node, const std::vector<String>& levels, size_t index, std::vector<RetainedMessage>& messages){
+    if (index == levels.size()) {
+        if (node->entry >= 0) emit(node->entry, messages);
+        return;
+    }
+
+    const String& level = levels[index];
+    // Wildcards at the first level don't match the "$SYS"-like topics.
+    bool skipSystem = (node == &root);
+
+    if (level == "#") {
+        // "a/#" also matches "a".
+        if (node->entry >= 0) emit(node->entry, messages);
+        for (auto const& [name, child] : node->children) {
+            if (skipSystem && name.startsWith("$")) continue;
+            emitSubtree(child, messages);
+        }
+    } else if (level == "+") {
+        for (auto const& [name, child] : node->children) {
+            if (skipSystem && name.startsWith("$")) continue;
+            match(child, levels, index + 1, messages);
+        }
+    } else {
+        auto it = node->children.find(level);
+        if (it != node->children.end()) {
+            match(it->second, levels, index + 1, messages);
+        }
+    }
+}
+
+void RetainedStore::match(const String& filter, std::vector<RetainedMessage>& messages){
+    if (root.children.empty()) return;
+
+    std::vector<String> levels;
+    int start = 0;
+    while (true) {
+        int end = filter.indexOf('/', start);
+        levels.push_back(filter.substring(start, end == -1 ? filter.length() : end));
+        if (end == -1) break;
+        start = end + 1;
+    }
+
+    match(&root, levels, 0, messages);
+}
+
+void RetainedStore::copyAll(std::vector<RetainedMessage>& messages){
+    messages.reserve(messages.size() + size());
+    for (int32_t index = lruTail; index >= 0; index = entries[index].newer) {
+        copy(index, messages);
+    }
+}
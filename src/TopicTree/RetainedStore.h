@@ -0,0 +1,127 @@
+#ifndef RETAINED_STORE_H
+#define RETAINED_STORE_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include "MqttMessages/MqttBytes.h"
+
+// Default size in bytes (topics + payloads) of the retained messages store.
+// The least recently used messages are evicted when it is full.
+#define RETAINEDSTORESIZE (8 * 1024)
+
+namespace mqttBrokerName{
+
+/** @brief A retained message copied out of the `RetainedStore`. */
+struct RetainedMessage {
+    String topic;
+    MqttBytes payload;
+    uint8_t qos;
+};
+
+/**
+ * @brief Retained messages, indexed by a tree of topic levels.
+ * * A subscription filter with wildcards (e.g. `plant/+/status`) is matched against
+ * the stored topics in one traversal of the tree. Topics and payloads are kept in 
+ * a single arena of a fixed byte size: when a new message does not fit, the least
+ * recently used messages (stored or fetched) are evicted and the arena is compacted.
+ * * @note Not thread-safe, the Broker guards it with `topicTrieMutex`.
+ */
+class RetainedStore {
+private:
+    struct Node {
+        String level;
+        Node* parent = nullptr;
+        std::map<String, Node*> children;
+
+        /** @brief Index in `entries` of the message of this topic, -1 if none. */
+        int32_t entry = -1;
+    };
+
+    struct Entry {
+        uint32_t offset;
+        uint16_t topicLength;
+        uint32_t payloadLength;
+        uint8_t qos;
+        Node* node;
+
+        /** @brief LRU list links (indexes in `entries`), most recently used first. */
+        int32_t newer;
+        int32_t older;
+    };
+
+    Node root;
+
+    /** @brief Topics and payloads, lazily allocated with `capacity` bytes. */
+    uint8_t* arena = nullptr;
+    size_t capacity = RETAINEDSTORESIZE;
+
+    /** @brief End of the allocated part of the arena, and bytes still referenced. */
+    size_t arenaEnd = 0;
+    size_t liveBytes = 0;
+
+    std::vector<Entry> entries;
+    std::vector<int32_t> freeEntries;
+    int32_t lruHead = -1;
+    int32_t lruTail = -1;
+
+    Node* findNode(const String& topic, bool create);
+
+    /** @brief Removes the nodes left without message nor children, from `node` up. */
+    void prune(Node* node);
+
+    void unlink(int32_t index);
+    void touch(int32_t index);
+
+    /** @brief Frees a message: its bytes become garbage until the next compaction. */
+    void release(int32_t index);
+
+    /** @brief Reserves `size` bytes, evicting LRU messages and compacting if needed. */
+    bool allocate(size_t size, uint32_t& offset);
+
+    void compact();
+    void copy(int32_t index, std::vector<RetainedMessage>& messages);
+    void emit(int32_t index, std::vector<RetainedMessage>& messages);
+    void emitSubtree(Node* node, std::vector<RetainedMessage>& messages);
+    void match(Node* node, const std::vector<String>& levels, size_t index, std::vector<RetainedMessage>& messages);
+    void deleteChildren(Node* node);
+
+public:
+    ~RetainedStore();
+
+    /**
+     * @brief Sets the arena size in bytes, dropping the stored messages.
+     */
+    void setCapacity(size_t bytes);
+
+    /**
+     * @brief Stores the retained message of a topic, replacing the previous one.
+     * * An empty payload removes the retained message of the topic.
+     * 
+     * @return false if the message is bigger than the whole store.
+     */
+    bool store(const String& topic, const MqttBytes& payload, uint8_t qos);
+
+    /**
+     * @brief Collects the retained messages matching a subscription filter.
+     * 
+     * @param filter Topic filter, may contain `+` and `#` wildcards.
+     * @param messages Output, copies of the matching messages.
+     */
+    void match(const String& filter, std::vector<RetainedMessage>& messages);
+
+    /**
+     * @brief Copies all the retained messages, least recently used first.
+     * * Storing them back in this order restores the eviction order. Not a use.
+     */
+    void copyAll(std::vector<RetainedMessage>& messages);
+
+    /** @brief Number of retained messages. */
+    size_t size(){
+        return entries.size() - freeEntries.size();
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // RETAINED_STORE_H
@@ -0,0 +1,53 @@
+#include "MqttBroker/MqttBroker.h"
+
+using namespace mqttBrokerName;
+
+SubscriberSet::~SubscriberSet() {
+    while (head != nullptr) {
+        Entry* next = head->next;
+        trie->releaseEntry(head);
+        head = next;
+    }
+}
+
+bool SubscriberSet::set(int key, const Subscriber& subscriber) {
+    Subscriber* stored = find(key);
+    if (stored != nullptr) {
+        *stored = subscriber;
+        return true;
+    }
+
+    Entry* entry = trie->newEntry();
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->key = key;
+    entry->subscriber = subscriber;
+    entry->next = head;
+    head = entry;
+    count++;
+    return true;
+}
+
+void SubscriberSet::erase(int key) {
+    Entry** link = &head;
+    while (*link != nullptr) {
+        Entry* entry = *link;
+        if (entry->key == key) {
+            *link = entry->next;
+            trie->releaseEntry(entry);
+            count--;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+Subscriber* SubscriberSet::find(int key) {
+    for (Entry* entry = head; entry != nullptr; entry = entry->next) {
+        if (entry->key == key) {
+            return &entry->subscriber;
+        }
+    }
+    return nullptr;
+}
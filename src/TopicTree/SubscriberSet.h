@@ -0,0 +1,77 @@
+#ifndef SUBSCRIBER_SET_H
+#define SUBSCRIBER_SET_H
+
+#include <Arduino.h>
+#include <vector>
+#include "MqttBroker/ClientTable.h"
+
+namespace mqttBrokerName{
+
+class Trie;
+
+/**
+ * @brief Trie entry: a subscribed client with the QoS granted to its subscription.
+ */
+struct Subscriber {
+    ClientHandle handle;
+    uint8_t qos;
+
+    /** @brief Persistent session of the client, 0 for a clean session. */
+    uint16_t sessionId;
+};
+
+/**
+ * @brief Subscribers of a Trie node, keyed by client id, session key or local 
+ * subscription key. 
+ * * A linked list: a topic filter has a handful of subscribers, and its entries come 
+ * from the `Trie` that owns it (its preallocated pool after `Trie::reserve`).
+ */
+class SubscriberSet {
+public:
+    struct Entry {
+        int key;
+        Subscriber subscriber;
+        Entry* next;
+    };
+
+private:
+    Entry* head = nullptr;
+    uint16_t count = 0;
+
+    /** @brief Allocates and frees the entries. */
+    Trie* trie;
+
+public:
+    SubscriberSet(Trie* trie) : trie(trie) {}
+    ~SubscriberSet();
+
+    SubscriberSet(const SubscriberSet&) = delete;
+    SubscriberSet& operator=(const SubscriberSet&) = delete;
+
+    /**
+     * @brief Adds a subscriber, or replaces the one stored with the same key.
+     * @return false if no entry is left, the subscriber is not added.
+     */
+    bool set(int key, const Subscriber& subscriber);
+
+    /** @brief Removes the subscriber of a key, if any. */
+    void erase(int key);
+
+    /** @brief Subscriber of a key, nullptr if there is none. */
+    Subscriber* find(int key);
+
+    /** @brief Appends every subscriber to `subscribers`. */
+    void collect(std::vector<Subscriber>& subscribers) const {
+        for (Entry* entry = head; entry != nullptr; entry = entry->next) {
+            subscribers.push_back(entry->subscriber);
+        }
+    }
+
+    uint16_t size() const {
+        return count;
+    }
+};
+
+} // namespace mqttBrokerName
+
+#endif // SUBSCRIBER_SET_H
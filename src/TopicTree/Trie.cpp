@@ -8,27 +8,124 @@ Trie::Trie()
 }
 Trie::~Trie()
 {
-    delete root;
+    if (isReserved()) {
+        releaseArenas();
+    } else {
+        delete root;
+    }
 }
 void Trie::clear()
 {
     numElem = 0;
-    delete root;
-    root = new NodeTrie();
+    if (isReserved()) {
+        // Every node and entry goes back to the reserved storage at once.
+        nodesUsed = 0;
+        setsUsed = 0;
+        freeEntries = nullptr;
+        // As many entries as sets: one per subscription.
+        for (uint16_t i = 0; i < numSets; i++) {
+            releaseEntry(&entryArena[i]);
+        }
+        root = newNode();
+    } else {
+        delete root;
+        root = new NodeTrie();
+    }
+}
+
+void Trie::reserve(uint16_t maxSubscriptions, uint32_t maxNodes, size_t maxTopicLength)
+{
+    if (!isReserved()) {
+        delete root;
+    }
+    releaseArenas();
+
+    // Raw storage: nodes and sets are built in place when taken. Walked on every
+    // publish, so kept in internal RAM.
+    nodeArena = (NodeTrie*)MemoryPolicy::allocate(sizeof(NodeTrie) * maxNodes, MEMORY_METADATA);
+    setArena = (SubscriberSet*)MemoryPolicy::allocate(sizeof(SubscriberSet) * maxSubscriptions, MEMORY_METADATA);
+    entryArena = (SubscriberSet::Entry*)MemoryPolicy::allocate(sizeof(SubscriberSet::Entry) * maxSubscriptions, MEMORY_METADATA);
+    if (!nodeArena || !setArena || !entryArena) {
+        log_e("Failed to allocate the Trie storage"); ESP.restart();
+    }
+    numNodes = maxNodes;
+    numSets = maxSubscriptions;
+
+    // Topic, end mark and terminator.
+    query.reserve(maxTopicLength + 2);
+    clear();
+}
+
+void Trie::releaseArenas()
+{
+    MemoryPolicy::release(nodeArena);
+    MemoryPolicy::release(setArena);
+    MemoryPolicy::release(entryArena);
+    nodeArena = nullptr;
+    setArena = nullptr;
+    entryArena = nullptr;
+    freeEntries = nullptr;
+    numNodes = nodesUsed = 0;
+    numSets = setsUsed = 0;
+}
+
+NodeTrie* Trie::newNode()
+{
+    if (!isReserved()) {
+        return new NodeTrie();
+    }
+    if (nodesUsed == numNodes) {
+        return NULL;
+    }
+    return new (&nodeArena[nodesUsed++]) NodeTrie();
+}
+
+SubscriberSet* Trie::newSubscriberSet()
+{
+    if (!isReserved()) {
+        return new SubscriberSet(this);
+    }
+    if (setsUsed == numSets) {
+        return NULL;
+    }
+    return new (&setArena[setsUsed++]) SubscriberSet(this);
+}
+
+SubscriberSet::Entry* Trie::newEntry()
+{
+    if (!isReserved()) {
+        return new SubscriberSet::Entry;
+    }
+    SubscriberSet::Entry* entry = freeEntries;
+    if (entry != NULL) {
+        freeEntries = entry->next;
+    }
+    return entry;
+}
+
+void Trie::releaseEntry(SubscriberSet::Entry* entry)
+{
+    if (!isReserved()) {
+        delete entry;
+        return;
+    }
+    entry->next = freeEntries;
+    freeEntries = entry;
 }
 
 NodeTrie* Trie::insert(String topic)
 {
     NodeTrie *tmp = root;
     unsigned int i = 0;
-    topic += '$';// add end mark to the topic.
+    topic += TRIEENDMARK;// add end mark to the topic.
 
     // start iterate insertion.
-    while (topic[i] != '$')
+    while (topic[i] != TRIEENDMARK)
     {   
         // if the char is not present, insert the char in the trie.
-        if (tmp->find(topic[i]) == NULL){
-            tmp->takeNew(topic[i]);
+        if (tmp->find(topic[i]) == NULL && !tmp->takeNew(topic[i], this)){
+            log_w("Trie storage full, topic %s not inserted.", topic.c_str());
+            return NULL;
         }
 
         // down to the next level of this branch.    
@@ -36,10 +133,13 @@ NodeTrie* Trie::insert(String topic)
         i++; // next char to insert.
     }
 
-    if (tmp->find('$') == NULL)
+    if (tmp->find(TRIEENDMARK) == NULL)
     {   
         // insert end mark in the current node.
-        tmp->insert('$', tmp);
+        if (!tmp->insert(TRIEENDMARK, tmp, this)) {
+            log_w("Trie storage full, topic %s not inserted.", topic.c_str());
+            return NULL;
+        }
         numElem++;
     }
     return tmp;
@@ -50,9 +150,9 @@ bool Trie::find(String topic)
     NodeTrie *tmp = root;
     unsigned int i = 0;   
     // add end mark to the topic.
-    topic += '$';
+    topic += TRIEENDMARK;
 
-    while (topic[i] != '$')
+    while (topic[i] != TRIEENDMARK)
     {
         if (tmp->find(topic[i]) == NULL){
             return false;
@@ -62,21 +162,36 @@ bool Trie::find(String topic)
         i++;
     }
     
-    return ( (i == topic.length() - 1) && (tmp->find('$')) ); 
+    return ( (i == topic.length() - 1) && (tmp->find(TRIEENDMARK)) ); 
 }
 
-NodeTrie* Trie::subscribeToTopic(String topic, MqttClient* client){
+NodeTrie* Trie::subscribeToTopic(String topic, MqttClient* client, uint8_t qos){
     NodeTrie* aux = insert(topic);
-    aux->addSubscribedMqttClient(client);
+    if (aux == NULL || !aux->addSubscribedMqttClient(client, qos)) {
+        return NULL;
+    }
     return aux;
 }
 
-std::vector<MqttClient*>* Trie::getSubscribedMqttClients(String topic){
-    
-    std::vector<MqttClient*>* clients = new std::vector<MqttClient*>();    
-    NodeTrie *tmp = root;
-    unsigned int i = 0;
-    topic += '$';
-    tmp->findSubscribedMqttClients(clients,topic,i);
-    return clients;
-}
\ No newline at end of file
+NodeTrie* Trie::subscribeSession(String topic, int subscriberKey, uint16_t sessionId, uint8_t qos){
+    NodeTrie* aux = insert(topic);
+    if (aux == NULL || !aux->addSubscribedSession(subscriberKey, sessionId, qos)) {
+        return NULL;
+    }
+    return aux;
+}
+
+NodeTrie* Trie::subscribeLocal(String topic, uint16_t subscriptionId){
+    NodeTrie* aux = insert(topic);
+    if (aux == NULL || !aux->addLocalSubscriber(subscriptionId)) {
+        return NULL;
+    }
+    return aux;
+}
+
+void Trie::getSubscribedMqttClients(const String& topic, std::vector<Subscriber>& clients){
+    // Reused buffer: no copy of the topic is allocated once it is large enough.
+    query = topic;
+    query += TRIEENDMARK;
+    root->findSubscribedMqttClients(&clients, query, 0);
+}
@@ -0,0 +1,131 @@
+#include "IoUringListener.h"
+#include "ConcurrentTasks/IoUringLoopTask.h"
+
+#if MQTTBROKER_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+
+using namespace mqttBrokerName;
+
+IoUringTcpServerListener::IoUringTcpServerListener(uint16_t port) : port(port) {
+}
+
+IoUringTcpServerListener::~IoUringTcpServerListener() {
+    stop();
+    delete loopTask;
+}
+
+void IoUringTcpServerListener::begin() {
+    if (listenFd >= 0) return;
+
+    if (!loop) {
+        loop = std::make_shared<IoUringLoop>();
+    }
+    if (!loop->ready()) {
+        log_e("TCP Listener: io_uring unavailable, use MqttBrokerFactory::createTcpBroker()");
+        return;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        log_e("TCP Listener: socket() failed: %d", errno);
+        return;
+    }
+
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        log_e("TCP Listener: can't listen on port %u: %d", port, errno);
+        ::close(listenFd);
+        listenFd = -1;
+        return;
+    }
+
+    // The ACCEPT is prepared by the loop thread, the only writer of the ring.
+    id = loop->add(this);
+    acceptArmed = false;
+    loop->requestFlush(id);
+
+    if (!loopTask) {
+        loopTask = new IoUringLoopTask(loop);
+    }
+    loopTask->start();
+    log_i("TCP Listener (io_uring) started on port %u", port);
+}
+
+void IoUringTcpServerListener::stop() {
+    if (listenFd < 0) return;
+
+    // Ends between two polls, once the running dispatch is over.
+    loopTask->stop();
+
+    // Ends the pending ACCEPT and frees the port, the descriptor is closed by the loop.
+    ::shutdown(listenFd, SHUT_RDWR);
+    loop->remove(id, listenFd);
+    listenFd = -1;
+}
+
+void IoUringTcpServerListener::onFlush() {
+    if (acceptArmed || listenFd < 0) return;
+
+    io_uring_sqe* sqe = loop->prepare(id, IoUringOp::ACCEPT);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    acceptArmed = true;
+}
+
+void IoUringTcpServerListener::onCompletion(IoUringOp op, int32_t result, uint32_t flags) {
+    if (op != IoUringOp::ACCEPT) return;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        // Ended by the kernel (e.g. an error): armed again by the next iteration.
+        acceptArmed = false;
+        loop->requestFlush(id);
+    }
+
+    if (result < 0) {
+        log_w("TCP Listener: accept() failed: %d", -result);
+        return;
+    }
+    int fd = result;
+
+    if (!this->broker) {
+        // No broker assigned to handle this, reject connection
+        ::close(fd);
+        return;
+    }
+
+    // MQTT packets are small: don't wait to coalesce them.
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    // A multishot ACCEPT has no room for the address of each connection.
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    getpeername(fd, (sockaddr*)&address, &length);
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+
+    // 1. Wrap the socket into our Transport Adapter, sharing this ring.
+    MqttTransport* transport = new IoUringTransport(fd, loop, String(ip));
+
+    // 2. Inject the transport into the Broker logic
+    this->accept(transport);
+}
+
+#endif // MQTTBROKER_IO_URING
@@ -0,0 +1,71 @@
+#ifndef IO_URING_LISTENER_H
+#define IO_URING_LISTENER_H
+
+#include "MqttBroker/MqttBroker.h"
+
+#if MQTTBROKER_IO_URING
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Concrete implementation of ServerListener for TCP connections on Linux, over io_uring.
+ * * Alternative to `PosixTcpServerListener` for many busy clients: a multishot ACCEPT
+ * on an `IoUringLoop`, run by an `IoUringLoopTask` (the Network Thread). Accepted 
+ * connections are wrapped in an `IoUringTransport` sharing the same ring.
+ */
+class IoUringTcpServerListener : public ServerListener, public IoUringHandler {
+private:
+    /**
+     * @brief The port number to listen on.
+     */
+    uint16_t port;
+
+    int listenFd = -1;
+
+    /** @brief Registration of the listener in the loop. */
+    uint32_t id = 0;
+
+    bool acceptArmed = false;
+
+    /** @brief Shared with the transports, which may be deleted after the listener. */
+    std::shared_ptr<IoUringLoop> loop;
+
+    IoUringLoopTask* loopTask = nullptr;
+
+public:
+    /**
+     * @brief Construct a new io_uring Tcp Server Listener.
+     * * @param port The TCP port to listen on (default MQTT is 1883).
+     */
+    IoUringTcpServerListener(uint16_t port);
+
+    ~IoUringTcpServerListener();
+
+    /**
+     * @brief Binds the port, arms the ACCEPT and starts the event loop task.
+     * * Logs an error and does nothing if the kernel lacks io_uring.
+     */
+    void begin() override;
+
+    /**
+     * @brief Stops the event loop task and closes the listening socket.
+     * * Accepted connections are no longer serviced.
+     */
+    void stop() override;
+
+    /**
+     * @brief Arms the multishot ACCEPT (event loop thread).
+     */
+    void onFlush() override;
+
+    /**
+     * @brief Hands an accepted connection to the broker (event loop thread).
+     */
+    void onCompletion(IoUringOp op, int32_t result, uint32_t flags) override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTTBROKER_IO_URING
+
+#endif // IO_URING_LISTENER_H
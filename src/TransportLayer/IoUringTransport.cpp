@@ -0,0 +1,577 @@
+#include "IoUringTransport.h"
+
+#if MQTTBROKER_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+// Receive buffer group of the ring, registered by the loop.
+#define IOURINGBUFFERGROUP 0
+
+/****************************** IoUringLoop Class ****************************************/
+
+IoUringLoop::IoUringLoop(){
+    mutex = xSemaphoreCreateRecursiveMutex();
+    flushMutex = xSemaphoreCreateMutex();
+    if (!mutex || !flushMutex) {
+        log_e("Failed to create io_uring loop mutex"); ESP.restart();
+    }
+
+    if (!setup()) {
+        log_e("io_uring not available: %d", errno);
+    }
+}
+
+IoUringLoop::~IoUringLoop(){
+    // Closing the ring cancels every operation still pending.
+    if (ringFd >= 0) ::close(ringFd);
+    if (wakeFd >= 0) ::close(wakeFd);
+    for (int fd : closing) ::close(fd);
+    for (auto& retired : retiredSends) delete retired.second;
+
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    if (bufferRing) munmap(bufferRing, bufferRingSize);
+    free(buffers);
+
+    vSemaphoreDelete(flushMutex);
+    vSemaphoreDelete(mutex);
+}
+
+bool IoUringLoop::setup(){
+    io_uring_params params = {};
+    ringFd = syscall(__NR_io_uring_setup, IOURINGENTRIES, &params);
+    if (ringFd < 0) return false;
+
+    // The wait timeout is passed to io_uring_enter (Linux 5.11).
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (entries == MAP_FAILED) return false;
+    sqes = (io_uring_sqe*)entries;
+
+    uint8_t* sq = (uint8_t*)sqRing;
+    sqHead = (std::atomic<uint32_t>*)(sq + params.sq_off.head);
+    sqTail = (std::atomic<uint32_t>*)(sq + params.sq_off.tail);
+    sqMask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+    sqArray = (uint32_t*)(sq + params.sq_off.array);
+    sqLocalTail = sqTail->load(std::memory_order_relaxed);
+    // Entry i of the queue is always sqes[i].
+    for (uint32_t i = 0; i <= sqMask; i++) {
+        sqArray[i] = i;
+    }
+
+    uint8_t* cq = (uint8_t*)cqRing;
+    cqHead = (std::atomic<uint32_t>*)(cq + params.cq_off.head);
+    cqTail = (std::atomic<uint32_t>*)(cq + params.cq_off.tail);
+    cqMask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Receive buffers, selected by the kernel for each multishot RECV completion (Linux 5.19).
+    buffers = (uint8_t*)malloc((size_t)IOURINGBUFFERS * IOURINGBUFFERSIZE);
+    if (!buffers) return false;
+
+    bufferRingSize = IOURINGBUFFERS * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) return false;
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = (uint64_t)(uintptr_t)ring;
+    registration.ring_entries = IOURINGBUFFERS;
+    registration.bgid = IOURINGBUFFERGROUP;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        munmap(ring, bufferRingSize);
+        return false;
+    }
+    bufferRing = (io_uring_buf*)ring;
+    for (uint16_t i = 0; i < IOURINGBUFFERS; i++) {
+        recycle(i);
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) return false;
+    armWake();
+    return true;
+}
+
+uint64_t IoUringLoop::userData(uint32_t id, uint32_t generation, IoUringOp op){
+    return ((uint64_t)generation << 32) | ((id & 0xFFFFFF) << 8) | (uint8_t)op;
+}
+
+int IoUringLoop::enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags, int timeoutMs){
+    if (!(flags & IORING_ENTER_GETEVENTS)) {
+        return syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, flags, nullptr, 0);
+    }
+
+    __kernel_timespec timeout = {};
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+
+    io_uring_getevents_arg argument = {};
+    argument.sigmask_sz = _NSIG / 8;
+    argument.ts = (uint64_t)(uintptr_t)&timeout;
+
+    return syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+                   flags | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+}
+
+void IoUringLoop::armWake(){
+    io_uring_sqe* sqe = prepare(0, IoUringOp::WAKE);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = (uint64_t)(uintptr_t)&wakeCounter;
+    sqe->len = sizeof(wakeCounter);
+    sqe->off = (uint64_t)-1;
+}
+
+uint32_t IoUringLoop::add(IoUringHandler* handler){
+    lock();
+    uint32_t id;
+    do {
+        id = nextId++ & 0xFFFFFF;
+    } while (id == 0 || handlers.count(id));
+
+    handlers[id] = {handler, nextGeneration++};
+    unlock();
+    return id;
+}
+
+void IoUringLoop::remove(uint32_t id, int fd, String* sending){
+    lock();
+    auto it = handlers.find(id);
+    if (it != handlers.end()) {
+        if (sending) {
+            retiredSends[userData(id, it->second.generation, IoUringOp::SEND)] = sending;
+        }
+        handlers.erase(it);
+    } else {
+        delete sending;
+    }
+    if (fd >= 0) {
+        closing.push_back(fd);
+    }
+    unlock();
+}
+
+io_uring_sqe* IoUringLoop::prepare(uint32_t id, IoUringOp op){
+    if (ringFd < 0) return nullptr;
+
+    if (sqLocalTail - sqHead->load(std::memory_order_acquire) > sqMask) {
+        // Full: submit what is queued and retry.
+        sqTail->store(sqLocalTail, std::memory_order_release);
+        enter(sqLocalTail - sqHead->load(std::memory_order_acquire), 0, 0, 0);
+        if (sqLocalTail - sqHead->load(std::memory_order_acquire) > sqMask) {
+            log_e("io_uring submission queue full");
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = operationOf(id, op);
+    sqLocalTail++;
+    return sqe;
+}
+
+uint64_t IoUringLoop::operationOf(uint32_t id, IoUringOp op){
+    auto it = handlers.find(id);
+    return userData(id, it != handlers.end() ? it->second.generation : 0, op);
+}
+
+void IoUringLoop::requestFlush(uint32_t id){
+    bool wake = false;
+    if (xSemaphoreTake(flushMutex, portMAX_DELAY) == pdTRUE) {
+        wake = flushRequests.empty() && !dispatching;
+        flushRequests.push_back(id);
+        xSemaphoreGive(flushMutex);
+    }
+
+    // Requests made while dispatching are run by the same iteration.
+    if (wake) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            log_w("io_uring wake failed: %d", errno);
+        }
+    }
+}
+
+void IoUringLoop::recycle(uint16_t bufferId){
+    // Not io_uring_buf_ring::bufs: its flexible array is misplaced when compiled as C++.
+    io_uring_buf* entry = &bufferRing[bufferTail & (IOURINGBUFFERS - 1)];
+    entry->addr = (uint64_t)(uintptr_t)buffer(bufferId);
+    entry->len = IOURINGBUFFERSIZE;
+    entry->bid = bufferId;
+    bufferTail++;
+    __atomic_store_n(&bufferRing[0].resv, bufferTail, __ATOMIC_RELEASE);
+}
+
+void IoUringLoop::poll(int timeoutMs){
+    if (ringFd < 0) {
+        vTaskDelay(timeoutMs);
+        return;
+    }
+
+    // One syscall submits the operations prepared since the last iteration, for every
+    // connection, and waits without the lock: handlers can be removed meanwhile.
+    sqTail->store(sqLocalTail, std::memory_order_release);
+    uint32_t toSubmit = sqLocalTail - sqHead->load(std::memory_order_acquire);
+    int result = enter(toSubmit, 1, IORING_ENTER_GETEVENTS, timeoutMs);
+    if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        log_w("io_uring_enter failed: %d", errno);
+    }
+
+    lock();
+
+    // No queued operation refers to the removed descriptors anymore, they can be reused.
+    if (sqHead->load(std::memory_order_acquire) == sqLocalTail) {
+        for (int fd : closing) ::close(fd);
+        closing.clear();
+    }
+
+    if (xSemaphoreTake(flushMutex, portMAX_DELAY) == pdTRUE) {
+        dispatching = true;
+        xSemaphoreGive(flushMutex);
+    }
+
+    uint32_t head = cqHead->load(std::memory_order_relaxed);
+    while (head != cqTail->load(std::memory_order_acquire)) {
+        io_uring_cqe* cqe = &cqes[head & cqMask];
+        uint64_t data = cqe->user_data;
+        int32_t res = cqe->res;
+        uint32_t flags = cqe->flags;
+        cqHead->store(++head, std::memory_order_release);
+
+        IoUringOp op = (IoUringOp)(data & 0xFF);
+        uint32_t id = (data >> 8) & 0xFFFFFF;
+        uint32_t generation = data >> 32;
+
+        if (op == IoUringOp::WAKE) {
+            armWake();
+            continue;
+        }
+
+        auto it = handlers.find(id);
+        if (it == handlers.end() || it->second.generation != generation) {
+            // Removed since the operation was submitted: stale completion.
+            if (op == IoUringOp::SEND) {
+                auto retired = retiredSends.find(data);
+                if (retired != retiredSends.end()) {
+                    delete retired->second;
+                    retiredSends.erase(retired);
+                }
+            }
+            if (flags & IORING_CQE_F_BUFFER) {
+                recycle(flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            continue;
+        }
+
+        it->second.handler->onCompletion(op, res, flags);
+    }
+
+    // Then the sends staged by the Workers (and by the callbacks above).
+    while (true) {
+        std::vector<uint32_t> requests;
+        if (xSemaphoreTake(flushMutex, portMAX_DELAY) == pdTRUE) {
+            requests.swap(flushRequests);
+            dispatching = !requests.empty();
+            xSemaphoreGive(flushMutex);
+        }
+        if (requests.empty()) break;
+
+        for (uint32_t id : requests) {
+            auto it = handlers.find(id);
+            if (it != handlers.end()) {
+                it->second.handler->onFlush();
+            }
+        }
+    }
+
+    unlock();
+}
+
+/****************************** IoUringTransport Class ***********************************/
+
+IoUringTransport::IoUringTransport(int fd, std::shared_ptr<IoUringLoop> loop, const String& ip)
+    : _fd(fd), _loop(loop), _ip(ip) {
+    _txMutex = xSemaphoreCreateMutex();
+    if (!_txMutex) {
+        log_e("Failed to create transport mutex"); ESP.restart();
+    }
+    _staged = new String();
+    _sendBuffer = new String();
+
+    // Built by the loop thread, on the completion of its ACCEPT: the RECV is
+    // submitted once the MqttClient has set its callbacks.
+    _id = _loop->add(this);
+    _loop->lock();
+    _armRecv();
+    _loop->unlock();
+}
+
+IoUringTransport::~IoUringTransport(){
+    // Ends the RECV (and a blocked SEND) still pending in the kernel.
+    ::shutdown(_fd, SHUT_RDWR);
+
+    // Waits for a running callback of this transport.
+    _loop->lock();
+    for (const HeldBuffer& held : _held) {
+        _loop->recycle(held.bufferId);
+    }
+    if (_sending) {
+        // The kernel may still read it, the loop frees it on completion.
+        _loop->remove(_id, _fd, _sendBuffer);
+    } else {
+        _loop->remove(_id, _fd);
+        delete _sendBuffer;
+    }
+    _loop->unlock();
+
+    delete _staged;
+    vSemaphoreDelete(_txMutex);
+}
+
+void IoUringTransport::_armRecv(){
+    io_uring_sqe* sqe = _loop->prepare(_id, IoUringOp::RECV);
+    if (!sqe) {
+        close();
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = _fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IOURINGBUFFERGROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    _recvArmed = true;
+}
+
+void IoUringTransport::_submitSend(){
+    // Call with `_txMutex` held.
+    size_t length = _sendBuffer->length() - _sendOffset;
+    io_uring_sqe* sqe = _loop->prepare(_id, IoUringOp::SEND);
+    if (!sqe) {
+        close();
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = _fd;
+    sqe->addr = (uint64_t)(uintptr_t)(_sendBuffer->c_str() + _sendOffset);
+    sqe->len = length;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    _sending = true;
+}
+
+size_t IoUringTransport::send(const char* data, size_t len){
+    if (!_open) {
+        log_e("TCP Send Failed: Client not connected");
+        return 0;
+    }
+
+    bool request = false;
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) != pdTRUE) return 0;
+    _staged->concat(data, len);
+    request = !_flushPending;
+    _flushPending = true;
+    xSemaphoreGive(_txMutex);
+
+    // Everything staged until the loop runs leaves in one SEND.
+    if (request) {
+        _loop->requestFlush(_id);
+    }
+    return len;
+}
+
+size_t IoUringTransport::memoryUsage(){
+    size_t bytes = sizeof(*this) + 2 * sizeof(String) + _ip.length();
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+        bytes += _staged->length() + _sendBuffer->length();
+        xSemaphoreGive(_txMutex);
+    }
+    return bytes;
+}
+
+size_t IoUringTransport::space(){
+    if (!_open) return 0;
+
+    long available = IOURINGSENDBUFFER;
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+        available -= _staged->length();
+        if (_sending) available -= _sendBuffer->length() - _sendOffset;
+        xSemaphoreGive(_txMutex);
+    }
+    return available > 0 ? available : 0;
+}
+
+void IoUringTransport::close(){
+    // Completes the RECV with 0: the loop reports the disconnection, as AsyncTCP does.
+    ::shutdown(_fd, SHUT_RDWR);
+}
+
+void IoUringTransport::pauseReceive(){
+    _rxPaused = true;
+    _loop->requestFlush(_id);
+}
+
+void IoUringTransport::resumeReceive(){
+    _rxPaused = false;
+    _loop->requestFlush(_id);
+}
+
+void IoUringTransport::_deliverHeld(){
+    size_t delivered = 0;
+    while (delivered < _held.size() && _open && !_rxPaused) {
+        HeldBuffer held = _held[delivered++];
+        notifyData(_loop->buffer(held.bufferId), held.length);
+        _loop->recycle(held.bufferId);
+    }
+    _held.erase(_held.begin(), _held.begin() + delivered);
+}
+
+void IoUringTransport::onFlush(){
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+        _flushPending = false;
+        if (!_sending && _staged->length() > 0 && _open) {
+            std::swap(_staged, _sendBuffer);
+            _sendOffset = 0;
+            _submitSend();
+        }
+        xSemaphoreGive(_txMutex);
+    }
+
+    if (_rxPaused) {
+        // Data completed before the cancellation is held until resumed.
+        if (_recvArmed && !_cancelling) {
+            io_uring_sqe* sqe = _loop->prepare(_id, IoUringOp::CANCEL);
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = _loop->operationOf(_id, IoUringOp::RECV);
+                _cancelling = true;
+            }
+        }
+        return;
+    }
+
+    _deliverHeld();
+    if (!_recvArmed && !_rxPaused && _open) {
+        _armRecv();
+    }
+}
+
+void IoUringTransport::onCompletion(IoUringOp op, int32_t result, uint32_t flags){
+    if (op == IoUringOp::RECV) {
+        _onRecv(result, flags);
+    } else if (op == IoUringOp::SEND) {
+        _onSend(result);
+    }
+}
+
+void IoUringTransport::_onRecv(int32_t result, uint32_t flags){
+    bool more = flags & IORING_CQE_F_MORE;
+    if (!more) {
+        _recvArmed = false;
+        _cancelling = false;
+    }
+
+    if (result > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!_open) {
+            _loop->recycle(bufferId);
+        } else if (_rxPaused || !_held.empty()) {
+            _held.push_back({bufferId, (uint16_t)result});
+        } else {
+            notifyData(_loop->buffer(bufferId), result);
+            _loop->recycle(bufferId);
+        }
+    } else if (result == -ENOBUFS) {
+        // Every registered buffer is in use: retried by the next iteration.
+        if (!_rxPaused) _loop->requestFlush(_id);
+        return;
+    } else if (result != -ECANCELED) {
+        // 0 is an orderly shutdown by the peer.
+        _disconnected();
+        return;
+    }
+
+    // The kernel ends a multishot RECV on its own (e.g. buffers exhausted).
+    if (!_recvArmed && !_rxPaused && _open && _held.empty()) {
+        _armRecv();
+    }
+}
+
+void IoUringTransport::_onSend(int32_t result){
+    if (result < 0) {
+        if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+            _sending = false;
+            xSemaphoreGive(_txMutex);
+        }
+        log_e("TCP Send Failed: %d", -result);
+        close();
+        _disconnected();
+        return;
+    }
+
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) != pdTRUE) return;
+    _sendOffset += result;
+    if (_sendOffset < _sendBuffer->length()) {
+        // Partial write: the remainder goes first.
+        _submitSend();
+        xSemaphoreGive(_txMutex);
+        return;
+    }
+
+    *_sendBuffer = "";
+    _sendOffset = 0;
+    _sending = false;
+    // Staged while this SEND was in flight.
+    if (_staged->length() > 0 && _open) {
+        std::swap(_staged, _sendBuffer);
+        _submitSend();
+    }
+    xSemaphoreGive(_txMutex);
+
+    if (_open) notifyReadyToSend();
+}
+
+void IoUringTransport::_disconnected(){
+    if (_open.exchange(false)) {
+        notifyDisconnect();
+    }
+}
+
+#endif // MQTTBROKER_IO_URING
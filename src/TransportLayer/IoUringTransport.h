@@ -0,0 +1,312 @@
+#ifndef IO_URING_TRANSPORT_H
+#define IO_URING_TRANSPORT_H
+
+#include "MqttTransport.h"
+
+#if MQTTBROKER_IO_URING
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Submission queue depth of the ring (the completion queue is twice as large).
+#define IOURINGENTRIES 256
+
+// Receive buffers registered in the kernel, shared by all the connections of a ring.
+// Must be a power of 2.
+#define IOURINGBUFFERS 256
+#define IOURINGBUFFERSIZE 2048
+
+// Bytes a connection accepts before `space()` reports it full: the rest waits in the
+// MqttClient outbox. Everything accepted is sent by a single SEND of the next loop iteration.
+#define IOURINGSENDBUFFER (16 * 1024)
+
+// Max wait (ms) of the event loop for a completion.
+#define IOURINGWAITMS 100
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+/** @brief Operation a completion belongs to, carried in its `user_data`. */
+enum class IoUringOp : uint8_t {
+    ACCEPT,
+    RECV,
+    SEND,
+    CANCEL,
+    WAKE
+};
+
+/**
+ * @brief Receiver of the completions of the operations submitted for it in an `IoUringLoop`.
+ */
+class IoUringHandler {
+public:
+    virtual ~IoUringHandler() {}
+
+    /**
+     * @brief Called from the event loop thread, with the loop lock held.
+     * @param op Operation that completed.
+     * @param result Result of the operation (bytes, fd, or -errno).
+     * @param flags Completion flags (IORING_CQE_F_MORE, IORING_CQE_F_BUFFER...).
+     */
+    virtual void onCompletion(IoUringOp op, int32_t result, uint32_t flags) = 0;
+
+    /**
+     * @brief Called from the event loop thread, with the loop lock held, after a
+     * `requestFlush()`: the only place, besides `onCompletion`, where operations are submitted.
+     */
+    virtual void onFlush() {}
+};
+
+/**
+ * @brief io_uring instance shared by a listener and the connections it accepted.
+ * * Counterpart of `PosixEventLoop` driven by completions instead of readiness. The
+ * listener keeps one multishot ACCEPT and each connection one multishot RECV armed,
+ * receiving into a ring of buffers registered in the kernel, so a message costs no
+ * syscall at all. Sends are staged by the Workers and submitted by the loop thread:
+ * one SEND per connection and a single `io_uring_enter` per iteration, for every client.
+ * * @note Only the loop thread writes the submission queue. Other threads ask it for
+ * work with `requestFlush()`, which wakes it through an eventfd. Registrations carry
+ * a generation, like `PosixEventLoop`, and the descriptor of a removed one is closed
+ * after the next submission: an operation prepared for it can't hit a reused fd.
+ * Shared with `std::shared_ptr`: the connections may outlive their listener.
+ */
+class IoUringLoop {
+private:
+    int ringFd = -1;
+    int wakeFd = -1;
+
+    // Mapped rings.
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    // Submission queue.
+    std::atomic<uint32_t>* sqHead;
+    std::atomic<uint32_t>* sqTail;
+    uint32_t sqMask;
+    uint32_t* sqArray;
+    /** @brief Tail of the prepared entries, published to the kernel by `poll()`. */
+    uint32_t sqLocalTail;
+
+    // Completion queue.
+    std::atomic<uint32_t>* cqHead;
+    std::atomic<uint32_t>* cqTail;
+    uint32_t cqMask;
+    io_uring_cqe* cqes;
+
+    // Registered receive buffers. The ring tail overlays the reserved field of the first entry.
+    io_uring_buf* bufferRing = nullptr;
+    size_t bufferRingSize = 0;
+    uint8_t* buffers = nullptr;
+    uint16_t bufferTail = 0;
+
+    struct Registration {
+        IoUringHandler* handler;
+        uint32_t generation;
+    };
+    std::map<uint32_t, Registration> handlers;
+    uint32_t nextId = 1;
+    uint32_t nextGeneration = 1;
+
+    /** @brief Send buffers of removed handlers, freed when their SEND completes. */
+    std::map<uint64_t, String*> retiredSends;
+
+    /** @brief Descriptors of removed handlers, closed after the next submission. */
+    std::vector<int> closing;
+
+    /** @brief Handlers waiting for `onFlush()`. */
+    std::vector<uint32_t> flushRequests;
+    /** @brief Set while completions are dispatched: requests made meanwhile need no wake up. */
+    bool dispatching = false;
+    SemaphoreHandle_t flushMutex;
+
+    uint64_t wakeCounter;
+
+    SemaphoreHandle_t mutex;
+
+    bool setup();
+    void armWake();
+    int enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags, int timeoutMs);
+
+    static uint64_t userData(uint32_t id, uint32_t generation, IoUringOp op);
+
+public:
+    IoUringLoop();
+    ~IoUringLoop();
+
+    /** @brief false if the kernel lacks io_uring or provided buffer rings (Linux < 5.19). */
+    bool ready() const {
+        return bufferRing != nullptr;
+    }
+
+    /**
+     * @brief Registers a handler.
+     * @return Its id, used to submit operations on its behalf.
+     */
+    uint32_t add(IoUringHandler* handler);
+
+    /**
+     * @brief Unregisters a handler, waiting for it if it is running. Its pending
+     * completions are dropped.
+     * * @param fd Descriptor of the handler, closed once no queued operation can reach it.
+     * @param sending In-flight send buffer, owned by the loop until its completion.
+     */
+    void remove(uint32_t id, int fd, String* sending = nullptr);
+
+    /**
+     * @brief Returns a zeroed submission entry tagged for `id` and `op`, submitted with
+     * the next `poll()`. Loop thread only, nullptr if the queue stays full.
+     */
+    io_uring_sqe* prepare(uint32_t id, IoUringOp op);
+
+    /**
+     * @brief User data of the operations of `id`, the target of an ASYNC_CANCEL.
+     */
+    uint64_t operationOf(uint32_t id, IoUringOp op);
+
+    /**
+     * @brief Schedules `onFlush()` of a handler in the loop thread. Any thread.
+     */
+    void requestFlush(uint32_t id);
+
+    /** @brief Data of a registered receive buffer, selected by the kernel for a RECV. */
+    uint8_t* buffer(uint16_t bufferId) {
+        return buffers + (size_t)bufferId * IOURINGBUFFERSIZE;
+    }
+
+    /** @brief Gives a receive buffer back to the kernel. Call with the loop lock held. */
+    void recycle(uint16_t bufferId);
+
+    /**
+     * @brief Submits the prepared operations, waits up to `timeoutMs` for completions
+     * and dispatches them.
+     */
+    void poll(int timeoutMs);
+
+    void lock(){
+        xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+
+    void unlock(){
+        xSemaphoreGiveRecursive(mutex);
+    }
+};
+
+/**
+ * @brief Concrete implementation of MqttTransport over a socket served by io_uring.
+ * * Same contract as `PosixTcpTransport`, with completions instead of readiness: a
+ * multishot RECV delivers the data in the registered buffers of the loop, and `send()`
+ * only appends to a staging buffer, handed to the kernel by the next loop iteration.
+ * Publishes routed to a client between two iterations leave in one SEND, and the
+ * SENDs of all the clients in one syscall. `notifyReadyToSend()` is raised when a SEND
+ * completes with nothing left to send.
+ * * @note **Receive Backpressure:** pausing cancels the RECV. Data completed before the
+ * cancellation is held (in its registered buffer) and delivered on resume, then the
+ * socket is read again. Meanwhile TCP closes the window of the peer.
+ */
+class IoUringTransport : public MqttTransport, public IoUringHandler {
+private:
+    int _fd;
+    uint32_t _id;
+    std::shared_ptr<IoUringLoop> _loop;
+    String _ip;
+
+    /** @brief Cleared once, when the connection is found closed. */
+    std::atomic<bool> _open{true};
+    std::atomic<bool> _rxPaused{false};
+
+    // Receive state, loop thread only.
+    bool _recvArmed = false;
+    bool _cancelling = false;
+    struct HeldBuffer {
+        uint16_t bufferId;
+        uint16_t length;
+    };
+    std::vector<HeldBuffer> _held;
+
+    /** @brief Bytes accepted by `send()`, waiting for the next loop iteration. */
+    String* _staged;
+
+    /**
+     * @brief Buffer of the SEND in flight and bytes of it already sent. Swapped with
+     * `_staged` when a SEND is submitted, so both keep their capacity.
+     */
+    String* _sendBuffer;
+    size_t _sendOffset = 0;
+    bool _sending = false;
+
+    /** @brief A flush is requested and not yet run, avoids queuing one per `send()`. */
+    bool _flushPending = false;
+
+    /** @brief Guards the send buffers and `_flushPending`. */
+    SemaphoreHandle_t _txMutex;
+
+    void _armRecv();
+
+    /** @brief Submits the rest of `_sendBuffer`. Call with `_txMutex` held. */
+    void _submitSend();
+
+    /** @brief Delivers the held buffers, until they run out or the receive side is paused. */
+    void _deliverHeld();
+
+    void _onRecv(int32_t result, uint32_t flags);
+    void _onSend(int32_t result);
+
+    /** @brief Marks the connection closed and notifies it, once. */
+    void _disconnected();
+
+public:
+    /**
+     * @brief Wraps an accepted socket and starts receiving on it.
+     * * @param fd Connected socket.
+     * @param loop Ring of the listener that accepted it.
+     * @param ip Remote address.
+     */
+    IoUringTransport(int fd, std::shared_ptr<IoUringLoop> loop, const String& ip);
+
+    /**
+     * @brief Unregisters the transport, the socket is closed by the loop.
+     */
+    ~IoUringTransport();
+
+    size_t send(const char* data, size_t len) override;
+
+    /**
+     * @brief Shuts the connection down, the disconnection is notified by the event loop.
+     */
+    void close() override;
+
+    bool connected() override {
+        return _open;
+    }
+
+    bool canSend() override {
+        return _open && space() > 0;
+    }
+
+    size_t space() override;
+
+    void pauseReceive() override;
+
+    void resumeReceive() override;
+
+    String getIP() override {
+        return _ip;
+    }
+
+    size_t memoryUsage() override;
+
+    void onCompletion(IoUringOp op, int32_t result, uint32_t flags) override;
+
+    void onFlush() override;
+};
+
+#endif // MQTTBROKER_IO_URING
+
+#endif // IO_URING_TRANSPORT_H
@@ -0,0 +1,98 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include "MqttTransport.h"
+#include <atomic>
+
+/**
+ * @brief In-memory implementation of MqttTransport, without any network.
+ * * The application plays the remote client: bytes passed to `write()` reach the
+ * MqttClient as if received from a socket, and the packets the Broker sends are
+ * handed to the `onReceive` callback. Meant for tests and for firmware that wants
+ * a full MQTT session in-process, e.g.
+ * `broker->acceptClient(new LoopbackTransport(onReceive))`.
+ * * @note **Receive Backpressure:** while the Broker pauses the transport (lossless
+ * mode), `write()` refuses the bytes and returns 0: the caller retries later, as a
+ * TCP peer would with a closed window.
+ * @note `write()` runs the MqttClient packet processing in the caller thread, which
+ * acts as the Network Thread: use a single thread per transport.
+ */
+class LoopbackTransport : public MqttTransport {
+private:
+    std::function<void(const uint8_t*, size_t)> _onReceive;
+    String _name;
+
+    std::atomic<bool> _open{true};
+    std::atomic<bool> _rxPaused{false};
+
+public:
+    /**
+     * @brief Construct a new Loopback Transport.
+     * * @param onReceive Called with the bytes sent by the Broker, from the thread
+     * that sends them (a Worker or the `write()` caller).
+     * @param name Returned by `getIP()`, shown in the Broker logs.
+     */
+    LoopbackTransport(std::function<void(const uint8_t*, size_t)> onReceive, const String& name = "loopback")
+        : _onReceive(onReceive), _name(name) {
+    }
+
+    /**
+     * @brief Feeds bytes from the application (the remote client) to the Broker.
+     * * @return len, or 0 if the transport is paused or closed (nothing was consumed).
+     */
+    size_t write(const uint8_t* data, size_t len) {
+        if (!_open || _rxPaused) return 0;
+        notifyData((uint8_t*)data, len);
+        return len;
+    }
+
+    size_t send(const char* data, size_t len) override {
+        if (!_open) return 0;
+        if (_onReceive) {
+            _onReceive((const uint8_t*)data, len);
+        }
+        return len;
+    }
+
+    /**
+     * @brief Closes the connection, notified to the MqttClient right away (once).
+     */
+    void close() override {
+        if (_open.exchange(false)) {
+            notifyDisconnect();
+        }
+    }
+
+    bool connected() override {
+        return _open;
+    }
+
+    bool canSend() override {
+        return _open;
+    }
+
+    /**
+     * @brief Unbounded: `onReceive` takes every packet synchronously.
+     */
+    size_t space() override {
+        return _open ? SIZE_MAX : 0;
+    }
+
+    void pauseReceive() override {
+        _rxPaused = true;
+    }
+
+    void resumeReceive() override {
+        _rxPaused = false;
+    }
+
+    String getIP() override {
+        return _name;
+    }
+
+    size_t memoryUsage() override {
+        return sizeof(*this) + _name.length();
+    }
+};
+
+#endif // LOOPBACK_TRANSPORT_H
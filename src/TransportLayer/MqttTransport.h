@@ -4,28 +4,81 @@
 #include <Arduino.h>
 #include <functional>
 
+/*
+ * Network backend: AsyncTCP and ESPAsyncWebServer on the ESP32, non-blocking 
+ * POSIX sockets driven by epoll on Linux (`PosixTcpServerListener`). 
+ * Can be forced with -DMQTTBROKER_POSIX_SOCKETS=0 or 1.
+ */
+#ifndef MQTTBROKER_POSIX_SOCKETS
+#if defined(__linux__)
+#define MQTTBROKER_POSIX_SOCKETS 1
+#else
+#define MQTTBROKER_POSIX_SOCKETS 0
+#endif
+#endif
+
+/*
+ * Alternative Linux backend built on io_uring (`IoUringTcpServerListener`), selected
+ * with `MqttBrokerFactory::createIoUringBroker()`. Needs Linux 5.19 at runtime.
+ * Can be disabled with -DMQTTBROKER_IO_URING=0.
+ */
+#ifndef MQTTBROKER_IO_URING
+#if MQTTBROKER_POSIX_SOCKETS && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MQTTBROKER_IO_URING 1
+#endif
+#endif
+#endif
+#ifndef MQTTBROKER_IO_URING
+#define MQTTBROKER_IO_URING 0
+#endif
+
+/*
+ * TLS engine of `TlsServerListener`: the mbedTLS of the ESP32 core, OpenSSL on Linux
+ * (link with -lssl -lcrypto), or mbedTLS on Linux with -DMQTTBROKER_TLS_OPENSSL=0.
+ */
+#ifndef MQTTBROKER_TLS_OPENSSL
+#if MQTTBROKER_POSIX_SOCKETS && defined(__has_include)
+#if __has_include(<openssl/ssl.h>)
+#define MQTTBROKER_TLS_OPENSSL 1
+#endif
+#endif
+#endif
+#ifndef MQTTBROKER_TLS_OPENSSL
+#define MQTTBROKER_TLS_OPENSSL 0
+#endif
+
+// TLS (`TlsServerListener`, `createTlsBroker()`) is built with -DMQTTBROKER_TLS=1 (the
+// CMake build does it when OpenSSL is found). Off by default until the mbedTLS backend
+// has been verified on ESP32 hardware.
+#ifndef MQTTBROKER_TLS
+#define MQTTBROKER_TLS 0
+#endif
+
 /**
- * @brief Abstract interface for MQTT Transport layers.
- * * This class defines the contract that any network transport (TCP, WebSocket, etc.)
- * must implement to be used by the MqttClient. It decouples the MQTT protocol logic
- * from the underlying network technology, allowing the broker to support multiple
- * protocols using the Strategy Pattern.
+ * @brief Receiver of the events of a `MqttTransport`: the `MqttClient`, or a transport 
+ * wrapping another one (e.g. `TlsTransport`).
+ * * A transport keeps one pointer to its listener instead of a callback object per 
+ * event, so the per-connection state stays small and nothing is allocated to bind it.
  */
-class MqttTransport {
-protected:
+class MqttTransportListener {
+public:
+    virtual ~MqttTransportListener() {}
+
     /**
-     * @brief Callback function triggered when new data arrives.
-     * Arguments: (uint8_t* data, size_t length)
+     * @brief New data arrived.
+     * @param data Bytes received, only valid during the call.
+     * @param len Number of bytes.
      */
-    std::function<void(uint8_t*, size_t)> _onData;
+    virtual void onTransportData(uint8_t* data, size_t len) = 0;
 
     /**
-     * @brief Callback function triggered when the connection is lost.
+     * @brief The connection is lost (closed by either side, error or timeout).
      */
-    std::function<void()> _onDisconnect;
+    virtual void onTransportDisconnect() = 0;
 
     /**
-     * @brief Callback triggered when the transport is ready to send more data.
+     * @brief The transport is ready to send more data.
      *
      * This event acts as the **Flow Control Signal**. It is invoked by the 
      * underlying transport implementation (TcpTransport/WsTransport) when:
@@ -35,10 +88,72 @@ protected:
      * The `MqttClient` listens to this event to trigger the draining of its 
      * software `_outbox`.
      */
-    std::function<void()> _onReadyToSend;
+    virtual void onTransportReadyToSend() = 0;
+};
+
+/**
+ * @brief Adapts per-event callbacks to `MqttTransportListener`, behind 
+ * `MqttTransport::setOnData()`, `setOnDisconnect()` and `setOnReadyToSend()`.
+ */
+class CallbackTransportListener : public MqttTransportListener {
+public:
+    std::function<void(uint8_t*, size_t)> onData;
+    std::function<void()> onDisconnect;
+    std::function<void()> onReadyToSend;
+
+    void onTransportData(uint8_t* data, size_t len) override {
+        if (onData) onData(data, len);
+    }
+
+    void onTransportDisconnect() override {
+        if (onDisconnect) onDisconnect();
+    }
+
+    void onTransportReadyToSend() override {
+        if (onReadyToSend) onReadyToSend();
+    }
+};
+
+/**
+ * @brief Abstract interface for MQTT Transport layers.
+ * * This class defines the contract that any network transport (TCP, WebSocket, etc.)
+ * must implement to be used by the MqttClient. It decouples the MQTT protocol logic
+ * from the underlying network technology, allowing the broker to support multiple
+ * protocols using the Strategy Pattern.
+ */
+class MqttTransport {
+protected:
+    /** @brief Receiver of the events, not owned (nullptr until the MqttClient binds itself). */
+    MqttTransportListener* _listener = nullptr;
+
+    /** @brief Owned adapter of the `setOn...()` callbacks, only created by their first call. */
+    CallbackTransportListener* _callbacks = nullptr;
+
+    CallbackTransportListener* callbacks() {
+        if (!_callbacks) _callbacks = new CallbackTransportListener();
+        _listener = _callbacks;
+        return _callbacks;
+    }
+
+    /** @brief Passes received bytes to the listener. */
+    void notifyData(uint8_t* data, size_t len) {
+        if (_listener) _listener->onTransportData(data, len);
+    }
+
+    /** @brief Reports the end of the connection to the listener. */
+    void notifyDisconnect() {
+        if (_listener) _listener->onTransportDisconnect();
+    }
+
+    /** @brief Raises the Flow Control Signal, see `MqttTransportListener::onTransportReadyToSend`. */
+    void notifyReadyToSend() {
+        if (_listener) _listener->onTransportReadyToSend();
+    }
 
 public:
-    virtual ~MqttTransport() {}
+    virtual ~MqttTransport() {
+        delete _callbacks;
+    }
 
     /**
      * @brief Sends raw bytes over the specific transport medium.
@@ -76,6 +191,26 @@ public:
      */
     virtual size_t space() = 0;
 
+    /**
+     * @brief Stops acknowledging incoming data (Receive Backpressure).
+     *
+     * Used by the lossless publish mode: when the Broker event queue is full,
+     * the `MqttClient` pauses its transport so the remote peer is throttled by 
+     * TCP's own flow control (the receive window is not reopened) instead of 
+     * the Broker dropping data. Bytes already in flight are still delivered 
+     * to the listener.
+     *
+     * Default implementation does nothing (transport without flow control).
+     */
+    virtual void pauseReceive() {}
+
+    /**
+     * @brief Resumes acknowledging incoming data.
+     * Acknowledges every byte held back since `pauseReceive()`, reopening the
+     * TCP receive window so the peer can send again.
+     */
+    virtual void resumeReceive() {}
+
     /**
      * @brief Gets the IP address of the connected client.
      * * @return String Representation of the IP address (e.g., "192.168.1.50").
@@ -83,29 +218,37 @@ public:
     virtual String getIP() = 0;
 
     /**
-     * @brief Registers the callback to handle incoming data.
+     * @brief Bytes used by this connection on the Broker side: the transport object
+     * and its buffers, without the network stack. See `MqttBroker::getClientMemoryReport()`.
+     */
+    virtual size_t memoryUsage() { return 0; }
+
+    /**
+     * @brief Registers the receiver of the data, disconnection and Flow Control events.
      * Called by MqttClient to link its logic with the network events.
+     * * @param listener Not owned, must outlive the transport events.
+     */
+    void setListener(MqttTransportListener* listener) { _listener = listener; }
+
+    /**
+     * @brief Registers the callback to handle incoming data.
+     * Replaces the listener with a `CallbackTransportListener`, allocated once.
      * * @param cb The function to call when data is received.
      */
-    void setOnData(std::function<void(uint8_t*, size_t)> cb) { _onData = cb; }
+    void setOnData(std::function<void(uint8_t*, size_t)> cb) { callbacks()->onData = cb; }
 
     /**
      * @brief Registers the callback to handle disconnection events.
-     * Called by MqttClient to link its cleanup logic with the network events.
      * * @param cb The function to call when the connection closes.
      */
-    void setOnDisconnect(std::function<void()> cb) { _onDisconnect = cb; }
+    void setOnDisconnect(std::function<void()> cb) { callbacks()->onDisconnect = cb; }
 
     /**
-     * @brief Registers the Flow Control callback.
-     *
-     * The `MqttClient` uses this method to attach its `_drainOutbox` logic 
-     * to the transport's readiness events. This closes the loop for the 
-     * Store-and-Forward mechanism used during network congestion.
-     *
-     * @param cb The function to call when the transport can accept data.
+     * @brief Registers the Flow Control callback, see 
+     * `MqttTransportListener::onTransportReadyToSend`.
+     * * @param cb The function to call when the transport can accept data.
      */
-    void setOnReadyToSend(std::function<void()> cb) { _onReadyToSend = cb; }
+    void setOnReadyToSend(std::function<void()> cb) { callbacks()->onReadyToSend = cb; }
 };
 
 #endif // MQTT_TRANSPORT_H
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "PosixTcpListener.h"
+#include "ConcurrentTasks/PosixEventLoopTask.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+
+using namespace mqttBrokerName;
+
+PosixTcpServerListener::PosixTcpServerListener(uint16_t port) : port(port) {
+}
+
+PosixTcpServerListener::~PosixTcpServerListener() {
+    stop();
+    delete loopTask;
+}
+
+void PosixTcpServerListener::begin() {
+    if (listenFd >= 0) return;
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        log_e("TCP Listener: socket() failed: %d", errno);
+        return;
+    }
+
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        log_e("TCP Listener: can't listen on port %u: %d", port, errno);
+        ::close(listenFd);
+        listenFd = -1;
+        return;
+    }
+
+    if (!loop) {
+        loop = std::make_shared<PosixEventLoop>();
+    }
+    loop->add(listenFd, this, EPOLLIN);
+
+    if (!loopTask) {
+        loopTask = new PosixEventLoopTask(loop);
+    }
+    loopTask->start();
+    log_i("TCP Listener started on port %u", port);
+}
+
+void PosixTcpServerListener::stop() {
+    if (listenFd < 0) return;
+
+    // Ends between two polls, once the running dispatch is over.
+    loopTask->stop();
+
+    loop->remove(listenFd);
+    ::close(listenFd);
+    listenFd = -1;
+}
+
+void PosixTcpServerListener::onEvents(uint32_t) {
+    while (true) {
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        int fd = accept4(listenFd, (sockaddr*)&address, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_w("TCP Listener: accept() failed: %d", errno);
+            }
+            return;
+        }
+
+        if (!this->broker) {
+            // No broker assigned to handle this, reject connection
+            ::close(fd);
+            continue;
+        }
+
+        // MQTT packets are small: don't wait to coalesce them.
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+
+        // 1. Wrap the socket into our Transport Adapter, sharing this event loop.
+        MqttTransport* transport = new PosixTcpTransport(fd, loop, String(ip));
+
+        // 2. Inject the transport into the Broker logic
+        this->accept(transport);
+    }
+}
+
+#endif // MQTTBROKER_POSIX_SOCKETS
@@ -0,0 +1,60 @@
+#ifndef POSIX_TCP_LISTENER_H
+#define POSIX_TCP_LISTENER_H
+
+#include "MqttBroker/MqttBroker.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Concrete implementation of ServerListener for TCP connections on Linux.
+ * * Listens on a non-blocking POSIX socket registered in a `PosixEventLoop`, run by a
+ * `PosixEventLoopTask` (the Network Thread). Accepted connections are wrapped in a
+ * `PosixTcpTransport` sharing the same loop, and passed to the `MqttBroker`.
+ */
+class PosixTcpServerListener : public ServerListener, public PosixEventHandler {
+private:
+    /**
+     * @brief The port number to listen on.
+     */
+    uint16_t port;
+
+    int listenFd = -1;
+
+    /** @brief Shared with the transports, which may be deleted after the listener. */
+    std::shared_ptr<PosixEventLoop> loop;
+
+    PosixEventLoopTask* loopTask = nullptr;
+
+public:
+    /**
+     * @brief Construct a new Posix Tcp Server Listener.
+     * * @param port The TCP port to listen on (default MQTT is 1883).
+     */
+    PosixTcpServerListener(uint16_t port);
+
+    ~PosixTcpServerListener();
+
+    /**
+     * @brief Binds the port and starts the event loop task.
+     */
+    void begin() override;
+
+    /**
+     * @brief Stops the event loop task and closes the listening socket.
+     * * Accepted connections are no longer serviced.
+     */
+    void stop() override;
+
+    /**
+     * @brief Accepts all the pending connections (event loop thread).
+     */
+    void onEvents(uint32_t events) override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTTBROKER_POSIX_SOCKETS
+
+#endif // POSIX_TCP_LISTENER_H
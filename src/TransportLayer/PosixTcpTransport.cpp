@@ -0,0 +1,246 @@
+#include "PosixTcpTransport.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <errno.h>
+#include <unistd.h>
+
+/****************************** PosixEventLoop Class *************************************/
+
+PosixEventLoop::PosixEventLoop(){
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        log_e("Failed to create epoll instance: %d", errno);
+    }
+
+    mutex = xSemaphoreCreateRecursiveMutex();
+    if (!mutex) {
+        log_e("Failed to create event loop mutex"); ESP.restart();
+    }
+}
+
+PosixEventLoop::~PosixEventLoop(){
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+    vSemaphoreDelete(mutex);
+}
+
+bool PosixEventLoop::add(int fd, PosixEventHandler* handler, uint32_t events){
+    lock();
+    uint32_t generation = nextGeneration++;
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.u64 = ((uint64_t)generation << 32) | (uint32_t)fd;
+
+    bool added = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    if (added) {
+        handlers[fd] = {handler, generation};
+    } else {
+        log_e("epoll_ctl ADD failed for fd %d: %d", fd, errno);
+    }
+    unlock();
+    return added;
+}
+
+void PosixEventLoop::rearm(int fd, uint32_t events){
+    lock();
+    auto it = handlers.find(fd);
+    if (it != handlers.end()) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = ((uint64_t)it->second.generation << 32) | (uint32_t)fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+    unlock();
+}
+
+void PosixEventLoop::remove(int fd){
+    lock();
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+    unlock();
+}
+
+void PosixEventLoop::poll(int timeoutMs){
+    epoll_event events[POSIXEVENTBATCH];
+
+    // Waits without the lock, handlers can be removed meanwhile.
+    int ready = epoll_wait(epollFd, events, POSIXEVENTBATCH, timeoutMs);
+    if (ready <= 0) return;
+
+    lock();
+    for (int i = 0; i < ready; i++) {
+        int fd = (int)(uint32_t)events[i].data.u64;
+        uint32_t generation = events[i].data.u64 >> 32;
+
+        // Removed (or fd reused) since epoll_wait returned: stale event.
+        auto it = handlers.find(fd);
+        if (it == handlers.end() || it->second.generation != generation) continue;
+
+        it->second.handler->onEvents(events[i].events);
+    }
+    unlock();
+}
+
+/****************************** PosixTcpTransport Class **********************************/
+
+PosixTcpTransport::PosixTcpTransport(int fd, std::shared_ptr<PosixEventLoop> loop, const String& ip)
+    : _fd(fd), _loop(loop), _ip(ip) {
+    _txMutex = xSemaphoreCreateMutex();
+    if (!_txMutex) {
+        log_e("Failed to create transport mutex"); ESP.restart();
+    }
+
+    // Events are dispatched by the loop thread, which is the one accepting this
+    // socket: none can run before the MqttClient sets its callbacks.
+    _loop->add(_fd, this, events());
+}
+
+PosixTcpTransport::~PosixTcpTransport(){
+    // Waits for a running callback of this transport.
+    _loop->remove(_fd);
+    ::close(_fd);
+    vSemaphoreDelete(_txMutex);
+}
+
+uint32_t PosixTcpTransport::events(){
+    // Edge-triggered: EPOLLOUT is only raised when send buffer space is freed.
+    return EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+}
+
+size_t PosixTcpTransport::send(const char* data, size_t len){
+    if (!_open) {
+        log_e("TCP Send Failed: Client not connected");
+        return 0;
+    }
+
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) != pdTRUE) return 0;
+
+    // Nothing may overtake the bytes already waiting for the socket.
+    size_t written = 0;
+    if (_unsent.length() == 0) {
+        ssize_t n = ::send(_fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            xSemaphoreGive(_txMutex);
+            log_e("TCP Send Failed: %d", errno);
+            close();
+            return 0;
+        }
+        written = n > 0 ? n : 0;
+    }
+
+    if (written < len) {
+        log_v("TCP Partial Write! Tried: %u, Wrote: %u", (unsigned)len, (unsigned)written);
+        _unsent.concat(data + written, len - written);
+    }
+    xSemaphoreGive(_txMutex);
+    return len;
+}
+
+bool PosixTcpTransport::_flushUnsent(){
+    size_t length = _unsent.length();
+    if (length == 0) return true;
+
+    ssize_t n = ::send(_fd, _unsent.c_str(), length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n <= 0) return false;
+
+    _unsent = _unsent.substring(n);
+    return (size_t)n == length;
+}
+
+size_t PosixTcpTransport::memoryUsage(){
+    size_t bytes = sizeof(*this) + _ip.length();
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+        bytes += _unsent.length();
+        xSemaphoreGive(_txMutex);
+    }
+    return bytes;
+}
+
+size_t PosixTcpTransport::space(){
+    if (!_open) return 0;
+
+    int bufferSize = 0;
+    socklen_t optionLength = sizeof(bufferSize);
+    int queued = 0;
+    if (getsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, &optionLength) != 0 ||
+        ioctl(_fd, SIOCOUTQ, &queued) != 0) {
+        return 0;
+    }
+
+    // Linux reports twice the payload capacity, the other half is bookkeeping.
+    long available = (long)bufferSize / 2 - queued;
+
+    if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+        available -= _unsent.length();
+        xSemaphoreGive(_txMutex);
+    }
+    return available > 0 ? available : 0;
+}
+
+void PosixTcpTransport::close(){
+    // Raises EPOLLHUP: the loop reports the disconnection, as AsyncTCP does.
+    ::shutdown(_fd, SHUT_RDWR);
+}
+
+void PosixTcpTransport::resumeReceive(){
+    _rxPaused = false;
+
+    // Data left in the socket while paused raises no new edge.
+    _loop->rearm(_fd, events());
+}
+
+void PosixTcpTransport::_readAvailable(){
+    uint8_t buffer[1460];
+
+    while (_open && !_rxPaused) {
+        ssize_t n = recv(_fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            notifyData(buffer, n);
+        } else if (n == 0) {
+            _disconnected(); // Orderly shutdown by the peer.
+            return;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                _disconnected();
+            }
+            if (errno != EINTR) return;
+        }
+    }
+}
+
+void PosixTcpTransport::_disconnected(){
+    if (_open.exchange(false)) {
+        notifyDisconnect();
+    }
+}
+
+void PosixTcpTransport::onEvents(uint32_t events){
+    if (!_open) return;
+
+    // Read first: the last bytes of a closing peer are still delivered.
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        _readAvailable();
+    }
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        _disconnected();
+        return;
+    }
+
+    if (_open && (events & EPOLLOUT)) {
+        bool flushed = false;
+        if (xSemaphoreTake(_txMutex, portMAX_DELAY) == pdTRUE) {
+            flushed = _flushUnsent();
+            xSemaphoreGive(_txMutex);
+        }
+        if (flushed) notifyReadyToSend();
+    }
+}
+
+#endif // MQTTBROKER_POSIX_SOCKETS
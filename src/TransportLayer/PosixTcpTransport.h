@@ -0,0 +1,177 @@
+#ifndef POSIX_TCP_TRANSPORT_H
+#define POSIX_TCP_TRANSPORT_H
+
+#include "MqttTransport.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+// Max number of epoll events dispatched per wait, and max wait (ms) of the event loop.
+#define POSIXEVENTBATCH 64
+#define POSIXEVENTWAITMS 100
+
+/**
+ * @brief Receiver of the readiness events of a file descriptor registered in a `PosixEventLoop`.
+ */
+class PosixEventHandler {
+public:
+    virtual ~PosixEventHandler() {}
+
+    /**
+     * @brief Called from the event loop thread, with the loop lock held.
+     * @param events Ready epoll events (EPOLLIN, EPOLLOUT, EPOLLHUP...).
+     */
+    virtual void onEvents(uint32_t events) = 0;
+};
+
+/**
+ * @brief epoll instance shared by a listener and the connections it accepted.
+ * * Plays the role of the AsyncTCP task: one thread (`PosixEventLoopTask`) waits for
+ * the readiness of every socket and dispatches it to its handler.
+ * * @note Each registration is tagged with a generation, like a `ClientHandle`: an event
+ * read before its handler was removed (and its fd reused) is dropped. Dispatching
+ * and removal are serialized by a recursive lock, so a handler can be deleted from
+ * a callback of another one (e.g. a rejected client) but never while it runs.
+ * Shared with `std::shared_ptr`: the connections may outlive their listener.
+ */
+class PosixEventLoop {
+private:
+    int epollFd;
+
+    struct Registration {
+        PosixEventHandler* handler;
+        uint32_t generation;
+    };
+    std::map<int, Registration> handlers;
+    uint32_t nextGeneration = 1;
+
+    SemaphoreHandle_t mutex;
+
+public:
+    PosixEventLoop();
+    ~PosixEventLoop();
+
+    /**
+     * @brief Registers a non-blocking socket.
+     * @param events epoll events to wait for.
+     */
+    bool add(int fd, PosixEventHandler* handler, uint32_t events);
+
+    /**
+     * @brief Re-arms a registration. With edge-triggered events, readiness that is
+     * already true is reported again (e.g. data left unread while paused).
+     */
+    void rearm(int fd, uint32_t events);
+
+    /**
+     * @brief Unregisters a socket, waiting for its handler if it is running.
+     */
+    void remove(int fd);
+
+    /**
+     * @brief Waits up to `timeoutMs` for ready sockets and dispatches their events.
+     */
+    void poll(int timeoutMs);
+
+    void lock(){
+        xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+
+    void unlock(){
+        xSemaphoreGiveRecursive(mutex);
+    }
+};
+
+/**
+ * @brief Concrete implementation of MqttTransport over a non-blocking POSIX socket.
+ * * Linux counterpart of `TcpTransport`, without AsyncTCP. Readiness comes from
+ * edge-triggered epoll events: EPOLLIN reads until the socket is drained, and
+ * EPOLLOUT, raised when the kernel frees send buffer space, drives `notifyReadyToSend()`.
+ * `space()` reports the free part of the kernel send buffer, so the MqttClient outbox
+ * holds what the socket can't take.
+ * * @note **Receive Backpressure:** while paused the socket is simply not read, the kernel
+ * receive buffer fills up and TCP closes the window of the peer.
+ */
+class PosixTcpTransport : public MqttTransport, public PosixEventHandler {
+private:
+    int _fd;
+    std::shared_ptr<PosixEventLoop> _loop;
+    String _ip;
+
+    /** @brief Cleared once, when the connection is found closed. */
+    std::atomic<bool> _open{true};
+    std::atomic<bool> _rxPaused{false};
+
+    /**
+     * @brief Bytes accepted by `send()` that the kernel did not take, flushed on EPOLLOUT.
+     * * Only happens when `space()` was optimistic, it keeps the stream intact.
+     */
+    String _unsent;
+
+    /** @brief Guards `_unsent` and the writes, sends come from the Workers and the loop. */
+    SemaphoreHandle_t _txMutex;
+
+    /** @brief Writes `_unsent` to the socket. Call with `_txMutex` held. */
+    bool _flushUnsent();
+
+    /** @brief Reads until the socket is drained, the receive side is paused or closed. */
+    void _readAvailable();
+
+    /** @brief Marks the connection closed and notifies it, once. */
+    void _disconnected();
+
+    static uint32_t events();
+
+public:
+    /**
+     * @brief Wraps an accepted socket and registers it in the event loop.
+     * * @param fd Connected socket, already non-blocking.
+     * @param loop Event loop of the listener that accepted it.
+     * @param ip Remote address.
+     */
+    PosixTcpTransport(int fd, std::shared_ptr<PosixEventLoop> loop, const String& ip);
+
+    /**
+     * @brief Unregisters and closes the socket.
+     */
+    ~PosixTcpTransport();
+
+    size_t send(const char* data, size_t len) override;
+
+    /**
+     * @brief Shuts the connection down, the disconnection is notified by the event loop.
+     * The descriptor stays open until the transport is deleted, so it can't be reused meanwhile.
+     */
+    void close() override;
+
+    bool connected() override {
+        return _open;
+    }
+
+    bool canSend() override {
+        return _open && space() > 0;
+    }
+
+    size_t space() override;
+
+    void pauseReceive() override {
+        _rxPaused = true;
+    }
+
+    void resumeReceive() override;
+
+    String getIP() override {
+        return _ip;
+    }
+
+    size_t memoryUsage() override;
+
+    void onEvents(uint32_t events) override;
+};
+
+#endif // MQTTBROKER_POSIX_SOCKETS
+
+#endif // POSIX_TCP_TRANSPORT_H
@@ -0,0 +1,75 @@
+#include "UdpSocket.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <unistd.h>
+
+bool PosixUdpSocket::begin(uint16_t port) {
+    if (_fd >= 0) return true;
+
+    _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        log_e("UDP: socket() failed: %d", errno);
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        log_e("UDP: can't bind port %u: %d", port, errno);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    _loop->add(_fd, this, EPOLLIN | EPOLLET);
+    return true;
+}
+
+void PosixUdpSocket::stop() {
+    if (_fd < 0) return;
+
+    _loop->remove(_fd);
+    ::close(_fd);
+    _fd = -1;
+}
+
+bool PosixUdpSocket::sendTo(const UdpEndpoint& destination, const uint8_t* data, size_t len) {
+    if (_fd < 0) return false;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = destination.address;
+    address.sin_port = htons(destination.port);
+
+    return sendto(_fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL, (sockaddr*)&address, sizeof(address)) == (ssize_t)len;
+}
+
+void PosixUdpSocket::onEvents(uint32_t) {
+    // Edge-triggered: read until the socket is drained.
+    while (_fd >= 0) {
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        ssize_t n = recvfrom(_fd, _buffer, sizeof(_buffer), 0, (sockaddr*)&address, &length);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_w("UDP: recvfrom() failed: %d", errno);
+            }
+            if (errno != EINTR) return;
+            continue;
+        }
+
+        if (_onDatagram) {
+            _onDatagram(UdpEndpoint{address.sin_addr.s_addr, ntohs(address.sin_port)}, _buffer, n);
+        }
+    }
+}
+
+#endif // MQTTBROKER_POSIX_SOCKETS
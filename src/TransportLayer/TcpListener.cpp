@@ -1,6 +1,8 @@
-#include "TcpTransport.h"
 #include "MqttBroker/MqttBroker.h"
 
+#if !MQTTBROKER_POSIX_SOCKETS
+#include "TcpTransport.h"
+
 using namespace mqttBrokerName;
 
 TcpServerListener::TcpServerListener(uint16_t port) : port(port), server(nullptr) {
@@ -20,13 +22,13 @@ void TcpServerListener::begin() {
     }
 
     // Configure callback for new TCP connections
-    server->onClient([this](void* arg, AsyncClient* client) {
+    server->onClient([this](void*, AsyncClient* client) {
         if (this->broker) {
             // 1. Wrap the raw AsyncClient into our Transport Adapter
             MqttTransport* transport = new TcpTransport(client);
             
             // 2. Inject the transport into the Broker logic
-            this->broker->acceptClient(transport);
+            this->accept(transport);
         } else {
             // No broker assigned to handle this, reject connection
             client->close();
@@ -42,4 +44,6 @@ void TcpServerListener::stop() {
     if (server) {
         server->end();
     }
-}
\ No newline at end of file
+}
+
+#endif // !MQTTBROKER_POSIX_SOCKETS
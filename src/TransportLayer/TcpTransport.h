@@ -3,6 +3,7 @@
 
 #include "MqttTransport.h"
 #include <AsyncTCP.h>
+#include <atomic>
 
 /**
  * @brief Concrete implementation of MqttTransport for TCP connections.
@@ -20,42 +21,66 @@ class TcpTransport : public MqttTransport {
 private:
     AsyncClient* _client;
 
+    /**
+     * @brief Receive Backpressure state.
+     * While `_rxPaused` is set, incoming segments are not acknowledged 
+     * (`AsyncClient::ackLater`), and their length is accumulated in 
+     * `_rxUnacked` until `resumeReceive()` acknowledges them.
+     * @note Written from the Worker Task and read from the AsyncTCP task.
+     */
+    std::atomic<bool> _rxPaused{false};
+    std::atomic<size_t> _rxUnacked{0};
+
+    /**
+     * @brief Acknowledges all the bytes held back while paused.
+     */
+    void _ackPending() {
+        size_t pending = _rxUnacked.exchange(0);
+        if (pending && _client) {
+            _client->ack(pending);
+        }
+    }
+
 public:
     
     TcpTransport(AsyncClient* client) : _client(client) {
         // Configure AsyncTCP callbacks immediately
         
         // 1. Data received
-        _client->onData([this](void* arg, AsyncClient* c, void* data, size_t len) {
-            if (_onData) {
-                _onData((uint8_t*)data, len);
+        _client->onData([this](void*, AsyncClient* c, void* data, size_t len) {
+            if (_rxPaused) {
+                // Keep the window closed: this segment is acked on resume.
+                c->ackLater();
+                _rxUnacked += len;
+
+                // resumeReceive() may have run between the check and the add.
+                if (!_rxPaused) _ackPending();
             }
+            notifyData((uint8_t*)data, len);
         });
 
         // 2. Disconnection
-        _client->onDisconnect([this](void* arg, AsyncClient* c) {
-            if (_onDisconnect) {
-                _onDisconnect();
-            }
+        _client->onDisconnect([this](void*, AsyncClient*) {
+            notifyDisconnect();
         });
 
         // 3. Error / Timeout (Treated as disconnect)
-        _client->onError([this](void* arg, AsyncClient* c, int8_t error) {
-            if (_onDisconnect) _onDisconnect();
+        _client->onError([this](void*, AsyncClient*, int8_t) {
+            notifyDisconnect();
         });
-        _client->onTimeout([this](void* arg, AsyncClient* c, uint32_t time) {
-            if (_onDisconnect) _onDisconnect();
+        _client->onTimeout([this](void*, AsyncClient*, uint32_t) {
+            notifyDisconnect();
         });
 
         
         // 4. Ready to send notifications
-        _client->onAck([this](void* arg, AsyncClient* c, size_t len, uint32_t time){
-            if (_onReadyToSend) _onReadyToSend();
+        _client->onAck([this](void*, AsyncClient*, size_t, uint32_t){
+            notifyReadyToSend();
         });
 
         // 5. Poll event (also indicates readiness to send)
-        _client->onPoll([this](void* arg, AsyncClient* c){
-            if (_onReadyToSend) _onReadyToSend();
+        _client->onPoll([this](void*, AsyncClient*){
+            notifyReadyToSend();
         });
     }
 
@@ -98,10 +123,26 @@ size_t send(const char* data, size_t len) override {
     size_t space() override { 
         return _client ? _client->space() : 0; 
     }
+
+    void pauseReceive() override {
+        _rxPaused = true;
+    }
+
+    void resumeReceive() override {
+        _rxPaused = false;
+        _ackPending();
+    }
     
     String getIP() override {
         return _client ? _client->remoteIP().toString() : "0.0.0.0";
     }
+
+    /**
+     * @brief This object and the `AsyncClient` it owns, not the lwIP buffers.
+     */
+    size_t memoryUsage() override {
+        return sizeof(*this) + (_client ? sizeof(AsyncClient) : 0);
+    }
 };
 
 #endif // TCP_TRANSPORT_H
\ No newline at end of file
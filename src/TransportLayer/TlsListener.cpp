@@ -0,0 +1,48 @@
+#include "TlsListener.h"
+
+#if MQTTBROKER_TLS
+
+using namespace mqttBrokerName;
+
+TlsServerListener::TlsServerListener(ServerListener* inner, const TlsConfig& config) : inner(inner), config(config) {
+    inner->setOuter(this);
+}
+
+TlsServerListener::~TlsServerListener() {
+    stop();
+    delete inner;
+}
+
+void TlsServerListener::begin() {
+    if (!context) {
+        std::shared_ptr<TlsContext> created = std::make_shared<TlsContext>();
+        if (!created->begin(config)) {
+            log_e("TLS Listener: invalid certificate or key, not listening");
+            return;
+        }
+        context = created;
+    }
+
+    // The TLS handshake happens before the CONNECT, within the same deadline.
+    if (broker->getHandshakeTimeout() < TLSHANDSHAKETIMEOUT) {
+        broker->setHandshakeTimeout(TLSHANDSHAKETIMEOUT);
+    }
+
+    // The inner listener checks its broker before accepting.
+    inner->setBroker(broker);
+    inner->begin();
+}
+
+void TlsServerListener::stop() {
+    inner->stop();
+}
+
+bool TlsServerListener::accept(MqttTransport* transport) {
+    // 1. Wrap the plain connection, the handshake starts with its first bytes.
+    MqttTransport* secure = new TlsTransport(transport, context);
+
+    // 2. Inject the transport into the Broker logic (a refused one deletes both)
+    return ServerListener::accept(secure);
+}
+
+#endif // MQTTBROKER_TLS
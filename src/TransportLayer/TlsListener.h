@@ -0,0 +1,56 @@
+#ifndef TLS_LISTENER_H
+#define TLS_LISTENER_H
+
+#include "MqttBroker/MqttBroker.h"
+
+#if MQTTBROKER_TLS
+
+namespace mqttBrokerName{
+
+/**
+ * @brief Decorator of a ServerListener that wraps its connections in TLS.
+ * * The inner listener (TCP on the ESP32, POSIX or io_uring on Linux) accepts the 
+ * sockets, each one is wrapped in a `TlsTransport` before reaching the `MqttBroker`. 
+ * Reconnecting clients present their session ticket and skip the full handshake.
+ * * @note On the ESP32 the handshake runs in the AsyncTCP task: its stack must hold 
+ * mbedTLS (CONFIG_ASYNC_TCP_STACK_SIZE of 16KB is a safe value).
+ */
+class TlsServerListener : public ServerListener {
+private:
+    /** @brief Listener of the underlying connections, owned. */
+    ServerListener* inner;
+
+    TlsConfig config;
+
+    /** @brief Shared with the transports, which may be deleted after the listener. */
+    std::shared_ptr<TlsContext> context;
+
+public:
+    /**
+     * @brief Construct a new Tls Server Listener.
+     * * @param inner Listener of the plain connections, owned from now on.
+     * @param config Certificate, key and limits. The PEM strings are not copied.
+     */
+    TlsServerListener(ServerListener* inner, const TlsConfig& config);
+
+    ~TlsServerListener();
+
+    /**
+     * @brief Loads the credentials, then starts the inner listener.
+     * * Logs an error and listens to nothing if they can't be used.
+     */
+    void begin() override;
+
+    void stop() override;
+
+    /**
+     * @brief Wraps a connection of the inner listener in TLS.
+     */
+    bool accept(MqttTransport* transport) override;
+};
+
+} // namespace mqttBrokerName
+
+#endif // MQTTBROKER_TLS
+
+#endif // TLS_LISTENER_H
@@ -0,0 +1,626 @@
+#include "TlsTransport.h"
+
+#if MQTTBROKER_TLS
+
+#include <algorithm>
+#include <string.h>
+#include "MqttBroker/MemoryPolicy.h"
+
+// Bytes a record adds to its plaintext: header, nonce, tag (AES-GCM) and padding margin.
+#define TLSRECORDOVERHEAD 40
+
+// Plaintext read from the engine per call, on the stack of the network thread.
+#define TLSREADCHUNK 512
+
+// Records held back by a connection when the wrapped transport is full, see TlsTransport::_cipherPending.
+#define TLSPENDINGRECORDS 2
+
+#if MQTTBROKER_TLS_OPENSSL
+
+/****************************** OpenSSL backend ******************************************/
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+
+struct TlsContext::Impl {
+    SSL_CTX* ctx = nullptr;
+
+    ~Impl() {
+        if (ctx) SSL_CTX_free(ctx);
+    }
+
+    bool begin(TlsConfig& config) {
+        ctx = SSL_CTX_new(TLS_server_method());
+        if (!ctx) return false;
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+        // Certificate followed by its chain.
+        BIO* pem = BIO_new_mem_buf(config.certificate, -1);
+        X509* certificate = PEM_read_bio_X509(pem, nullptr, nullptr, nullptr);
+        bool loaded = certificate && SSL_CTX_use_certificate(ctx, certificate) == 1;
+        X509_free(certificate);
+        while (loaded) {
+            X509* issuer = PEM_read_bio_X509(pem, nullptr, nullptr, nullptr);
+            if (!issuer) break;
+            SSL_CTX_add_extra_chain_cert(ctx, issuer);
+        }
+        BIO_free(pem);
+        ERR_clear_error(); // End of the chain.
+
+        pem = BIO_new_mem_buf(config.privateKey, -1);
+        EVP_PKEY* key = PEM_read_bio_PrivateKey(pem, nullptr, nullptr, nullptr);
+        loaded = loaded && key && SSL_CTX_use_PrivateKey(ctx, key) == 1 && SSL_CTX_check_private_key(ctx) == 1;
+        EVP_PKEY_free(key);
+        BIO_free(pem);
+        if (!loaded) return false;
+
+        // Stateless resumption: the session travels in the ticket, no server cache.
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        if (config.ticketLifetime > 0) {
+            SSL_CTX_set_timeout(ctx, config.ticketLifetime);
+            SSL_CTX_set_num_tickets(ctx, 1);
+        } else {
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+            SSL_CTX_set_num_tickets(ctx, 0);
+        }
+
+        // Small records, and no buffers kept by idle connections.
+        SSL_CTX_set_max_send_fragment(ctx, config.recordSize);
+        SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+        return true;
+    }
+};
+
+struct TlsTransport::Session {
+    SSL* ssl = nullptr;
+    BIO* input = nullptr;
+
+    /** @brief Records produced by the engine, until the transport takes them. */
+    BIO* output = nullptr;
+
+    TlsTransport* transport = nullptr;
+
+    ~Session() {
+        if (ssl) SSL_free(ssl); // Frees the BIOs too.
+    }
+
+    bool begin(TlsContext::Impl* context, TlsTransport* transport) {
+        this->transport = transport;
+        ssl = SSL_new(context->ctx);
+        if (!ssl) return false;
+        input = BIO_new(BIO_s_mem());
+        output = BIO_new(BIO_s_mem());
+        SSL_set_bio(ssl, input, output);
+        SSL_set_accept_state(ssl);
+        return true;
+    }
+
+    /** @brief Writes the records of the output BIO, what the transport can't take stays there. */
+    void drain() {
+        char* data;
+        long length = BIO_get_mem_data(output, &data);
+        if (length <= 0) return;
+
+        size_t written = transport->_writeCipher((const uint8_t*)data, length);
+        if (written == (size_t)length) {
+            (void)BIO_reset(output);
+            return;
+        }
+        uint8_t skipped[TLSREADCHUNK];
+        while (written > 0) {
+            int n = BIO_read(output, skipped, std::min(written, sizeof(skipped)));
+            if (n <= 0) break;
+            written -= n;
+        }
+    }
+
+    /** @return true once the engine holds no output. */
+    bool flush() {
+        drain();
+        return BIO_ctrl_pending(output) == 0;
+    }
+
+    bool pending() {
+        return BIO_ctrl_pending(output) > 0;
+    }
+
+    void feed(const uint8_t* data, size_t len) {
+        BIO_write(input, data, len);
+    }
+
+    /** @return Plaintext bytes, 0 if more ciphertext is needed, -1 on error or close. */
+    int read(uint8_t* buffer, size_t size) {
+        int n = SSL_read(ssl, buffer, size);
+        drain(); // Handshake messages, tickets, alerts.
+        if (n > 0) return n;
+
+        int error = SSL_get_error(ssl, n);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) return 0;
+        if (error == SSL_ERROR_SSL) {
+            log_w("TLS error: %s", ERR_error_string(ERR_get_error(), nullptr));
+        }
+        ERR_clear_error();
+        return -1;
+    }
+
+    bool write(const uint8_t* data, size_t len) {
+        // Memory BIO: a write takes everything, split in records by max_send_fragment.
+        bool written = SSL_write(ssl, data, len) == (int)len;
+        drain();
+        if (!written) ERR_clear_error();
+        return written;
+    }
+
+    bool established() {
+        return SSL_is_init_finished(ssl);
+    }
+
+    bool resumed() {
+        return SSL_session_reused(ssl);
+    }
+};
+
+#else
+
+/****************************** mbedTLS backend ******************************************/
+
+// Each connection holds a receive buffer of MBEDTLS_SSL_IN_CONTENT_LEN and a send buffer
+// of MBEDTLS_SSL_OUT_CONTENT_LEN bytes (plus the record overhead), 16KB each by default.
+// They are settings of the compiled engine, not of this library: on the ESP32 set
+// CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN and CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN (see
+// platformio.ini). The send buffer only needs TlsConfig::recordSize; the receive one must
+// hold the largest record of the clients, 16KB unless they negotiate max_fragment_length.
+
+#include "mbedtls/version.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/error.h"
+
+struct TlsContext::Impl {
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt certificate;
+    mbedtls_pk_context key;
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_context tickets;
+#endif
+
+    Impl() {
+        mbedtls_ssl_config_init(&conf);
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ctr_drbg_init(&drbg);
+        mbedtls_x509_crt_init(&certificate);
+        mbedtls_pk_init(&key);
+#if defined(MBEDTLS_SSL_TICKET_C)
+        mbedtls_ssl_ticket_init(&tickets);
+#endif
+    }
+
+    ~Impl() {
+#if defined(MBEDTLS_SSL_TICKET_C)
+        mbedtls_ssl_ticket_free(&tickets);
+#endif
+        mbedtls_pk_free(&key);
+        mbedtls_x509_crt_free(&certificate);
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+        mbedtls_ssl_config_free(&conf);
+    }
+
+    bool begin(TlsConfig& config) {
+        const char* personalization = "MqttBroker";
+        if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                  (const unsigned char*)personalization, strlen(personalization)) != 0) {
+            return false;
+        }
+
+        // PEM lengths include the terminating NUL.
+        if (mbedtls_x509_crt_parse(&certificate, (const unsigned char*)config.certificate,
+                                   strlen(config.certificate) + 1) != 0) {
+            return false;
+        }
+#if MBEDTLS_VERSION_MAJOR >= 3
+        int parsed = mbedtls_pk_parse_key(&key, (const unsigned char*)config.privateKey,
+                                          strlen(config.privateKey) + 1, nullptr, 0,
+                                          mbedtls_ctr_drbg_random, &drbg);
+#else
+        int parsed = mbedtls_pk_parse_key(&key, (const unsigned char*)config.privateKey,
+                                          strlen(config.privateKey) + 1, nullptr, 0);
+#endif
+        if (parsed != 0) return false;
+
+        if (mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                        MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+            return false;
+        }
+        mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+        if (mbedtls_ssl_conf_own_cert(&conf, &certificate, &key) != 0) return false;
+
+#if defined(MBEDTLS_SSL_OUT_CONTENT_LEN)
+        // A record never exceeds the send buffer of the engine.
+        config.recordSize = std::min<uint16_t>(config.recordSize, MBEDTLS_SSL_OUT_CONTENT_LEN);
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        // Records sent are bounded by a max_fragment_length: the largest one within recordSize.
+        static const struct {
+            uint16_t size;
+            unsigned char code;
+        } fragments[] = {
+            {4096, MBEDTLS_SSL_MAX_FRAG_LEN_4096},
+            {2048, MBEDTLS_SSL_MAX_FRAG_LEN_2048},
+            {1024, MBEDTLS_SSL_MAX_FRAG_LEN_1024},
+            {512, MBEDTLS_SSL_MAX_FRAG_LEN_512},
+        };
+        unsigned char fragmentCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+        if (config.recordSize < 16384) {
+            for (const auto& fragment : fragments) {
+                if (fragment.size <= config.recordSize) {
+                    fragmentCode = fragment.code;
+                    config.recordSize = fragment.size;
+                    break;
+                }
+            }
+        }
+        if (mbedtls_ssl_conf_max_frag_len(&conf, fragmentCode) != 0) return false;
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+        // Stateless resumption: the session travels in the ticket, no server cache.
+        if (config.ticketLifetime > 0) {
+            if (mbedtls_ssl_ticket_setup(&tickets, mbedtls_ctr_drbg_random, &drbg,
+                                         MBEDTLS_CIPHER_AES_256_GCM, config.ticketLifetime) != 0) {
+                return false;
+            }
+            mbedtls_ssl_conf_session_tickets_cb(&conf, mbedtls_ssl_ticket_write,
+                                                mbedtls_ssl_ticket_parse, &tickets);
+        }
+#endif
+        return true;
+    }
+};
+
+struct TlsTransport::Session {
+    mbedtls_ssl_context ssl;
+    bool handshakeDone = false;
+
+    /** @brief Ciphertext received and not yet consumed by the engine. */
+    String in;
+    size_t inOffset = 0;
+
+    /** @brief The engine holds a record the transport could not take, see `flush()`. */
+    bool outPending = false;
+
+    TlsTransport* transport = nullptr;
+
+    Session() {
+        mbedtls_ssl_init(&ssl);
+    }
+
+    ~Session() {
+        mbedtls_ssl_free(&ssl);
+    }
+
+    static int sendCallback(void* context, const unsigned char* data, size_t len) {
+        Session* session = (Session*)context;
+        size_t written = session->transport->_writeCipher(data, len);
+        if (written < len) session->outPending = true;
+        return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    static int recvCallback(void* context, unsigned char* buffer, size_t len) {
+        Session* session = (Session*)context;
+        size_t available = session->in.length() - session->inOffset;
+        if (available == 0) return MBEDTLS_ERR_SSL_WANT_READ;
+
+        size_t n = len < available ? len : available;
+        memcpy(buffer, session->in.c_str() + session->inOffset, n);
+        session->inOffset += n;
+        if (session->inOffset == session->in.length()) {
+            session->in = "";
+            session->inOffset = 0;
+        }
+        return n;
+    }
+
+    bool begin(TlsContext::Impl* context, TlsTransport* transport) {
+        this->transport = transport;
+        if (mbedtls_ssl_setup(&ssl, &context->conf) != 0) return false;
+        mbedtls_ssl_set_bio(&ssl, this, sendCallback, recvCallback, nullptr);
+        return true;
+    }
+
+    void feed(const uint8_t* data, size_t len) {
+        in.concat((const char*)data, len);
+    }
+
+    /** @return Plaintext bytes, 0 if more ciphertext is needed, -1 on error or close. */
+    int read(uint8_t* buffer, size_t size) {
+        if (!handshakeDone) {
+            // Each step first flushes the records held back, sendCallback flags them again.
+            outPending = false;
+            int result = mbedtls_ssl_handshake(&ssl);
+            if (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+            if (result != 0) {
+                log_w("TLS handshake failed: -0x%04x", -result);
+                return -1;
+            }
+            handshakeDone = true;
+        }
+
+        int n = mbedtls_ssl_read(&ssl, buffer, size);
+        if (n > 0) return n;
+        if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+        if (n != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY && n != 0) {
+            log_w("TLS read failed: -0x%04x", -n);
+        }
+        return -1;
+    }
+
+    bool write(const uint8_t* data, size_t len) {
+        uint16_t recordSize = transport->_context->getRecordSize();
+        while (len > 0) {
+            // A held back record is flushed by the next write, which would drop its data.
+            if (outPending) return false;
+
+            // The client may have negotiated smaller records (max_fragment_length).
+            size_t chunk = len < recordSize ? len : recordSize;
+            int payload = mbedtls_ssl_get_max_out_record_payload(&ssl);
+            if (payload > 0 && chunk > (size_t)payload) chunk = payload;
+
+            int n = mbedtls_ssl_write(&ssl, data, chunk);
+            if (n == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                // The record of the chunk is built, it leaves with flush().
+                n = chunk;
+            }
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    /** @return true once the engine holds no output. The handshake resumes in read(). */
+    bool flush() {
+        if (!outPending) return true;
+        if (!handshakeDone) return false;
+
+        outPending = false;
+        int result = mbedtls_ssl_write(&ssl, nullptr, 0); // Only flushes, out_left is set.
+        if (result < 0 && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            log_w("TLS flush failed: -0x%04x", -result);
+        }
+        return !outPending;
+    }
+
+    bool pending() {
+        return outPending;
+    }
+
+    bool established() {
+        return handshakeDone;
+    }
+
+    bool resumed() {
+        // Not exposed by the mbedTLS API.
+        return false;
+    }
+};
+
+#endif // MQTTBROKER_TLS_OPENSSL
+
+/****************************** TlsContext Class *****************************************/
+
+TlsContext::~TlsContext(){
+    delete impl;
+}
+
+bool TlsContext::begin(const TlsConfig& config){
+    if (!config.certificate || !config.privateKey) {
+        log_e("TLS: certificate and private key are required");
+        return false;
+    }
+
+    recordSize = std::max<uint16_t>(512, std::min<uint16_t>(config.recordSize, 16384));
+    TlsConfig limited = config;
+    limited.recordSize = recordSize;
+
+    delete impl;
+    impl = new Impl();
+    if (!impl->begin(limited)) {
+        log_e("TLS: can't load the certificate or the private key");
+        delete impl;
+        impl = nullptr;
+        return false;
+    }
+
+    // The engine may round it down.
+    recordSize = limited.recordSize;
+    return true;
+}
+
+/****************************** TlsTransport Class ***************************************/
+
+TlsTransport::TlsTransport(MqttTransport* inner, std::shared_ptr<TlsContext> context)
+    : _inner(inner), _context(context) {
+    _tlsMutex = xSemaphoreCreateMutex();
+    if (!_tlsMutex) {
+        log_e("Failed to create TLS mutex"); ESP.restart();
+    }
+
+    _session = new Session();
+    if (!_session->begin(_context->engine(), this)) {
+        _fail("can't create the session");
+    }
+
+    // The wrapped transport only carries records, its events are forwarded.
+    _inner->setListener(this);
+}
+
+void TlsTransport::onTransportData(uint8_t* data, size_t len) {
+    _onCipher(data, len);
+}
+
+void TlsTransport::onTransportDisconnect() {
+    notifyDisconnect();
+}
+
+void TlsTransport::onTransportReadyToSend() {
+    if (!_established) {
+        // The handshake goes on once its held back records are out.
+        _onCipher(nullptr, 0);
+        return;
+    }
+
+    bool flushed = false;
+    if (xSemaphoreTake(_tlsMutex, portMAX_DELAY) == pdTRUE) {
+        flushed = _flushCipher();
+        xSemaphoreGive(_tlsMutex);
+    }
+    if (flushed) notifyReadyToSend();
+}
+
+TlsTransport::~TlsTransport(){
+    // The wrapped transport may still raise events until it is deleted.
+    delete _inner;
+    delete _session;
+    MemoryPolicy::release(_cipherBuffer);
+    vSemaphoreDelete(_tlsMutex);
+}
+
+void TlsTransport::_fail(const char* reason){
+    log_w("TLS %s: %s, closing.", _inner->getIP().c_str(), reason);
+    _failed = true;
+    _inner->close();
+}
+
+bool TlsTransport::_flushCipher(){
+    // Oldest first: the ring, then what the engine held back.
+    while (!_cipherPending.empty()) {
+        uint32_t contiguous;
+        const uint8_t* data = _cipherPending.peek(contiguous);
+        size_t room = std::min<size_t>(contiguous, _inner->space());
+        size_t written = room > 0 ? _inner->send((const char*)data, room) : 0;
+        _cipherPending.consume(std::min<size_t>(written, room));
+        if (written < contiguous) return false;
+    }
+    return _session->flush();
+}
+
+size_t TlsTransport::_writeCipher(const uint8_t* data, size_t len){
+    size_t written = 0;
+    if (_cipherPending.empty()) {
+        size_t room = std::min(len, _inner->space());
+        if (room > 0) written = std::min(_inner->send((const char*)data, room), room);
+        if (written == len) return len;
+    }
+
+    if (!_cipherPending.enabled()) {
+        uint32_t capacity = TLSPENDINGRECORDS * (_context->getRecordSize() + TLSRECORDOVERHEAD);
+        _cipherBuffer = (uint8_t*)MemoryPolicy::allocate(capacity, MEMORY_OUTBOX);
+        if (!_cipherBuffer) return written;
+        _cipherPending.setBuffer(_cipherBuffer, capacity);
+    }
+
+    // What doesn't fit stays in the engine, which offers it again on the next flush.
+    uint32_t room = _cipherPending.capacityBytes() - _cipherPending.size();
+    uint32_t taken = std::min<size_t>(len - written, room);
+    _cipherPending.write(data + written, taken);
+    return written + taken;
+}
+
+void TlsTransport::_onCipher(uint8_t* data, size_t len){
+    if (_failed) return;
+
+    String plaintext;
+    bool error = false;
+    bool handshakeDone = false;
+    bool resumed = false;
+
+    if (xSemaphoreTake(_tlsMutex, portMAX_DELAY) != pdTRUE) return;
+    if (len > 0) _session->feed(data, len);
+
+    uint8_t buffer[TLSREADCHUNK];
+    while (true) {
+        int n = _session->read(buffer, sizeof(buffer));
+        if (n < 0) {
+            error = true;
+            break;
+        }
+        if (n == 0) break;
+        plaintext.concat((const char*)buffer, n);
+    }
+
+    if (!_established && _session->established()) {
+        _established = true;
+        handshakeDone = true;
+        resumed = _session->resumed();
+    }
+
+    // Handshake records, session ticket or alert.
+    _flushCipher();
+    xSemaphoreGive(_tlsMutex);
+
+    if (handshakeDone) {
+        log_i("TLS %s: handshake done%s.", _inner->getIP().c_str(),
+              resumed ? " (session resumed)" : "");
+    }
+
+    if (plaintext.length() > 0) {
+        notifyData((uint8_t*)plaintext.c_str(), plaintext.length());
+    }
+
+    if (error) {
+        _fail(_established ? "connection closed" : "handshake failed");
+    }
+}
+
+size_t TlsTransport::send(const char* data, size_t len){
+    if (!_established || _failed) {
+        log_e("TLS Send Failed: session not established");
+        return 0;
+    }
+
+    bool written = false;
+    if (xSemaphoreTake(_tlsMutex, portMAX_DELAY) == pdTRUE) {
+        written = _session->write((const uint8_t*)data, len);
+        _flushCipher();
+        xSemaphoreGive(_tlsMutex);
+    }
+
+    if (!written) {
+        _fail("write failed");
+        return 0;
+    }
+    return len;
+}
+
+size_t TlsTransport::memoryUsage(){
+    size_t bytes = sizeof(*this) + _inner->memoryUsage();
+    if (xSemaphoreTake(_tlsMutex, portMAX_DELAY) == pdTRUE) {
+        bytes += _cipherPending.capacityBytes();
+        xSemaphoreGive(_tlsMutex);
+    }
+    return bytes;
+}
+
+size_t TlsTransport::space(){
+    bool pending = true;
+    if (xSemaphoreTake(_tlsMutex, portMAX_DELAY) == pdTRUE) {
+        pending = !_cipherPending.empty() || _session->pending();
+        xSemaphoreGive(_tlsMutex);
+    }
+    if (pending) return 0;
+
+    size_t available = _inner->space();
+    size_t records = available / (_context->getRecordSize() + TLSRECORDOVERHEAD) + 1;
+    size_t overhead = records * TLSRECORDOVERHEAD;
+    return available > overhead ? available - overhead : 0;
+}
+
+#endif // MQTTBROKER_TLS
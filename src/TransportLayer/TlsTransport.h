@@ -0,0 +1,198 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#include "MqttTransport.h"
+
+#if MQTTBROKER_TLS
+
+#include <atomic>
+#include <memory>
+#include "MqttClient/ByteRing.h"
+
+// Default plaintext size of the records sent to a client. Smaller records mean smaller
+// buffers per connection, the usual MQTT packet fits in one.
+#define TLSRECORDSIZE 2048
+
+// Default validity (seconds) of a session ticket: within it a reconnecting client
+// resumes its session without the full handshake.
+#define TLSTICKETLIFETIME 86400
+
+/**
+ * @brief Server credentials and limits of a `TlsServerListener`.
+ * * The PEM strings are not copied: they must outlive the listener (e.g. constants).
+ */
+struct TlsConfig {
+    /** @brief Server certificate, PEM, optionally followed by its chain. */
+    const char* certificate = nullptr;
+
+    /** @brief Private key of the certificate, PEM. */
+    const char* privateKey = nullptr;
+
+    /**
+     * @brief Max plaintext bytes of an outgoing record (512 to 16384).
+     * * With OpenSSL the record buffers are also released while a connection is idle.
+     * With mbedTLS it is rounded down to a max_fragment_length (512, 1024, 2048, 4096 or
+     * 16384) and to MBEDTLS_SSL_OUT_CONTENT_LEN. The engine buffers themselves are fixed
+     * at build time: CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN and CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN
+     * in the ESP-IDF configuration (see platformio.ini).
+     */
+    uint16_t recordSize = TLSRECORDSIZE;
+
+    /** @brief Session ticket lifetime in seconds, 0 disables the tickets. */
+    uint32_t ticketLifetime = TLSTICKETLIFETIME;
+};
+
+/**
+ * @brief Server side TLS state shared by all the connections of a listener:
+ * credentials, ticket keys and the engine configuration (mbedTLS on the ESP32,
+ * OpenSSL on Linux).
+ * * @warning The mbedTLS backend, used on the ESP32, is experimental: not verified on
+ * hardware yet, the host tests run the OpenSSL one.
+ */
+class TlsContext {
+public:
+    /** @brief Engine specific state, defined by the backend. */
+    struct Impl;
+
+private:
+    Impl* impl = nullptr;
+    uint16_t recordSize = TLSRECORDSIZE;
+
+public:
+    ~TlsContext();
+
+    /**
+     * @brief Loads the credentials and configures the engine.
+     * @return false (logged) if the certificate or the key can't be used.
+     */
+    bool begin(const TlsConfig& config);
+
+    Impl* engine() {
+        return impl;
+    }
+
+    uint16_t getRecordSize() const {
+        return recordSize;
+    }
+};
+
+/**
+ * @brief Decorator of an MqttTransport that runs TLS over it.
+ * * Ciphertext received by the wrapped transport (TCP, POSIX, io_uring) is fed to the
+ * engine and the decrypted bytes are passed on to its listener; `send()` encrypts and
+ * writes the records to the wrapped transport. The handshake runs on the first bytes
+ * received, the MqttClient only sees data once it is done.
+ * * @note <b>Thread Safety:</b> the engine is guarded by `_tlsMutex`, records are written
+ * to the wrapped transport under it, so they leave in order. Plaintext is delivered
+ * after the mutex is released: the MqttClient may answer from its callback.
+ */
+class TlsTransport : public MqttTransport, public MqttTransportListener {
+public:
+    /** @brief Per connection engine state, defined by the backend. */
+    struct Session;
+
+private:
+    MqttTransport* _inner;
+    std::shared_ptr<TlsContext> _context;
+    Session* _session;
+
+    /**
+     * @brief Records the wrapped transport could not take yet, written on its next ready
+     * event. Room for two records, allocated the first time it is needed: past it the
+     * engine keeps its output until the ring drains.
+     */
+    mqttBrokerName::ByteRing _cipherPending;
+    uint8_t* _cipherBuffer = nullptr;
+
+    bool _established = false;
+    std::atomic<bool> _failed{false};
+
+    SemaphoreHandle_t _tlsMutex;
+
+    /**
+     * @brief Writes the pending records, then the output held back by the engine. Call 
+     * with `_tlsMutex` held.
+     * @return true once nothing is left.
+     */
+    bool _flushCipher();
+
+    /**
+     * @brief Output of the engine: to the wrapped transport as far as it has room, the
+     * rest to `_cipherPending`. Call with `_tlsMutex` held.
+     * @return Bytes taken, fewer than len once the ring is full: the engine keeps the rest.
+     */
+    size_t _writeCipher(const uint8_t* data, size_t len);
+
+    /** @brief Runs the received ciphertext through the engine. */
+    void _onCipher(uint8_t* data, size_t len);
+
+    /** @brief Aborts the connection after a TLS error. */
+    void _fail(const char* reason);
+
+public:
+    /**
+     * @brief Wraps an accepted connection, the server handshake starts with its data.
+     * * @param inner Plain transport, owned from now on.
+     * @param context TLS configuration of the listener.
+     */
+    TlsTransport(MqttTransport* inner, std::shared_ptr<TlsContext> context);
+
+    /**
+     * @brief Frees the TLS session and the wrapped transport.
+     */
+    ~TlsTransport();
+
+    /**
+     * @brief Encrypts `data` into records of at most `TlsConfig::recordSize` bytes.
+     * @return len, or 0 if the handshake is not done or failed.
+     */
+    size_t send(const char* data, size_t len) override;
+
+    void close() override {
+        _inner->close();
+    }
+
+    bool connected() override {
+        return _inner->connected() && !_failed;
+    }
+
+    bool canSend() override {
+        return _established && connected() && space() > 0;
+    }
+
+    /**
+     * @brief Room of the wrapped transport, minus the record overhead. 0 while records
+     * are pending.
+     */
+    size_t space() override;
+
+    /**
+     * @brief This object, the pending records ring and the wrapped transport. The engine 
+     * session (buffers of mbedTLS or OpenSSL) is not counted.
+     */
+    size_t memoryUsage() override;
+
+    void pauseReceive() override {
+        _inner->pauseReceive();
+    }
+
+    void resumeReceive() override {
+        _inner->resumeReceive();
+    }
+
+    String getIP() override {
+        return _inner->getIP();
+    }
+
+    /** @brief Ciphertext from the wrapped transport. */
+    void onTransportData(uint8_t* data, size_t len) override;
+
+    void onTransportDisconnect() override;
+
+    /** @brief Writes the records held back, then raises the signal once they are all out. */
+    void onTransportReadyToSend() override;
+};
+
+#endif // MQTTBROKER_TLS
+
+#endif // TLS_TRANSPORT_H
@@ -0,0 +1,154 @@
+#ifndef UDP_SOCKET_H
+#define UDP_SOCKET_H
+
+#include "MqttTransport.h"
+
+#if MQTTBROKER_POSIX_SOCKETS
+#include "PosixTcpTransport.h"
+#include <arpa/inet.h>
+#else
+#include <AsyncUDP.h>
+#endif
+
+// Largest datagram read from the socket: an Ethernet frame without the IP and UDP headers.
+#define UDPMAXDATAGRAM 1472
+
+/**
+ * @brief Remote address of a datagram: IPv4 address (network byte order) and port.
+ */
+struct UdpEndpoint {
+    uint32_t address;
+    uint16_t port;
+
+    bool operator==(const UdpEndpoint& other) const {
+        return address == other.address && port == other.port;
+    }
+
+    bool operator<(const UdpEndpoint& other) const {
+        return address != other.address ? address < other.address : port < other.port;
+    }
+
+    String toString() const {
+#if MQTTBROKER_POSIX_SOCKETS
+        char ip[INET_ADDRSTRLEN];
+        in_addr in;
+        in.s_addr = address;
+        inet_ntop(AF_INET, &in, ip, sizeof(ip));
+        return String(ip) + ":" + String(port);
+#else
+        return IPAddress(address).toString() + ":" + String(port);
+#endif
+    }
+};
+
+/**
+ * @brief Abstract interface for datagram sockets, the counterpart of `MqttTransport`
+ * for connectionless protocols (e.g. MQTT-SN).
+ * * One socket serves every remote peer: each datagram is delivered with its source.
+ */
+class UdpSocket {
+protected:
+    /**
+     * @brief Callback function triggered when a datagram arrives.
+     * Arguments: (source, data, length)
+     */
+    std::function<void(const UdpEndpoint&, const uint8_t*, size_t)> _onDatagram;
+
+public:
+    virtual ~UdpSocket() {}
+
+    /**
+     * @brief Binds the port and starts receiving.
+     * @return false if the port can't be used.
+     */
+    virtual bool begin(uint16_t port) = 0;
+
+    /**
+     * @brief Stops receiving and releases the port.
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief Sends one datagram, without blocking. Any thread.
+     * @return false if it was not sent (UDP gives no further guarantee anyway).
+     */
+    virtual bool sendTo(const UdpEndpoint& destination, const uint8_t* data, size_t len) = 0;
+
+    /**
+     * @brief Registers the callback to handle incoming datagrams.
+     */
+    void setOnDatagram(std::function<void(const UdpEndpoint&, const uint8_t*, size_t)> cb) { _onDatagram = cb; }
+};
+
+#if MQTTBROKER_POSIX_SOCKETS
+
+/**
+ * @brief Concrete implementation of UdpSocket over a non-blocking POSIX socket.
+ * * Registered in a `PosixEventLoop`: datagrams are read and delivered by the loop thread.
+ */
+class PosixUdpSocket : public UdpSocket, public PosixEventHandler {
+private:
+    int _fd = -1;
+    std::shared_ptr<PosixEventLoop> _loop;
+
+    /** @brief Receive buffer, kept off the 4KB stack of the loop task. */
+    uint8_t _buffer[UDPMAXDATAGRAM];
+
+public:
+    /**
+     * @param loop Event loop that reads the socket, run by the owner.
+     */
+    PosixUdpSocket(std::shared_ptr<PosixEventLoop> loop) : _loop(loop) {
+    }
+
+    ~PosixUdpSocket() {
+        stop();
+    }
+
+    bool begin(uint16_t port) override;
+
+    void stop() override;
+
+    bool sendTo(const UdpEndpoint& destination, const uint8_t* data, size_t len) override;
+
+    /**
+     * @brief Reads every pending datagram (event loop thread).
+     */
+    void onEvents(uint32_t events) override;
+};
+
+#else
+
+/**
+ * @brief Concrete implementation of UdpSocket for the ESP32, adapter of `AsyncUDP`.
+ * * Datagrams are delivered from the AsyncUDP task.
+ */
+class AsyncUdpSocket : public UdpSocket {
+private:
+    AsyncUDP _udp;
+
+public:
+    bool begin(uint16_t port) override {
+        if (!_udp.listen(port)) {
+            return false;
+        }
+        _udp.onPacket([this](AsyncUDPPacket& packet) {
+            if (_onDatagram) {
+                _onDatagram(UdpEndpoint{(uint32_t)packet.remoteIP(), packet.remotePort()}, packet.data(), packet.length());
+            }
+        });
+        return true;
+    }
+
+    void stop() override {
+        _udp.close();
+    }
+
+    bool sendTo(const UdpEndpoint& destination, const uint8_t* data, size_t len) override {
+        return _udp.writeTo(data, len, IPAddress(destination.address), destination.port) == len;
+    }
+};
+
+#endif // MQTTBROKER_POSIX_SOCKETS
+
+#endif // UDP_SOCKET_H
@@ -1,5 +1,7 @@
 #include "MqttBroker/MqttBroker.h"
 
+#if !MQTTBROKER_POSIX_SOCKETS
+
 using namespace mqttBrokerName;
 
 WsServerListener::WsServerListener(uint16_t port, const char* wsEndpoint) : port(port), wsEndpoint(wsEndpoint), webServer(nullptr), ws(nullptr) {
@@ -40,19 +42,20 @@ void WsServerListener::stop() {
     activeTransports.clear();
 }
 
-void WsServerListener::onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len) {
+void WsServerListener::onWsEvent(AsyncWebSocket *, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len) {
     
     // 1. NEW CONNECTION
     if (type == WS_EVT_CONNECT) {
         // Create the Transport Adapter
         WsTransport* transport = new WsTransport(client);
         
-        // Register in our routing map (WS ID -> Transport)
-        activeTransports[client->id()] = transport;
-
         // Hand over to the Broker (which will create the MqttClient)
         if (broker) {
-            broker->acceptClient(transport);
+            // Register in our routing map (WS ID -> Transport) only once accepted:
+            // a refused transport is already deleted.
+            if (accept(transport)) {
+                activeTransports[client->id()] = transport;
+            }
         } else {
             // No broker to handle it, close and clean up
             client->close();
@@ -80,10 +83,12 @@ void WsServerListener::onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient *
     else if (type == WS_EVT_DATA) {
         AwsFrameInfo * info = (AwsFrameInfo*)arg;
         
-        // MQTT always uses binary frames. We process only if it's a final frame and binary opcode.
-        // (Note: For very large fragmented MQTT messages, reassembly logic would be needed here, 
-        // but this covers 99% of use cases).
-        if (info->final && info->index == 0 && info->len == len && info->opcode == WS_BINARY) {
+        // MQTT always uses binary messages. A large one arrives in several events: the
+        // chunks of a frame bigger than a TCP segment (`index` > 0), and the continuation
+        // frames of a fragmented message (`opcode` WS_CONTINUATION, `message_opcode` 
+        // WS_BINARY). WebSocket boundaries mean nothing to MQTT, so each chunk is streamed
+        // in order to the packet reader, which already handles partial packets.
+        if (info->message_opcode == WS_BINARY && len > 0) {
             
             auto it = activeTransports.find(client->id());
             if (it != activeTransports.end()) {
@@ -92,4 +97,6 @@ void WsServerListener::onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient *
             }
         }
     }
-}
\ No newline at end of file
+}
+
+#endif // !MQTTBROKER_POSIX_SOCKETS
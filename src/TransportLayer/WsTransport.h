@@ -3,6 +3,18 @@
 
 #include "MqttTransport.h"
 #include <ESPAsyncWebServer.h>
+#include <atomic>
+
+// Bytes sent to a WebSocket client and not yet acknowledged by TCP before `space()`
+// reports it full, the rest waits in the MqttClient outbox. Defaults to the lwIP
+// TCP send buffer.
+#ifndef WSSENDWINDOW
+#ifdef CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#define WSSENDWINDOW CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#else
+#define WSSENDWINDOW 5744
+#endif
+#endif
 
 /**
  * @brief Concrete implementation of MqttTransport for WebSocket connections.
@@ -13,11 +25,53 @@
  * per client, the underlying `AsyncWebSocket` uses a single **Global Event Listener** * for all connected clients. Therefore, this class provides helper methods 
  * (`handleIncomingData`, `handleDisconnect`) that must be called by the `WsServerListener` 
  * when it routes global events to this specific transport instance.
+ * * @note **Send Flow Control:** every frame queued by `send()` is counted until TCP
+ * acknowledges it, so `space()` reports the real room left in `WSSENDWINDOW`. The
+ * ack and poll events of the underlying `AsyncClient` are chained (the WebSocket 
+ * client still runs its queue first) to raise the ready to send signal, as `TcpTransport` does.
  */
 class WsTransport : public MqttTransport {
 private:
     AsyncWebSocketClient* _client;
 
+    /**
+     * @brief Receive Backpressure state, see `TcpTransport`.
+     * The underlying `AsyncClient` is throttled directly, since WS data events 
+     * are dispatched synchronously from its `onData` callback.
+     */
+    std::atomic<bool> _rxPaused{false};
+    std::atomic<size_t> _rxUnacked{0};
+
+    /**
+     * @brief Worst case WebSocket frame header (2 + 8 length + 4 mask bytes).
+     * `_rxUnacked` counts payload bytes only, so every held frame adds this
+     * margin; AsyncTCP clamps `ack()` to the bytes it really held back.
+     */
+    static const size_t WS_MAX_FRAME_HEADER = 14;
+
+    void _ackPending() {
+        size_t pending = _rxUnacked.exchange(0);
+        if (pending && _client && _client->client()) {
+            _client->client()->ack(pending);
+        }
+    }
+
+    /** @brief Frame bytes queued by `send()` and not yet acknowledged by TCP. */
+    std::atomic<size_t> _txUnacked{0};
+
+    /** @brief Size of the header of an unmasked (server to client) frame. */
+    static size_t _frameHeader(size_t len) {
+        return len < 126 ? 2 : (len < 65536 ? 4 : 10);
+    }
+
+    void _onAcked(size_t len) {
+        // Acks also cover the control frames of the library: never below zero.
+        size_t unacked = _txUnacked.load();
+        while (!_txUnacked.compare_exchange_weak(unacked, unacked > len ? unacked - len : 0)) {
+        }
+        notifyReadyToSend();
+    }
+
 public:
     
     /**
@@ -27,6 +81,18 @@ public:
     WsTransport(AsyncWebSocketClient* client) : _client(client) {
         // In WS, connection/disconnection events are managed by the global Listener,
         // so we do not assign internal callbacks from _client here as we do in TCP.
+        // Only the flow control events of its AsyncClient are chained.
+        AsyncClient* tcp = _client ? _client->client() : nullptr;
+        if (tcp) {
+            tcp->onAck([this](void*, AsyncClient*, size_t len, uint32_t time) {
+                _client->_onAck(len, time);
+                _onAcked(len);
+            });
+            tcp->onPoll([this](void*, AsyncClient*) {
+                _client->_onPoll();
+                notifyReadyToSend();
+            });
+        }
     }
 
     ~WsTransport() {
@@ -35,6 +101,17 @@ public:
         if (_client && _client->status() == WS_CONNECTED) {
             _client->close();
         }
+
+        // Gives the flow control events back to the WebSocket client alone.
+        AsyncClient* tcp = _client && _client->status() != WS_DISCONNECTED ? _client->client() : nullptr;
+        if (tcp) {
+            tcp->onAck([](void* r, AsyncClient*, size_t len, uint32_t time) {
+                ((AsyncWebSocketClient*)r)->_onAck(len, time);
+            }, _client);
+            tcp->onPoll([](void* r, AsyncClient*) {
+                ((AsyncWebSocketClient*)r)->_onPoll();
+            }, _client);
+        }
     }
 
     // --- MqttTransport Interface Implementation ---
@@ -42,6 +119,7 @@ public:
     size_t send(const char* data, size_t len) override {
         // MQTT over WebSockets MUST be binary.
         if (_client && _client->status() == WS_CONNECTED) {
+            _txUnacked += len + _frameHeader(len);
             _client->binary((uint8_t*)data, len);
             return len;
         }
@@ -63,28 +141,55 @@ public:
     }
 
     size_t space() override {
-        // WebSockets library does not expose "exact free bytes" easily.
-        // We return a safe arbitrary value if the queue is not full to allow sending.
-        if (canSend()) return 1024; 
-        return 0;
+        if (!canSend()) return 0;
+
+        // An idle connection takes a packet of any size, the WebSocket client sends
+        // it piece by piece: a packet larger than the window can't stall in the outbox.
+        size_t unacked = _txUnacked;
+        if (unacked == 0) return SIZE_MAX;
+
+        // Room for the payload of one more frame (header included in the window).
+        if (unacked >= WSSENDWINDOW) return 0;
+        size_t room = WSSENDWINDOW - unacked;
+        return room > _frameHeader(room) ? room - _frameHeader(room) : 0;
+    }
+
+    void pauseReceive() override {
+        _rxPaused = true;
+    }
+
+    void resumeReceive() override {
+        _rxPaused = false;
+        _ackPending();
     }
 
     String getIP() override {
         return _client ? _client->remoteIP().toString() : "0.0.0.0";
     }
 
+    /**
+     * @brief This object only: the `AsyncWebSocketClient` and its queue belong to the server.
+     */
+    size_t memoryUsage() override {
+        return sizeof(*this);
+    }
+
     // --- Listener Specific Methods ---
 
     /**
      * @brief Injects incoming data into the transport processing pipeline.
      * This method is called by the WsServerListener when data arrives for this specific client ID.
+     * The data is any chunk of a binary message, not necessarily a whole frame or MQTT packet.
      * @param data Pointer to the received data buffer.
      * @param len Length of the received data.
      */
     void handleIncomingData(uint8_t* data, size_t len) {
-        if (_onData) {
-            _onData(data, len);
+        if (_rxPaused && _client && _client->client()) {
+            _client->client()->ackLater();
+            _rxUnacked += len + WS_MAX_FRAME_HEADER;
+            if (!_rxPaused) _ackPending();
         }
+        notifyData(data, len);
     }
 
     /**
@@ -92,9 +197,7 @@ public:
      * This method is called by the WsServerListener when it detects this client has disconnected.
      */
     void handleDisconnect() {
-        if (_onDisconnect) {
-            _onDisconnect();
-        }
+        notifyDisconnect();
     }
 };
 
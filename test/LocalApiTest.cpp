@@ -0,0 +1,127 @@
+/*
+ * The in-process API with 2 workers: local publishes reach local callbacks and a
+ * LoopbackTransport client, a client publish reaches a local callback, retained
+ * messages are passed at subscription time, unsubscribe stops the deliveries and
+ * a callback can publish from a worker.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <mutex>
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+/** @brief Waits up to 2 s for `condition`. */
+template <typename Condition>
+static bool eventually(Condition condition) {
+    for (int i = 0; i < 400; i++) {
+        if (condition()) return true;
+        delay(5);
+    }
+    return condition();
+}
+
+/** @brief Publishes, retrying while the queue of the first worker is full. */
+static void publishQueued(MqttBroker* broker, const String& topic, const String& payload, uint8_t qos = 0, bool retain = false) {
+    for (int i = 0; i < 2000 && !broker->publish(topic, payload, qos, retain); i++) delay(1);
+}
+
+int main() {
+    MqttBroker* broker = new MqttBroker(nullptr);
+    broker->setNumWorkers(2);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+
+    // Not started yet.
+    CHECK(!broker->publish("sensors/kitchen/temp", "0"));
+    CHECK(broker->subscribe("", [](PublishMqttMessage&) {}) == 0);
+
+    std::mutex mutex;
+    std::string lastTopic, lastPayload;
+    std::atomic<int> temperatures{0}, everything{0};
+    uint16_t temperatureId = broker->subscribe("sensors/+/temp", [&](PublishMqttMessage& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastTopic = message.getTopic().getTopic().c_str();
+        lastPayload = message.getTopic().getPayLoad().toString().c_str();
+        temperatures++;
+    });
+    CHECK(temperatureId != 0);
+    CHECK(broker->subscribe("#", [&](PublishMqttMessage&) { everything++; }) != 0);
+    broker->startBroker();
+
+    // A loopback MQTT client (QoS 0: it never acknowledges).
+    PacketCounter loopbackPackets;
+    LoopbackTransport* loopback = new LoopbackTransport([&](const uint8_t* data, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex);
+        loopbackPackets.feed((const char*)data, len);
+    }, "loopback");
+    broker->acceptClient(loopback);
+    std::string packets = connect("loopback") + subscribe(1, "sensors/#");
+    CHECK(loopback->write((const uint8_t*)packets.data(), packets.size()) == packets.size());
+    CHECK(eventually([&] { std::lock_guard<std::mutex> lock(mutex); return loopbackPackets.count[SUBACK] == 1; }));
+
+    for (int i = 0; i < 100; i++) {
+        publishQueued(broker, "sensors/kitchen/temp", String(i), 1);
+    }
+    publishQueued(broker, "other", "o");
+    CHECK(eventually([&] { return temperatures == 100 && everything == 101; }));
+    CHECK(eventually([&] { std::lock_guard<std::mutex> lock(mutex); return loopbackPackets.count[PUBLISH] == 100; }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(lastTopic == "sensors/kitchen/temp");
+        CHECK(lastPayload == "99");
+    }
+
+    // From the loopback client to the local callbacks.
+    std::string fromClient = publish("sensors/door/temp", "fromclient");
+    CHECK(loopback->write((const uint8_t*)fromClient.data(), fromClient.size()) == fromClient.size());
+    CHECK(eventually([&] { return temperatures == 101; }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(lastTopic == "sensors/door/temp");
+        CHECK(lastPayload == "fromclient");
+    }
+
+    // Retained: passed to the callback by subscribe().
+    publishQueued(broker, "cfg/mode", "eco", 0, true);
+    delay(100);
+    int retained = 0;
+    bool retainFlag = false;
+    broker->subscribe("cfg/#", [&](PublishMqttMessage& message) {
+        retained++;
+        retainFlag = message.isRetain();
+    });
+    CHECK(retained == 1);
+    CHECK(retainFlag);
+
+    // Unsubscribed: only "#" still matches.
+    broker->unsubscribe(temperatureId);
+    broker->unsubscribe(999);
+    int everythingBefore = everything;
+    publishQueued(broker, "sensors/kitchen/temp", "after");
+    CHECK(eventually([&] { return everything == everythingBefore + 1; }));
+    delay(50);
+    CHECK(temperatures == 101);
+
+    // A callback publishing from the worker that runs it.
+    std::atomic<int> pongs{0};
+    broker->subscribe("ping", [&](PublishMqttMessage& message) {
+        broker->publish("pong", message.getTopic().getPayLoad());
+    });
+    broker->subscribe("pong", [&](PublishMqttMessage&) { pongs++; });
+    publishQueued(broker, "ping", "1");
+    CHECK(eventually([&] { return pongs == 1; }));
+
+    uint32_t localDeliveries = 0;
+    for (int i = 0; i < broker->getNumWorkers(); i++) {
+        localDeliveries += broker->getShardStats(i).localDeliveries;
+    }
+    CHECK(localDeliveries > 0);
+
+    loopback->close();
+    broker->stopBroker();
+    delete broker;
+    printf("LocalApiTest: %u local deliveries\n", localDeliveries);
+    return 0;
+}
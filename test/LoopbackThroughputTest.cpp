@@ -0,0 +1,172 @@
+/*
+ * QoS 1 throughput against the in-flight window size. A LoopbackTransport
+ * subscriber acknowledges each PUBLISH after a fixed delay, emulating the round
+ * trip of a network: with a window of W messages, about W are delivered per round
+ * trip, while a window of 1 is stop-and-wait.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+using Clock = std::chrono::steady_clock;
+
+static const int MESSAGES = 400;
+
+// Messages published and not yet acknowledged, kept below the outbox of the subscriber
+// (setOutBoxMaxSize(), default 100) which drops the QoS 1 publishes beyond it.
+static const int BACKLOG = 80;
+
+// Time between the delivery of a PUBLISH and its PUBACK.
+static const std::chrono::microseconds ROUNDTRIP(2000);
+
+/**
+ * @brief The remote client: parses the packets sent by the broker, and acknowledges
+ * the QoS 1 publishes from its own thread once the round trip has elapsed.
+ */
+class DelayedAckSubscriber {
+private:
+    struct PendingAck {
+        uint16_t packetId;
+        Clock::time_point due;
+    };
+
+    std::mutex mutex;
+    std::string stream;
+    std::deque<PendingAck> pendingAcks;
+    std::thread acker;
+    std::atomic<bool> running{true};
+
+    void onReceive(const uint8_t* data, size_t length) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stream.append((const char*)data, length);
+        while (stream.size() >= 2) {
+            size_t index = 1, remaining = 0, multiplier = 1;
+            while (true) {
+                if (index >= stream.size()) return;
+                uint8_t digit = stream[index++];
+                remaining += (digit & 127) * multiplier;
+                multiplier *= 128;
+                if (!(digit & 128)) break;
+            }
+            if (stream.size() < index + remaining) return;
+
+            uint8_t header = stream[0];
+            packets[header >> 4]++;
+            if ((header >> 4) == PUBLISH && (header & 0x06) == 0x02) {
+                size_t topicLength = ((uint8_t)stream[index] << 8) | (uint8_t)stream[index + 1];
+                size_t offset = index + 2 + topicLength;
+                uint16_t packetId = ((uint8_t)stream[offset] << 8) | (uint8_t)stream[offset + 1];
+                pendingAcks.push_back({packetId, Clock::now() + ROUNDTRIP});
+            }
+            stream.erase(0, index + remaining);
+        }
+    }
+
+    void acknowledge() {
+        while (running) {
+            PendingAck ack;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pendingAcks.empty() || pendingAcks.front().due > Clock::now()) {
+                    ack.packetId = 0;
+                } else {
+                    ack = pendingAcks.front();
+                    pendingAcks.pop_front();
+                }
+            }
+            if (ack.packetId == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            std::string puback = packet(0x40, std::string(1, (char)(ack.packetId >> 8)) + (char)(ack.packetId & 0xff));
+            writeAll(puback);
+            acknowledged++;
+        }
+    }
+
+public:
+    LoopbackTransport* transport;
+    std::atomic<int> packets[16] = {};
+    std::atomic<int> acknowledged{0};
+
+    DelayedAckSubscriber() {
+        transport = new LoopbackTransport([this](const uint8_t* data, size_t length) { onReceive(data, length); }, "subscriber");
+    }
+
+    ~DelayedAckSubscriber() {
+        running = false;
+        if (acker.joinable()) acker.join();
+    }
+
+    void startAcknowledging() {
+        acker = std::thread([this] { acknowledge(); });
+    }
+
+    /** @brief Writes from the calling thread, retrying while the transport is paused. */
+    void writeAll(const std::string& bytes) {
+        while (transport->connected() && transport->write((const uint8_t*)bytes.data(), bytes.size()) == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+};
+
+/** @brief Messages per second delivered and acknowledged with the given window. */
+static double measure(uint16_t windowSize) {
+    MqttBroker* broker = new MqttBroker(nullptr);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+    broker->setInflightWindowSize(windowSize);
+    broker->startBroker();
+
+    DelayedAckSubscriber subscriber;
+    broker->acceptClient(subscriber.transport);
+    subscriber.writeAll(connect("subscriber"));
+    subscriber.writeAll(subscribe(1, "loopback/#", 1));
+    for (int i = 0; i < 200 && subscriber.packets[SUBACK] == 0; i++) delay(5);
+    CHECK(subscriber.packets[CONNECTACK] == 1);
+    CHECK(subscriber.packets[SUBACK] == 1);
+    subscriber.startAcknowledging();
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < MESSAGES; i++) {
+        while (i - subscriber.acknowledged >= BACKLOG) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        while (!broker->publish("loopback/throughput", String(i), 1)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    for (int i = 0; i < 30000 && subscriber.acknowledged < MESSAGES; i++) {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    CHECK(subscriber.acknowledged == MESSAGES);
+    CHECK(subscriber.packets[PUBLISH] == MESSAGES);
+
+    broker->stopBroker();
+    delete broker;
+    return MESSAGES / seconds;
+}
+
+int main() {
+    const uint16_t windowSizes[] = {1, 4, 16, 64};
+    double throughput[4];
+
+    printf("window  messages/s (%d QoS 1 messages, %ld us round trip)\n", MESSAGES, (long)ROUNDTRIP.count());
+    for (int i = 0; i < 4; i++) {
+        throughput[i] = measure(windowSizes[i]);
+        printf("%6u  %10.0f\n", windowSizes[i], throughput[i]);
+    }
+
+    // Stop-and-wait is bound by the round trip, a larger window pipelines the deliveries.
+    CHECK(throughput[0] < 1.5e6 / ROUNDTRIP.count());
+    CHECK(throughput[2] > 4 * throughput[0]);
+    return 0;
+}
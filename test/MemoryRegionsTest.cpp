@@ -0,0 +1,118 @@
+/*
+ * Placement of the broker buffers with two regions: built with
+ * MQTTBROKER_EMULATED_MEMORY=0 over the heap_caps double of test/heapcaps, so
+ * MemoryPolicy runs its ESP32 code and every buffer is checked by its address.
+ * Bulk buffers land in PSRAM, metadata stays internal, and each region falls back
+ * to the other one once full.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include "esp_heap_caps.h"
+#include <mutex>
+#include <vector>
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const size_t INTERNALBYTES = 256 * 1024;
+static const size_t EXTERNALBYTES = 1024 * 1024;
+
+static bool inPsram(const void* buffer) {
+    return hostheapcaps::contains(MALLOC_CAP_SPIRAM, buffer);
+}
+
+static bool inInternal(const void* buffer) {
+    return hostheapcaps::contains(MALLOC_CAP_INTERNAL, buffer);
+}
+
+int main() {
+    hostheapcaps::configure(INTERNALBYTES, EXTERNALBYTES);
+    CHECK(MemoryPolicy::hasExternal());
+    CHECK(MemoryPolicy::getStats(MEMORY_EXTERNAL).capacity == EXTERNALBYTES);
+
+    // Placement by use and size.
+    void* payload = MemoryPolicy::allocate(4000, MEMORY_PAYLOAD);
+    void* smallPayload = MemoryPolicy::allocate(64, MEMORY_PAYLOAD);
+    void* metadata = MemoryPolicy::allocate(4000, MEMORY_METADATA);
+    CHECK(inPsram(payload));
+    CHECK(inInternal(smallPayload));
+    CHECK(inInternal(metadata));
+    MemoryPolicy::release(payload);
+    MemoryPolicy::release(smallPayload);
+    MemoryPolicy::release(metadata);
+
+    // A preallocated broker: client objects internal, readers, outboxes and retained store in PSRAM.
+    StaticMqttBroker<16, 64, 1024, 4096>* broker = new StaticMqttBroker<16, 64, 1024, 4096>(nullptr);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+    broker->startBroker();
+
+    MemoryRegionStats internal = MemoryPolicy::getStats(MEMORY_INTERNAL);
+    MemoryRegionStats external = MemoryPolicy::getStats(MEMORY_EXTERNAL);
+    printf("started: internal %zu bytes (metadata %zu), PSRAM %zu bytes (readers %zu, outboxes %zu, retained %zu)\n",
+           internal.used, internal.usedBy[MEMORY_METADATA], external.used,
+           external.usedBy[MEMORY_READER], external.usedBy[MEMORY_OUTBOX], external.usedBy[MEMORY_RETAINED]);
+    CHECK(internal.usedBy[MEMORY_METADATA] > 0);
+    CHECK(external.usedBy[MEMORY_METADATA] == 0);
+    CHECK(external.usedBy[MEMORY_READER] >= 16 * 1024);
+    CHECK(external.usedBy[MEMORY_OUTBOX] >= 16 * 4096);
+    CHECK(internal.usedBy[MEMORY_READER] == 0 && internal.usedBy[MEMORY_OUTBOX] == 0);
+    CHECK(internal.failures == 0 && external.failures == 0);
+
+    // Messages still flow through buffers in PSRAM.
+    PacketCounter packets;
+    std::mutex mutex;
+    LoopbackTransport* client = new LoopbackTransport([&](const uint8_t* data, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex);
+        packets.feed((const char*)data, len);
+    }, "client");
+    broker->acceptClient(client);
+    std::string bytes = connect("client") + subscribe(1, "a/#") + publish("a/big", std::string(800, 'x'));
+    CHECK(client->write((const uint8_t*)bytes.data(), bytes.size()) == bytes.size());
+    for (int i = 0; i < 400; i++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (packets.count[PUBLISH] == 1) break;
+        }
+        delay(5);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(packets.count[PUBLISH] == 1);
+    }
+
+    // PSRAM exhausted: bulk buffers fall back to internal RAM, counted as failures.
+    std::vector<void*> buffers;
+    void* buffer;
+    while ((buffer = MemoryPolicy::allocate(4000, MEMORY_PAYLOAD)) != nullptr && inPsram(buffer)) {
+        buffers.push_back(buffer);
+    }
+    CHECK(buffer != nullptr);
+    CHECK(inInternal(buffer));
+    buffers.push_back(buffer);
+    uint32_t externalFailures = MemoryPolicy::getStats(MEMORY_EXTERNAL).failures;
+    CHECK(externalFailures >= 1);
+    printf("PSRAM full after %zu payloads of 4000 bytes, then internal RAM\n", buffers.size() - 1);
+
+    // Both exhausted: the allocation fails, after trying both regions.
+    while ((buffer = MemoryPolicy::allocate(4000, MEMORY_PAYLOAD)) != nullptr) {
+        CHECK(inInternal(buffer));
+        buffers.push_back(buffer);
+    }
+    CHECK(MemoryPolicy::getStats(MEMORY_INTERNAL).failures >= 1);
+    CHECK(MemoryPolicy::getStats(MEMORY_EXTERNAL).failures > externalFailures);
+
+    // Internal RAM full: metadata takes the room freed in PSRAM rather than failing.
+    CHECK(inPsram(buffers.front()));
+    MemoryPolicy::release(buffers.front());
+    buffers.front() = MemoryPolicy::allocate(4000, MEMORY_METADATA);
+    CHECK(inPsram(buffers.front()));
+
+    for (void* b : buffers) MemoryPolicy::release(b);
+    client->close();
+    broker->stopBroker();
+    delete broker;
+    printf("MemoryRegionsTest: passed\n");
+    return 0;
+}
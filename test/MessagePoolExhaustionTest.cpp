@@ -0,0 +1,72 @@
+/*
+ * A StaticMqttBroker with 4 message buffers and a local callback blocking its worker:
+ * the publishes beyond the pool are dropped and counted, not acknowledged and never
+ * taken from the heap, and once the worker is released the pool serves again.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const int MESSAGE_BUFFERS = 4;
+static const int PUBLISHES = 10;
+
+/** @brief Waits up to 2 s for `condition`. */
+template <typename Condition>
+static bool eventually(Condition condition) {
+    for (int i = 0; i < 400; i++) {
+        if (condition()) return true;
+        delay(5);
+    }
+    return condition();
+}
+
+int main() {
+    StaticMqttBroker<4, 16, 1024, 4096, 16, MESSAGE_BUFFERS>* broker = 
+        new StaticMqttBroker<4, 16, 1024, 4096, 16, MESSAGE_BUFFERS>(nullptr);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+
+    // The worker holds the first message until the test releases it.
+    std::atomic<bool> blocked{true};
+    std::atomic<int> localDeliveries{0};
+    CHECK(broker->subscribe("alarms/#", [&](PublishMqttMessage&) {
+        while (blocked) delay(1);
+        localDeliveries++;
+    }) != 0);
+    broker->startBroker();
+
+    std::atomic<int> acknowledged{0};
+    LoopbackTransport* transport = new LoopbackTransport([&](const uint8_t* data, size_t) {
+        if ((data[0] >> 4) == PUBACK) acknowledged++;
+    });
+    CHECK(broker->acceptClient(transport));
+    transport->write((const uint8_t*)connect("publisher").data(), connect("publisher").size());
+
+    // Parsed by this thread: the publishes wait in the worker queue with their message.
+    for (int i = 0; i < PUBLISHES; i++) {
+        std::string bytes = publish("alarms/door", "open", 1, i + 1);
+        CHECK(transport->write((const uint8_t*)bytes.data(), bytes.size()) == bytes.size());
+    }
+    BrokerTraffic traffic = broker->getTraffic();
+    printf("%d publishes, %u dropped, %d acknowledged\n", PUBLISHES, traffic.publishesDropped, (int)acknowledged);
+    CHECK(traffic.publishesDropped == PUBLISHES - MESSAGE_BUFFERS);
+    CHECK(acknowledged == MESSAGE_BUFFERS);
+
+    // Released, every message goes back to the pool.
+    blocked = false;
+    CHECK(eventually([&] { return localDeliveries == MESSAGE_BUFFERS; }));
+    for (int i = 0; i < MESSAGE_BUFFERS; i++) {
+        std::string bytes = publish("alarms/window", "open", 1, PUBLISHES + i + 1);
+        CHECK(transport->write((const uint8_t*)bytes.data(), bytes.size()) == bytes.size());
+    }
+    CHECK(eventually([&] { return localDeliveries == 2 * MESSAGE_BUFFERS; }));
+    CHECK(acknowledged == 2 * MESSAGE_BUFFERS);
+    CHECK(broker->getTraffic().publishesDropped == PUBLISHES - MESSAGE_BUFFERS);
+
+    broker->stopBroker();
+    delete broker;
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * The MQTT-SN gateway over a real UDP socket (PosixUdpSocket): a device searches
+ * the gateway, connects, registers a topic, publishes at QoS 0 and 1 to a local
+ * subscriber, subscribes and receives a publish of the broker.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <mutex>
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const uint16_t PORT = 18840;
+static const uint8_t GATEWAYID = 7;
+
+// MQTT-SN message types.
+enum : uint8_t {
+    SN_SEARCHGW = 0x01, SN_GWINFO = 0x02, SN_CONNECT = 0x04, SN_CONNACK = 0x05,
+    SN_REGISTER = 0x0A, SN_REGACK = 0x0B, SN_PUBLISH = 0x0C, SN_PUBACK = 0x0D,
+    SN_SUBSCRIBE = 0x12, SN_SUBACK = 0x13, SN_DISCONNECT = 0x18
+};
+
+static std::string snPacket(uint8_t type, const std::string& body) {
+    return std::string(1, (char)(body.size() + 2)) + (char)type + body;
+}
+
+static std::string u16(uint16_t value) {
+    return std::string(1, (char)(value >> 8)) + (char)(value & 0xff);
+}
+
+static uint16_t readU16(const std::string& bytes, size_t offset) {
+    return ((uint8_t)bytes[offset] << 8) | (uint8_t)bytes[offset + 1];
+}
+
+/**
+ * @brief An MQTT-SN device on its own UDP socket, bound to an ephemeral port.
+ */
+class Device {
+private:
+    int fd;
+    sockaddr_in gateway = {};
+
+public:
+    Device() {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        CHECK(fd >= 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        CHECK(bind(fd, (sockaddr*)&address, sizeof(address)) == 0);
+        gateway.sin_family = AF_INET;
+        gateway.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        gateway.sin_port = htons(PORT);
+    }
+
+    ~Device() {
+        ::close(fd);
+    }
+
+    void send(const std::string& datagram) {
+        CHECK(sendto(fd, datagram.data(), datagram.size(), 0, (sockaddr*)&gateway, sizeof(gateway)) == (ssize_t)datagram.size());
+    }
+
+    /** @brief Next datagram, empty on timeout. */
+    std::string receive(int timeoutMs = 1000) {
+        pollfd readable = {fd, POLLIN, 0};
+        if (poll(&readable, 1, timeoutMs) <= 0) return "";
+        char buffer[UDPMAXDATAGRAM];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        return n > 0 ? std::string(buffer, n) : "";
+    }
+
+    /** @brief Next datagram, checked to be of `type`. */
+    std::string expect(uint8_t type) {
+        std::string datagram = receive();
+        CHECK(datagram.size() >= 2);
+        CHECK((uint8_t)datagram[1] == type);
+        CHECK((uint8_t)datagram[0] == datagram.size());
+        return datagram;
+    }
+};
+
+int main() {
+    MqttBroker* broker = new MqttBroker(nullptr);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+    broker->addListener(new MqttSnGateway(PORT, GATEWAYID));
+
+    std::mutex mutex;
+    std::atomic<int> received{0};
+    std::string lastMessage;
+    broker->subscribe("sensors/#", [&](PublishMqttMessage& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastMessage = String(message.getTopic().getTopic() + "=" + message.getTopic().getPayLoad().toString()).c_str();
+        received++;
+    });
+    broker->startBroker();
+
+    Device device;
+
+    device.send(snPacket(SN_SEARCHGW, std::string(1, '\0')));
+    std::string gwInfo = device.expect(SN_GWINFO);
+    CHECK((uint8_t)gwInfo[2] == GATEWAYID);
+
+    // Flags: Clean Session. Protocol id 1, keep-alive 60 s.
+    device.send(snPacket(SN_CONNECT, std::string(1, (char)0x04) + (char)0x01 + u16(60) + "device1"));
+    std::string connAck = device.expect(SN_CONNACK);
+    CHECK(connAck[2] == 0);
+
+    device.send(snPacket(SN_REGISTER, u16(0) + u16(1) + "sensors/t1"));
+    std::string regAck = device.expect(SN_REGACK);
+    uint16_t topicId = readU16(regAck, 2);
+    CHECK(topicId != 0);
+    CHECK(readU16(regAck, 4) == 1);
+    CHECK(regAck[6] == 0);
+
+    // QoS 0, normal topic id.
+    device.send(snPacket(SN_PUBLISH, std::string(1, (char)0x00) + u16(topicId) + u16(0) + "21.5"));
+    for (int i = 0; i < 200 && received < 1; i++) delay(5);
+    CHECK(received == 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(lastMessage == "sensors/t1=21.5");
+    }
+
+    // QoS 1: acknowledged with PUBACK.
+    device.send(snPacket(SN_PUBLISH, std::string(1, (char)0x20) + u16(topicId) + u16(2) + "22.0"));
+    std::string pubAck = device.expect(SN_PUBACK);
+    CHECK(readU16(pubAck, 2) == topicId);
+    CHECK(readU16(pubAck, 4) == 2);
+    CHECK(pubAck[6] == 0);
+    for (int i = 0; i < 200 && received < 2; i++) delay(5);
+    CHECK(received == 2);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(lastMessage == "sensors/t1=22.0");
+    }
+
+    // Unknown topic id: rejected (return code 2, invalid topic id).
+    device.send(snPacket(SN_PUBLISH, std::string(1, (char)0x20) + u16(topicId + 100) + u16(3) + "x"));
+    pubAck = device.expect(SN_PUBACK);
+    CHECK(pubAck[6] == 2);
+
+    // The subscription reuses the registered topic id, the broker publishes to it.
+    device.send(snPacket(SN_SUBSCRIBE, std::string(1, (char)0x00) + u16(4) + "sensors/t1"));
+    std::string subAck = device.expect(SN_SUBACK);
+    CHECK(readU16(subAck, 3) == topicId);
+    CHECK(readU16(subAck, 5) == 4);
+    CHECK(subAck[7] == 0);
+
+    CHECK(broker->publish("sensors/t1", "23.5"));
+    std::string publish = device.expect(SN_PUBLISH);
+    CHECK(readU16(publish, 3) == topicId);
+    CHECK(publish.substr(7) == "23.5");
+
+    device.send(snPacket(SN_DISCONNECT, ""));
+    device.expect(SN_DISCONNECT);
+
+    broker->stopBroker();
+    delete broker;
+    printf("MqttSnGatewayTest: passed\n");
+    return 0;
+}
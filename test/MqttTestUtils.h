@@ -0,0 +1,149 @@
+#ifndef MQTT_TEST_UTILS_H
+#define MQTT_TEST_UTILS_H
+
+/*
+ * Helpers of the host tests: MQTT 3.1.1 packets built by hand, a blocking TCP
+ * client and the CHECK macro. Every test is an executable returning nonzero on failure.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "MqttMessages/ControlPacketType.h"
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+namespace mqtttest {
+
+/** @brief Fixed header with the remaining length, followed by `body`. */
+inline std::string packet(uint8_t header, const std::string& body) {
+    std::string bytes(1, (char)header);
+    size_t length = body.size();
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        bytes += (char)(length ? digit | 128 : digit);
+    } while (length);
+    return bytes + body;
+}
+
+inline std::string utf8(const std::string& text) {
+    std::string bytes;
+    bytes += (char)(text.size() >> 8);
+    bytes += (char)(text.size() & 0xff);
+    return bytes + text;
+}
+
+inline std::string connect(const std::string& clientId, bool cleanSession = true, uint16_t keepAlive = 60) {
+    return packet(0x10, utf8("MQTT") + (char)4 + (char)(cleanSession ? 2 : 0) +
+                  (char)(keepAlive >> 8) + (char)(keepAlive & 0xff) + utf8(clientId));
+}
+
+inline std::string subscribe(uint16_t packetId, const std::string& topic, uint8_t qos = 0) {
+    return packet(0x82, std::string(1, (char)(packetId >> 8)) + (char)(packetId & 0xff) + utf8(topic) + (char)qos);
+}
+
+inline std::string publish(const std::string& topic, const std::string& payload, uint8_t qos = 0, uint16_t packetId = 0) {
+    std::string body = utf8(topic);
+    if (qos) {
+        body += (char)(packetId >> 8);
+        body += (char)(packetId & 0xff);
+    }
+    return packet(0x30 | (qos << 1), body + payload);
+}
+
+inline std::string disconnect() {
+    return packet(0xe0, "");
+}
+
+/**
+ * @brief Splits a byte stream into MQTT packets and counts them by type
+ * (CONNECTACK, PUBLISH... of ControlPacketType.h).
+ */
+struct PacketCounter {
+    std::string pending;
+    int count[16] = {0};
+    /** @brief The packets themselves, only kept when `keep` is set. */
+    bool keep = false;
+    std::vector<std::string> packets;
+
+    void feed(const char* data, size_t length) {
+        pending.append(data, length);
+        while (pending.size() >= 2) {
+            size_t index = 1, remaining = 0, multiplier = 1;
+            while (true) {
+                if (index >= pending.size()) return;
+                uint8_t digit = pending[index++];
+                remaining += (digit & 127) * multiplier;
+                multiplier *= 128;
+                if (!(digit & 128)) break;
+            }
+            if (pending.size() < index + remaining) return;
+            count[(uint8_t)pending[0] >> 4]++;
+            if (keep) packets.push_back(pending.substr(0, index + remaining));
+            pending.erase(0, index + remaining);
+        }
+    }
+};
+
+/**
+ * @brief A blocking MQTT connection to 127.0.0.1.
+ */
+class TestClient {
+public:
+    int fd = -1;
+    PacketCounter received;
+
+    explicit TestClient(uint16_t port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        CHECK(::connect(fd, (sockaddr*)&address, sizeof(address)) == 0);
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    ~TestClient() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    void send(const std::string& bytes) {
+        size_t sent = 0;
+        while (sent < bytes.size()) {
+            ssize_t n = ::write(fd, bytes.data() + sent, bytes.size() - sent);
+            CHECK(n > 0);
+            sent += n;
+        }
+    }
+
+    /** @brief Reads until `count` packets of `type` were received in total, or the timeout. */
+    bool waitFor(uint8_t type, int count, int timeoutMs = 2000) {
+        char buffer[16 * 1024];
+        pollfd readable = {fd, POLLIN, 0};
+        while (received.count[type] < count) {
+            if (poll(&readable, 1, timeoutMs) <= 0) return false;
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0) return false;
+            received.feed(buffer, n);
+        }
+        return true;
+    }
+};
+
+} // namespace mqtttest
+
+#endif // MQTT_TEST_UTILS_H
@@ -0,0 +1,63 @@
+/*
+ * The broker over the POSIX backend and the host shim: real TCP clients connect,
+ * subscribe and publish at QoS 0 and 1 (lossless mode), then the broker is stopped and deleted.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const uint16_t PORT = 18831;
+static const int SUBSCRIBERS = 4;
+static const int MESSAGES = 200;
+
+int main() {
+    MqttBroker* broker = MqttBrokerFactory::createTcpBroker(PORT);
+    // The burst is larger than the event queue: throttle the publisher instead of dropping.
+    broker->setLosslessMode(true);
+    broker->startBroker();
+
+    TestClient* subscribers[SUBSCRIBERS];
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        subscribers[i] = new TestClient(PORT);
+        subscribers[i]->send(connect("subscriber" + std::to_string(i)));
+        subscribers[i]->send(subscribe(1, "sensors/+/temperature", 1));
+        CHECK(subscribers[i]->waitFor(CONNECTACK, 1));
+        CHECK(subscribers[i]->waitFor(SUBACK, 1));
+    }
+
+    TestClient publisher(PORT);
+    publisher.send(connect("publisher"));
+    CHECK(publisher.waitFor(CONNECTACK, 1));
+
+    std::string burst;
+    for (int i = 0; i < MESSAGES; i++) {
+        burst += publish("sensors/" + std::to_string(i % 8) + "/temperature", std::to_string(i));
+    }
+    publisher.send(burst);
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        CHECK(subscribers[i]->waitFor(PUBLISH, MESSAGES));
+    }
+
+    publisher.send(publish("sensors/kitchen/temperature", "21.5", 1, 7));
+    CHECK(publisher.waitFor(PUBACK, 1));
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        CHECK(subscribers[i]->waitFor(PUBLISH, MESSAGES + 1));
+    }
+
+    // Not subscribed.
+    publisher.send(publish("sensors/kitchen/humidity", "40"));
+    publisher.send(disconnect());
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        subscribers[i]->send(disconnect());
+        CHECK(!subscribers[i]->waitFor(PUBLISH, MESSAGES + 2, 200));
+        delete subscribers[i];
+    }
+
+    broker->stopBroker();
+    delete broker;
+    printf("PosixTcpBrokerTest: %d subscribers received %d messages\n", SUBSCRIBERS, MESSAGES + 1);
+    return 0;
+}
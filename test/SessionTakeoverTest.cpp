@@ -0,0 +1,82 @@
+/*
+ * A persistent session taken over by a second connection with the same client id
+ * while a QoS 1 publish is unacknowledged: the new connection resends it, with the
+ * DUP flag, and the publishes that follow get other packet ids.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const uint16_t PORT = 18832;
+
+static uint16_t packetIdOf(const std::string& publish) {
+    size_t index = 1;
+    while ((uint8_t)publish[index] & 128) index++;
+    index++;
+    size_t topicLength = ((uint8_t)publish[index] << 8) | (uint8_t)publish[index + 1];
+    index += 2 + topicLength;
+    return ((uint8_t)publish[index] << 8) | (uint8_t)publish[index + 1];
+}
+
+int main() {
+    MqttBroker* broker = MqttBrokerFactory::createTcpBroker(PORT);
+    broker->startBroker();
+
+    TestClient publisher(PORT);
+    publisher.send(connect("publisher"));
+    CHECK(publisher.waitFor(CONNECTACK, 1));
+
+    // Receives the publish, never acknowledges it.
+    TestClient* first = new TestClient(PORT);
+    first->received.keep = true;
+    first->send(connect("sensor", false));
+    first->send(subscribe(1, "alarms/#", 1));
+    CHECK(first->waitFor(CONNECTACK, 1));
+    CHECK(first->waitFor(SUBACK, 1));
+
+    publisher.send(publish("alarms/door", "open", 1, 1));
+    CHECK(publisher.waitFor(PUBACK, 1));
+    CHECK(first->waitFor(PUBLISH, 1));
+    uint16_t unacknowledged = packetIdOf(first->received.packets.back());
+
+    // Same client id, the first connection is still open.
+    TestClient second(PORT);
+    second.received.keep = true;
+    second.send(connect("sensor", false));
+    CHECK(second.waitFor(CONNECTACK, 1));
+    CHECK(second.received.packets[0][2] == 1);  // Session present.
+    CHECK(second.waitFor(PUBLISH, 1));
+    const std::string& resent = second.received.packets.back();
+    CHECK(((uint8_t)resent[0] & 0x08) != 0);
+    CHECK(packetIdOf(resent) == unacknowledged);
+    delete first;
+
+    publisher.send(publish("alarms/window", "open", 1, 2));
+    CHECK(publisher.waitFor(PUBACK, 2));
+    CHECK(second.waitFor(PUBLISH, 2));
+    const std::string& next = second.received.packets.back();
+    CHECK(((uint8_t)next[0] & 0x08) == 0);
+    CHECK(packetIdOf(next) != unacknowledged);
+
+    // Acknowledged now: not resent to a third connection.
+    second.send(packet(0x40, std::string(1, (char)(unacknowledged >> 8)) + (char)(unacknowledged & 0xff)));
+    uint16_t nextId = packetIdOf(next);
+    second.send(packet(0x40, std::string(1, (char)(nextId >> 8)) + (char)(nextId & 0xff)));
+    second.send(disconnect());
+    CHECK(!second.waitFor(PUBLISH, 3, 200));
+
+    TestClient third(PORT);
+    third.send(connect("sensor", false));
+    CHECK(third.waitFor(CONNECTACK, 1));
+    CHECK(!third.waitFor(PUBLISH, 1, 500));
+
+    third.send(disconnect());
+    publisher.send(disconnect());
+    broker->stopBroker();
+    delete broker;
+    printf("SessionTakeoverTest: unacknowledged PacketID %u resent after the takeover\n", unacknowledged);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * A StaticMqttBroker with 2 workers, built with MQTTBROKER_COUNT_ALLOCATIONS: after
+ * the connections and the subscriptions, publishes at QoS 0 and 1 fan out to
+ * subscribers owned by both workers and to a local callback, subscribers and the
+ * publisher acknowledge, the publisher pings, and no steady-state path may touch
+ * the heap: the test fails as soon as the counter moves.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <mutex>
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const int SUBSCRIBERS = 8;
+static const int ROUNDS = 200;
+
+/** @brief Waits up to 2 s for `condition`. */
+template <typename Condition>
+static bool eventually(Condition condition) {
+    for (int i = 0; i < 400; i++) {
+        if (condition()) return true;
+        delay(5);
+    }
+    return condition();
+}
+
+/**
+ * @brief A loopback MQTT client. Its receive callback runs on the workers, inside
+ * their counted scopes: it only touches preallocated memory.
+ */
+struct Peer {
+    LoopbackTransport* transport = nullptr;
+    std::atomic<int> received[16];
+
+    // Packet ids of the QoS 1 publishes received, acknowledged by the test thread.
+    std::mutex mutex;
+    uint16_t pendingAcks[4096];
+    int pendingCount = 0;
+
+    Peer() {
+        for (std::atomic<int>& count : received) count = 0;
+    }
+
+    void onPacket(const uint8_t* data, size_t) {
+        uint8_t type = data[0] >> 4;
+        received[type]++;
+        if (type != PUBLISH || ((data[0] >> 1) & 0x03) == 0) return;
+
+        // Fixed header, topic, then the packet id.
+        size_t index = 1;
+        while (data[index] & 0x80) index++;
+        index++;
+        index += 2 + ((data[index] << 8) | data[index + 1]);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingCount < 4096) pendingAcks[pendingCount++] = (data[index] << 8) | data[index + 1];
+    }
+
+    void write(const std::string& bytes) {
+        for (int i = 0; i < 2000 && transport->write((const uint8_t*)bytes.data(), bytes.size()) == 0; i++) {
+            delay(1);
+        }
+    }
+
+    void acknowledge() {
+        std::string acks;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < pendingCount; i++) {
+                acks += packet(0x40, std::string(1, (char)(pendingAcks[i] >> 8)) + (char)(pendingAcks[i] & 0xff));
+            }
+            pendingCount = 0;
+        }
+        if (!acks.empty()) write(acks);
+    }
+};
+
+int main() {
+    StaticMqttBroker<16, 64, 1024, 4096>* broker = new StaticMqttBroker<16, 64, 1024, 4096>(nullptr);
+    broker->setNumWorkers(2);
+    broker->setAcceptRateLimit(0);
+    broker->setMaxPendingClients(16);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+
+    std::atomic<int> localDeliveries{0};
+    CHECK(broker->subscribe("sensors/+/temp", [&](PublishMqttMessage&) { localDeliveries++; }) != 0);
+    broker->startBroker();
+
+    // 1. Subscribers, half at QoS 0 and half at QoS 1, spread over both workers.
+    Peer peers[SUBSCRIBERS + 1];
+    for (int i = 0; i <= SUBSCRIBERS; i++) {
+        Peer& peer = peers[i];
+        peer.transport = new LoopbackTransport([&peer](const uint8_t* data, size_t len) { peer.onPacket(data, len); });
+        CHECK(broker->acceptClient(peer.transport));
+        peer.write(connect("peer" + std::to_string(i)));
+        if (i < SUBSCRIBERS) peer.write(subscribe(1, "sensors/+/temp", i % 2));
+    }
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        CHECK(eventually([&] { return peers[i].received[SUBACK] == 1; }));
+    }
+    Peer& publisher = peers[SUBSCRIBERS];
+    CHECK(eventually([&] { return publisher.received[CONNECTACK] == 1; }));
+    uint32_t before = broker->getSteadyStateAllocations();
+
+    // 2. The steady state: publishes, acknowledgments in both directions and pings.
+    std::string qos0 = publish("sensors/kitchen/temp", "21.5");
+    for (int round = 0; round < ROUNDS; round++) {
+        publisher.write(qos0);
+        publisher.write(publish("sensors/hall/temp", "19.0", 1, round + 1));
+        if (round % 50 == 0) publisher.write(packet(0xc0, ""));
+
+        for (int i = 1; i < SUBSCRIBERS; i += 2) peers[i].acknowledge();
+
+        // Routed before the next batch: a slow worker must not fill its queue (dropped).
+        if (round % 10 == 9) {
+            CHECK(eventually([&] {
+                for (int i = 1; i < SUBSCRIBERS; i += 2) peers[i].acknowledge();
+                return localDeliveries == 2 * (round + 1);
+            }));
+        }
+    }
+    CHECK(eventually([&] {
+        for (int i = 1; i < SUBSCRIBERS; i += 2) peers[i].acknowledge();
+        for (int i = 0; i < SUBSCRIBERS; i++) {
+            if (peers[i].received[PUBLISH] != 2 * ROUNDS) return false;
+        }
+        return publisher.received[PUBACK] == ROUNDS && localDeliveries == 2 * ROUNDS;
+    }));
+    CHECK(publisher.received[PINGRESP] == ROUNDS / 50);
+
+    uint32_t allocations = broker->getSteadyStateAllocations() - before;
+    printf("%d publishes to %d subscribers: %u steady-state allocations\n", 2 * ROUNDS, SUBSCRIBERS, allocations);
+    CHECK(allocations == 0);
+
+    broker->stopBroker();
+    delete broker;
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Load generator of the POSIX TCP backends: one publisher sends QoS 0 messages as
+ * fast as it can to N subscribers of the same topic, in lossless mode, and the
+ * deliveries per second are reported.
+ *
+ *   TcpLoadBenchmark <epoll|io_uring> [subscribers] [messages] [payload bytes]
+ *
+ * ctest runs a short load on both backends, checking that every message reaches
+ * every subscriber. test/benchmark.sh runs the full comparison.
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#if MQTTBROKER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const uint16_t PORT = 18832;
+
+// Exit code of a skipped test (SKIP_RETURN_CODE of ctest).
+static const int SKIPPED = 77;
+
+#if MQTTBROKER_IO_URING
+/** @brief False when the kernel has no io_uring, or it is disabled (e.g. in a container). */
+static bool ioUringAvailable() {
+    io_uring_params params = {};
+    int fd = syscall(__NR_io_uring_setup, 1, &params);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+}
+#endif
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <epoll|io_uring> [subscribers] [messages] [payload bytes]\n", argv[0]);
+        return 2;
+    }
+    bool ioUring = strcmp(argv[1], "io_uring") == 0;
+    int subscribers = argc > 2 ? atoi(argv[2]) : 14;
+    long messages = argc > 3 ? atol(argv[3]) : 50000;
+    size_t payloadSize = argc > 4 ? atoi(argv[4]) : 64;
+
+    ServerListener* listener;
+#if MQTTBROKER_IO_URING
+    if (ioUring) {
+        if (!ioUringAvailable()) {
+            printf("io_uring is not available, skipped\n");
+            return SKIPPED;
+        }
+        listener = new IoUringTcpServerListener(PORT);
+    } else
+#endif
+    {
+        if (ioUring) {
+            printf("built without io_uring, skipped\n");
+            return SKIPPED;
+        }
+        listener = new PosixTcpServerListener(PORT);
+    }
+
+    MqttBroker* broker = new MqttBroker(listener);
+    broker->setLosslessMode(true);
+    // Every subscriber connects at once.
+    broker->setAcceptRateLimit(0);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+    broker->startBroker();
+
+    std::vector<TestClient*> clients;
+    for (int i = 0; i < subscribers; i++) {
+        TestClient* client = new TestClient(PORT);
+        client->send(connect("subscriber" + std::to_string(i)));
+        client->send(subscribe(1, "load/#"));
+        CHECK(client->waitFor(SUBACK, 1));
+        clients.push_back(client);
+    }
+    TestClient publisher(PORT);
+    publisher.send(connect("publisher"));
+    CHECK(publisher.waitFor(CONNECTACK, 1));
+
+    std::vector<long> delivered(subscribers, 0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < subscribers; i++) {
+        readers.emplace_back([&, i] {
+            clients[i]->waitFor(PUBLISH, messages, 5000);
+            delivered[i] = clients[i]->received.count[PUBLISH];
+        });
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string message = publish("load/test", std::string(payloadSize, 'x'));
+    std::string batch;
+    for (long i = 0; i < messages; i++) {
+        batch += message;
+        if (batch.size() >= 32 * 1024) {
+            publisher.send(batch);
+            batch.clear();
+        }
+    }
+    publisher.send(batch);
+    for (std::thread& reader : readers) reader.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long total = 0;
+    for (long count : delivered) total += count;
+    printf("%s: %d subscribers, %ld messages of %zu bytes: %ld deliveries in %.2f s = %.0f msg/s\n",
+           ioUring ? "io_uring" : "epoll", subscribers, messages, payloadSize, total, seconds, total / seconds);
+    CHECK(total == messages * subscribers);
+
+    for (TestClient* client : clients) delete client;
+    broker->stopBroker();
+    delete broker;
+    return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * MQTTS over the POSIX TCP backends, with a self-signed certificate generated at
+ * start: OpenSSL clients connect, subscribe and receive a burst from a publisher
+ * through small records and subscribers slow to read, a reconnecting client resumes
+ * its session with the ticket, and a plaintext client is dropped. Before that, a
+ * `TlsTransport` over a wire with a few bytes of room holds its records back, in its
+ * ring and in the engine, and writes them in order as the room comes.
+ *
+ *   TlsBrokerTest <epoll|io_uring>
+ */
+
+#include "EmbeddedMqttBroker.h"
+#include "MqttTestUtils.h"
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <vector>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#if MQTTBROKER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace mqttBrokerName;
+using namespace mqtttest;
+
+static const uint16_t PORT = 18850;
+
+// Exit code of a skipped test (SKIP_RETURN_CODE of ctest).
+static const int SKIPPED = 77;
+
+static const int SUBSCRIBERS = 4;
+static const int MESSAGES = 2000;
+
+// Receive buffer of the subscribers: small, so the server side fills up and holds records back.
+static const int SUBSCRIBERRCVBUF = 4096;
+
+#if MQTTBROKER_IO_URING
+/** @brief False when the kernel has no io_uring, or it is disabled (e.g. in a container). */
+static bool ioUringAvailable() {
+    io_uring_params params = {};
+    int fd = syscall(__NR_io_uring_setup, 1, &params);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+}
+#endif
+
+static std::string toPem(BIO* bio) {
+    char* data;
+    long length = BIO_get_mem_data(bio, &data);
+    std::string pem(data, length);
+    BIO_free(bio);
+    return pem;
+}
+
+/** @brief A P-256 key and a certificate for "localhost" signed by itself, PEM. */
+static void generateCertificate(std::string& certificate, std::string& privateKey) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    CHECK(key != nullptr);
+
+    X509* x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+    X509_set_pubkey(x509, key);
+    X509_NAME* name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    CHECK(X509_sign(x509, key, EVP_sha256()) > 0);
+
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, x509);
+    certificate = toPem(bio);
+    bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    privateKey = toPem(bio);
+
+    X509_free(x509);
+    EVP_PKEY_free(key);
+}
+
+/**
+ * @brief A TLS MQTT connection to 127.0.0.1, non-blocking once the handshake is done:
+ * a subscriber slow to read must not hold up the others.
+ */
+class TlsTestClient {
+public:
+    int fd = -1;
+    SSL* ssl = nullptr;
+    PacketCounter received;
+
+    TlsTestClient(SSL_CTX* context, SSL_SESSION* session = nullptr, int receiveBuffer = 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (receiveBuffer > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(PORT);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        CHECK(::connect(fd, (sockaddr*)&address, sizeof(address)) == 0);
+
+        ssl = SSL_new(context);
+        SSL_set_fd(ssl, fd);
+        if (session) SSL_set_session(ssl, session);
+        CHECK(SSL_connect(ssl) == 1);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~TlsTestClient() {
+        // Sends close_notify: a session ended without it is not resumable.
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        ::close(fd);
+    }
+
+    void send(const std::string& bytes) {
+        size_t sent = 0;
+        while (sent < bytes.size()) {
+            int n = SSL_write(ssl, bytes.data() + sent, bytes.size() - sent);
+            if (n > 0) {
+                sent += n;
+                continue;
+            }
+            int error = SSL_get_error(ssl, n);
+            CHECK(error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ);
+            pollfd ready = {fd, (short)(error == SSL_ERROR_WANT_WRITE ? POLLOUT : POLLIN), 0};
+            poll(&ready, 1, 100);
+        }
+    }
+
+    /** @brief Reads what has arrived, waiting up to `timeoutMs` for the first bytes. */
+    void receive(int timeoutMs) {
+        char buffer[16 * 1024];
+        pollfd readable = {fd, POLLIN, 0};
+        if (SSL_pending(ssl) == 0 && poll(&readable, 1, timeoutMs) <= 0) return;
+        while (true) {
+            int n = SSL_read(ssl, buffer, sizeof(buffer));
+            if (n <= 0) return;
+            received.feed(buffer, n);
+        }
+    }
+
+    bool waitFor(uint8_t type, int count, int timeoutMs = 2000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (received.count[type] < count) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            receive(10);
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Wrapped transport of `checkHeldBackRecords()`: takes at most `room` bytes,
+ * which the test moves to the client.
+ */
+class ThrottledWire : public MqttTransport {
+public:
+    std::string sent;
+    size_t room = 0;
+
+    size_t send(const char* data, size_t len) override {
+        CHECK(len <= room);
+        sent.append(data, len);
+        room -= len;
+        return len;
+    }
+
+    void close() override {}
+    bool connected() override { return true; }
+    bool canSend() override { return room > 0; }
+    size_t space() override { return room; }
+    String getIP() override { return "wire"; }
+
+    void receive(const std::string& bytes) {
+        notifyData((uint8_t*)bytes.data(), bytes.size());
+    }
+
+    void ready(size_t bytes) {
+        room += bytes;
+        notifyReadyToSend();
+    }
+};
+
+/** @brief Moves the bytes the server wrote to the client engine, returns what the client wrote. */
+static std::string exchange(ThrottledWire* wire, BIO* toClient, BIO* fromClient) {
+    BIO_write(toClient, wire->sent.data(), wire->sent.size());
+    wire->sent.clear();
+    std::string bytes;
+    char* data;
+    long length = BIO_get_mem_data(fromClient, &data);
+    if (length > 0) bytes.assign(data, length);
+    (void)BIO_reset(fromClient);
+    return bytes;
+}
+
+static void checkHeldBackRecords(const std::string& certificate, const std::string& privateKey) {
+    TlsConfig config;
+    config.certificate = certificate.c_str();
+    config.privateKey = privateKey.c_str();
+    config.recordSize = 512;
+    std::shared_ptr<TlsContext> context = std::make_shared<TlsContext>();
+    CHECK(context->begin(config));
+
+    ThrottledWire* wire = new ThrottledWire();
+    TlsTransport* transport = new TlsTransport(wire, context);
+    std::string plaintext;
+    int readySignals = 0;
+    transport->setOnData([&plaintext](uint8_t* data, size_t len) { plaintext.append((char*)data, len); });
+    transport->setOnReadyToSend([&readySignals] { readySignals++; });
+
+    SSL_CTX* clientContext = SSL_CTX_new(TLS_client_method());
+    SSL* client = SSL_new(clientContext);
+    BIO* toClient = BIO_new(BIO_s_mem());
+    BIO* fromClient = BIO_new(BIO_s_mem());
+    SSL_set_bio(client, toClient, fromClient);
+    SSL_set_connect_state(client);
+
+    // 1. Handshake through a wire taking 100 bytes per ready event.
+    for (int round = 0; round < 200 && !SSL_is_init_finished(client); round++) {
+        SSL_do_handshake(client);
+        std::string bytes = exchange(wire, toClient, fromClient);
+        if (!bytes.empty()) wire->receive(bytes);
+        wire->ready(100);
+        BIO_write(toClient, wire->sent.data(), wire->sent.size());
+        wire->sent.clear();
+    }
+    CHECK(SSL_is_init_finished(client));
+
+    // 2. More than the ring holds, with no room: the ring fills, the engine keeps the rest.
+    std::string message;
+    for (int i = 0; i < 6000; i++) message += (char)('a' + i % 26);
+    wire->room = 0;
+    CHECK(transport->send(message.data(), message.size()) == message.size());
+    CHECK(transport->space() == 0);
+    CHECK(transport->memoryUsage() >= 2 * (512 + 40));
+
+    // 3. Written in order as the room comes, the signal raised once everything is out.
+    std::string received;
+    char buffer[1024];
+    int signalsBefore = readySignals;
+    for (int round = 0; round < 1000 && received.size() < message.size(); round++) {
+        wire->ready(300);
+        exchange(wire, toClient, fromClient);
+        int n;
+        while ((n = SSL_read(client, buffer, sizeof(buffer))) > 0) received.append(buffer, n);
+    }
+    CHECK(received == message);
+    wire->ready(300);
+    CHECK(transport->space() > 0);
+    CHECK(readySignals > signalsBefore);
+
+    SSL_free(client);
+    SSL_CTX_free(clientContext);
+    delete transport;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <epoll|io_uring>\n", argv[0]);
+        return 2;
+    }
+    bool ioUring = strcmp(argv[1], "io_uring") == 0;
+
+    ServerListener* inner;
+#if MQTTBROKER_IO_URING
+    if (ioUring) {
+        if (!ioUringAvailable()) {
+            printf("io_uring is not available, skipped\n");
+            return SKIPPED;
+        }
+        inner = new IoUringTcpServerListener(PORT);
+    } else
+#endif
+    {
+        if (ioUring) {
+            printf("built without io_uring, skipped\n");
+            return SKIPPED;
+        }
+        inner = new PosixTcpServerListener(PORT);
+    }
+
+    static std::string certificate, privateKey;
+    generateCertificate(certificate, privateKey);
+    checkHeldBackRecords(certificate, privateKey);
+
+    // Records smaller than the large payloads, which span several of them.
+    TlsConfig config;
+    config.certificate = certificate.c_str();
+    config.privateKey = privateKey.c_str();
+    config.recordSize = 1024;
+
+    MqttBroker* broker = new MqttBroker(new TlsServerListener(inner, config));
+    broker->setLosslessMode(true);
+    broker->setAcceptRateLimit(0);
+    broker->setSnapshotInterval(0);
+    broker->setOfflineLogEnabled(false);
+    broker->startBroker();
+
+    SSL_CTX* context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT);
+
+    // 1. Subscribers with a small receive buffer.
+    std::vector<TlsTestClient*> subscribers;
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        TlsTestClient* subscriber = new TlsTestClient(context, nullptr, SUBSCRIBERRCVBUF);
+        subscriber->send(connect("subscriber" + std::to_string(i)));
+        subscriber->send(subscribe(1, "t/#"));
+        CHECK(subscriber->waitFor(CONNECTACK, 1));
+        CHECK(subscriber->waitFor(SUBACK, 1));
+        subscribers.push_back(subscriber);
+    }
+
+    // 2. The publisher. With TLS 1.3 the ticket arrives after the handshake, read with the CONNACK.
+    TlsTestClient* publisher = new TlsTestClient(context);
+    publisher->send(connect("publisher"));
+    CHECK(publisher->waitFor(CONNECTACK, 1));
+    SSL_SESSION* session = SSL_get1_session(publisher->ssl);
+    CHECK(session != nullptr && SSL_SESSION_is_resumable(session));
+
+    // 3. A burst, every 7th payload over three records, written while the subscribers read.
+    std::string burst;
+    for (int k = 0; k < MESSAGES; k++) {
+        burst += publish("t/x", std::string(k % 7 == 0 ? 3000 : 100, 'a' + k % 26));
+    }
+    std::thread writer([publisher, &burst] { publisher->send(burst); });
+
+    int expected = SUBSCRIBERS * MESSAGES;
+    int delivered = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (delivered < expected && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+        delivered = 0;
+        for (TlsTestClient* subscriber : subscribers) {
+            subscriber->receive(5);
+            delivered += subscriber->received.count[PUBLISH];
+        }
+    }
+    writer.join();
+    printf("%s: %d/%d deliveries\n", argv[1], delivered, expected);
+    CHECK(delivered == expected);
+    delete publisher;
+
+    // 4. Reconnection with the ticket: resumed, without the certificate exchange.
+    TlsTestClient* resumed = new TlsTestClient(context, session);
+    CHECK(SSL_session_reused(resumed->ssl) == 1);
+    resumed->send(connect("publisher"));
+    resumed->send(publish("t/y", "resumed"));
+    CHECK(resumed->waitFor(CONNECTACK, 1));
+    for (TlsTestClient* subscriber : subscribers) {
+        CHECK(subscriber->waitFor(PUBLISH, MESSAGES + 1));
+    }
+    delete resumed;
+    SSL_SESSION_free(session);
+
+    // 5. A plaintext CONNECT is not a handshake: at most an alert, never a CONNACK, then closed.
+    TestClient plaintext(PORT);
+    plaintext.send(connect("plaintext"));
+    std::string answer;
+    bool closed = false;
+    pollfd readable = {plaintext.fd, POLLIN, 0};
+    while (!closed && poll(&readable, 1, 3000) == 1) {
+        char buffer[256];
+        ssize_t n = ::read(plaintext.fd, buffer, sizeof(buffer));
+        if (n <= 0) closed = true;
+        else answer.append(buffer, n);
+    }
+    CHECK(closed);
+    CHECK(answer.empty() || (uint8_t)answer[0] != (CONNECTACK << 4));
+
+    for (TlsTestClient* subscriber : subscribers) delete subscriber;
+    SSL_CTX_free(context);
+    broker->stopBroker();
+    delete broker;
+    printf("TLS broker test passed\n");
+    return 0;
+}
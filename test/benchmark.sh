@@ -0,0 +1,16 @@
+#!/bin/sh
+# Compares the epoll and io_uring TCP backends with TcpLoadBenchmark.
+#   test/benchmark.sh [build directory] [subscribers] [messages] [payload bytes]
+# Build first with: cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+set -e
+BUILD=${1:-build}
+SUBSCRIBERS=${2:-14}
+MESSAGES=${3:-50000}
+PAYLOAD=${4:-64}
+
+cd "$BUILD/test"
+for backend in epoll io_uring; do
+    for run in 1 2 3; do
+        ./TcpLoadBenchmark $backend $SUBSCRIBERS $MESSAGES $PAYLOAD
+    done
+done
@@ -0,0 +1,104 @@
+#include "esp_heap_caps.h"
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+// Alignment of every block, as malloc.
+static const size_t ALIGNMENT = alignof(std::max_align_t);
+
+/**
+ * @brief A first-fit allocator over one fixed block of memory.
+ */
+class Arena {
+private:
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    // Allocated blocks: offset to size.
+    std::map<size_t, size_t> blocks;
+    std::mutex mutex;
+
+public:
+    void configure(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free(base);
+        base = bytes > 0 ? (uint8_t*)aligned_alloc(ALIGNMENT, (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) : nullptr;
+        capacity = bytes;
+        used = 0;
+        blocks.clear();
+    }
+
+    void* allocate(size_t bytes) {
+        bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t offset = 0;
+        for (auto const& [start, size] : blocks) {
+            if (start - offset >= bytes) break;
+            offset = start + size;
+        }
+        if (bytes == 0 || offset + bytes > capacity) {
+            return nullptr;
+        }
+        blocks[offset] = bytes;
+        used += bytes;
+        return base + offset;
+    }
+
+    bool release(void* ptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!contains(ptr)) return false;
+
+        auto it = blocks.find((uint8_t*)ptr - base);
+        if (it == blocks.end()) abort();
+        used -= it->second;
+        blocks.erase(it);
+        return true;
+    }
+
+    bool contains(const void* ptr) const {
+        return base != nullptr && ptr >= base && ptr < base + capacity;
+    }
+
+    size_t total() const {
+        return capacity;
+    }
+
+    size_t available() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return capacity - used;
+    }
+};
+
+static Arena internal;
+static Arena external;
+
+static Arena& arenaFor(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? external : internal;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return arenaFor(caps).allocate(size);
+}
+
+void heap_caps_free(void* ptr) {
+    if (ptr == nullptr) return;
+    if (!internal.release(ptr) && !external.release(ptr)) abort();
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return arenaFor(caps).total();
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return arenaFor(caps).available();
+}
+
+void hostheapcaps::configure(size_t internalBytes, size_t externalBytes) {
+    internal.configure(internalBytes);
+    external.configure(externalBytes);
+}
+
+bool hostheapcaps::contains(uint32_t caps, const void* ptr) {
+    return arenaFor(caps).contains(ptr);
+}
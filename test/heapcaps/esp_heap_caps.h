@@ -0,0 +1,32 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+/*
+ * Test double of the ESP-IDF capability-based heap: two separate arenas, internal RAM
+ * and PSRAM, so a host build with MQTTBROKER_EMULATED_MEMORY=0 runs the ESP32 code
+ * of MemoryPolicy and the tests can tell from its address where a buffer landed.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+size_t heap_caps_get_total_size(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+
+namespace hostheapcaps {
+
+/** @brief Sizes the arenas, before the first allocation. 0 bytes of PSRAM: a board without it. */
+void configure(size_t internalBytes, size_t externalBytes);
+
+/** @brief true if `ptr` points into the arena of `caps` (MALLOC_CAP_INTERNAL or MALLOC_CAP_SPIRAM). */
+bool contains(uint32_t caps, const void* ptr);
+
+} // namespace hostheapcaps
+
+#endif // HOST_ESP_HEAP_CAPS_H